@@ -8,6 +8,13 @@ ZUBAX_CHIBIOS_DIR := $(dir $(lastword $(MAKEFILE_LIST)))
 
 CPPSRC += $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/libstdcpp.cpp                  \
           $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/sys_console.cpp                \
+          $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/format.cpp                     \
+          $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/trace.cpp                      \
+          $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/profiler.cpp                   \
+          $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/thread_stats.cpp               \
+          $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/probe.cpp                      \
+          $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/benchmark.cpp                  \
+          $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/latency.cpp                    \
           $(ZUBAX_CHIBIOS_DIR)/zubax_chibios/sys/sys.cpp
 
 UINCDIR += $(ZUBAX_CHIBIOS_DIR)
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Host test of the UAVCAN v1 (Cyphal) over CAN FD transport used by the firmware loader.
+ * The transfers are exchanged through the in-process loopback bus, including a complete file download
+ * via uavcan.file.Read from a stand-in file server.
+ */
+
+#include <zubax_chibios/bootloader/loaders/cyphal_transport.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace os::bootloader::cyphal_loader;
+
+namespace
+{
+
+unsigned g_num_failures = 0;
+
+#define CHECK(x)                                                                        \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(x))                                                                       \
+        {                                                                               \
+            std::printf("%s:%d: CHECK FAILED: %s\n", __FILE__, __LINE__, #x);           \
+            g_num_failures++;                                                           \
+        }                                                                               \
+    }                                                                                   \
+    while (false)
+
+constexpr std::uint8_t ClientNodeID = 42;
+constexpr std::uint8_t ServerNodeID = 10;
+constexpr std::size_t MaxPayload = 1024;
+
+using Iface = LoopbackCANFDIface<>;
+using Reassembler = TransferReassembler<MaxPayload, 4>;
+
+std::vector<std::uint8_t> makePattern(const std::size_t size, const std::uint8_t seed)
+{
+    std::vector<std::uint8_t> out(size);
+    for (std::size_t i = 0; i < size; i++)
+    {
+        out[i] = std::uint8_t(i * 7U + seed);
+    }
+    return out;
+}
+
+/**
+ * Drains the RX queue of the interface into the reassembler; returns the number of completed transfers.
+ * The last completed transfer is copied out.
+ */
+unsigned receiveAll(Iface& iface,
+                    const std::uint8_t local_node_id,
+                    Reassembler& reassembler,
+                    std::vector<std::uint8_t>& out_payload,
+                    TransferMetadata& out_meta)
+{
+    unsigned num_transfers = 0;
+    while (true)
+    {
+        const auto res = iface.receive(0);
+        if (res.first < 1)
+        {
+            break;
+        }
+
+        TransferMetadata meta;
+        if (!parseFrame(res.second, local_node_id, meta))
+        {
+            continue;
+        }
+
+        Reassembler::Transfer transfer;
+        if (reassembler.accept(res.second, meta, 0, transfer))
+        {
+            out_payload.assign(transfer.payload, transfer.payload + transfer.payload_size);
+            out_meta = transfer.meta;
+            num_transfers++;
+        }
+    }
+    return num_transfers;
+}
+
+/**
+ * Captures the frames instead of delivering them, so that they can be inspected and tampered with.
+ */
+class RecordingIface : public ICANFDIface
+{
+public:
+    std::vector<CANFDFrame> frames;
+
+    int init(const std::uint32_t, const std::uint32_t, const Mode, const AcceptanceFilterConfig&) override
+    {
+        return 0;
+    }
+
+    int send(const CANFDFrame& frame, const int) override
+    {
+        frames.push_back(frame);
+        return 1;
+    }
+
+    std::pair<int, CANFDFrame> receive(const int) override
+    {
+        return {0, CANFDFrame()};
+    }
+};
+
+void testCRC()
+{
+    impl_::CRC16CCITT crc;
+    crc.add(reinterpret_cast<const std::uint8_t*>("123456789"), 9);
+    CHECK(crc.get() == 0x29B1U);                // The standard check value of CRC-16-CCITT-FALSE
+}
+
+void testTailBytes()
+{
+    // 200 bytes of payload plus 2 bytes of CRC make 4 frames: 63 + 63 + 63 + 13, padded to 15 + tail = 16
+    RecordingIface rec;
+    TransferMetadata meta;
+    meta.kind = TransferKind::Request;
+    meta.port_id = 123;
+    meta.remote_node_id = ServerNodeID;
+    meta.transfer_id = 29;
+
+    const auto payload = makePattern(200, 1);
+    CHECK(sendTransfer(rec, ClientNodeID, meta, payload.data(), payload.size(), 0) == 4);
+    CHECK(rec.frames.size() == 4);
+    if (rec.frames.size() != 4)
+    {
+        return;
+    }
+
+    const std::uint8_t expected_tails[] = {0xA0 | 29, 0x00 | 29, 0x20 | 29, 0x40 | 29};
+    for (std::size_t i = 0; i < rec.frames.size(); i++)
+    {
+        const auto& f = rec.frames[i];
+        CHECK(f.data_len == ((i < 3) ? 64 : 16));
+        CHECK(f.data[f.data_len - 1U] == expected_tails[i]);
+
+        TransferMetadata parsed;
+        CHECK(parseFrame(f, ServerNodeID, parsed));
+        CHECK(parsed.kind == TransferKind::Request);
+        CHECK(parsed.port_id == 123);
+        CHECK(parsed.remote_node_id == ClientNodeID);
+        CHECK(parsed.transfer_id == 29);
+        CHECK(!parseFrame(f, ServerNodeID + 1U, parsed));  // Addressed to another node
+    }
+
+    // Single-frame transfers have all three tail flags set
+    rec.frames.clear();
+    CHECK(sendTransfer(rec, ClientNodeID, meta, payload.data(), 10, 0) == 1);
+    CHECK((rec.frames.size() == 1) && (rec.frames[0].data_len == 12) && (rec.frames[0].data[11] == (0xE0 | 29)));
+}
+
+void testRoundTrip()
+{
+    Iface a;
+    Iface b;
+    b.attach(a);
+    CHECK(a.init(1000000, 4000000, ICANFDIface::Mode::Normal, {}) == 0);
+    CHECK(b.init(1000000, 4000000, ICANFDIface::Mode::Normal, {}) == 0);
+
+    Reassembler reassembler;
+    std::uint8_t transfer_id = 0;
+
+    for (const std::size_t size : {0U, 1U, 7U, 8U, 62U, 63U, 64U, 65U, 118U, 124U, 125U, 126U, 127U,
+                                   200U, 260U, 500U, 1024U})
+    {
+        const auto payload = makePattern(size, std::uint8_t(size));
+
+        TransferMetadata meta;
+        meta.kind = TransferKind::Response;
+        meta.port_id = file_read::ServiceID;
+        meta.remote_node_id = ServerNodeID;
+        meta.transfer_id = transfer_id++;
+
+        const int num_frames = sendTransfer(a, ClientNodeID, meta, payload.data(), payload.size(), 0);
+        CHECK(num_frames == int((size <= 63) ? 1 : ((size + 2U + 62U) / 63U)));
+
+        std::vector<std::uint8_t> received;
+        TransferMetadata received_meta;
+        CHECK(receiveAll(b, ServerNodeID, reassembler, received, received_meta) == 1);
+
+        // The padding of the last frame is delivered as part of the payload; it is shorter than 16 bytes and zero
+        CHECK(received.size() >= size);
+        CHECK((received.size() - size) < 16U);
+        CHECK(std::equal(payload.begin(), payload.end(), received.begin()));
+        CHECK(std::all_of(received.begin() + std::ptrdiff_t(size), received.end(),
+                          [](std::uint8_t x) { return x == 0; }));
+        CHECK(received_meta.kind == TransferKind::Response);
+        CHECK(received_meta.remote_node_id == ClientNodeID);
+        CHECK(received_meta.transfer_id == meta.transfer_id);
+    }
+}
+
+void testCorruption()
+{
+    TransferMetadata meta;
+    meta.kind = TransferKind::Request;
+    meta.port_id = 321;
+    meta.remote_node_id = ServerNodeID;
+    meta.transfer_id = 3;
+
+    const auto payload = makePattern(300, 5);
+    RecordingIface rec;
+    CHECK(sendTransfer(rec, ClientNodeID, meta, payload.data(), payload.size(), 0) == 5);
+
+    const auto deliver = [](Reassembler& r, const std::vector<CANFDFrame>& frames)
+    {
+        unsigned n = 0;
+        for (const auto& f : frames)
+        {
+            TransferMetadata m;
+            Reassembler::Transfer t;
+            if (parseFrame(f, ServerNodeID, m) && r.accept(f, m, 0, t))
+            {
+                n++;
+            }
+        }
+        return n;
+    };
+
+    {
+        Reassembler r;
+        CHECK(deliver(r, rec.frames) == 1);             // Sanity check
+    }
+    {
+        auto frames = rec.frames;
+        frames[2].data[10] ^= 1U;                       // Bad CRC
+        Reassembler r;
+        CHECK(deliver(r, frames) == 0);
+    }
+    {
+        auto frames = rec.frames;
+        frames.insert(frames.begin() + 2, frames[1]);  // Duplicate frame, rejected by the toggle bit
+        Reassembler r;
+        CHECK(deliver(r, frames) == 1);
+    }
+    {
+        auto frames = rec.frames;
+        frames.erase(frames.begin() + 2);              // Missing frame
+        Reassembler r;
+        CHECK(deliver(r, frames) == 0);
+    }
+    {
+        auto frames = rec.frames;
+        frames.erase(frames.begin());                   // Missing start of transfer
+        Reassembler r;
+        CHECK(deliver(r, frames) == 0);
+    }
+}
+
+/**
+ * Serves one file via uavcan.file.Read, like the file server on the other end of the bus would.
+ */
+class StandInFileServer
+{
+    Iface& iface_;
+    const std::vector<std::uint8_t>& file_;
+    const char* const path_;
+    Reassembler reassembler_;
+
+public:
+    unsigned num_requests = 0;
+
+    StandInFileServer(Iface& iface, const std::vector<std::uint8_t>& file, const char* path) :
+        iface_(iface),
+        file_(file),
+        path_(path)
+    { }
+
+    void spin()
+    {
+        std::vector<std::uint8_t> request;
+        TransferMetadata meta;
+        if (receiveAll(iface_, ServerNodeID, reassembler_, request, meta) == 0)
+        {
+            return;
+        }
+        CHECK(meta.kind == TransferKind::Request);
+        CHECK(meta.port_id == file_read::ServiceID);
+        num_requests++;
+
+        std::uint64_t offset = 0;
+        const char* path = nullptr;
+        std::size_t path_length = 0;
+        CHECK(file_read::deserializeRequest(request.data(), request.size(), offset, path, path_length));
+
+        std::uint8_t response[file_read::MaxResponseSize]{};
+        std::size_t response_size = 0;
+        if ((path_length != std::strlen(path_)) || (std::memcmp(path, path_, path_length) != 0))
+        {
+            response_size = file_read::serializeResponse(4, nullptr, 0, response);      // Not found
+        }
+        else
+        {
+            const std::size_t n = (offset < file_.size()) ? std::min(file_.size() - std::size_t(offset),
+                                                                     file_read::DataCapacity) : 0U;
+            response_size = file_read::serializeResponse(0, file_.data() + offset, n, response);
+        }
+
+        TransferMetadata response_meta = meta;
+        response_meta.kind = TransferKind::Response;
+        CHECK(sendTransfer(iface_, ServerNodeID, response_meta, response, response_size, 0) > 0);
+    }
+};
+
+void testFileRead()
+{
+    Iface client;
+    Iface server;
+    server.attach(client);
+
+    // The client accepts only the service transfers addressed to it, the same filter as the loader uses
+    ICANFDIface::AcceptanceFilterConfig filt;
+    filt.id   = impl_::CANIDServiceNotMessage | (std::uint32_t(ClientNodeID) << 7);
+    filt.mask = impl_::CANIDServiceNotMessage | (std::uint32_t(impl_::MaxNodeID) << 7);
+    CHECK(client.init(1000000, 4000000, ICANFDIface::Mode::Normal, filt) == 0);
+    CHECK(server.init(1000000, 4000000, ICANFDIface::Mode::Normal, {}) == 0);
+
+    const auto file = makePattern(1000, 99);       // Not a multiple of the chunk size
+    const char* const path = "firmware/image.bin";
+    StandInFileServer file_server(server, file, path);
+
+    Reassembler reassembler;
+    std::vector<std::uint8_t> downloaded;
+    std::uint8_t transfer_id = 0;
+
+    while (true)
+    {
+        std::uint8_t request[file_read::MaxRequestSize]{};
+        const std::size_t request_size = file_read::serializeRequest(downloaded.size(), path, std::strlen(path),
+                                                                     request);
+        TransferMetadata meta;
+        meta.kind = TransferKind::Request;
+        meta.port_id = file_read::ServiceID;
+        meta.remote_node_id = ServerNodeID;
+        meta.transfer_id = transfer_id;
+        CHECK(sendTransfer(client, ClientNodeID, meta, request, request_size, 0) == 1);
+
+        file_server.spin();
+
+        std::vector<std::uint8_t> response;
+        TransferMetadata response_meta;
+        CHECK(receiveAll(client, ClientNodeID, reassembler, response, response_meta) == 1);
+        CHECK(response_meta.transfer_id == transfer_id);
+        CHECK(response_meta.remote_node_id == ServerNodeID);
+        CHECK(response.size() >= 4);
+        if (response.size() < 4)
+        {
+            break;
+        }
+
+        std::uint8_t data[file_read::DataCapacity]{};
+        const int res = file_read::deserializeResponse(response.data(), response.size(), data);
+        CHECK(res >= 0);
+        if (res <= 0)
+        {
+            break;
+        }
+        downloaded.insert(downloaded.end(), &data[0], &data[res]);
+        transfer_id = std::uint8_t((transfer_id + 1U) & impl_::TransferIDMask);
+    }
+
+    CHECK(downloaded == file);
+    CHECK(file_server.num_requests == 5);           // 4 chunks and the empty response at the end of file
+
+    // Nonexistent file
+    std::uint8_t request[file_read::MaxRequestSize]{};
+    const std::size_t request_size = file_read::serializeRequest(0, "nope", 4, request);
+    TransferMetadata meta;
+    meta.kind = TransferKind::Request;
+    meta.port_id = file_read::ServiceID;
+    meta.remote_node_id = ServerNodeID;
+    CHECK(sendTransfer(client, ClientNodeID, meta, request, request_size, 0) == 1);
+    file_server.spin();
+    std::vector<std::uint8_t> response;
+    TransferMetadata response_meta;
+    CHECK(receiveAll(client, ClientNodeID, reassembler, response, response_meta) == 1);
+    std::uint8_t data[file_read::DataCapacity]{};
+    CHECK(file_read::deserializeResponse(response.data(), response.size(), data) == -4);
+}
+
+}
+
+int main()
+{
+    testCRC();
+    testTailBytes();
+    testRoundTrip();
+    testCorruption();
+    testFileRead();
+
+    std::printf("%s: %u failures\n", __FILE__, g_num_failures);
+    return (g_num_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
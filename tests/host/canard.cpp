@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Stand-in for libcanard, see canard.h.
+ */
+
+#include "canard.h"
+#include <cstring>
+#include <algorithm>
+#include <memory>
+
+namespace
+{
+
+constexpr std::uint64_t TransferTimeoutUSec = 2000000;
+
+constexpr std::uint8_t TailStartOfTransfer = 0x80;
+constexpr std::uint8_t TailEndOfTransfer   = 0x40;
+constexpr std::uint8_t TailToggle          = 0x20;
+constexpr std::uint8_t TailTransferIDMask  = 0x1F;
+
+std::uint16_t crcAddByte(std::uint16_t crc, const std::uint8_t byte)
+{
+    crc = std::uint16_t(crc ^ (std::uint16_t(byte) << 8U));
+    for (unsigned i = 0; i < 8; i++)
+    {
+        crc = ((crc & 0x8000U) != 0) ? std::uint16_t((crc << 1U) ^ 0x1021U) : std::uint16_t(crc << 1U);
+    }
+    return crc;
+}
+
+std::uint16_t crcAdd(std::uint16_t crc, const std::uint8_t* data, std::size_t size)
+{
+    while (size --> 0)
+    {
+        crc = crcAddByte(crc, *data++);
+    }
+    return crc;
+}
+
+std::uint16_t crcAddSignature(std::uint16_t crc, const std::uint64_t data_type_signature)
+{
+    for (unsigned shift = 0; shift < 64; shift += 8)
+    {
+        crc = crcAddByte(crc, std::uint8_t(data_type_signature >> shift));
+    }
+    return crc;
+}
+
+void updatePoolStatistics(CanardInstance* ins, const int delta)
+{
+    auto& st = ins->pool_statistics;
+    st.current_usage_blocks = std::uint16_t(st.current_usage_blocks + delta);
+    st.peak_usage_blocks = std::max(st.peak_usage_blocks, st.current_usage_blocks);
+}
+
+/**
+ * Inserts the frame into the TX queue keeping the order of the CAN arbitration; FIFO among equal IDs.
+ */
+bool pushTxQueue(CanardInstance* ins, const CanardCANFrame& frame)
+{
+    CanardTxQueueItem* const item = ins->tx_free_list;
+    if (item == nullptr)
+    {
+        return false;
+    }
+    ins->tx_free_list = item->next;
+    updatePoolStatistics(ins, 1);
+
+    item->frame = frame;
+    CanardTxQueueItem** pos = &ins->tx_queue;
+    while ((*pos != nullptr) &&
+           (((*pos)->frame.id & CANARD_CAN_EXT_ID_MASK) <= (frame.id & CANARD_CAN_EXT_ID_MASK)))
+    {
+        pos = &(*pos)->next;
+    }
+    item->next = *pos;
+    *pos = item;
+    return true;
+}
+
+/**
+ * Returns the number of frames or a negated error code.
+ */
+std::int16_t enqueueTxFrames(CanardInstance* ins,
+                             const std::uint32_t can_id,
+                             const std::uint8_t* const transfer_id,
+                             const std::uint16_t crc,
+                             const std::uint8_t* const payload,
+                             const std::uint16_t payload_len)
+{
+    if ((payload_len > 0) && (payload == nullptr))
+    {
+        return -CANARD_ERROR_INVALID_ARGUMENT;
+    }
+
+    const std::uint8_t tid = std::uint8_t(*transfer_id & TailTransferIDMask);
+    CanardCANFrame frame{};
+    frame.id = can_id | CANARD_CAN_FRAME_EFF;
+
+    if (payload_len < CANARD_CAN_FRAME_MAX_DATA_LEN)
+    {
+        std::memcpy(&frame.data[0], payload, payload_len);
+        frame.data[payload_len] = std::uint8_t(TailStartOfTransfer | TailEndOfTransfer | tid);
+        frame.data_len = std::uint8_t(payload_len + 1U);
+        return pushTxQueue(ins, frame) ? 1 : -CANARD_ERROR_OUT_OF_MEMORY;
+    }
+
+    std::int16_t num_frames = 0;
+    std::uint16_t offset = 0;
+    std::uint8_t toggle = 0;
+    while (offset < payload_len)
+    {
+        std::uint8_t i = 0;
+        if (num_frames == 0)
+        {
+            frame.data[i++] = std::uint8_t(crc);
+            frame.data[i++] = std::uint8_t(crc >> 8U);
+        }
+        while ((i < (CANARD_CAN_FRAME_MAX_DATA_LEN - 1U)) && (offset < payload_len))
+        {
+            frame.data[i++] = payload[offset++];
+        }
+        frame.data[i] = std::uint8_t(((num_frames == 0) ? TailStartOfTransfer : 0U) |
+                                     ((offset >= payload_len) ? TailEndOfTransfer : 0U) |
+                                     (toggle != 0 ? TailToggle : 0U) |
+                                     tid);
+        frame.data_len = std::uint8_t(i + 1U);
+        if (!pushTxQueue(ins, frame))
+        {
+            return -CANARD_ERROR_OUT_OF_MEMORY;
+        }
+        num_frames++;
+        toggle ^= 1U;
+    }
+    return num_frames;
+}
+
+void incrementTransferID(std::uint8_t* const transfer_id)
+{
+    *transfer_id = std::uint8_t((*transfer_id + 1U) & TailTransferIDMask);
+}
+
+/**
+ * The bit order follows the DSDL: the most significant bits of every byte come first.
+ */
+void copyBitArray(const std::uint8_t* src, std::uint32_t src_offset, const std::uint32_t src_len,
+                  std::uint8_t* dst, std::uint32_t dst_offset)
+{
+    src += src_offset / 8U;
+    dst += dst_offset / 8U;
+    src_offset %= 8U;
+    dst_offset %= 8U;
+
+    const std::uint32_t last_bit = src_offset + src_len;
+    while (last_bit > src_offset)
+    {
+        const std::uint8_t src_bit_offset = std::uint8_t(src_offset % 8U);
+        const std::uint8_t dst_bit_offset = std::uint8_t(dst_offset % 8U);
+        const std::uint8_t max_offset = std::max(src_bit_offset, dst_bit_offset);
+        const std::uint32_t copy_bits = std::min<std::uint32_t>(last_bit - src_offset, 8U - max_offset);
+
+        const std::uint8_t write_mask = std::uint8_t(std::uint8_t(0xFF00U >> copy_bits) >> dst_bit_offset);
+        const std::uint8_t src_data = std::uint8_t((std::uint32_t(src[src_offset / 8U]) << src_bit_offset) >>
+                                                   dst_bit_offset);
+        dst[dst_offset / 8U] = std::uint8_t((dst[dst_offset / 8U] & ~write_mask) | (src_data & write_mask));
+
+        src_offset += copy_bits;
+        dst_offset += copy_bits;
+    }
+}
+
+std::uint8_t getStandardByteLength(const std::uint8_t bit_length)
+{
+    if (bit_length == 1)
+    {
+        return sizeof(bool);
+    }
+    if (bit_length <= 8)
+    {
+        return 1;
+    }
+    if (bit_length <= 16)
+    {
+        return 2;
+    }
+    if (bit_length <= 32)
+    {
+        return 4;
+    }
+    return 8;
+}
+
+CanardRxState* findRxState(CanardInstance* ins, const std::uint32_t descriptor, const bool create)
+{
+    CanardRxState* free_state = nullptr;
+    for (auto& x : ins->rx_states)
+    {
+        if (x.dtid_tt_snid_dnid == descriptor)
+        {
+            return &x;
+        }
+        if ((free_state == nullptr) && (x.dtid_tt_snid_dnid == 0))
+        {
+            free_state = &x;
+        }
+    }
+    if (create && (free_state != nullptr))
+    {
+        std::memset(free_state, 0, sizeof(*free_state));
+        free_state->dtid_tt_snid_dnid = descriptor;
+        updatePoolStatistics(ins, 1);
+    }
+    return create ? free_state : nullptr;
+}
+
+void resetRxState(CanardRxState* const state, const std::uint8_t transfer_id, const std::uint16_t crc)
+{
+    state->payload_len = 0;
+    state->transfer_id = transfer_id;
+    state->next_toggle = 0;
+    state->calculated_crc = crc;
+    state->payload_crc = 0;
+}
+
+} // namespace
+
+void canardInit(CanardInstance* out_ins,
+                void* mem_arena,
+                std::size_t mem_arena_size,
+                CanardOnTransferReception on_reception,
+                CanardShouldAcceptTransfer should_accept,
+                void* user_reference)
+{
+    std::memset(out_ins, 0, sizeof(*out_ins));
+    out_ins->on_reception = on_reception;
+    out_ins->should_accept = should_accept;
+    out_ins->user_reference = user_reference;
+
+    void* ptr = mem_arena;
+    if (std::align(alignof(CanardTxQueueItem), sizeof(CanardTxQueueItem), ptr, mem_arena_size) != nullptr)
+    {
+        auto* const items = static_cast<CanardTxQueueItem*>(ptr);
+        const std::size_t num_items = std::min<std::size_t>(mem_arena_size / sizeof(CanardTxQueueItem), 0xFFFFU);
+        for (std::size_t i = 0; i < num_items; i++)
+        {
+            items[i].next = (i + 1U < num_items) ? &items[i + 1U] : nullptr;
+        }
+        out_ins->tx_free_list = (num_items > 0) ? &items[0] : nullptr;
+        out_ins->pool_statistics.capacity_blocks = std::uint16_t(num_items + CANARD_HOST_RX_STATES);
+    }
+}
+
+void* canardGetUserReference(CanardInstance* ins)
+{
+    return ins->user_reference;
+}
+
+void canardSetLocalNodeID(CanardInstance* ins, std::uint8_t self_node_id)
+{
+    if ((ins->node_id == CANARD_BROADCAST_NODE_ID) &&
+        (self_node_id >= CANARD_MIN_NODE_ID) && (self_node_id <= CANARD_MAX_NODE_ID))
+    {
+        ins->node_id = self_node_id;
+    }
+}
+
+std::uint8_t canardGetLocalNodeID(const CanardInstance* ins)
+{
+    return ins->node_id;
+}
+
+std::int16_t canardBroadcast(CanardInstance* ins,
+                             std::uint64_t data_type_signature,
+                             std::uint16_t data_type_id,
+                             std::uint8_t* inout_transfer_id,
+                             std::uint8_t priority,
+                             const void* payload,
+                             std::uint16_t payload_len)
+{
+    if ((inout_transfer_id == nullptr) || (priority > CANARD_TRANSFER_PRIORITY_LOWEST))
+    {
+        return -CANARD_ERROR_INVALID_ARGUMENT;
+    }
+
+    const auto data = static_cast<const std::uint8_t*>(payload);
+    std::uint32_t can_id = 0;
+    std::uint16_t crc = 0xFFFFU;
+
+    if (ins->node_id == CANARD_BROADCAST_NODE_ID)
+    {
+        if (payload_len >= CANARD_CAN_FRAME_MAX_DATA_LEN)
+        {
+            return -CANARD_ERROR_NODE_ID_NOT_SET;       // Anonymous transfers are single-frame only
+        }
+        const std::uint16_t discriminator = std::uint16_t(crcAdd(0xFFFFU, data, payload_len) & 0x7FFEU);
+        can_id = (std::uint32_t(priority) << 24U) | (std::uint32_t(discriminator) << 9U) |
+                 (std::uint32_t(data_type_id & 3U) << 8U);
+    }
+    else
+    {
+        can_id = (std::uint32_t(priority) << 24U) | (std::uint32_t(data_type_id) << 8U) | ins->node_id;
+        if (payload_len >= CANARD_CAN_FRAME_MAX_DATA_LEN)
+        {
+            crc = crcAdd(crcAddSignature(crc, data_type_signature), data, payload_len);
+        }
+    }
+
+    const std::int16_t result = enqueueTxFrames(ins, can_id, inout_transfer_id, crc, data, payload_len);
+    if (result > 0)
+    {
+        incrementTransferID(inout_transfer_id);
+    }
+    return result;
+}
+
+std::int16_t canardRequestOrRespond(CanardInstance* ins,
+                                    std::uint8_t destination_node_id,
+                                    std::uint64_t data_type_signature,
+                                    std::uint8_t data_type_id,
+                                    std::uint8_t* inout_transfer_id,
+                                    std::uint8_t priority,
+                                    CanardRequestResponse kind,
+                                    const void* payload,
+                                    std::uint16_t payload_len)
+{
+    if ((inout_transfer_id == nullptr) || (priority > CANARD_TRANSFER_PRIORITY_LOWEST) ||
+        (destination_node_id < CANARD_MIN_NODE_ID) || (destination_node_id > CANARD_MAX_NODE_ID))
+    {
+        return -CANARD_ERROR_INVALID_ARGUMENT;
+    }
+    if (ins->node_id == CANARD_BROADCAST_NODE_ID)
+    {
+        return -CANARD_ERROR_NODE_ID_NOT_SET;
+    }
+
+    const auto data = static_cast<const std::uint8_t*>(payload);
+    const std::uint32_t can_id = (std::uint32_t(priority) << 24U) | (std::uint32_t(data_type_id) << 16U) |
+                                 (std::uint32_t(kind) << 15U) | (std::uint32_t(destination_node_id) << 8U) |
+                                 (1U << 7U) | ins->node_id;
+    std::uint16_t crc = 0xFFFFU;
+    if (payload_len >= CANARD_CAN_FRAME_MAX_DATA_LEN)
+    {
+        crc = crcAdd(crcAddSignature(crc, data_type_signature), data, payload_len);
+    }
+
+    const std::int16_t result = enqueueTxFrames(ins, can_id, inout_transfer_id, crc, data, payload_len);
+    if ((result > 0) && (kind == CanardRequest))        // Response transfer ID is the same as of the request
+    {
+        incrementTransferID(inout_transfer_id);
+    }
+    return result;
+}
+
+const CanardCANFrame* canardPeekTxQueue(const CanardInstance* ins)
+{
+    return (ins->tx_queue != nullptr) ? &ins->tx_queue->frame : nullptr;
+}
+
+void canardPopTxQueue(CanardInstance* ins)
+{
+    CanardTxQueueItem* const item = ins->tx_queue;
+    if (item != nullptr)
+    {
+        ins->tx_queue = item->next;
+        item->next = ins->tx_free_list;
+        ins->tx_free_list = item;
+        updatePoolStatistics(ins, -1);
+    }
+}
+
+std::int16_t canardHandleRxFrame(CanardInstance* ins, const CanardCANFrame* frame, std::uint64_t timestamp_usec)
+{
+    if (((frame->id & CANARD_CAN_FRAME_EFF) == 0) ||
+        ((frame->id & (CANARD_CAN_FRAME_RTR | CANARD_CAN_FRAME_ERR)) != 0) ||
+        (frame->data_len < 1))
+    {
+        return -CANARD_ERROR_RX_INCOMPATIBLE_PACKET;
+    }
+
+    const std::uint32_t id = frame->id & CANARD_CAN_EXT_ID_MASK;
+    const bool service = (id & (1U << 7U)) != 0;
+    const auto transfer_type = service ? (((id & (1U << 15U)) != 0) ? CanardTransferTypeRequest :
+                                                                       CanardTransferTypeResponse) :
+                                         CanardTransferTypeBroadcast;
+    const std::uint8_t source_node_id = std::uint8_t(id & 0x7FU);
+    const std::uint8_t destination_node_id = service ? std::uint8_t((id >> 8U) & 0x7FU) : 0U;
+    std::uint16_t data_type_id = service ? std::uint16_t((id >> 16U) & 0xFFU) : std::uint16_t((id >> 8U) & 0xFFFFU);
+    if ((!service) && (source_node_id == CANARD_BROADCAST_NODE_ID))
+    {
+        data_type_id = std::uint16_t((id >> 8U) & 3U);
+    }
+    const std::uint8_t priority = std::uint8_t((id >> 24U) & 0x1FU);
+
+    if (service && (destination_node_id != ins->node_id))
+    {
+        return -CANARD_ERROR_RX_WRONG_ADDRESS;
+    }
+
+    const std::uint8_t tail = frame->data[frame->data_len - 1U];
+    const std::uint8_t transfer_id = tail & TailTransferIDMask;
+    const bool first_frame = (tail & TailStartOfTransfer) != 0;
+    const bool last_frame = (tail & TailEndOfTransfer) != 0;
+
+    std::uint64_t data_type_signature = 0;
+    if ((ins->should_accept == nullptr) ||
+        !ins->should_accept(ins, &data_type_signature, data_type_id, transfer_type, source_node_id))
+    {
+        return -CANARD_ERROR_RX_NOT_WANTED;
+    }
+
+    CanardRxTransfer transfer{};
+    transfer.timestamp_usec = timestamp_usec;
+    transfer.data_type_id = data_type_id;
+    transfer.transfer_type = std::uint8_t(transfer_type);
+    transfer.transfer_id = transfer_id;
+    transfer.priority = priority;
+    transfer.source_node_id = source_node_id;
+
+    if (source_node_id == CANARD_BROADCAST_NODE_ID)     // Anonymous transfers are stateless
+    {
+        if (!(first_frame && last_frame))
+        {
+            return -CANARD_ERROR_RX_INCOMPATIBLE_PACKET;
+        }
+        transfer.payload_head = &frame->data[0];
+        transfer.payload_len = std::uint16_t(frame->data_len - 1U);
+        ins->on_reception(ins, &transfer);
+        return CANARD_OK;
+    }
+
+    const std::uint32_t descriptor = std::uint32_t(data_type_id) | (std::uint32_t(transfer_type) << 16U) |
+                                     (std::uint32_t(source_node_id) << 18U) |
+                                     (std::uint32_t(destination_node_id) << 25U);
+    CanardRxState* const state = findRxState(ins, descriptor, first_frame);
+    if (state == nullptr)
+    {
+        return first_frame ? -CANARD_ERROR_OUT_OF_MEMORY : -CANARD_ERROR_RX_MISSED_START;
+    }
+
+    const std::uint16_t initial_crc = crcAddSignature(0xFFFFU, data_type_signature);
+    const bool not_initialized = state->timestamp_usec == 0;
+    const bool tid_timed_out = (timestamp_usec - state->timestamp_usec) > TransferTimeoutUSec;
+    const bool not_previous_tid = ((transfer_id - state->transfer_id) & TailTransferIDMask) > 1U;
+    if (not_initialized || tid_timed_out || (first_frame && not_previous_tid))
+    {
+        resetRxState(state, transfer_id, initial_crc);
+        if (!first_frame)
+        {
+            state->transfer_id = std::uint8_t((state->transfer_id + 1U) & TailTransferIDMask);
+            return -CANARD_ERROR_RX_MISSED_START;
+        }
+    }
+
+    if (first_frame && last_frame)                      // Single-frame transfer
+    {
+        state->timestamp_usec = timestamp_usec;
+        transfer.payload_head = &frame->data[0];
+        transfer.payload_len = std::uint16_t(frame->data_len - 1U);
+        ins->on_reception(ins, &transfer);
+        resetRxState(state, std::uint8_t((transfer_id + 1U) & TailTransferIDMask), initial_crc);
+        return CANARD_OK;
+    }
+
+    if (((tail & TailToggle) != 0) != (state->next_toggle != 0))
+    {
+        return -CANARD_ERROR_RX_WRONG_TOGGLE;
+    }
+    if (transfer_id != state->transfer_id)
+    {
+        return -CANARD_ERROR_RX_UNEXPECTED_TID;
+    }
+
+    const std::uint8_t* data = &frame->data[0];
+    std::size_t size = frame->data_len - 1U;
+    if (first_frame)
+    {
+        if (size < 3)
+        {
+            return -CANARD_ERROR_RX_SHORT_FRAME;
+        }
+        state->timestamp_usec = timestamp_usec;
+        state->payload_crc = std::uint16_t(data[0] | (data[1] << 8U));
+        data += 2;
+        size -= 2;
+    }
+    if ((state->payload_len + size) > sizeof(state->buffer))
+    {
+        resetRxState(state, std::uint8_t((transfer_id + 1U) & TailTransferIDMask), initial_crc);
+        return -CANARD_ERROR_OUT_OF_MEMORY;
+    }
+    std::memcpy(&state->buffer[state->payload_len], data, size);
+    state->payload_len = std::uint16_t(state->payload_len + size);
+    state->calculated_crc = crcAdd(state->calculated_crc, data, size);
+    state->next_toggle ^= 1U;
+
+    if (last_frame)
+    {
+        const bool crc_ok = state->calculated_crc == state->payload_crc;
+        if (crc_ok)
+        {
+            transfer.payload_head = &state->buffer[0];
+            transfer.payload_len = state->payload_len;
+            ins->on_reception(ins, &transfer);
+        }
+        resetRxState(state, std::uint8_t((transfer_id + 1U) & TailTransferIDMask), initial_crc);
+        return crc_ok ? CANARD_OK : -CANARD_ERROR_RX_BAD_CRC;
+    }
+    return CANARD_OK;
+}
+
+void canardCleanupStaleTransfers(CanardInstance* ins, std::uint64_t current_time_usec)
+{
+    for (auto& x : ins->rx_states)
+    {
+        if ((x.dtid_tt_snid_dnid != 0) && ((current_time_usec - x.timestamp_usec) > TransferTimeoutUSec))
+        {
+            x.dtid_tt_snid_dnid = 0;
+            updatePoolStatistics(ins, -1);
+        }
+    }
+}
+
+std::int16_t canardDecodeScalar(const CanardRxTransfer* transfer,
+                                std::uint32_t bit_offset,
+                                std::uint8_t bit_length,
+                                bool value_is_signed,
+                                void* out_value)
+{
+    if ((transfer == nullptr) || (out_value == nullptr) || (bit_length < 1) || (bit_length > 64))
+    {
+        return -CANARD_ERROR_INVALID_ARGUMENT;
+    }
+
+    const std::uint32_t payload_bits = std::uint32_t(transfer->payload_len) * 8U;
+    if (bit_offset >= payload_bits)
+    {
+        return 0;
+    }
+    const std::uint32_t available_bits = std::min<std::uint32_t>(bit_length, payload_bits - bit_offset);
+
+    std::uint8_t bytes[8]{};
+    copyBitArray(transfer->payload_head, bit_offset, available_bits, &bytes[0], 0);
+    if ((bit_length % 8U) != 0)
+    {
+        bytes[bit_length / 8U] = std::uint8_t(bytes[bit_length / 8U] >> ((8U - (bit_length % 8U)) & 7U));
+    }
+
+    std::uint64_t value = 0;
+    for (unsigned i = 0; i < 8; i++)
+    {
+        value |= std::uint64_t(bytes[i]) << (i * 8U);
+    }
+    const std::uint8_t std_byte_length = getStandardByteLength(bit_length);
+    if (value_is_signed && (bit_length < 64) && ((value & (1ULL << (bit_length - 1U))) != 0))
+    {
+        value |= ~((1ULL << bit_length) - 1U);          // Sign extension
+    }
+
+    if (bit_length == 1)
+    {
+        *static_cast<bool*>(out_value) = value != 0;
+    }
+    else
+    {
+        std::memcpy(out_value, &value, std_byte_length);   // The host is little-endian
+    }
+    return std::int16_t(available_bits);
+}
+
+void canardEncodeScalar(void* destination, std::uint32_t bit_offset, std::uint8_t bit_length, const void* value)
+{
+    if ((destination == nullptr) || (value == nullptr) || (bit_length < 1) || (bit_length > 64))
+    {
+        return;
+    }
+
+    std::uint8_t bytes[8]{};
+    if (bit_length == 1)
+    {
+        bytes[0] = *static_cast<const bool*>(value) ? 1U : 0U;
+    }
+    else
+    {
+        std::memcpy(&bytes[0], value, getStandardByteLength(bit_length));
+    }
+    if ((bit_length % 8U) != 0)
+    {
+        bytes[bit_length / 8U] = std::uint8_t(bytes[bit_length / 8U] << ((8U - (bit_length % 8U)) & 7U));
+    }
+    copyBitArray(&bytes[0], 0, bit_length, static_cast<std::uint8_t*>(destination), bit_offset);
+}
+
+void canardReleaseRxTransferPayload(CanardInstance*, CanardRxTransfer* transfer)
+{
+    transfer->payload_head = nullptr;                   // The buffer belongs to the RX state
+    transfer->payload_len = 0;
+}
+
+CanardPoolAllocatorStatistics canardGetPoolAllocatorStatistics(CanardInstance* ins)
+{
+    return ins->pool_statistics;
+}
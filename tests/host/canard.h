@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Stand-in for libcanard (UAVCAN v0), for the host tests; implemented in canard.cpp.
+ * The API, the CAN ID layout, the tail byte, the transfer CRC, and the scalar codec follow libcanard, so the nodes
+ * built against it interoperate with each other exactly like the real ones. The differences are internal:
+ * the TX queue items are allocated from the memory arena, while the RX states have a fixed capacity per instance.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#define CANARD_OK                                   0
+#define CANARD_ERROR_INVALID_ARGUMENT               2
+#define CANARD_ERROR_OUT_OF_MEMORY                  3
+#define CANARD_ERROR_NODE_ID_NOT_SET                4
+#define CANARD_ERROR_INTERNAL                       9
+#define CANARD_ERROR_RX_INCOMPATIBLE_PACKET         10
+#define CANARD_ERROR_RX_WRONG_ADDRESS               11
+#define CANARD_ERROR_RX_NOT_WANTED                  12
+#define CANARD_ERROR_RX_MISSED_START                13
+#define CANARD_ERROR_RX_WRONG_TOGGLE                14
+#define CANARD_ERROR_RX_UNEXPECTED_TID              15
+#define CANARD_ERROR_RX_SHORT_FRAME                 16
+#define CANARD_ERROR_RX_BAD_CRC                     17
+
+#define CANARD_CAN_FRAME_MAX_DATA_LEN               8U
+#define CANARD_CAN_EXT_ID_MASK                      0x1FFFFFFFU
+#define CANARD_CAN_FRAME_EFF                        (1UL << 31U)
+#define CANARD_CAN_FRAME_RTR                        (1UL << 30U)
+#define CANARD_CAN_FRAME_ERR                        (1UL << 29U)
+
+#define CANARD_BROADCAST_NODE_ID                    0
+#define CANARD_MIN_NODE_ID                          1
+#define CANARD_MAX_NODE_ID                          127
+
+#define CANARD_TRANSFER_PRIORITY_HIGHEST            0
+#define CANARD_TRANSFER_PRIORITY_HIGH               8
+#define CANARD_TRANSFER_PRIORITY_MEDIUM             16
+#define CANARD_TRANSFER_PRIORITY_LOW                24
+#define CANARD_TRANSFER_PRIORITY_LOWEST             31
+
+/// Not a part of libcanard: capacity of the RX states of an instance and the maximum size of a received transfer
+#define CANARD_HOST_RX_STATES                       32U
+#define CANARD_HOST_MAX_RX_PAYLOAD                  512U
+
+typedef enum
+{
+    CanardRequest = 1,
+    CanardResponse = 0
+} CanardRequestResponse;
+
+typedef enum
+{
+    CanardTransferTypeResponse = 0,
+    CanardTransferTypeRequest = 1,
+    CanardTransferTypeBroadcast = 2
+} CanardTransferType;
+
+struct CanardCANFrame
+{
+    std::uint32_t id;
+    std::uint8_t data[CANARD_CAN_FRAME_MAX_DATA_LEN];
+    std::uint8_t data_len;
+};
+
+struct CanardRxTransfer
+{
+    std::uint64_t timestamp_usec;
+    const std::uint8_t* payload_head;                   ///< The whole payload is contiguous here
+    std::uint16_t payload_len;
+    std::uint16_t data_type_id;
+    std::uint8_t transfer_type;
+    std::uint8_t transfer_id;
+    std::uint8_t priority;
+    std::uint8_t source_node_id;
+};
+
+struct CanardInstance;
+
+typedef bool (*CanardShouldAcceptTransfer)(const CanardInstance* ins,
+                                           std::uint64_t* out_data_type_signature,
+                                           std::uint16_t data_type_id,
+                                           CanardTransferType transfer_type,
+                                           std::uint8_t source_node_id);
+
+typedef void (*CanardOnTransferReception)(CanardInstance* ins, CanardRxTransfer* transfer);
+
+struct CanardTxQueueItem
+{
+    CanardTxQueueItem* next;
+    CanardCANFrame frame;
+};
+
+struct CanardPoolAllocatorStatistics
+{
+    std::uint16_t capacity_blocks;
+    std::uint16_t current_usage_blocks;
+    std::uint16_t peak_usage_blocks;
+};
+
+struct CanardRxState
+{
+    std::uint32_t dtid_tt_snid_dnid;                    ///< Zero if the state is not used
+    std::uint64_t timestamp_usec;
+    std::uint16_t payload_crc;
+    std::uint16_t calculated_crc;
+    std::uint16_t payload_len;
+    std::uint8_t transfer_id;
+    std::uint8_t next_toggle;
+    std::uint8_t buffer[CANARD_HOST_MAX_RX_PAYLOAD];
+};
+
+struct CanardInstance
+{
+    std::uint8_t node_id;
+    CanardShouldAcceptTransfer should_accept;
+    CanardOnTransferReception on_reception;
+    CanardTxQueueItem* tx_queue;
+    CanardTxQueueItem* tx_free_list;                    ///< The memory arena, cut into the TX queue items
+    CanardPoolAllocatorStatistics pool_statistics;
+    CanardRxState rx_states[CANARD_HOST_RX_STATES];
+    void* user_reference;
+};
+
+void canardInit(CanardInstance* out_ins,
+                void* mem_arena,
+                std::size_t mem_arena_size,
+                CanardOnTransferReception on_reception,
+                CanardShouldAcceptTransfer should_accept,
+                void* user_reference);
+
+void* canardGetUserReference(CanardInstance* ins);
+
+void canardSetLocalNodeID(CanardInstance* ins, std::uint8_t self_node_id);
+
+std::uint8_t canardGetLocalNodeID(const CanardInstance* ins);
+
+std::int16_t canardBroadcast(CanardInstance* ins,
+                             std::uint64_t data_type_signature,
+                             std::uint16_t data_type_id,
+                             std::uint8_t* inout_transfer_id,
+                             std::uint8_t priority,
+                             const void* payload,
+                             std::uint16_t payload_len);
+
+std::int16_t canardRequestOrRespond(CanardInstance* ins,
+                                    std::uint8_t destination_node_id,
+                                    std::uint64_t data_type_signature,
+                                    std::uint8_t data_type_id,
+                                    std::uint8_t* inout_transfer_id,
+                                    std::uint8_t priority,
+                                    CanardRequestResponse kind,
+                                    const void* payload,
+                                    std::uint16_t payload_len);
+
+const CanardCANFrame* canardPeekTxQueue(const CanardInstance* ins);
+
+void canardPopTxQueue(CanardInstance* ins);
+
+std::int16_t canardHandleRxFrame(CanardInstance* ins, const CanardCANFrame* frame, std::uint64_t timestamp_usec);
+
+void canardCleanupStaleTransfers(CanardInstance* ins, std::uint64_t current_time_usec);
+
+std::int16_t canardDecodeScalar(const CanardRxTransfer* transfer,
+                                std::uint32_t bit_offset,
+                                std::uint8_t bit_length,
+                                bool value_is_signed,
+                                void* out_value);
+
+void canardEncodeScalar(void* destination, std::uint32_t bit_offset, std::uint8_t bit_length, const void* value);
+
+void canardReleaseRxTransferPayload(CanardInstance* ins, CanardRxTransfer* transfer);
+
+CanardPoolAllocatorStatistics canardGetPoolAllocatorStatistics(CanardInstance* ins);
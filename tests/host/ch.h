@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Stand-in for the ChibiOS kernel API used by the library headers, for the host tests.
+ * The services needed by the tests are implemented in kernel.cpp on top of a virtual time scheduler;
+ * the rest is only declared, so that the headers compile.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#define TRUE                        1
+#define FALSE                       0
+
+#define CH_CFG_ST_FREQUENCY         1000000
+#define CH_CFG_ST_RESOLUTION        32
+#define CH_CFG_USE_REGISTRY         FALSE
+#define CH_CFG_USE_DYNAMIC          FALSE
+#define CH_DBG_FILL_THREADS         FALSE
+#define CH_DBG_ENABLE_STACK_CHECK   FALSE
+
+typedef std::uint32_t systime_t;
+typedef std::uint32_t sysinterval_t;
+typedef std::uint64_t time_conv_t;
+typedef std::uint32_t syssts_t;
+typedef std::uint32_t tprio_t;
+typedef std::int32_t msg_t;
+typedef std::int32_t cnt_t;
+typedef std::uint32_t eventmask_t;
+typedef std::uint32_t rtcnt_t;
+typedef std::uint64_t stkalign_t;
+
+#define MSG_OK                      ((msg_t)0)
+#define MSG_TIMEOUT                 ((msg_t)-1)
+#define MSG_RESET                   ((msg_t)-2)
+
+#define IDLEPRIO                    ((tprio_t)1)
+#define LOWPRIO                     ((tprio_t)2)
+#define NORMALPRIO                  ((tprio_t)128)
+#define HIGHPRIO                    ((tprio_t)255)
+
+#define TIME_IMMEDIATE              ((sysinterval_t)0)
+#define TIME_INFINITE               ((sysinterval_t)-1)
+
+#define TIME_S2I(secs)   ((sysinterval_t)((time_conv_t)(secs) * (time_conv_t)CH_CFG_ST_FREQUENCY))
+#define TIME_MS2I(msecs) ((sysinterval_t)((((time_conv_t)(msecs) * (time_conv_t)CH_CFG_ST_FREQUENCY) + \
+                                           (time_conv_t)999) / (time_conv_t)1000))
+#define TIME_US2I(usecs) ((sysinterval_t)((((time_conv_t)(usecs) * (time_conv_t)CH_CFG_ST_FREQUENCY) + \
+                                           (time_conv_t)999999) / (time_conv_t)1000000))
+#define TIME_I2MS(interval) (time_msecs_t)((((time_conv_t)(interval) * (time_conv_t)1000) + \
+                                            (time_conv_t)CH_CFG_ST_FREQUENCY - (time_conv_t)1) / \
+                                           (time_conv_t)CH_CFG_ST_FREQUENCY)
+#define TIME_I2US(interval) (time_usecs_t)((((time_conv_t)(interval) * (time_conv_t)1000000) + \
+                                            (time_conv_t)CH_CFG_ST_FREQUENCY - (time_conv_t)1) / \
+                                           (time_conv_t)CH_CFG_ST_FREQUENCY)
+
+typedef std::uint32_t time_msecs_t;
+typedef std::uint32_t time_usecs_t;
+
+struct thread_t
+{
+    const char* name = "";
+    tprio_t prio = NORMALPRIO;
+};
+
+struct mutex_t
+{
+    thread_t* owner = nullptr;
+};
+
+systime_t chVTGetSystemTimeX();
+#define chVTGetSystemTime()             chVTGetSystemTimeX()
+#define chVTTimeElapsedSinceX(start)    ((sysinterval_t)(chVTGetSystemTimeX() - (start)))
+
+void chThdSleep(sysinterval_t interval);
+void chThdSleepUntil(systime_t time);
+void chThdYield();
+thread_t* chThdGetSelfX();
+#define chThdSleepSeconds(sec)          chThdSleep(TIME_S2I(sec))
+#define chThdSleepMilliseconds(msec)    chThdSleep(TIME_MS2I(msec))
+#define chThdSleepMicroseconds(usec)    chThdSleep(TIME_US2I(usec))
+
+/*
+ * The scheduler is cooperative, so the critical sections do nothing.
+ */
+inline void chSysLock() { }
+inline void chSysUnlock() { }
+inline void chSysLockFromISR() { }
+inline void chSysUnlockFromISR() { }
+inline syssts_t chSysGetStatusAndLockX() { return 0; }
+inline void chSysRestoreStatusX(syssts_t) { }
+inline bool port_irq_enabled(syssts_t) { return true; }
+inline bool port_is_isr_context() { return false; }
+
+rtcnt_t chSysGetRealtimeCounterX();
+[[noreturn]] void chSysHalt(const char* reason);
+
+thread_t* chRegFirstThread();
+thread_t* chRegNextThread(thread_t* tp);
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Stand-in for the ChibiOS C++ wrapper, see ch.h.
+ * Every thread is a host thread, but only one of them runs at a time; see kernel.cpp.
+ */
+
+#pragma once
+
+#include "ch.h"
+
+namespace chibios_rt
+{
+
+class ThreadReference
+{
+public:
+    thread_t* thread_ref;
+
+    ThreadReference(thread_t* tp = nullptr) : thread_ref(tp) { }
+};
+
+class Mutex
+{
+public:
+    ::mutex_t mutex;
+
+    void lock();
+    void unlock();
+    bool tryLock();
+};
+
+class BinarySemaphore
+{
+    bool taken_;
+
+public:
+    explicit BinarySemaphore(bool taken) : taken_(taken) { }
+
+    BinarySemaphore(const BinarySemaphore&) = delete;
+    BinarySemaphore& operator=(const BinarySemaphore&) = delete;
+
+    msg_t wait(sysinterval_t timeout = TIME_INFINITE);
+    void signal();
+    void signalI() { signal(); }
+    void reset(bool taken) { taken_ = taken; }
+};
+
+class BaseThread
+{
+protected:
+    /**
+     * Creates the host thread that invokes main(); see kernel.cpp.
+     */
+    ThreadReference startThread(tprio_t prio);
+
+public:
+    virtual ~BaseThread() = default;
+
+    virtual void main() = 0;
+
+    static tprio_t setPriority(tprio_t newprio);
+
+    static void setName(const char* tname) { chThdGetSelfX()->name = tname; }
+};
+
+template <int N>
+class BaseStaticThread : public BaseThread
+{
+public:
+    ThreadReference start(tprio_t prio) { return startThread(prio); }
+};
+
+}
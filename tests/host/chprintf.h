@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Stand-in for the ChibiOS formatted output API, for the host tests; see hal.h.
+ */
+
+#pragma once
+
+#include <cstdarg>
+#include "hal.h"
+
+int chvprintf(BaseSequentialStream* chp, const char* fmt, va_list ap);
+int chprintf(BaseSequentialStream* chp, const char* fmt, ...);
+int chsnprintf(char* str, std::size_t size, const char* fmt, ...);
+int chvsnprintf(char* str, std::size_t size, const char* fmt, va_list ap);
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Stand-in for the ChibiOS HAL API used by the library headers, for the host tests; declarations only.
+ */
+
+#pragma once
+
+#include "ch.h"
+
+struct BaseSequentialStream;
+
+struct BaseSequentialStreamVMT
+{
+    std::size_t instance_offset;
+    std::size_t (*write)(void* instance, const std::uint8_t* bp, std::size_t n);
+    std::size_t (*read)(void* instance, std::uint8_t* bp, std::size_t n);
+    msg_t (*put)(void* instance, std::uint8_t b);
+    msg_t (*get)(void* instance);
+};
+
+struct BaseSequentialStream
+{
+    const BaseSequentialStreamVMT* vmt;
+};
+
+struct DWT_Type
+{
+    volatile std::uint32_t CTRL;
+    volatile std::uint32_t CYCCNT;
+};
+
+extern DWT_Type* DWT;
+
+#define STM32_HCLK                  72000000
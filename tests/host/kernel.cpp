@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Virtual time scheduler behind the ChibiOS stand-in, see ch.h.
+ * Every thread is a host thread, but they are scheduled cooperatively: only one of them runs at a time, and it
+ * runs until it blocks. When no thread is ready to run, the virtual time jumps to the earliest wake-up moment.
+ * Hence the time spent computing is zero, and a simulated second takes as long as the computations it contains.
+ * The threads are picked in a round-robin order; the priorities are recorded but ignored.
+ */
+
+#include "ch.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr std::uint64_t Never = std::numeric_limits<std::uint64_t>::max();
+
+struct Thread
+{
+    thread_t tcb;
+    std::condition_variable cv;
+    std::function<bool ()> ready_condition;     ///< Empty if the thread waits for the wake-up time only
+    std::uint64_t wake_at = 0;
+    bool blocked = false;
+};
+
+std::mutex g_mutex;
+std::uint64_t g_now = 0;
+Thread* g_current = nullptr;
+thread_local Thread* t_self = nullptr;
+
+/**
+ * Constructed on first use, because the static objects under test may start their threads before main().
+ */
+std::vector<Thread*>& getThreads()
+{
+    static std::vector<Thread*> threads;
+    return threads;
+}
+
+/**
+ * The thread that invokes the kernel first is registered as the running one; that is the main thread.
+ * The mutex must be locked by the caller.
+ */
+Thread& getSelf()
+{
+    if (t_self == nullptr)
+    {
+        if (g_current != nullptr)
+        {
+            std::fputs("Kernel: unregistered thread\n", stderr);
+            std::abort();
+        }
+        t_self = new Thread;
+        t_self->tcb.name = "main";
+        getThreads().push_back(t_self);
+        g_current = t_self;
+    }
+    return *t_self;
+}
+
+bool isReady(const Thread& t)
+{
+    return t.blocked && ((t.wake_at <= g_now) || (t.ready_condition && t.ready_condition()));
+}
+
+/**
+ * Picks the next thread to run after the specified one, advancing the time if nobody is ready.
+ */
+Thread& pickNext(const Thread& after)
+{
+    const std::vector<Thread*>& threads = getThreads();
+    std::size_t start = 0;
+    while ((start < threads.size()) && (threads[start] != &after))
+    {
+        start++;
+    }
+
+    while (true)
+    {
+        std::uint64_t earliest = Never;
+        for (std::size_t i = 1; i <= threads.size(); i++)
+        {
+            Thread& t = *threads[(start + i) % threads.size()];
+            if (isReady(t))
+            {
+                return t;
+            }
+            if (t.blocked)
+            {
+                earliest = std::min(earliest, t.wake_at);
+            }
+        }
+        if (earliest == Never)
+        {
+            std::fprintf(stderr, "Kernel: deadlock at %llu us\n", static_cast<unsigned long long>(g_now));
+            std::_Exit(EXIT_FAILURE);
+        }
+        g_now = earliest;
+    }
+}
+
+/**
+ * Hands the CPU over to the next thread; returns when this thread is scheduled again.
+ */
+void switchAway(std::unique_lock<std::mutex>& lock, Thread& self)
+{
+    Thread& next = pickNext(self);
+    next.blocked = false;
+    next.ready_condition = nullptr;
+    g_current = &next;
+    next.cv.notify_one();
+    self.cv.wait(lock, [&self]() { return g_current == &self; });
+}
+
+/**
+ * Blocks the calling thread until the condition holds or the time comes, whichever happens first.
+ * The condition is evaluated by the scheduler with the mutex locked.
+ */
+void block(std::unique_lock<std::mutex>& lock, std::function<bool ()> ready_condition, const std::uint64_t wake_at)
+{
+    Thread& self = getSelf();
+    self.ready_condition = std::move(ready_condition);
+    self.wake_at = wake_at;
+    self.blocked = true;
+    switchAway(lock, self);
+}
+
+void sleepUntilVirtualTime(const std::uint64_t wake_at)
+{
+    std::unique_lock<std::mutex> lock(g_mutex);
+    while (g_now < wake_at)
+    {
+        block(lock, nullptr, wake_at);
+    }
+}
+
+} // namespace
+
+systime_t chVTGetSystemTimeX()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return systime_t(g_now);
+}
+
+void chThdSleep(const sysinterval_t interval)
+{
+    if (interval == TIME_IMMEDIATE)
+    {
+        chThdYield();
+        return;
+    }
+    std::uint64_t wake_at = Never;
+    if (interval != TIME_INFINITE)
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        wake_at = g_now + interval;
+    }
+    sleepUntilVirtualTime(wake_at);
+}
+
+void chThdSleepUntil(const systime_t time)
+{
+    const sysinterval_t interval = sysinterval_t(time - chVTGetSystemTimeX());
+    if (interval != TIME_IMMEDIATE)
+    {
+        chThdSleep(interval);
+    }
+}
+
+void chThdYield()
+{
+    std::unique_lock<std::mutex> lock(g_mutex);
+    block(lock, nullptr, g_now);
+}
+
+thread_t* chThdGetSelfX()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return &getSelf().tcb;
+}
+
+rtcnt_t chSysGetRealtimeCounterX()
+{
+    return rtcnt_t(chVTGetSystemTimeX());
+}
+
+void chSysHalt(const char* reason)
+{
+    std::fprintf(stderr, "Kernel: halted: %s\n", (reason != nullptr) ? reason : "");
+    std::abort();
+}
+
+namespace chibios_rt
+{
+
+void Mutex::lock()
+{
+    std::unique_lock<std::mutex> lock(g_mutex);
+    Thread& self = getSelf();
+    if (mutex.owner == &self.tcb)
+    {
+        std::fprintf(stderr, "Kernel: recursive lock of mutex %p by %s\n", static_cast<void*>(this), self.tcb.name);
+        std::abort();
+    }
+    while (mutex.owner != nullptr)
+    {
+        block(lock, [this]() { return mutex.owner == nullptr; }, Never);
+    }
+    mutex.owner = &self.tcb;
+}
+
+void Mutex::unlock()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    mutex.owner = nullptr;
+}
+
+bool Mutex::tryLock()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (mutex.owner != nullptr)
+    {
+        return false;
+    }
+    mutex.owner = &getSelf().tcb;
+    return true;
+}
+
+msg_t BinarySemaphore::wait(const sysinterval_t timeout)
+{
+    std::unique_lock<std::mutex> lock(g_mutex);
+    const std::uint64_t wake_at = (timeout == TIME_INFINITE) ? Never : (g_now + timeout);
+    while (taken_)
+    {
+        if (g_now >= wake_at)
+        {
+            return MSG_TIMEOUT;
+        }
+        block(lock, [this]() { return !taken_; }, wake_at);
+    }
+    taken_ = true;
+    return MSG_OK;
+}
+
+void BinarySemaphore::signal()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    taken_ = false;
+}
+
+ThreadReference BaseThread::startThread(const tprio_t prio)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    (void) getSelf();
+
+    Thread* const t = new Thread;               // Never deleted, like the static threads of the firmware
+    t->tcb.prio = prio;
+    t->blocked = true;                          // Ready to run, but the caller keeps running until it blocks
+    getThreads().push_back(t);
+
+    std::thread([this, t]()
+        {
+            {
+                std::unique_lock<std::mutex> lock(g_mutex);
+                t_self = t;
+                t->cv.wait(lock, [t]() { return g_current == t; });
+            }
+            main();
+            std::unique_lock<std::mutex> lock(g_mutex);
+            Thread& next = pickNext(*t);
+            std::vector<Thread*>& threads = getThreads();
+            threads.erase(std::find(threads.begin(), threads.end(), t));
+            next.blocked = false;
+            next.ready_condition = nullptr;
+            g_current = &next;
+            next.cv.notify_one();
+        }).detach();
+
+    return ThreadReference(&t->tcb);
+}
+
+tprio_t BaseThread::setPriority(const tprio_t newprio)
+{
+    thread_t* const self = chThdGetSelfX();
+    const tprio_t old = self->prio;
+    self->prio = newprio;
+    return old;
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Stand-ins for the parts of the library and of the C library that the headers under test depend on.
+ * The log messages are printed with the virtual timestamp if the environment variable HOST_TEST_LOG is set,
+ * and discarded otherwise. The sleep functions use the virtual time, like the ones in sys.cpp.
+ */
+
+#include <zubax_chibios/os.hpp>
+#include <chprintf.h>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace
+{
+
+bool g_reboot_requested = false;
+
+void vlog(const char* name, const char* format, va_list vl)
+{
+    static const bool Enabled = std::getenv("HOST_TEST_LOG") != nullptr;
+    if (Enabled)
+    {
+        const systime_t ts = chVTGetSystemTimeX();
+        std::printf("%u.%06u %s: ", unsigned(ts / 1000000U), unsigned(ts % 1000000U), name);
+        std::vprintf(format, vl);
+        std::printf("\n");
+    }
+}
+
+} // namespace
+
+namespace os
+{
+
+void requestReboot()
+{
+    g_reboot_requested = true;
+}
+
+bool isRebootRequested()
+{
+    return g_reboot_requested;
+}
+
+Logger::~Logger() { }
+
+void Logger::println(const char* format, ...)
+{
+    va_list vl;
+    va_start(vl, format);
+    vlog(name_, format, vl);
+    va_end(vl);
+}
+
+void Logger::puts(const char* line)
+{
+    println("%s", line);
+}
+
+}
+
+int chsnprintf(char* str, std::size_t size, const char* fmt, ...)
+{
+    va_list vl;
+    va_start(vl, fmt);
+    const int out = std::vsnprintf(str, size, fmt, vl);
+    va_end(vl);
+    return out;
+}
+
+int usleep(useconds_t useconds)
+{
+    if (useconds > 0)
+    {
+        chThdSleepMicroseconds(useconds);
+    }
+    return 0;
+}
+
+unsigned sleep(unsigned int seconds)
+{
+    if (seconds > 0)
+    {
+        chThdSleepSeconds(seconds);
+    }
+    return 0;
+}
+
+int watchdogCreate(unsigned)
+{
+    return 0;
+}
+
+void watchdogReset(int) { }
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Stand-in for the subset of the Senoval fixed-capacity string used by the library, for the host tests.
+ * The strings are truncated at the capacity, like the original.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+namespace senoval
+{
+
+template <std::size_t Capacity>
+class String
+{
+    char buf_[Capacity + 1]{};
+    std::size_t len_ = 0;
+
+public:
+    String() = default;
+
+    String(const char* str)
+    {
+        *this += str;
+    }
+
+    template <std::size_t OtherCapacity>
+    String(const String<OtherCapacity>& other)
+    {
+        *this += other;
+    }
+
+    static constexpr unsigned capacity() { return unsigned(Capacity); }    ///< Same as size_t on the targets
+
+    std::size_t length() const { return len_; }
+    std::size_t size()   const { return len_; }
+    bool empty()         const { return len_ == 0; }
+
+    const char* c_str() const { return &buf_[0]; }
+
+    const char* begin() const { return &buf_[0]; }
+    const char* end()   const { return &buf_[len_]; }
+
+    char operator[](const std::size_t index) const { return buf_[index]; }
+
+    void clear()
+    {
+        len_ = 0;
+        buf_[0] = '\0';
+    }
+
+    void push_back(const char c)
+    {
+        if (len_ < Capacity)
+        {
+            buf_[len_++] = c;
+            buf_[len_] = '\0';
+        }
+    }
+
+    String& operator+=(const char* str)
+    {
+        while (*str != '\0')
+        {
+            push_back(*str++);
+        }
+        return *this;
+    }
+
+    template <std::size_t OtherCapacity>
+    String& operator+=(const String<OtherCapacity>& other)
+    {
+        for (const char c : other)
+        {
+            push_back(c);
+        }
+        return *this;
+    }
+
+    template <std::size_t OtherCapacity>
+    String<Capacity + OtherCapacity> operator+(const String<OtherCapacity>& other) const
+    {
+        String<Capacity + OtherCapacity> out(*this);
+        out += other;
+        return out;
+    }
+
+    bool operator==(const char* str) const { return std::strcmp(c_str(), str) == 0; }
+
+    template <std::size_t OtherCapacity>
+    bool operator==(const String<OtherCapacity>& other) const { return *this == other.c_str(); }
+};
+
+template <typename T>
+String<24> convertIntToString(const T value)
+{
+    static_assert(std::is_integral<T>::value, "Integer expected");
+    char buf[24]{};
+    if (std::is_signed<T>::value)
+    {
+        (void) std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(value));
+    }
+    else
+    {
+        (void) std::snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(value));
+    }
+    return String<24>(buf);
+}
+
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Host test of the UAVCAN firmware loader running in the in-process simulator.
+ * The loader, the simulated peers, and the benchmark run unmodified on the virtual time kernel from host/,
+ * so the measured times are determined by the simulated CAN bus alone. The benchmark sweep is expected to
+ * follow the bus bit rate, and a node that has cached a node ID that is taken is expected to give it up.
+ */
+
+#include <zubax_chibios/bootloader/loaders/uavcan_simulator.hpp>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace os::bootloader::uavcan_loader;
+
+namespace
+{
+
+unsigned g_num_failures = 0;
+
+#define CHECK(x)                                                                        \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(x))                                                                       \
+        {                                                                               \
+            std::printf("%s:%d: CHECK FAILED: %s\n", __FILE__, __LINE__, #x);           \
+            g_num_failures++;                                                           \
+        }                                                                               \
+    }                                                                                   \
+    while (false)
+
+constexpr std::uint32_t ImageSize = 16384;
+constexpr unsigned NumServers = 2;
+
+using Node = UAVCANFirmwareUpdateNode<4096, 8192, NumServers>;
+using Peer = sim::SimulatedPeer<>;
+
+HardwareInfo makeHardwareInfo(const std::uint8_t seed)
+{
+    HardwareInfo hw;
+    hw.major = 1;
+    for (unsigned i = 0; i < hw.unique_id.size(); i++)
+    {
+        hw.unique_id[i] = std::uint8_t(seed + i);
+    }
+    return hw;
+}
+
+/**
+ * Keeps the node ID in memory, like the RAM shared with the application does across a restart.
+ */
+class NetworkParametersCache : public INetworkParametersCache
+{
+    CachedNetworkParameters params_;
+    bool valid_ = false;
+
+public:
+    std::optional<CachedNetworkParameters> load() override
+    {
+        return valid_ ? std::optional<CachedNetworkParameters>(params_) : std::nullopt;
+    }
+
+    void store(const CachedNetworkParameters& params) override
+    {
+        params_ = params;
+        valid_ = true;
+    }
+};
+
+/*
+ * All nodes exist for the lifetime of the process, because their threads never exit.
+ */
+sim::VirtualCANBus g_bus(125000);
+Peer g_allocator_and_server(g_bus, 10, ImageSize, true);
+Peer g_server(g_bus, 11, ImageSize, false);
+
+sim::NullAppStorageBackend g_backend(65536);
+::os::bootloader::Bootloader g_bootloader(g_backend);
+sim::VirtualCANIface g_node_iface(g_bus);
+Node g_node(g_bootloader, g_node_iface, NodeName("com.zubax.test"), makeHardwareInfo(1));
+
+void testBenchmarkSweep()
+{
+    static const std::uint32_t BitRates[] = { 125000, 1000000 };
+    constexpr unsigned NumBitRates = sizeof(BitRates) / sizeof(BitRates[0]);
+    Peer* const servers[NumServers] = { &g_allocator_and_server, &g_server };
+
+    sim::BenchmarkResult results[NumBitRates][NumServers];
+    const unsigned num_failures = sim::runBenchmarkSweep(g_node, g_bootloader, g_bus, servers, NumServers,
+                                                         BitRates, NumBitRates, NORMALPRIO,
+        [&](const sim::BenchmarkResult& r, const std::uint32_t bit_rate, const unsigned window_size)
+        {
+            sim::printBenchmarkResult(r, bit_rate, window_size);
+            std::printf("%7u bps, window %u: status %d, online %6u ms, transfer %6u ms, %u B served\n",
+                        unsigned(bit_rate), window_size, r.status,
+                        unsigned(r.time_to_online_usec / 1000U), unsigned(r.transfer_time_usec / 1000U),
+                        unsigned(r.bytes_served));
+            const unsigned rate_index = (bit_rate == BitRates[0]) ? 0U : 1U;
+            results[rate_index][window_size - 1U] = r;
+        });
+    CHECK(num_failures == 0);
+
+    for (unsigned w = 0; w < NumServers; w++)
+    {
+        const auto& slow = results[0][w];
+        const auto& fast = results[1][w];
+        CHECK(slow.status >= 0);
+        CHECK(fast.status >= 0);
+        CHECK(slow.bytes_served >= ImageSize);
+        CHECK(fast.bytes_served >= ImageSize);
+        CHECK(slow.bus.frames_delivered > 0);
+        CHECK(slow.bus.frames_corrupted == 0);
+
+        /*
+         * Both the request pacing of the node and the bus time scale with the bit rate: 8x in theory, less the
+         * fixed latencies. Delivery quantized to a timer tick would make both rates look much more alike.
+         */
+        CHECK(fast.transfer_time_usec > 0);
+        CHECK(slow.transfer_time_usec > (fast.transfer_time_usec * 5U));
+
+        /*
+         * The lower bound is the bus time of the payload: at least 256 + 2 bytes per 7-byte frame of
+         * at least 67 + 56 bits.
+         */
+        const std::uint64_t min_frames = (std::uint64_t(ImageSize) / 256U) * ((256U + 2U + 6U) / 7U);
+        CHECK(slow.transfer_time_usec > (min_frames * 123U * 1000000U) / 125000U);
+    }
+}
+
+/**
+ * The cached node ID is taken by another node: the node under test has to notice that within the first
+ * NodeStatus period, drop the cached value, and get a new one from the allocator.
+ */
+void testCachedNodeIDConflict()
+{
+    const std::uint8_t taken_node_id = g_server.getNodeID();
+
+    static NetworkParametersCache cache;
+    CachedNetworkParameters params;
+    params.can_bus_bit_rate = g_bus.getBitRate();
+    params.node_id = taken_node_id;
+    cache.store(params);
+
+    static sim::VirtualCANIface iface(g_bus);
+    static Node node(g_bootloader, iface, NodeName("com.zubax.test.cached"), makeHardwareInfo(100), &cache);
+    (void) node.start(NORMALPRIO);
+
+    ::os::bootloader::MonotonicTimekeeper timekeeper;
+    const std::uint64_t deadline = timekeeper.getMicroseconds() + 30000000ULL;
+    while ((node.getLocalNodeID() == 0 || node.getLocalNodeID() == taken_node_id) &&
+           (timekeeper.getMicroseconds() < deadline))
+    {
+        chThdSleepMilliseconds(10);
+    }
+
+    CHECK(node.getLocalNodeID() != 0);
+    CHECK(node.getLocalNodeID() != taken_node_id);
+    const auto stored = cache.load();
+    CHECK(stored.has_value() && (stored->node_id == node.getLocalNodeID()));
+}
+
+}
+
+int main()
+{
+    g_allocator_and_server.start(NORMALPRIO);
+    g_server.start(NORMALPRIO);
+
+    testBenchmarkSweep();
+    testCachedNodeIDConflict();
+
+    std::printf("%s: %u failures\n", __FILE__, g_num_failures);
+    std::fflush(stdout);
+    std::_Exit((g_num_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE);   // The node threads never exit
+}
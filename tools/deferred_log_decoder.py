@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2018 Zubax Robotics, zubax.com
+# Distributed under the MIT License, available in the file LICENSE.
+# Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+#
+# Converts the console output of a firmware built with CONSOLE_DEFERRED_LOGGING=1 back into text.
+# The deferred log records contain only the addresses of the format string and of the logger name, which are
+# looked up in the ELF file of the firmware, so the ELF must match the running firmware exactly.
+# The regular text output is passed through unchanged.
+#
+# Usage examples:
+#   stty -F /dev/ttyUSB0 115200 raw && ./deferred_log_decoder.py firmware.elf /dev/ttyUSB0
+#   ./deferred_log_decoder.py firmware.elf captured_output.bin
+#
+
+import re
+import sys
+import struct
+import argparse
+
+try:
+    # noinspection PyUnresolvedReferences
+    from elftools.elf.elffile import ELFFile
+except ImportError:
+    print('Missing pyelftools, please install it: pip3 install pyelftools', file=sys.stderr)
+    exit(1)
+
+
+RECORD_MARKER = 0
+RECORD_HEADER_SIZE = 12         # Format string address, logger name address, timestamp
+MAX_RECORD_KIND_TAG = 0x100     # Records of other kinds begin with a small tag instead of the format string address
+
+# Conversion specifiers supported by chprintf(). Capital D, U, X, O denote long, which is 32-bit on the target.
+FORMAT_SPECIFIER_REGEX = re.compile(r'%([-+ #0]*)(\d+|\*)?(?:\.(\d+|\*))?(l?)([dDiIuUxXoOcsfp%])')
+
+
+class StringTable:
+    """Reads null-terminated strings from the allocated sections of an ELF file by their target address."""
+
+    def __init__(self, elf_path: str):
+        self._regions = []
+        with open(elf_path, 'rb') as f:
+            elf = ELFFile(f)
+            for section in elf.iter_sections():
+                if section['sh_type'] == 'SHT_PROGBITS' and section['sh_flags'] & 0x2:    # SHF_ALLOC
+                    self._regions.append((section['sh_addr'], section.data()))
+        self._cache = {}
+
+    def get(self, address: int) -> str:
+        if address in self._cache:
+            return self._cache[address]
+        for base, data in self._regions:
+            if base <= address < base + len(data):
+                end = data.find(b'\0', address - base)
+                end = len(data) if end < 0 else end
+                out = data[address - base:end].decode('utf8', errors='replace')
+                self._cache[address] = out
+                return out
+        return '<unknown string 0x%08x>' % address
+
+
+def render(fmt: str, payload: bytes) -> str:
+    """Renders the format string using the raw arguments from the record payload."""
+    offset = 0
+
+    def take_word() -> bytes:
+        nonlocal offset
+        if offset + 4 > len(payload):
+            raise ValueError('truncated')
+        out = payload[offset:offset + 4]
+        offset += 4
+        return out
+
+    def substitute(match) -> str:
+        nonlocal offset
+        flags, width, precision, _, conversion = match.groups()
+        if conversion == '%':
+            return '%'
+        if width == '*':
+            width = str(struct.unpack('<i', take_word())[0])
+        if precision == '*':
+            precision = str(struct.unpack('<i', take_word())[0])
+        spec = '%' + flags + (width or '') + (('.' + precision) if precision is not None else '')
+        try:
+            if conversion == 's':
+                length = payload[offset]
+                value = payload[offset + 1:offset + 1 + length].decode('utf8', errors='replace')
+                offset += 1 + length
+                return (spec + 's') % value
+            if conversion == 'f':
+                return (spec + 'f') % struct.unpack('<f', take_word())[0]
+            if conversion == 'c':
+                return (spec + 'c') % chr(struct.unpack('<I', take_word())[0] & 0xFF)
+            if conversion == 'p':
+                return '0x%08x' % struct.unpack('<I', take_word())[0]
+            if conversion in 'dDiI':
+                return (spec + 'd') % struct.unpack('<i', take_word())[0]
+            if conversion in 'uU':
+                return (spec + 'd') % struct.unpack('<I', take_word())[0]
+            return (spec + {'x': 'x', 'X': 'X', 'o': 'o', 'O': 'o'}[conversion]) % struct.unpack('<I', take_word())[0]
+        except (ValueError, IndexError):
+            return '<?>'
+
+    return FORMAT_SPECIFIER_REGEX.sub(substitute, fmt)
+
+
+class Decoder:
+    """
+    Splits the raw console byte stream into text and deferred log records.
+    The text output never contains zero bytes, which is why zero is used as the record marker.
+    """
+
+    def __init__(self, strings, tick_frequency: float):
+        self._strings = strings
+        self._tick_frequency = tick_frequency
+        self._buffer = bytearray()
+
+    def feed(self, data: bytes) -> str:
+        self._buffer += data
+        out = []
+        while self._buffer:
+            marker_index = self._buffer.find(RECORD_MARKER)
+            if marker_index < 0:
+                out.append(self._buffer.decode('utf8', errors='replace'))
+                self._buffer.clear()
+                break
+            if marker_index > 0:
+                out.append(self._buffer[:marker_index].decode('utf8', errors='replace'))
+                del self._buffer[:marker_index]
+                continue
+            if len(self._buffer) < 2 or len(self._buffer) < 2 + self._buffer[1]:
+                break                           # Waiting for the rest of the record
+            length = self._buffer[1]
+            record = bytes(self._buffer[2:2 + length])
+            del self._buffer[:2 + length]
+            out.append(self._decode_record(record))
+        return ''.join(out)
+
+    def _decode_record(self, record: bytes) -> str:
+        if len(record) >= 4 and struct.unpack('<I', record[:4])[0] < MAX_RECORD_KIND_TAG:
+            return ''                           # Not a log record, e.g. profiler samples; see profiler.py
+        if len(record) < RECORD_HEADER_SIZE:
+            return '<malformed deferred log record>\r\n'
+        format_address, name_address, timestamp = struct.unpack('<III', record[:RECORD_HEADER_SIZE])
+        text = render(self._strings.get(format_address), record[RECORD_HEADER_SIZE:])
+        return '[%12.4f] %s: %s\r\n' % (timestamp / self._tick_frequency, self._strings.get(name_address), text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decodes the deferred log records in the console output')
+    parser.add_argument('elf', help='ELF file of the running firmware')
+    parser.add_argument('input', nargs='?', default='-', help='file or serial port to read from; stdin by default')
+    parser.add_argument('--tick-frequency', type=float, default=1000,
+                        help='frequency of the system timer, i.e. CH_CFG_ST_FREQUENCY (default 1000)')
+    args = parser.parse_args()
+
+    decoder = Decoder(StringTable(args.elf), args.tick_frequency)
+    source = sys.stdin.buffer if args.input == '-' else open(args.input, 'rb', buffering=0)
+    try:
+        while True:
+            data = source.read1(1024) if hasattr(source, 'read1') else source.read(1024)
+            if not data:
+                break
+            sys.stdout.write(decoder.feed(data))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
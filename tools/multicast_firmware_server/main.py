@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2018 Zubax Robotics, zubax.com
+# Distributed under the MIT License, available in the file LICENSE.
+# Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+#
+# Updates many UAVCAN bootloaders at once using the multicast firmware stream.
+# The image is broadcast once; the nodes that have missed a chunk request the data starting from the missing offset,
+# and the stream is rewound to the lowest offset requested by any node. The nodes that do not support multicast
+# fall back to regular unicast file reads, which are served as well.
+#
+
+import os
+import sys
+import time
+import argparse
+import logging
+
+try:
+    # noinspection PyUnresolvedReferences
+    import uavcan
+except ImportError:
+    print('Missing PyUAVCAN, please install it: pip3 install "uavcan>=1.0.0.dev26"', file=sys.stderr)
+    exit(1)
+
+
+CHUNK_SIZE = 256
+
+DSDL_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'dsdl', 'zubax')
+
+
+logger = logging.getLogger('main')
+
+
+def _crc64we(data: bytes) -> int:
+    crc = 0xFFFFFFFFFFFFFFFF
+    for b in data:
+        crc ^= b << 56
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x42F0E1EBA9EA3693) if crc & (1 << 63) else (crc << 1)
+            crc &= 0xFFFFFFFFFFFFFFFF
+    return crc ^ 0xFFFFFFFFFFFFFFFF
+
+
+def compute_stream_id(path: str) -> int:
+    return _crc64we(path.encode('utf8')) & 0xFFFFFFFF
+
+
+class MulticastStreamer:
+    def __init__(self, node, remote_path: str, image: bytes):
+        self._node = node
+        self._remote_path = remote_path
+        self._image = image
+        self._stream_id = compute_stream_id(remote_path)
+        self._needs = {}            # Node ID --> offset of the next chunk that the node is waiting for
+        self._finished = set()
+
+        self._node.add_handler(uavcan.thirdparty.zubax.bootloader.MulticastChunkRequest, self._on_request)
+
+    @property
+    def finished_node_ids(self):
+        return set(self._finished)
+
+    @property
+    def active_node_ids(self):
+        return set(self._needs.keys())
+
+    def _on_request(self, event):
+        if event.message.stream_id != self._stream_id:
+            return
+
+        nid = event.transfer.source_node_id
+        offset = int(event.message.offset)
+        if nid not in self._needs:
+            logger.info('Node %d has joined the stream at offset %d', nid, offset)
+        self._needs[nid] = offset
+        self._finished.discard(nid)
+
+    def send_next_chunk(self):
+        if not self._needs:
+            return
+
+        offset = min(self._needs.values())
+        data = self._image[offset:offset + CHUNK_SIZE]
+
+        msg = uavcan.thirdparty.zubax.bootloader.MulticastChunk(stream_id=self._stream_id,
+                                                                offset=offset,
+                                                                data=list(data))
+        self._node.broadcast(msg, priority=uavcan.TRANSFER_PRIORITY_LOWEST)
+
+        # Assuming successful delivery; the nodes will request the chunk again if they have missed it
+        for nid in [nid for nid, o in self._needs.items() if o == offset]:
+            if data:
+                self._needs[nid] = offset + len(data)
+            else:
+                del self._needs[nid]
+                self._finished.add(nid)
+                logger.info('Node %d has received the entire image', nid)
+
+
+def main() -> int:
+    argparser = argparse.ArgumentParser(description='Multicast firmware update server for UAVCAN bootloaders')
+    argparser.add_argument('iface', help='name of the CAN interface, e.g. "can0", "/dev/ttyACM0"')
+    argparser.add_argument('image', help='path to the firmware image file')
+    argparser.add_argument('targets', help='node IDs of the nodes to update', type=int, nargs='+')
+    argparser.add_argument('--bitrate', help='CAN bus bit rate (default: 1000000)', type=int, default=1000000)
+    argparser.add_argument('--nid', help='local node ID (default: 127)', type=int, default=127)
+    argparser.add_argument('--chunk-interval', help='delay between chunks in seconds; the nodes need some time to '
+                           'write the data into the flash memory (default: 0.02)', type=float, default=0.02)
+    argparser.add_argument('--timeout', help='give up after this many seconds (default: 600)', type=float, default=600)
+    argparser.add_argument('--verbose', '-v', action='count', help='verbosity level (-v, -vv)')
+    args = argparser.parse_args()
+
+    logging.basicConfig(level=logging.DEBUG if args.verbose else logging.INFO,
+                        format='%(asctime)s %(levelname)-.1s %(name)s: %(message)s')
+
+    uavcan.load_dsdl(DSDL_DIR)
+
+    with open(args.image, 'rb') as f:
+        image = f.read()
+
+    lookup_dir, remote_path = os.path.split(os.path.abspath(args.image))
+
+    node = uavcan.make_node(args.iface, node_id=args.nid, bitrate=args.bitrate)
+    node.node_info.name = 'com.zubax.multicast_firmware_server'
+
+    _file_server = uavcan.app.file_server.FileServer(node, [lookup_dir])   # Fallback for unicast reads
+    streamer = MulticastStreamer(node, remote_path, image)
+
+    def begin_update_callback(event):
+        if event is None:
+            logger.error('BeginFirmwareUpdate has timed out')
+        else:
+            logger.info('Node %d has responded to BeginFirmwareUpdate with error %d',
+                        event.transfer.source_node_id, event.response.error)
+
+    for nid in args.targets:
+        node.request(uavcan.protocol.file.BeginFirmwareUpdate.Request(source_node_id=args.nid,
+                                                                      image_file_remote_path=remote_path),
+                     nid, begin_update_callback)
+
+    node.periodic(args.chunk_interval, streamer.send_next_chunk)
+
+    started_at = time.monotonic()
+    while time.monotonic() - started_at < args.timeout:
+        node.spin(0.1)
+        if set(args.targets).issubset(streamer.finished_node_ids) and not streamer.active_node_ids:
+            logger.info('All nodes have been updated in %.1f seconds', time.monotonic() - started_at)
+            return 0
+
+    logger.error('Timed out; finished nodes: %r', sorted(streamer.finished_node_ids))
+    return 1
+
+
+if __name__ == '__main__':
+    exit(main())
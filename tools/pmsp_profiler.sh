@@ -9,6 +9,8 @@
 # Usage: Install flamegraph.pl in your PATH, configure your .gdbinit, run the script with proper arguments and go
 #        have a coffee. When you're back, you'll see the flamegraph. Note that frequent calls to GDB significantly
 #        interfere with normal operation of the target, which means that you can't profile real-time tasks with it.
+#        Prefer the on-target sampling profiler (zubax_chibios/sys/profiler.hpp, tools/profiler.py) where possible;
+#        this script remains useful for firmware that is not built with the profiler.
 #
 
 set -e
@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2018 Zubax Robotics, zubax.com
+# Distributed under the MIT License, available in the file LICENSE.
+# Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+#
+# Host side of the on-target sampling profiler (see zubax_chibios/sys/profiler.hpp).
+# Reads the console output of the firmware, extracts the binary profiler records, symbolizes the samples against
+# the ELF file of the running firmware, and emits folded stacks for flamegraph.pl. The regular text output and
+# the deferred log records are ignored. Reading stops at the end of the input or on Ctrl+C.
+#
+# Each folded stack consists of the context (thread or exception), the caller, and the sampled function.
+# The caller is derived from the link register, hence it is exact only for the leaf functions; in the other
+# functions the link register may hold a stale value, so the caller is omitted if it cannot be resolved.
+#
+# Usage examples:
+#   stty -F /dev/ttyACM0 115200 raw && ./profiler.py firmware.elf /dev/ttyACM0 | flamegraph.pl > flamegraph.svg
+#   ./profiler.py firmware.elf captured_output.bin > folded.txt
+#
+
+import sys
+import bisect
+import shutil
+import struct
+import argparse
+import subprocess
+import collections
+
+# Shared with the deferred log decoder, which lives in the same directory
+from deferred_log_decoder import StringTable, RECORD_MARKER
+
+try:
+    # noinspection PyUnresolvedReferences
+    from elftools.elf.elffile import ELFFile
+    # noinspection PyUnresolvedReferences
+    from elftools.elf.sections import SymbolTableSection
+except ImportError:
+    print('Missing pyelftools, please install it: pip3 install pyelftools', file=sys.stderr)
+    exit(1)
+
+
+RECORD_KIND_SAMPLES = 1
+RECORD_KIND_THREADS = 2
+
+MAX_EXCEPTION_NUMBER = 0x200    # Contexts below this value are exception numbers rather than thread addresses
+
+SYSTEM_EXCEPTION_NAMES = {
+    2: 'NMI', 3: 'HardFault', 4: 'MemManage', 5: 'BusFault', 6: 'UsageFault',
+    11: 'SVCall', 12: 'DebugMonitor', 14: 'PendSV', 15: 'SysTick',
+}
+
+
+class Symbolizer:
+    """Maps code addresses to the names of the functions using the symbol table of the ELF file."""
+
+    def __init__(self, elf_path: str):
+        functions = {}
+        with open(elf_path, 'rb') as f:
+            for section in ELFFile(f).iter_sections():
+                if not isinstance(section, SymbolTableSection):
+                    continue
+                for sym in section.iter_symbols():
+                    if sym['st_info']['type'] == 'STT_FUNC' and sym['st_size'] > 0 and sym.name:
+                        functions[sym['st_value'] & ~1] = (sym['st_size'], sym.name)     # Clearing the Thumb bit
+
+        self._addresses = sorted(functions.keys())
+        self._sizes = [functions[x][0] for x in self._addresses]
+        self._names = demangle([functions[x][1] for x in self._addresses])
+
+    def get(self, address: int):
+        """Returns the name of the function containing the address, or None."""
+        address &= ~1
+        index = bisect.bisect_right(self._addresses, address) - 1
+        if index >= 0 and address < self._addresses[index] + self._sizes[index]:
+            return self._names[index]
+        return None
+
+
+def demangle(names):
+    """Demangles the C++ names using c++filt if it is available; the names are returned as is otherwise."""
+    tool = shutil.which('arm-none-eabi-c++filt') or shutil.which('c++filt')
+    if tool is None or not names:
+        return names
+    out = subprocess.run([tool], input='\n'.join(names), stdout=subprocess.PIPE, universal_newlines=True).stdout
+    out = out.splitlines()
+    return out if len(out) == len(names) else names
+
+
+def describe_exception(number: int) -> str:
+    if number >= 16:
+        return '[IRQ %d]' % (number - 16)
+    return '[%s]' % SYSTEM_EXCEPTION_NAMES.get(number, 'Exception %d' % number)
+
+
+class Profile:
+    def __init__(self, symbolizer: Symbolizer, strings: StringTable):
+        self._symbolizer = symbolizer
+        self._strings = strings
+        self._thread_names = {}
+        self.stacks = collections.Counter()
+        self.functions = collections.Counter()
+        self.contexts = collections.Counter()
+        self.num_samples = 0
+        self.num_dropped = 0
+
+    def _describe_context(self, context: int) -> str:
+        if context < MAX_EXCEPTION_NUMBER:
+            return describe_exception(context)
+        name = self._thread_names.get(context)
+        return name if name else 'thread %08x' % context
+
+    def feed_record(self, record: bytes):
+        if len(record) < 4:
+            return
+        kind = struct.unpack('<I', record[:4])[0]
+        payload = record[4:]
+
+        if kind == RECORD_KIND_THREADS:
+            for offset in range(0, len(payload) - 7, 8):
+                thread, name_address = struct.unpack('<II', payload[offset:offset + 8])
+                self._thread_names[thread] = self._strings.get(name_address) if name_address else ''
+
+        elif kind == RECORD_KIND_SAMPLES and len(payload) >= 4:
+            self.num_dropped += struct.unpack('<I', payload[:4])[0]
+            for offset in range(4, len(payload) - 11, 12):
+                pc, lr, context = struct.unpack('<III', payload[offset:offset + 12])
+                self._add_sample(pc, lr, context)
+
+    def _add_sample(self, pc: int, lr: int, context: int):
+        function = self._symbolizer.get(pc) or '0x%08x' % pc
+        caller = self._symbolizer.get(lr)
+        frames = [self._describe_context(context)]
+        if caller is not None and caller != function:
+            frames.append(caller)
+        frames.append(function)
+
+        # The semicolon is the frame separator in the folded format
+        self.stacks[';'.join(x.replace(';', ':') for x in frames)] += 1
+        self.functions[function] += 1
+        self.contexts[frames[0]] += 1
+        self.num_samples += 1
+
+
+def split_records(buffer: bytearray):
+    """Extracts the complete binary records from the console byte stream, discarding the text in between."""
+    while True:
+        marker_index = buffer.find(RECORD_MARKER)
+        if marker_index < 0:
+            buffer.clear()
+            return
+        del buffer[:marker_index]
+        if len(buffer) < 2 or len(buffer) < 2 + buffer[1]:
+            return                              # Waiting for the rest of the record
+        length = buffer[1]
+        yield bytes(buffer[2:2 + length])
+        del buffer[:2 + length]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Converts the profiler samples into folded stacks for flamegraph.pl')
+    parser.add_argument('elf', help='ELF file of the running firmware')
+    parser.add_argument('input', nargs='?', default='-', help='file or serial port to read from; stdin by default')
+    parser.add_argument('--top', type=int, default=10, help='number of the top functions to report (default 10)')
+    args = parser.parse_args()
+
+    profile = Profile(Symbolizer(args.elf), StringTable(args.elf))
+    source = sys.stdin.buffer if args.input == '-' else open(args.input, 'rb', buffering=0)
+    buffer = bytearray()
+    try:
+        while True:
+            data = source.read1(1024) if hasattr(source, 'read1') else source.read(1024)
+            if not data:
+                break
+            buffer += data
+            for record in split_records(buffer):
+                profile.feed_record(record)
+            print('\r%d samples, %d dropped' % (profile.num_samples, profile.num_dropped), end='', file=sys.stderr)
+    except KeyboardInterrupt:
+        pass
+    print(file=sys.stderr)
+
+    for stack, count in sorted(profile.stacks.items()):
+        print(stack, count)
+
+    if profile.num_samples > 0:
+        print('Samples: %d, dropped: %d' % (profile.num_samples, profile.num_dropped), file=sys.stderr)
+        print('Contexts:', file=sys.stderr)
+        for name, count in profile.contexts.most_common():
+            print('% 5.1f%%   %s' % (100 * count / profile.num_samples, name), file=sys.stderr)
+        print('Top functions:', file=sys.stderr)
+        for name, count in profile.functions.most_common(args.top):
+            print('% 5.1f%%   %s' % (100 * count / profile.num_samples, name), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2018 Zubax Robotics, zubax.com
+# Distributed under the MIT License, available in the file LICENSE.
+# Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+#
+# Converts the trace dump produced by os::trace::dump() (e.g. via the shell command "trace dump") into
+# the Chrome trace format (JSON), which can be opened in chrome://tracing or https://ui.perfetto.dev.
+# The dump is looked up between the lines "TRACE BEGIN" and "TRACE END"; the rest of the input is ignored,
+# so a raw capture of the console output can be fed in directly. If the input contains several dumps,
+# the last one is used.
+#
+# The resulting trace contains:
+#   - the track "CPU", showing which thread was running at any moment;
+#   - the track "ISR", showing the interrupt handlers, including the nested ones;
+#   - one track per thread, showing the mutex waits, the mutex ownership, and the application spans.
+#
+# Usage examples:
+#   ./trace_to_chrome.py captured_output.txt > trace.json
+#   ./trace_to_chrome.py captured_output.txt -o trace.json
+#
+
+import sys
+import json
+import argparse
+
+
+EVENT_CONTEXT_SWITCH = 0
+EVENT_IRQ_ENTER = 1
+EVENT_IRQ_EXIT = 2
+EVENT_MUTEX_WAIT = 3
+EVENT_MUTEX_ACQUIRED = 4
+EVENT_MUTEX_RELEASED = 5
+EVENT_SPAN_BEGIN = 6
+EVENT_SPAN_END = 7
+
+PID = 1
+TID_CPU = 1
+TID_ISR = 2
+TID_UNKNOWN_THREAD = 3          # Events recorded before the first context switch
+
+# ARMv7-M exception numbers below 16 are the system exceptions
+SYSTEM_EXCEPTION_NAMES = {
+    2: 'NMI', 3: 'HardFault', 4: 'MemManage', 5: 'BusFault', 6: 'UsageFault',
+    11: 'SVCall', 12: 'DebugMonitor', 14: 'PendSV', 15: 'SysTick',
+}
+
+
+class Dump:
+    def __init__(self):
+        self.frequency = 0
+        self.threads = {}       # Address --> name
+        self.events = []        # (timestamp, type, argument, auxiliary, name)
+        self.num_lost = 0
+
+
+def parse(lines) -> Dump:
+    result = None
+    current = None
+    for line in lines:
+        words = line.strip().split(maxsplit=5)
+        if len(words) >= 3 and words[0] == 'TRACE' and words[1] == 'BEGIN':
+            current = Dump()
+            current.frequency = int(words[2])
+        elif current is None:
+            continue
+        elif len(words) >= 3 and words[0] == 'TRACE' and words[1] == 'END':
+            current.num_lost = int(words[2])
+            result = current
+            current = None
+        elif len(words) >= 2 and words[0] == 'T':
+            words = line.strip().split(maxsplit=2)      # Thread names may contain spaces
+            current.threads[int(words[1], 16)] = words[2] if len(words) > 2 else '?'
+        elif len(words) >= 5 and words[0] == 'E':
+            current.events.append((int(words[1], 16), int(words[2], 16), int(words[3], 16), int(words[4], 16),
+                                   words[5] if len(words) > 5 else ''))
+
+    if result is None:
+        raise ValueError('No complete trace dump found in the input')
+    return result
+
+
+def convert(dump: Dump) -> dict:
+    if dump.frequency <= 0:
+        raise ValueError('Invalid cycle counter frequency: %r' % dump.frequency)
+
+    thread_ids = {}
+
+    def get_thread_id(address: int) -> int:
+        if address not in thread_ids:
+            thread_ids[address] = TID_UNKNOWN_THREAD + 1 + len(thread_ids)
+        return thread_ids[address]
+
+    output = []
+
+    def emit(phase: str, ts: float, tid: int, name: str, **kwargs):
+        output.append(dict(ph=phase, ts=ts, pid=PID, tid=tid, name=name, **kwargs))
+
+    # The cycle counter is 32-bit, so it wraps around every few tens of seconds; the events are unwrapped
+    # assuming that the interval between adjacent events is shorter than half of the wrap-around period.
+    cycles = 0
+    previous_timestamp = dump.events[0][0] if dump.events else 0
+
+    current_thread = None
+    running_since = None
+    thread_stacks = {}      # Thread ID --> list of open slice names, used to close them at the end
+    isr_depth = 0
+    ts = 0.0
+
+    for timestamp, event_type, argument, auxiliary, name in dump.events:
+        delta = (timestamp - previous_timestamp) & 0xFFFFFFFF
+        if delta >= 0x80000000:
+            delta -= 0x100000000
+        cycles += delta
+        previous_timestamp = timestamp
+        ts = cycles * 1e6 / dump.frequency
+
+        tid = get_thread_id(current_thread) if current_thread is not None else TID_UNKNOWN_THREAD
+        stack = thread_stacks.setdefault(tid, [])
+
+        if event_type == EVENT_CONTEXT_SWITCH:
+            if current_thread is not None:
+                emit('X', running_since, TID_CPU, dump.threads.get(current_thread, '%08x' % current_thread),
+                     dur=ts - running_since)
+            current_thread = argument
+            running_since = ts
+
+        elif event_type == EVENT_IRQ_ENTER:
+            if auxiliary >= 16:
+                label = 'IRQ %d' % (auxiliary - 16)
+            else:
+                label = SYSTEM_EXCEPTION_NAMES.get(auxiliary, 'Exception %d' % auxiliary)
+            emit('B', ts, TID_ISR, label)
+            isr_depth += 1
+
+        elif event_type == EVENT_IRQ_EXIT:
+            if isr_depth > 0:           # The entry may have been overwritten
+                emit('E', ts, TID_ISR, '')
+                isr_depth -= 1
+
+        elif event_type == EVENT_MUTEX_WAIT:
+            emit('B', ts, tid, 'wait %08x' % argument, cat='mutex')
+            stack.append('wait')
+
+        elif event_type == EVENT_MUTEX_ACQUIRED:
+            if stack and stack[-1] == 'wait':
+                emit('E', ts, tid, '')
+                stack.pop()
+            emit('B', ts, tid, 'hold %08x' % argument, cat='mutex')
+            stack.append('hold')
+
+        elif event_type == EVENT_MUTEX_RELEASED:
+            if stack:
+                emit('E', ts, tid, '')
+                stack.pop()
+
+        elif event_type == EVENT_SPAN_BEGIN:
+            emit('B', ts, tid, name or '%08x' % argument, cat='span')
+            stack.append('span')
+
+        elif event_type == EVENT_SPAN_END:
+            if stack:
+                emit('E', ts, tid, '')
+                stack.pop()
+
+        else:
+            print('Unknown event type %d ignored' % event_type, file=sys.stderr)
+
+    # Closing the slices that were still open when the recording stopped
+    if current_thread is not None:
+        emit('X', running_since, TID_CPU, dump.threads.get(current_thread, '%08x' % current_thread),
+             dur=ts - running_since)
+    for _ in range(isr_depth):
+        emit('E', ts, TID_ISR, '')
+    for tid, stack in thread_stacks.items():
+        for _ in stack:
+            emit('E', ts, tid, '')
+
+    def name_track(tid: int, name: str):
+        output.append(dict(ph='M', pid=PID, tid=tid, name='thread_name', args=dict(name=name)))
+        output.append(dict(ph='M', pid=PID, tid=tid, name='thread_sort_index', args=dict(sort_index=tid)))
+
+    name_track(TID_CPU, 'CPU')
+    name_track(TID_ISR, 'ISR')
+    if TID_UNKNOWN_THREAD in thread_stacks:
+        name_track(TID_UNKNOWN_THREAD, '<before first context switch>')
+    for address, tid in thread_ids.items():
+        name_track(tid, '%s (%08x)' % (dump.threads.get(address, '?'), address))
+
+    return dict(traceEvents=output, displayTimeUnit='ns',
+                otherData=dict(cycle_counter_frequency=dump.frequency, events_lost=dump.num_lost))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Converts the trace dump into the Chrome trace format')
+    parser.add_argument('input', nargs='?', default='-', help='file containing the dump; stdin by default')
+    parser.add_argument('-o', '--output', default='-', help='output JSON file; stdout by default')
+    args = parser.parse_args()
+
+    source = sys.stdin if args.input == '-' else open(args.input, 'r', errors='replace')
+    with source:
+        dump = parse(source)
+
+    if dump.num_lost > 0:
+        print('%d oldest events were lost due to the buffer overrun' % dump.num_lost, file=sys.stderr)
+
+    result = convert(dump)
+    destination = sys.stdout if args.output == '-' else open(args.output, 'w')
+    with destination:
+        json.dump(result, destination)
+
+
+if __name__ == '__main__':
+    main()
@@ -183,7 +183,7 @@ class Bootloader
 
     std::uint8_t rom_buffer_[1024];             ///< Larger buffer enables faster CRC verification, which is important
 
-    chibios_rt::Mutex mutex_;
+    os::NamedMutex mutex_{"Bootloader"};
 
     /// Caching is needed because app check can sometimes take a very long time (several seconds)
     std::optional<AppInfo> cached_app_info_;
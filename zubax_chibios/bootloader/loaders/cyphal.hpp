@@ -0,0 +1,778 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#pragma once
+
+#include "../bootloader.hpp"
+#include "cyphal_transport.hpp"
+#include <zubax_chibios/os.hpp>
+#include <zubax_chibios/watchdog/watchdog.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <array>
+#include <utility>
+#include <cstddef>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <senoval/string.hpp>
+#include <unistd.h>
+
+
+namespace os
+{
+namespace bootloader
+{
+namespace cyphal_loader
+{
+
+using NodeName = senoval::String<50>;
+
+struct HardwareInfo
+{
+    std::uint8_t major = 0;                                     ///< Required field
+    std::uint8_t minor = 0;                                     ///< Required field
+
+    typedef std::array<std::uint8_t, 16> UniqueID;
+    UniqueID unique_id{};                                       ///< Required field
+
+    typedef std::array<std::uint8_t, 222> CertificateOfAuthenticity;
+    CertificateOfAuthenticity certificate_of_authenticity;      ///< Optional, set length to zero if not defined
+    std::uint8_t certificate_of_authenticity_length = 0;
+};
+
+/**
+ * Implementation details, please do not touch this.
+ */
+namespace impl_
+{
+/**
+ * This timeout should accommodate all operations with the application image storage
+ * (which is typically based on flash memory, which is slow).
+ * Image verification can take several seconds, especially if the image is invalid.
+ */
+static constexpr std::chrono::seconds WatchdogTimeout(5);
+
+static constexpr unsigned ServiceRequestTimeoutMillisecond = 1000;
+
+static constexpr unsigned ProgressReportIntervalMillisecond = 10000;
+
+/**
+ * Upper limit for a single blocking wait in the node thread.
+ * It defines how quickly the thread notices reboot requests issued from other threads.
+ */
+static constexpr unsigned MaxBlockingWaitMillisecond = 100;
+
+/**
+ * How long a single frame may wait for transmission before the whole transfer is abandoned.
+ */
+static constexpr unsigned TxTimeoutMillisecond = 10;
+
+/**
+ * File read retry policy, same as in the UAVCAN v0 loader.
+ */
+static constexpr unsigned FileReadMaxAttempts               = 4;
+static constexpr unsigned FileReadRetryBackoffMillisecond   = 200;
+
+using ::os::bootloader::MonotonicTimekeeper;
+
+namespace dsdl
+{
+/**
+ * Fixed port identifiers of the standard data types.
+ */
+static constexpr std::uint16_t HeartbeatSubjectID       = 7509;     ///< uavcan.node.Heartbeat.1.0
+static constexpr std::uint16_t DiagnosticRecordSubjectID = 8184;    ///< uavcan.diagnostic.Record.1.1
+static constexpr std::uint16_t FileReadServiceID        = file_read::ServiceID;     ///< uavcan.file.Read.1.1
+static constexpr std::uint16_t GetInfoServiceID         = 430;      ///< uavcan.node.GetInfo.1.0
+static constexpr std::uint16_t ExecuteCommandServiceID  = 435;      ///< uavcan.node.ExecuteCommand.1.1
+
+static constexpr std::size_t HeartbeatSize              = 7;
+static constexpr std::size_t FileReadDataCapacity       = file_read::DataCapacity;
+static constexpr std::size_t GetInfoMaxResponseSize     = 313;
+static constexpr std::size_t ExecuteCommandMaxRequestSize = 258;
+static constexpr std::size_t MaxFilePathLength          = file_read::MaxPathLength;
+
+/**
+ * The largest transfer that the node needs to receive: ExecuteCommand request or file read response.
+ */
+static constexpr std::size_t MaxReceivedPayloadSize = std::max<std::size_t>(ExecuteCommandMaxRequestSize,
+                                                                            file_read::MaxResponseSize);
+
+enum class Health : std::uint8_t
+{
+    Nominal  = 0,
+    Advisory = 1,
+    Caution  = 2,
+    Warning  = 3
+};
+
+enum class Mode : std::uint8_t
+{
+    Operational     = 0,
+    Initialization  = 1,
+    Maintenance     = 2,
+    SoftwareUpdate  = 3
+};
+
+enum class Severity : std::uint8_t
+{
+    Trace    = 0,
+    Debug    = 1,
+    Info     = 2,
+    Notice   = 3,
+    Warning  = 4,
+    Error    = 5,
+    Critical = 6,
+    Alert    = 7
+};
+
+static constexpr std::uint16_t CommandRestart               = 65535;
+static constexpr std::uint16_t CommandBeginSoftwareUpdate   = 65533;
+
+static constexpr std::uint8_t CommandStatusSuccess          = 0;
+static constexpr std::uint8_t CommandStatusBadCommand       = 3;
+static constexpr std::uint8_t CommandStatusBadState         = 5;
+
+}
+
+}       // namespace impl_
+
+/**
+ * A UAVCAN v1 (Cyphal) over CAN FD node that is useful solely for the purpose of firmware update.
+ * It is functionally equivalent to the UAVCAN v0 loader, with the following differences:
+ *  - The node ID and the bit rates shall be known in advance; neither autodetection nor allocation is supported.
+ *  - The update is requested via uavcan.node.ExecuteCommand (COMMAND_BEGIN_SOFTWARE_UPDATE) with the file path
+ *    in the parameter field; the file is fetched from the requesting node via uavcan.file.Read.
+ *  - There is only one file server at a time.
+ *
+ * Every file read response (256 bytes) fits into 5 CAN FD frames instead of 37 classic CAN frames.
+ */
+template <int StackSize = 4096>
+class CyphalFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
+                                 protected chibios_rt::BaseStaticThread<StackSize>
+{
+    ::os::bootloader::Bootloader& bootloader_;
+    ICANFDIface& iface_;
+
+    const NodeName node_name_;
+    const HardwareInfo hw_info_;
+
+    watchdog::Timer watchdog_;
+    impl_::MonotonicTimekeeper timekeeper_;
+    std::uint64_t next_1hz_task_invocation_ = 0;
+    bool init_done_ = false;
+
+    std::uint8_t local_node_id_ = 0;
+    std::uint32_t nominal_bit_rate_ = 0;
+    std::uint32_t data_bit_rate_ = 0;
+
+    bool update_requested_ = false;
+    std::uint8_t remote_server_node_id_ = 0;
+    senoval::String<impl_::dsdl::MaxFilePathLength> firmware_file_path_;
+
+    TransferReassembler<impl_::dsdl::MaxReceivedPayloadSize, 4> reassembler_;
+
+    os::Logger logger_{"Bootloader.Cyphal"};
+
+    std::uint8_t vendor_specific_status_ = 0;
+
+    std::uint8_t heartbeat_transfer_id_ = 0;
+    std::uint8_t diagnostic_record_transfer_id_ = 0;
+    std::uint8_t file_read_transfer_id_ = 0;
+
+    std::array<std::uint8_t, impl_::dsdl::FileReadDataCapacity> read_buffer_{};
+    int read_result_ = 0;
+
+
+    using chibios_rt::BaseStaticThread<StackSize>::start;       // This is overloaded below
+
+
+    void delayAfterDriverError()
+    {
+        watchdog_.reset();
+        (void) timekeeper_.getMicroseconds();   // This is needed to avoid overflow in the timekeeper
+        ::sleep(1);
+        watchdog_.reset();
+        (void) timekeeper_.getMicroseconds();
+    }
+
+    std::uint64_t getMonotonicTimestampUSec() const
+    {
+        return timekeeper_.getMicroseconds();
+    }
+
+    int sendTransfer(const TransferMetadata& meta, const std::uint8_t* const payload, const std::size_t size)
+    {
+        const int res = cyphal_loader::sendTransfer(iface_, local_node_id_, meta, payload, size,
+                                                    impl_::TxTimeoutMillisecond);
+        if (res < 0)
+        {
+            logger_.println("TX err %d port %u", res, unsigned(meta.port_id));
+        }
+        return res;
+    }
+
+    int sendMessage(const std::uint16_t subject_id,
+                    std::uint8_t& inout_transfer_id,
+                    const std::uint8_t priority,
+                    const std::uint8_t* const payload,
+                    const std::size_t size)
+    {
+        TransferMetadata meta;
+        meta.kind = TransferKind::Message;
+        meta.priority = priority;
+        meta.port_id = subject_id;
+        meta.transfer_id = inout_transfer_id++;
+        return sendTransfer(meta, payload, size);
+    }
+
+    void sendHeartbeat()
+    {
+        using namespace impl_;
+
+        /*
+         * Bootloader State        Node Mode       Node Health
+         * ----------------------------------------------------
+         * NoAppToBoot             SoftwareUpdate  Warning
+         * BootDelay               Maintenance     Nominal
+         * BootCancelled           Maintenance     Caution
+         * AppUpgradeInProgress    SoftwareUpdate  Nominal
+         * ReadyToBoot             Maintenance     Nominal
+         */
+        dsdl::Health health = dsdl::Health::Nominal;
+        dsdl::Mode mode     = dsdl::Mode::Maintenance;
+
+        switch (bootloader_.getState())
+        {
+        case State::NoAppToBoot:
+        {
+            mode   = dsdl::Mode::SoftwareUpdate;
+            health = dsdl::Health::Warning;
+            break;
+        }
+        case State::AppUpgradeInProgress:
+        {
+            mode = dsdl::Mode::SoftwareUpdate;
+            break;
+        }
+        case State::BootCancelled:
+        {
+            health = dsdl::Health::Caution;
+            break;
+        }
+        case State::BootDelay:
+        case State::ReadyToBoot:
+        {
+            break;
+        }
+        }
+
+        const std::uint32_t uptime_sec = std::uint32_t((timekeeper_.getUptimeMicroseconds() + 500000UL) / 1000000UL);
+
+        std::uint8_t buffer[dsdl::HeartbeatSize]{};
+        std::memcpy(&buffer[0], &uptime_sec, 4);                    // Little endian platforms only
+        buffer[4] = std::uint8_t(health);
+        buffer[5] = std::uint8_t(mode);
+        buffer[6] = vendor_specific_status_;
+
+        (void) sendMessage(dsdl::HeartbeatSubjectID, heartbeat_transfer_id_, 4, buffer, sizeof(buffer));
+    }
+
+    void sendLog(const impl_::dsdl::Severity severity, const senoval::String<90>& txt)
+    {
+        // The timestamp is left zero, which means unknown
+        std::uint8_t buffer[7 + 1 + 1 + 90]{};
+        buffer[7] = std::uint8_t(severity);
+        buffer[8] = std::uint8_t(txt.length());
+        std::copy(txt.begin(), txt.end(), &buffer[9]);
+
+        (void) sendMessage(impl_::dsdl::DiagnosticRecordSubjectID, diagnostic_record_transfer_id_, 7,
+                           buffer, 9U + txt.length());
+    }
+
+    void respond(const TransferMetadata& request_meta, const std::uint8_t* const payload, const std::size_t size)
+    {
+        TransferMetadata meta = request_meta;
+        meta.kind = TransferKind::Response;
+        (void) sendTransfer(meta, payload, size);
+    }
+
+    void initCANForNormalOperation()
+    {
+        watchdog_.reset();
+
+        while (!os::isRebootRequested())
+        {
+            // Only service transfers addressed to this node are needed
+            ICANFDIface::AcceptanceFilterConfig filt;
+            filt.id   = impl_::CANIDServiceNotMessage | (std::uint32_t(local_node_id_) << 7);
+            filt.mask = impl_::CANIDServiceNotMessage | (std::uint32_t(impl_::MaxNodeID) << 7);
+
+            const int res = iface_.init(nominal_bit_rate_, data_bit_rate_, ICANFDIface::Mode::Normal, filt);
+            if (res >= 0)
+            {
+                break;
+            }
+
+            logger_.println("CAN init err %d", res);
+            delayAfterDriverError();
+        }
+    }
+
+    void handle1HzTasks()
+    {
+        if (init_done_)
+        {
+            sendHeartbeat();
+        }
+    }
+
+    /**
+     * Sleeps until there is work to do or the deadline is reached, then processes the RX queue.
+     * Transmission is performed synchronously by the callers, so there is no TX queue to service here.
+     */
+    void poll(const std::uint64_t deadline_usec = std::numeric_limits<std::uint64_t>::max())
+    {
+        constexpr int MaxFramesPerSpin = 10;
+
+        // Wait for work
+        {
+            const std::uint64_t ts = getMonotonicTimestampUSec();
+            const std::uint64_t wait_until = std::min(deadline_usec, next_1hz_task_invocation_);
+            const std::uint64_t timeout_msec = (wait_until > ts) ? ((wait_until - ts + 999U) / 1000U) : 0;
+
+            const int res = iface_.waitForEvent(ICANFDIface::EventRxReady,
+                                                int(std::min<std::uint64_t>(timeout_msec,
+                                                                            impl_::MaxBlockingWaitMillisecond)));
+            if (res < 0)
+            {
+                logger_.println("Wait err %d", res);    // Proceeding anyway, the queue will be checked below
+            }
+        }
+
+        // Receive
+        for (int i = 0; i < MaxFramesPerSpin; i++)
+        {
+            if ((iface_.waitForEvent(ICANFDIface::EventRxReady, 0) & int(ICANFDIface::EventRxReady)) == 0)
+            {
+                break;                          // RX queue is empty
+            }
+
+            const auto res = iface_.receive(1); // Does not block unless the driver lacks event support
+            if (res.first < 1)
+            {
+                if (res.first < 0)
+                {
+                    logger_.println("RX err %d", res.first);
+                }
+                break;
+            }
+
+            TransferMetadata meta;
+            if (!parseFrame(res.second, local_node_id_, meta) || (meta.kind == TransferKind::Message))
+            {
+                continue;
+            }
+
+            typename decltype(reassembler_)::Transfer transfer;
+            if (reassembler_.accept(res.second, meta, getMonotonicTimestampUSec(), transfer))
+            {
+                onTransferReception(transfer.meta, transfer.payload, transfer.payload_size);
+            }
+        }
+
+        // 1Hz process
+        if (getMonotonicTimestampUSec() >= next_1hz_task_invocation_)
+        {
+            next_1hz_task_invocation_ += 1000000UL;
+            handle1HzTasks();
+        }
+    }
+
+    void main() override
+    {
+        this->setName("btldcyphal");
+
+        initCANForNormalOperation();
+        if (os::isRebootRequested())
+        {
+            return;
+        }
+
+        // This is the only info message we output during initialization.
+        // Fewer messages reduce the chances of breaking UART CLI data flow.
+        logger_.println("CAN FD %u/%u bps, NID %u",
+                        unsigned(nominal_bit_rate_), unsigned(data_bit_rate_), unsigned(local_node_id_));
+
+        init_done_ = true;
+
+        /*
+         * Update loop; run forever because there's nothing else to do
+         */
+        while (!os::isRebootRequested())
+        {
+            watchdog_.reset();
+
+            /*
+             * Waiting for the firmware update request
+             */
+            while ((!os::isRebootRequested()) && (!update_requested_))
+            {
+                watchdog_.reset();
+                poll();
+            }
+
+            if (os::isRebootRequested())
+            {
+                break;
+            }
+
+            logger_.println("FW server NID %u path %s",
+                            unsigned(remote_server_node_id_), firmware_file_path_.c_str());
+
+            /*
+             * Rewriting the old firmware with the new file
+             */
+            watchdog_.reset();
+            const int result = bootloader_.upgradeApp(*this);
+            watchdog_.reset();
+
+            sendHeartbeat();    // Announcing the new status of the bootloader ASAP
+
+            if (result >= 0)
+            {
+                vendor_specific_status_ = 0;
+                if (bootloader_.getState() == State::NoAppToBoot)
+                {
+                    sendLog(impl_::dsdl::Severity::Error, "Downloaded image is invalid");
+                }
+                else
+                {
+                    sendLog(impl_::dsdl::Severity::Info, "OK");
+                }
+            }
+            else
+            {
+                vendor_specific_status_ = std::uint8_t(std::min(std::abs(result), 0xFF));
+                sendLog(impl_::dsdl::Severity::Error,
+                        senoval::String<90>("Upgrade error ") + senoval::convertIntToString(result));
+            }
+
+            /*
+             * Reset everything to zero and loop again, because there's nothing else to do.
+             * The outer logic will request reboot if necessary.
+             */
+            update_requested_ = false;
+            firmware_file_path_.clear();
+        }
+
+        logger_.puts("Exit");
+        watchdog_.reset();
+    }
+
+    int sendFileReadRequest(const std::uint64_t offset)
+    {
+        using namespace impl_;
+
+        std::uint8_t buffer[file_read::MaxRequestSize]{};
+        const std::size_t size = file_read::serializeRequest(offset, firmware_file_path_.c_str(),
+                                                             firmware_file_path_.size(), buffer);
+
+        TransferMetadata meta;
+        meta.kind = TransferKind::Request;
+        meta.port_id = dsdl::FileReadServiceID;
+        meta.remote_node_id = remote_server_node_id_;
+        meta.transfer_id = file_read_transfer_id_;
+
+        const int res = sendTransfer(meta, buffer, size);
+        file_read_transfer_id_ = std::uint8_t((file_read_transfer_id_ + 1U) & TransferIDMask);
+        return res;
+    }
+
+    int download(IDownloadStreamSink& sink) override
+    {
+        using namespace impl_;
+
+        constexpr int PendingResult = std::numeric_limits<int>::max();
+
+        std::uint64_t offset = 0;
+        std::uint64_t next_progress_report_deadline = getMonotonicTimestampUSec();
+        unsigned num_failed_attempts = 0;
+
+        sendHeartbeat();        // Announcing the new state of the bootloader ASAP
+
+        while (true)
+        {
+            watchdog_.reset();
+
+            if (os::isRebootRequested())
+            {
+                return -ErrInterrupted;
+            }
+
+            /*
+             * Send request
+             */
+            read_result_ = PendingResult;
+            {
+                const int res = sendFileReadRequest(offset);
+                if (res < 0)
+                {
+                    return res;
+                }
+            }
+
+            /*
+             * Await response
+             * Note that the watchdog is not reset here, since its timeout is large enough to wait for response.
+             */
+            const std::uint64_t response_deadline =
+                getMonotonicTimestampUSec() + ServiceRequestTimeoutMillisecond * 1000U;
+
+            while ((read_result_ == PendingResult) && (getMonotonicTimestampUSec() < response_deadline))
+            {
+                poll(response_deadline);
+            }
+
+            if (read_result_ == PendingResult)
+            {
+                num_failed_attempts++;
+                if (num_failed_attempts >= FileReadMaxAttempts)
+                {
+                    return -ErrTimeout;
+                }
+
+                const unsigned backoff_msec = FileReadRetryBackoffMillisecond << (num_failed_attempts - 1U);
+                logger_.println("FW read timeout %u/%u, retry in %u ms",
+                                num_failed_attempts, FileReadMaxAttempts, backoff_msec);
+
+                const std::uint64_t retry_at = getMonotonicTimestampUSec() + backoff_msec * 1000U;
+                while (getMonotonicTimestampUSec() < retry_at)
+                {
+                    poll(retry_at);
+                }
+                continue;
+            }
+
+            num_failed_attempts = 0;
+
+            /*
+             * Process the response
+             * Observe that we don't constrain the maximum image size - either the bootloader
+             * or the storage backend will return error if we exceed it.
+             */
+            if (read_result_ < 0)
+            {
+                return read_result_;
+            }
+
+            if (read_result_ == 0)
+            {
+                return 0;               // Done
+            }
+
+            const int res = sink.handleNextDataChunk(read_buffer_.data(), unsigned(read_result_));
+            watchdog_.reset();
+            if (res < 0)
+            {
+                return res;
+            }
+
+            offset += unsigned(read_result_);
+
+            if (getMonotonicTimestampUSec() > next_progress_report_deadline)
+            {
+                next_progress_report_deadline += ProgressReportIntervalMillisecond * 1000U;
+                sendLog(dsdl::Severity::Info,
+                        senoval::convertIntToString(offset) + senoval::String<90>("B down..."));
+            }
+        }
+
+        assert(false);  // Should never get here
+        return -1;
+    }
+
+    void onTransferReception(const TransferMetadata& meta, const std::uint8_t* const payload, const std::size_t size)
+    {
+        using namespace impl_;
+
+        /*
+         * GetInfo request.
+         */
+        if ((meta.kind == TransferKind::Request) &&
+            (meta.port_id == dsdl::GetInfoServiceID))
+        {
+            std::uint8_t buffer[dsdl::GetInfoMaxResponseSize]{};
+            std::size_t offset = 0;
+
+            // Protocol version
+            buffer[offset++] = 1;
+            buffer[offset++] = 0;
+
+            // Hardware version
+            buffer[offset++] = hw_info_.major;
+            buffer[offset++] = hw_info_.minor;
+
+            // Software version, VCS revision (query the bootloader)
+            const auto sw_success = bootloader_.getAppInfo();
+            const AppInfo sw = sw_success.first;
+            buffer[offset++] = sw_success.second ? sw.major_version : 0;
+            buffer[offset++] = sw_success.second ? sw.minor_version : 0;
+            const std::uint64_t vcs_commit = sw_success.second ? sw.vcs_commit : 0;
+            std::memcpy(&buffer[offset], &vcs_commit, 8);                   // Little endian platforms only
+            offset += 8;
+
+            // Unique ID
+            std::memcpy(&buffer[offset], hw_info_.unique_id.data(), hw_info_.unique_id.size());
+            offset += hw_info_.unique_id.size();
+
+            // Name
+            buffer[offset++] = std::uint8_t(node_name_.length());
+            std::memcpy(&buffer[offset], node_name_.c_str(), node_name_.length());
+            offset += node_name_.length();
+
+            // Software image CRC (optional)
+            buffer[offset++] = sw_success.second ? 1 : 0;
+            if (sw_success.second)
+            {
+                std::memcpy(&buffer[offset], &sw.image_crc, 8);
+                offset += 8;
+            }
+
+            // Certificate of authenticity
+            buffer[offset++] = hw_info_.certificate_of_authenticity_length;
+            std::memcpy(&buffer[offset],
+                        hw_info_.certificate_of_authenticity.data(),
+                        hw_info_.certificate_of_authenticity_length);
+            offset += hw_info_.certificate_of_authenticity_length;
+
+            assert(offset <= dsdl::GetInfoMaxResponseSize);
+            respond(meta, buffer, offset);
+        }
+
+        /*
+         * ExecuteCommand request.
+         */
+        if ((meta.kind == TransferKind::Request) &&
+            (meta.port_id == dsdl::ExecuteCommandServiceID) &&
+            (size >= 3))
+        {
+            const std::uint16_t command = std::uint16_t(payload[0] | (payload[1] << 8));
+            const std::size_t param_len = std::min<std::size_t>(payload[2], size - 3U);
+            std::uint8_t status = dsdl::CommandStatusBadCommand;
+
+            if (command == dsdl::CommandRestart)
+            {
+                status = dsdl::CommandStatusSuccess;
+                // TODO: Delegate the decision to the application via callback
+                os::requestReboot();
+            }
+
+            if (command == dsdl::CommandBeginSoftwareUpdate)
+            {
+                const auto bl_state = bootloader_.getState();
+                if ((bl_state == State::AppUpgradeInProgress) ||
+                    (bl_state == State::ReadyToBoot) ||
+                    update_requested_)
+                {
+                    status = dsdl::CommandStatusBadState;
+                }
+                else
+                {
+                    // The file server is the node that has sent the request
+                    remote_server_node_id_ = meta.remote_node_id;
+                    firmware_file_path_.clear();
+                    for (std::size_t i = 0; i < std::min<std::size_t>(param_len, firmware_file_path_.capacity()); i++)
+                    {
+                        firmware_file_path_.push_back(char(payload[3 + i]));
+                    }
+                    update_requested_ = true;
+                    status = dsdl::CommandStatusSuccess;
+                }
+            }
+
+            respond(meta, &status, 1);
+        }
+
+        /*
+         * File read response.
+         */
+        if ((meta.kind == TransferKind::Response) &&
+            (meta.port_id == dsdl::FileReadServiceID) &&
+            (meta.remote_node_id == remote_server_node_id_) &&
+            (((meta.transfer_id + 1U) & TransferIDMask) == file_read_transfer_id_) &&
+            (size >= 4))
+        {
+            read_result_ = file_read::deserializeResponse(payload, size, read_buffer_.data());
+        }
+    }
+
+public:
+    /**
+     * @param bl                        mutable reference to the bootloader instance
+     * @param iface                     CAN FD driver adaptor instance
+     * @param name                      product ID, node name
+     * @param hw
+     */
+    CyphalFirmwareUpdateNode(::os::bootloader::Bootloader& bl,
+                             ICANFDIface& iface,
+                             const NodeName& name,
+                             const HardwareInfo& hw) :
+        bootloader_(bl),
+        iface_(iface),
+        node_name_(name),
+        hw_info_(hw)
+    {
+        next_1hz_task_invocation_ = getMonotonicTimestampUSec();
+    }
+
+    /**
+     * This function can be invoked only once.
+     *
+     * @param thread_priority           priority of the node thread
+     * @param node_id                   local node ID, [0, 127]
+     * @param nominal_bit_rate          arbitration phase bit rate
+     * @param data_bit_rate             data phase bit rate
+     * @param remote_server_node_id     set if known; values above 127 make the node wait for an update request
+     * @param remote_file_path          set if known; defaults to an empty string, which can be a valid path too
+     */
+    chibios_rt::ThreadReference start(const ::tprio_t thread_priority,
+                                      const std::uint8_t node_id,
+                                      const std::uint32_t nominal_bit_rate,
+                                      const std::uint32_t data_bit_rate,
+                                      const std::uint8_t remote_server_node_id = TransferMetadata::AnonymousNodeID,
+                                      const char* const remote_file_path = "")
+    {
+        assert(node_id <= impl_::MaxNodeID);
+        local_node_id_ = std::uint8_t(node_id & impl_::MaxNodeID);
+        nominal_bit_rate_ = nominal_bit_rate;
+        data_bit_rate_ = data_bit_rate;
+
+        if (remote_server_node_id <= impl_::MaxNodeID)
+        {
+            remote_server_node_id_ = remote_server_node_id;
+            firmware_file_path_ = remote_file_path;
+            update_requested_ = true;
+        }
+
+        watchdog_.start(impl_::WatchdogTimeout);
+
+        return chibios_rt::BaseStaticThread<StackSize>::start(thread_priority);
+    }
+
+    /**
+     * Returns the local node ID.
+     */
+    std::uint8_t getLocalNodeID() const
+    {
+        return local_node_id_;
+    }
+};
+
+}
+}
+}
@@ -0,0 +1,666 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#pragma once
+
+/*
+ * Minimal UAVCAN v1 (Cyphal) over CAN FD transport.
+ * Only the subset needed by the firmware loader is implemented: message publication, service requests and
+ * responses, multi-frame reassembly with CRC validation. Redundant transports are not supported.
+ *
+ * This header does not depend on the OS, so it can be used on the host as well, e.g. for testing the loader
+ * against a file server through the in-process loopback interface; see tests/cyphal_transport_test.cpp.
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <cassert>
+
+
+namespace os
+{
+namespace bootloader
+{
+namespace cyphal_loader
+{
+/**
+ * Error codes specific to this module.
+ */
+static constexpr std::int16_t ErrTimeout            = 31001;
+static constexpr std::int16_t ErrInterrupted        = 31002;
+static constexpr std::int16_t ErrTxTimeout          = 31003;
+
+/**
+ * CAN FD frame. Only extended identifiers are used by the protocol.
+ * The data length shall be one of the lengths representable by the DLC, see @ref roundUpFrameDataLength().
+ */
+struct CANFDFrame
+{
+    static constexpr std::uint8_t MTU = 64;
+
+    std::uint32_t id = 0;                               ///< 29-bit identifier, no flags
+    std::uint8_t data_len = 0;
+    std::array<std::uint8_t, MTU> data{};
+};
+
+/**
+ * Generic CAN FD controller driver interface.
+ * It mirrors the classic CAN interface of the UAVCAN v0 loader, except for the frame type and the bit rates.
+ */
+class ICANFDIface
+{
+public:
+    enum class Mode
+    {
+        Normal,
+        Silent
+    };
+
+    /**
+     * Acceptance filter configuration, applied to the 29-bit identifier.
+     * The default constructor makes a filter that accepts all frames.
+     */
+    struct AcceptanceFilterConfig
+    {
+        std::uint32_t id = 0;
+        std::uint32_t mask = 0;
+    };
+
+    virtual ~ICANFDIface() {}
+
+    /**
+     * Initializes the CAN hardware in the specified mode.
+     * @param nominal_bitrate       arbitration phase bit rate
+     * @param data_bitrate          data phase bit rate; bit rate switching is disabled if equals the nominal rate
+     * @retval 0                    Success
+     * @retval negative             Error
+     */
+    virtual int init(const std::uint32_t nominal_bitrate,
+                     const std::uint32_t data_bitrate,
+                     const Mode mode,
+                     const AcceptanceFilterConfig& acceptance_filter) = 0;
+
+    /**
+     * Transmits one CAN FD frame.
+     * @retval      1               Transmitted successfully
+     * @retval      0               Timed out
+     * @retval      negative        Error
+     */
+    virtual int send(const CANFDFrame& frame, const int timeout_millisec) = 0;
+
+    /**
+     * Reads one CAN FD frame from the RX queue.
+     * @retval      1               Read successfully
+     * @retval      0               Timed out
+     * @retval      negative        Error
+     */
+    virtual std::pair<int, CANFDFrame> receive(const int timeout_millisec) = 0;
+
+    static constexpr unsigned EventRxReady = 1U << 0;   ///< The RX queue contains at least one frame
+    static constexpr unsigned EventTxReady = 1U << 1;   ///< The TX queue can accept at least one frame
+
+    /**
+     * Blocks until at least one of the requested events is pending, or until the timeout expires.
+     * The default implementation reports all requested events as pending immediately.
+     * @retval      positive        Mask of pending events, a subset of the requested mask
+     * @retval      0               Timed out
+     * @retval      negative        Error
+     */
+    virtual int waitForEvent(const unsigned event_mask, const int timeout_millisec)
+    {
+        (void) timeout_millisec;
+        return int(event_mask);
+    }
+};
+
+/**
+ * Returns the smallest valid CAN FD data length that can accommodate the specified number of bytes.
+ */
+static inline constexpr std::uint8_t roundUpFrameDataLength(const std::size_t x)
+{
+    return (x <= 8)  ? std::uint8_t(x) :
+           (x <= 12) ? 12 :
+           (x <= 16) ? 16 :
+           (x <= 20) ? 20 :
+           (x <= 24) ? 24 :
+           (x <= 32) ? 32 :
+           (x <= 48) ? 48 : 64;
+}
+
+enum class TransferKind : std::uint8_t
+{
+    Message,
+    Request,
+    Response
+};
+
+/**
+ * Transfer metadata as encoded in the CAN ID and the tail byte.
+ * The remote node ID is the source for received transfers and the destination for transmitted service transfers.
+ */
+struct TransferMetadata
+{
+    static constexpr std::uint8_t AnonymousNodeID = 0xFF;
+
+    TransferKind kind = TransferKind::Message;
+    std::uint8_t priority = 4;                          ///< 0 - exceptional, 7 - optional; 4 is nominal
+    std::uint16_t port_id = 0;                          ///< Subject ID or service ID
+    std::uint8_t remote_node_id = AnonymousNodeID;
+    std::uint8_t transfer_id = 0;
+};
+
+/**
+ * Implementation details, please do not touch this.
+ */
+namespace impl_
+{
+static constexpr std::uint8_t MaxNodeID         = 127;
+static constexpr std::uint8_t TransferIDMask    = 31;
+
+static constexpr std::uint8_t TailStartOfTransfer   = 1U << 7;
+static constexpr std::uint8_t TailEndOfTransfer     = 1U << 6;
+static constexpr std::uint8_t TailToggle            = 1U << 5;
+
+static constexpr std::uint32_t CANIDServiceNotMessage   = 1UL << 25;
+static constexpr std::uint32_t CANIDRequestNotResponse  = 1UL << 24;
+static constexpr std::uint32_t CANIDAnonymousMessage    = 1UL << 24;
+static constexpr std::uint32_t CANIDReserved23          = 1UL << 23;
+static constexpr std::uint32_t CANIDReserved07          = 1UL << 7;
+static constexpr std::uint32_t CANIDMessageReserved2221 = 3UL << 21;
+
+/**
+ * CRC-16-CCITT-FALSE, used for multi-frame transfers.
+ * Initial value: 0xFFFF, poly: 0x1021, not reflected, no output xor.
+ * The residue is zero if the CRC is appended to the data in the big endian byte order.
+ */
+class CRC16CCITT
+{
+    std::uint16_t crc_ = 0xFFFFU;
+
+public:
+    void add(const std::uint8_t byte)
+    {
+        crc_ ^= std::uint16_t(byte << 8);
+        for (int i = 0; i < 8; i++)
+        {
+            crc_ = (crc_ & 0x8000U) ? std::uint16_t((crc_ << 1) ^ 0x1021U) : std::uint16_t(crc_ << 1);
+        }
+    }
+
+    void add(const std::uint8_t* data, std::size_t len)
+    {
+        while (len --> 0)
+        {
+            add(*data++);
+        }
+    }
+
+    std::uint16_t get() const { return crc_; }
+};
+
+static inline std::uint32_t makeCANID(const TransferMetadata& meta, const std::uint8_t local_node_id)
+{
+    std::uint32_t id = (std::uint32_t(meta.priority & 7U) << 26) | local_node_id;
+    if (meta.kind == TransferKind::Message)
+    {
+        id |= CANIDMessageReserved2221 | (std::uint32_t(meta.port_id & 0x1FFFU) << 8);
+    }
+    else
+    {
+        id |= CANIDServiceNotMessage |
+              ((meta.kind == TransferKind::Request) ? CANIDRequestNotResponse : 0) |
+              (std::uint32_t(meta.port_id & 0x1FFU) << 14) |
+              (std::uint32_t(meta.remote_node_id & MaxNodeID) << 7);
+    }
+    return id;
+}
+
+}   // namespace impl_
+
+/**
+ * Parses the CAN ID of a received frame.
+ * Returns false if the frame is malformed or if it is a service transfer addressed to another node.
+ * The transfer ID is taken from the tail byte, so the frame shall not be empty.
+ */
+static inline bool parseFrame(const CANFDFrame& frame, const std::uint8_t local_node_id, TransferMetadata& out_meta)
+{
+    using namespace impl_;
+
+    if ((frame.data_len == 0) || (frame.data_len > CANFDFrame::MTU) || ((frame.id & CANIDReserved23) != 0))
+    {
+        return false;
+    }
+
+    out_meta.priority = std::uint8_t((frame.id >> 26) & 7U);
+    out_meta.remote_node_id = std::uint8_t(frame.id & MaxNodeID);
+    out_meta.transfer_id = std::uint8_t(frame.data[frame.data_len - 1U] & TransferIDMask);
+
+    if ((frame.id & CANIDServiceNotMessage) != 0)
+    {
+        if (std::uint8_t((frame.id >> 7) & MaxNodeID) != local_node_id)
+        {
+            return false;
+        }
+        out_meta.kind = ((frame.id & CANIDRequestNotResponse) != 0) ? TransferKind::Request : TransferKind::Response;
+        out_meta.port_id = std::uint16_t((frame.id >> 14) & 0x1FFU);
+    }
+    else
+    {
+        if ((frame.id & CANIDReserved07) != 0)
+        {
+            return false;
+        }
+        if ((frame.id & CANIDAnonymousMessage) != 0)
+        {
+            out_meta.remote_node_id = TransferMetadata::AnonymousNodeID;
+        }
+        out_meta.kind = TransferKind::Message;
+        out_meta.port_id = std::uint16_t((frame.id >> 8) & 0x1FFFU);
+    }
+
+    return true;
+}
+
+/**
+ * Splits the payload into CAN FD frames and passes them to the interface one by one.
+ * Single-frame transfers carry up to 63 bytes of payload; larger transfers are protected with the transfer CRC.
+ * @retval      positive        Number of frames transmitted
+ * @retval      negative        Error
+ */
+static inline int sendTransfer(ICANFDIface& iface,
+                               const std::uint8_t local_node_id,
+                               const TransferMetadata& meta,
+                               const std::uint8_t* const payload,
+                               const std::size_t payload_size,
+                               const int timeout_millisec)
+{
+    using namespace impl_;
+
+    constexpr std::size_t MaxBytesPerFrame = CANFDFrame::MTU - 1U;
+
+    CANFDFrame frame;
+    frame.id = makeCANID(meta, local_node_id);
+
+    const std::uint8_t tid = std::uint8_t(meta.transfer_id & TransferIDMask);
+
+    /*
+     * Single-frame transfer, the padding is not covered by any CRC.
+     */
+    if (payload_size <= MaxBytesPerFrame)
+    {
+        frame.data_len = roundUpFrameDataLength(payload_size + 1U);
+        std::copy_n(payload, payload_size, frame.data.begin());
+        frame.data[frame.data_len - 1U] = std::uint8_t(TailStartOfTransfer | TailEndOfTransfer | TailToggle | tid);
+
+        const int res = iface.send(frame, timeout_millisec);
+        return (res == 0) ? -ErrTxTimeout : res;
+    }
+
+    /*
+     * Multi-frame transfer. The stream consists of the payload, the padding, and the CRC.
+     * The padding is needed only in the last frame; it exists only if the last frame is longer than 8 bytes,
+     * so the CRC is never split by the padding.
+     */
+    const std::size_t size_with_crc = payload_size + 2U;
+    const std::size_t num_frames = (size_with_crc + MaxBytesPerFrame - 1U) / MaxBytesPerFrame;
+    const std::size_t last_frame_bytes = size_with_crc - (num_frames - 1U) * MaxBytesPerFrame;
+    const std::size_t padding = roundUpFrameDataLength(last_frame_bytes + 1U) - 1U - last_frame_bytes;
+
+    CRC16CCITT crc;
+    crc.add(payload, payload_size);
+    for (std::size_t i = 0; i < padding; i++)
+    {
+        crc.add(0);
+    }
+
+    const std::size_t stream_size = payload_size + padding + 2U;
+    const auto stream_at = [&](const std::size_t index) -> std::uint8_t
+    {
+        if (index < payload_size)
+        {
+            return payload[index];
+        }
+        if (index < (payload_size + padding))
+        {
+            return 0;
+        }
+        return (index == (stream_size - 2U)) ? std::uint8_t(crc.get() >> 8) : std::uint8_t(crc.get() & 0xFFU);
+    };
+
+    std::size_t offset = 0;
+    std::uint8_t toggle = TailToggle;
+    for (std::size_t i = 0; i < num_frames; i++)
+    {
+        const std::size_t n = std::min(MaxBytesPerFrame, stream_size - offset);
+        for (std::size_t k = 0; k < n; k++)
+        {
+            frame.data[k] = stream_at(offset + k);
+        }
+        offset += n;
+
+        frame.data_len = std::uint8_t(n + 1U);
+        assert(frame.data_len == roundUpFrameDataLength(frame.data_len));
+        frame.data[n] = std::uint8_t(((i == 0) ? TailStartOfTransfer : 0) |
+                                     ((i == (num_frames - 1U)) ? TailEndOfTransfer : 0) |
+                                     toggle | tid);
+        toggle ^= TailToggle;
+
+        const int res = iface.send(frame, timeout_millisec);
+        if (res <= 0)
+        {
+            return (res == 0) ? -ErrTxTimeout : res;
+        }
+    }
+
+    assert(offset == stream_size);
+    return int(num_frames);
+}
+
+/**
+ * Reassembles incoming transfers from frames.
+ * Every session is identified by the transfer kind, the port ID, and the source node ID; the sessions are
+ * allocated from a fixed-size table, the least recently used session is evicted if the table is full.
+ * Payloads that exceed the capacity are truncated, which is in line with the implicit truncation rule.
+ */
+template <std::size_t PayloadCapacity, std::size_t NumSessions>
+class TransferReassembler
+{
+    static constexpr std::uint64_t SessionTimeoutUSec = 2000000;
+
+    struct Session
+    {
+        TransferMetadata meta;
+        bool active = false;
+        std::uint8_t expected_toggle = 0;
+        std::uint64_t updated_at_usec = 0;
+        std::size_t size = 0;                           ///< Number of received bytes, including the CRC
+        impl_::CRC16CCITT crc;
+        std::array<std::uint8_t, PayloadCapacity + 2U> payload{};
+    };
+
+    std::array<Session, NumSessions> sessions_{};
+    std::array<std::uint8_t, CANFDFrame::MTU - 1U> single_frame_payload_{};
+
+    Session& findSession(const TransferMetadata& meta, const std::uint64_t timestamp_usec)
+    {
+        Session* oldest = &sessions_[0];
+        for (auto& s : sessions_)
+        {
+            if (s.active &&
+                (s.meta.kind == meta.kind) &&
+                (s.meta.port_id == meta.port_id) &&
+                (s.meta.remote_node_id == meta.remote_node_id))
+            {
+                if ((timestamp_usec - s.updated_at_usec) > SessionTimeoutUSec)
+                {
+                    s.active = false;           // Stale, will be restarted by the next start-of-transfer frame
+                }
+                return s;
+            }
+            if ((!s.active) || (s.updated_at_usec < oldest->updated_at_usec))
+            {
+                oldest = &s;
+            }
+        }
+        oldest->active = false;
+        oldest->meta = meta;
+        return *oldest;
+    }
+
+public:
+    struct Transfer
+    {
+        TransferMetadata meta;
+        const std::uint8_t* payload = nullptr;
+        std::size_t payload_size = 0;
+    };
+
+    /**
+     * Accepts a frame that has been parsed with @ref parseFrame().
+     * Returns true if a transfer has been completed; the payload pointer is valid until the next call.
+     * The payload includes the padding of the last frame, which is harmless for DSDL deserialization.
+     */
+    bool accept(const CANFDFrame& frame,
+                const TransferMetadata& meta,
+                const std::uint64_t timestamp_usec,
+                Transfer& out_transfer)
+    {
+        using namespace impl_;
+
+        const std::uint8_t tail = frame.data[frame.data_len - 1U];
+        const std::size_t frame_payload_size = frame.data_len - 1U;
+
+        if (((tail & TailStartOfTransfer) != 0) && ((tail & TailEndOfTransfer) != 0))
+        {
+            if ((tail & TailToggle) == 0)
+            {
+                return false;
+            }
+            std::copy_n(frame.data.begin(), frame_payload_size, single_frame_payload_.begin());
+            out_transfer.meta = meta;
+            out_transfer.payload = single_frame_payload_.data();
+            out_transfer.payload_size = std::min(frame_payload_size, PayloadCapacity);
+            return true;
+        }
+
+        Session& s = findSession(meta, timestamp_usec);
+
+        if ((tail & TailStartOfTransfer) != 0)
+        {
+            if ((tail & TailToggle) == 0)
+            {
+                return false;
+            }
+            s.active = true;
+            s.meta = meta;
+            s.expected_toggle = TailToggle;
+            s.size = 0;
+            s.crc = CRC16CCITT();
+        }
+
+        if ((!s.active) ||
+            (s.meta.transfer_id != meta.transfer_id) ||
+            ((tail & TailToggle) != s.expected_toggle))
+        {
+            return false;                       // Missed the start of the transfer, or a duplicate frame
+        }
+
+        s.expected_toggle ^= TailToggle;
+        s.updated_at_usec = timestamp_usec;
+        s.crc.add(frame.data.data(), frame_payload_size);
+
+        const std::size_t n = std::min(frame_payload_size, s.payload.size() - s.size);
+        std::copy_n(frame.data.begin(), n, s.payload.begin() + s.size);
+        s.size += n;
+
+        if ((tail & TailEndOfTransfer) == 0)
+        {
+            return false;
+        }
+
+        s.active = false;
+        if ((s.crc.get() != 0) || (s.size < 2U))
+        {
+            return false;                       // Corrupted
+        }
+
+        out_transfer.meta = meta;
+        out_transfer.payload = s.payload.data();
+        out_transfer.payload_size = std::min(s.size - 2U, PayloadCapacity);
+        return true;
+    }
+};
+
+/**
+ * Serialization of uavcan.file.Read.1.1, which is needed by the loader as well as by the file servers on the host.
+ * The multi-byte fields are little endian.
+ */
+namespace file_read
+{
+static constexpr std::uint16_t ServiceID        = 408;
+static constexpr std::size_t DataCapacity       = 256;
+static constexpr std::size_t MaxPathLength      = 255;
+static constexpr std::size_t MaxRequestSize     = 5U + 1U + MaxPathLength;
+static constexpr std::size_t MaxResponseSize    = 2U + 2U + DataCapacity;
+
+/**
+ * Returns the number of bytes written; the path is truncated if too long.
+ */
+static inline std::size_t serializeRequest(const std::uint64_t offset,
+                                           const char* const path,
+                                           const std::size_t path_length,
+                                           std::uint8_t* const out_buffer)
+{
+    const std::size_t len = std::min(path_length, MaxPathLength);
+    for (unsigned i = 0; i < 5; i++)
+    {
+        out_buffer[i] = std::uint8_t(offset >> (i * 8U));
+    }
+    out_buffer[5] = std::uint8_t(len);
+    std::copy_n(path, len, &out_buffer[6]);
+    return 6U + len;
+}
+
+/**
+ * Returns false if the payload is malformed. The path points into the payload.
+ */
+static inline bool deserializeRequest(const std::uint8_t* const payload,
+                                      const std::size_t size,
+                                      std::uint64_t& out_offset,
+                                      const char*& out_path,
+                                      std::size_t& out_path_length)
+{
+    if ((size < 6U) || (size < (6U + payload[5])))
+    {
+        return false;
+    }
+    out_offset = 0;
+    for (unsigned i = 0; i < 5; i++)
+    {
+        out_offset |= std::uint64_t(payload[i]) << (i * 8U);
+    }
+    out_path = reinterpret_cast<const char*>(&payload[6]);
+    out_path_length = payload[5];
+    return true;
+}
+
+/**
+ * Returns the number of bytes written. The data is ignored if the error code is not zero.
+ */
+static inline std::size_t serializeResponse(const std::uint16_t error,
+                                            const std::uint8_t* const data,
+                                            const std::size_t data_size,
+                                            std::uint8_t* const out_buffer)
+{
+    const std::size_t len = (error == 0) ? std::min(data_size, DataCapacity) : 0U;
+    out_buffer[0] = std::uint8_t(error & 0xFFU);
+    out_buffer[1] = std::uint8_t(error >> 8);
+    out_buffer[2] = std::uint8_t(len & 0xFFU);
+    out_buffer[3] = std::uint8_t(len >> 8);
+    std::copy_n(data, len, &out_buffer[4]);
+    return 4U + len;
+}
+
+/**
+ * The payload shall be at least 4 bytes long. The output buffer shall accommodate DataCapacity bytes.
+ * @retval      non-negative    Number of data bytes; zero indicates the end of file
+ * @retval      negative        Error code reported by the server, negated
+ */
+static inline int deserializeResponse(const std::uint8_t* const payload,
+                                      const std::size_t size,
+                                      std::uint8_t* const out_data)
+{
+    assert(size >= 4U);
+    const std::uint16_t error = std::uint16_t(payload[0] | (payload[1] << 8));
+    if (error != 0)
+    {
+        return -int(error);
+    }
+    const std::size_t len = std::min<std::size_t>(std::size_t(payload[2] | (payload[3] << 8)),
+                                                  std::min(size - 4U, DataCapacity));
+    std::copy_n(&payload[4], len, out_data);
+    return int(len);
+}
+
+}
+
+/**
+ * In-process CAN FD bus for the host. Every attached interface receives the frames sent by the other interfaces
+ * that pass its acceptance filter; a frame is never looped back to its sender. Transmission is instantaneous,
+ * so the protocol logic can be exercised without hardware. Not thread-safe.
+ */
+template <std::size_t QueueCapacity = 256>
+class LoopbackCANFDIface : public ICANFDIface
+{
+    LoopbackCANFDIface* next_ = this;                   ///< The attached interfaces form a ring
+    AcceptanceFilterConfig filter_;
+    std::array<CANFDFrame, QueueCapacity> queue_{};
+    std::size_t queue_head_ = 0;
+    std::size_t queue_size_ = 0;
+    bool initialized_ = false;
+
+    void push(const CANFDFrame& frame)
+    {
+        if (initialized_ && ((frame.id & filter_.mask) == (filter_.id & filter_.mask)) &&
+            (queue_size_ < QueueCapacity))
+        {
+            queue_[(queue_head_ + queue_size_) % QueueCapacity] = frame;
+            queue_size_++;
+        }
+    }
+
+public:
+    /**
+     * Attaches this interface to the bus the other interface is attached to.
+     */
+    void attach(LoopbackCANFDIface& other)
+    {
+        next_ = other.next_;
+        other.next_ = this;
+    }
+
+    int init(const std::uint32_t, const std::uint32_t, const Mode, const AcceptanceFilterConfig& filter) override
+    {
+        filter_ = filter;
+        queue_size_ = 0;
+        initialized_ = true;
+        return 0;
+    }
+
+    int send(const CANFDFrame& frame, const int) override
+    {
+        for (LoopbackCANFDIface* p = next_; p != this; p = p->next_)
+        {
+            p->push(frame);
+        }
+        return 1;
+    }
+
+    std::pair<int, CANFDFrame> receive(const int) override
+    {
+        if (queue_size_ == 0)
+        {
+            return {0, CANFDFrame()};
+        }
+        const CANFDFrame frame = queue_[queue_head_];
+        queue_head_ = (queue_head_ + 1U) % QueueCapacity;
+        queue_size_--;
+        return {1, frame};
+    }
+
+    int waitForEvent(const unsigned event_mask, const int) override
+    {
+        return int(event_mask & (EventTxReady | ((queue_size_ > 0) ? EventRxReady : 0U)));
+    }
+};
+
+}
+}
+}
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "../bootloader.hpp"
+#include "../app_shared.hpp"
 #include <zubax_chibios/os.hpp>
 #include <zubax_chibios/watchdog/watchdog.hpp>
 #include <cstdint>
@@ -15,10 +16,16 @@
 #include <utility>
 #include <cstddef>
 #include <chrono>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <atomic>
 #include <canard.h>                     // This loader requires libcanard
 #include <senoval/string.hpp>           // And Senoval as well
 #include <unistd.h>
 #include <hal.h>
+#include <chprintf.h>
 
 
 namespace os
@@ -72,7 +79,7 @@ public:
      * @retval 0                Success
      * @retval negative         Error
      */
-    virtual int init(const std::uint32_t bitrate, const Mode mode, const AcceptanceFilterConfig& acceptance_filter);
+    virtual int init(const std::uint32_t bitrate, const Mode mode, const AcceptanceFilterConfig& acceptance_filter) = 0;
 
     /**
      * Transmits one CAN frame.
@@ -82,7 +89,7 @@ public:
      * @retval      0               Timed out
      * @retval      negative        Error
      */
-    virtual int send(const CanardCANFrame& frame, const int timeout_millisec);
+    virtual int send(const CanardCANFrame& frame, const int timeout_millisec) = 0;
 
     /**
      * Reads one CAN frame from the RX queue.
@@ -92,7 +99,83 @@ public:
      * @retval      0               Timed out
      * @retval      negative        Error
      */
-    virtual std::pair<int, CanardCANFrame> receive(const int timeout_millisec);
+    virtual std::pair<int, CanardCANFrame> receive(const int timeout_millisec) = 0;
+
+    /**
+     * Event flags used with @ref waitForEvent().
+     */
+    static constexpr unsigned EventRxReady = 1U << 0;   ///< The RX queue contains at least one frame
+    static constexpr unsigned EventTxReady = 1U << 1;   ///< The TX queue can accept at least one frame
+
+    /**
+     * Blocks until at least one of the requested events is pending, or until the timeout expires.
+     * Zero timeout makes the call non-blocking, which allows the caller to check the state of the queues.
+     * The node thread uses this method to sleep while there is nothing to do, so a proper implementation
+     * (e.g. based on a semaphore or an event source signaled from the CAN ISR) is highly recommended.
+     *
+     * The default implementation is provided for compatibility with drivers that lack event notifications.
+     * It reports all requested events as pending immediately, which makes the caller fall back to the
+     * blocking @ref receive() call, i.e. the old polling behavior.
+     *
+     * @retval      positive        Mask of pending events, a subset of the requested mask
+     * @retval      0               Timed out
+     * @retval      negative        Error
+     */
+    virtual int waitForEvent(const unsigned event_mask, const int timeout_millisec)
+    {
+        (void) timeout_millisec;
+        return int(event_mask);
+    }
+
+    /**
+     * Returns the number of CAN protocol errors (bit, stuff, form, CRC) detected by the controller since the
+     * last @ref init(). The counter must be functional in silent mode, too.
+     * A wrong bit rate causes protocol errors as soon as there is any traffic on the bus, which allows the
+     * bit rate detection logic to reject such bit rates quickly instead of listening for the full timeout.
+     *
+     * The default implementation reports that the feature is not supported.
+     *
+     * @retval      non-negative    Number of errors since initialization
+     * @retval      negative        Not supported
+     */
+    virtual int getProtocolErrorCount()
+    {
+        return -1;
+    }
+
+    /**
+     * Returns the number of frames lost due to RX FIFO overflow since the last @ref init().
+     * The default implementation reports that the feature is not supported.
+     *
+     * @retval      non-negative    Number of lost frames since initialization
+     * @retval      negative        Not supported
+     */
+    virtual int getRxOverflowCount()
+    {
+        return -1;
+    }
+};
+
+/**
+ * Counters and high-water marks collected by the node, see UAVCANFirmwareUpdateNode::getStatistics().
+ * They are never reset; the driver-specific counters are zero if not supported by the driver.
+ */
+struct NodeStatistics
+{
+    std::uint32_t rx_frames = 0;
+    std::uint32_t tx_frames = 0;
+    std::uint32_t rx_driver_errors = 0;
+    std::uint32_t tx_driver_errors = 0;
+    std::uint32_t tx_driver_queue_full = 0;         ///< The driver did not accept a frame, it will be retried later
+    std::uint32_t rx_overruns = 0;                  ///< Frames lost in the driver, since the last CAN init
+    std::uint32_t rx_transfer_errors = 0;           ///< Reassembly failures: missed frames, bad CRC, no memory
+
+    std::uint16_t tx_queue_depth_peak = 0;          ///< Frames in the libcanard TX queue
+    std::uint16_t rx_frames_per_spin_peak = 0;      ///< Reaching the per-spin limit means that RX is lagging
+
+    std::uint16_t memory_pool_capacity_blocks = 0;
+    std::uint16_t memory_pool_usage_blocks = 0;
+    std::uint16_t memory_pool_peak_usage_blocks = 0;
 };
 
 
@@ -111,6 +194,71 @@ struct HardwareInfo
     std::uint8_t certificate_of_authenticity_length = 0;
 };
 
+/**
+ * Network parameters discovered by the node at run time, which can be cached between restarts in order to
+ * skip the CAN bit rate detection and the dynamic node ID allocation.
+ * Zero means that the value is unknown.
+ */
+struct __attribute__((packed)) CachedNetworkParameters
+{
+    std::uint32_t can_bus_bit_rate = 0;
+    std::uint8_t node_id = 0;
+};
+
+/**
+ * This interface abstracts the storage of @ref CachedNetworkParameters.
+ * The storage should survive a soft reset; non-volatile storage is optional.
+ * Refer to @ref AppSharedNetworkParametersCache for a ready-to-use implementation.
+ */
+class INetworkParametersCache
+{
+public:
+    virtual ~INetworkParametersCache() { }
+
+    /**
+     * @return The stored parameters, or an empty option if there are none.
+     */
+    virtual std::optional<CachedNetworkParameters> load() = 0;
+
+    /**
+     * This method is invoked only if the parameters have changed, so it is safe to write flash here.
+     */
+    virtual void store(const CachedNetworkParameters& params) = 0;
+};
+
+/**
+ * Stores the network parameters using an app_shared marshaller, e.g. in the backup registers.
+ * Usage:
+ *     auto marshaller = app_shared::makeAppSharedMarshaller<CachedNetworkParameters>(&RTC->BKP0R, &RTC->BKP1R,
+ *                                                                                   &RTC->BKP2R, &RTC->BKP3R);
+ *     AppSharedNetworkParametersCache<decltype(marshaller)> cache(marshaller);
+ */
+template <typename Marshaller>
+class AppSharedNetworkParametersCache : public INetworkParametersCache
+{
+    Marshaller& marshaller_;
+
+public:
+    explicit AppSharedNetworkParametersCache(Marshaller& marshaller) :
+        marshaller_(marshaller)
+    { }
+
+    std::optional<CachedNetworkParameters> load() override
+    {
+        const auto res = marshaller_.read();
+        if (res.second)
+        {
+            return res.first;
+        }
+        return {};
+    }
+
+    void store(const CachedNetworkParameters& params) override
+    {
+        marshaller_.write(params);
+    }
+};
+
 /**
  * Implementation details, please do not touch this.
  */
@@ -127,6 +275,63 @@ static constexpr unsigned ServiceRequestTimeoutMillisecond = 1000;
 
 static constexpr unsigned ProgressReportIntervalMillisecond = 10000;
 
+/**
+ * The node statistics are published as a debug log message at this interval.
+ */
+static constexpr unsigned StatisticsReportIntervalMillisecond = 30000;
+
+/**
+ * Upper limit for a single blocking wait in the node thread.
+ * It defines how quickly the thread notices reboot requests issued from other threads.
+ */
+static constexpr unsigned MaxBlockingWaitMillisecond = 100;
+
+/**
+ * CAN bit rate detection timing.
+ * The short listen window is enough to detect the bit rate on a busy bus; the long window is enough to
+ * catch at least one NodeStatus message from any node, which is the worst case scenario (quiet bus).
+ * Listening is performed in slices so that a wrong bit rate can be rejected early upon a protocol error.
+ */
+static constexpr unsigned BitRateDetectionShortListenMillisecond = 50;
+static constexpr unsigned BitRateDetectionLongListenMillisecond  = 1100;
+static constexpr unsigned BitRateDetectionListenSliceMillisecond = 50;
+
+/**
+ * How long the cached network parameters are verified before use.
+ * The cached bit rate is accepted only if a frame is received and the controller reports no protocol errors;
+ * on a quiet bus the regular bit rate detection is performed. If protocol errors are reported after the node has
+ * gone online with the cached bit rate, the cached bit rate is invalidated, so that it is detected anew after
+ * the next restart.
+ * The short listen is not enough to verify the cached node ID, because the other nodes may publish NodeStatus
+ * only once per second. Therefore, after going online with the cached node ID, the node monitors the bus for one
+ * NodeStatus period; if another node is seen using the same node ID, the node ID is dropped and allocated anew.
+ */
+static constexpr unsigned CachedNetworkParametersVerificationMillisecond = 100;
+static constexpr unsigned CachedNodeIDMonitoringMillisecond              = 1100;
+
+/**
+ * Multicast firmware stream timing.
+ * If the server does not respond to the initial stream request within the probe timeout, the node falls back
+ * to unicast file reads. Same happens if the stream stalls for longer than the stall timeout.
+ * Requests for missing data are delayed randomly in order to let the nodes suppress duplicate requests:
+ * a node that has seen another node request the data at or before its own offset sends no request for the
+ * request interval, even if it detects a gap in the meantime.
+ */
+static constexpr unsigned MulticastProbeTimeoutMillisecond    = 300;
+static constexpr unsigned MulticastStallTimeoutMillisecond    = 3000;
+static constexpr unsigned MulticastRequestIntervalMillisecond = 500;
+static constexpr unsigned MulticastRequestMaxDelayMillisecond = 20;
+
+/**
+ * File read retry policy.
+ * A request that has timed out is repeated after an exponentially growing delay; the server is dropped once
+ * all attempts are exhausted. If all servers are dropped, the download is suspended rather than aborted:
+ * a repeated BeginFirmwareUpdate request with the same path resumes it from the last delivered offset.
+ */
+static constexpr unsigned FileReadMaxAttempts                 = 4;
+static constexpr unsigned FileReadRetryBackoffMillisecond     = 200;
+static constexpr unsigned FileReadResumeTimeoutMillisecond    = 20000;
+
 namespace dsdl
 {
 
@@ -173,6 +378,23 @@ using BeginFirmwareUpdate       = ServiceTypeInfo<40,    0xb7d725df72724126,  16
 using FileRead                  = ServiceTypeInfo<48,    0x8dcdca939f33f678,  1648,  2073>;
 using RestartNode               = ServiceTypeInfo<5,     0x569e05394a3017f0,    40,     1>;
 
+/*
+ * Vendor-specific types used for multicast firmware distribution; the signatures were computed from the
+ * following definitions. The stream ID is the lower 32 bits of CRC-64-WE of the file path.
+ *
+ *  zubax.bootloader.MulticastChunk (broadcast by the server; empty data means end of file):
+ *      uint32 stream_id
+ *      uint40 offset
+ *      uint8[<=256] data
+ *
+ *  zubax.bootloader.MulticastChunkRequest (broadcast by the nodes; requests the data starting from the offset):
+ *      uint32 stream_id
+ *      uint40 offset
+ *      uint8[<=200] path
+ */
+using MulticastChunk            = MessageTypeInfo<20500, 0x7697c5541733a974,  2129>;
+using MulticastChunkRequest     = MessageTypeInfo<20501, 0x53f4ad737c840143,  1680>;
+
 
 enum class NodeHealth : std::uint8_t
 {
@@ -189,43 +411,7 @@ enum class NodeMode : std::uint8_t
 
 }
 
-/**
- * This class provides an absolute time base that never overflows.
- * Note that the implementation requires two things:
- *      - The system tick interval must be an integer number of microseconds (checked at compile time)
- *      - The system time is queried at least once between system time overflows (not checked!)
- */
-class MonotonicTimekeeper
-{
-    static_assert(unsigned(1000000 / unsigned(1000000 / CH_CFG_ST_FREQUENCY)) == CH_CFG_ST_FREQUENCY,
-                  "The system tick interval must be an integer number of microseconds!");
-
-    mutable ::systime_t prev_sample_at_st_ = 0;
-    mutable std::uint64_t base_usec_ = 0;
-    const std::uint64_t started_at_usec_;
-
-public:
-    MonotonicTimekeeper() :
-        started_at_usec_(getMicroseconds())
-    { }
-
-    std::uint64_t getMicroseconds() const
-    {
-        // Computing increment since last invocation
-        const ::systime_t ts = chVTGetSystemTimeX();
-        const std::uint64_t increment_usec =
-            TIME_I2US(::systime_t(ts - prev_sample_at_st_)); // this shall be 64 bit wide!
-        prev_sample_at_st_ = ts;
-        // Add the increment to the absolute time estimate
-        base_usec_ += increment_usec;
-        return base_usec_;
-    }
-
-    std::uint64_t getUptimeMicroseconds() const
-    {
-        return getMicroseconds() - started_at_usec_;
-    }
-};
+using ::os::bootloader::MonotonicTimekeeper;
 
 /**
  * See uavcan.protocol.debug.LogMessage
@@ -246,12 +432,13 @@ enum class LogLevel : std::uint8_t
  * This class looks like a bowl of spaghetti because is has been carefully optimized for ROM footprint.
  * Aviod reading this code unless you've familiarized yourself with the UAVCAN specification.
  */
-template <int StackSize = 4096, int MemoryPoolSize = 8192>
+template <int StackSize = 4096, int MemoryPoolSize = 8192, int MaxFileServers = 2>
 class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
                                  protected chibios_rt::BaseStaticThread<StackSize>
 {
     ::os::bootloader::Bootloader& bootloader_;
     ICANIface& iface_;
+    INetworkParametersCache* const network_parameters_cache_;
 
     const NodeName node_name_;
     const HardwareInfo hw_info_;
@@ -265,11 +452,50 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
     CanardInstance canard_{};
 
     std::uint32_t can_bus_bit_rate_ = 0;
+    bool bit_rate_from_cache_ = false;                  ///< Until the first protocol error in normal operation
+    bool node_id_from_cache_ = false;                   ///< Until the cached node ID is verified online
+    bool node_id_conflict_monitoring_ = false;          ///< Set while the frames are checked for our source ID
+    bool node_id_conflict_detected_ = false;
     std::uint8_t confirmed_local_node_id_ = 0;          ///< This field is needed in order to avoid mutexes
 
+    static_assert(MaxFileServers >= 1, "At least one file server is required");
+
     std::uint8_t remote_server_node_id_ = 0;
     senoval::String<200> firmware_file_path_;
 
+    /// Servers that have offered the same file after the primary one; they are used concurrently with it
+    std::array<std::uint8_t, MaxFileServers - 1> additional_server_node_ids_{};
+
+    /**
+     * Every file server has one outstanding read request at a time.
+     * The image is split into stripes of FileReadChunkSize bytes, which are fetched from all servers concurrently
+     * and delivered to the sink in order.
+     */
+    static constexpr unsigned FileReadChunkSize = 256;
+
+    struct FileReadSlot
+    {
+        enum class State : std::uint8_t
+        {
+            Idle,               ///< Waiting for the deadline in order to send the next request
+            Pending,            ///< Request sent, waiting for the response until the deadline
+            Ready               ///< Response received, waiting to be delivered to the sink
+        };
+
+        State state = State::Idle;
+        std::uint8_t server_node_id = 0;        ///< Zero if the slot is not used
+        std::uint8_t num_failed_attempts = 0;   ///< Consecutive timeouts, reset upon response
+        int result = 0;                         ///< Number of bytes or negative error code
+        std::uint64_t offset = 0;
+        std::uint64_t deadline = 0;
+        std::array<std::uint8_t, FileReadChunkSize> buffer{};
+    };
+
+    std::array<FileReadSlot, MaxFileServers> file_read_slots_{};
+
+    /// Kept per server rather than per slot, so that the transfer IDs are not reused when the slots are reset
+    std::array<std::uint8_t, CANARD_MAX_NODE_ID + 1> file_read_transfer_ids_{};
+
     os::Logger logger_{"Bootloader.UAVCAN"};
 
     std::uint64_t send_next_node_id_allocation_request_at_ = 0;
@@ -280,14 +506,96 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
     std::uint8_t node_status_transfer_id_ = 0;
     std::uint8_t node_id_allocation_transfer_id_ = 0;
     std::uint8_t log_message_transfer_id_ = 0;
-    std::uint8_t file_read_transfer_id_ = 0;
+    std::uint8_t multicast_request_transfer_id_ = 0;
+
+    NodeStatistics statistics_;
+    std::uint64_t next_statistics_report_at_ = 0;
+
+    /**
+     * GetNodeInfo response with all static fields pre-serialized; only the NodeStatus prefix is patched per request.
+     * Rebuilt only when the application info may have changed, i.e. at startup and after an upgrade attempt.
+     */
+    std::array<std::uint8_t, impl_::dsdl::GetNodeInfo::MaxSizeBytesResponse> node_info_response_{};
+    std::uint16_t node_info_response_size_ = 0;
 
     std::array<std::uint8_t, 256> read_buffer_{};
     int read_result_ = 0;
 
+    bool multicast_active_ = false;
+    bool multicast_gap_detected_ = false;           ///< Set when a chunk beyond the expected offset is received
+    /// When another node has last requested the data at or before our offset; zero if not seen
+    std::uint64_t multicast_foreign_request_at_ = 0;
+    std::uint32_t multicast_stream_id_ = 0;
+    std::uint64_t multicast_expected_offset_ = 0;
+
+    std::atomic<bool> restart_requested_{false};
+    std::uint32_t restart_can_bus_bit_rate_ = 0;    ///< Written before the flag is set, read after it is observed
+    std::uint8_t restart_node_id_ = 0;
+
 
     using chibios_rt::BaseStaticThread<StackSize>::start;       // This is overloaded below
 
+    /**
+     * Every blocking loop of the node thread checks this in order to leave the current session.
+     */
+    bool isStopRequested() const
+    {
+        return os::isRebootRequested() || restart_requested_;
+    }
+
+    /**
+     * Brings the node into the initial state, as if it has just been constructed.
+     * The transfer ID counters are retained, so that the other nodes do not see them reused.
+     */
+    void resetSession(const std::uint32_t can_bus_bit_rate,
+                      const std::uint8_t node_id,
+                      const std::uint8_t remote_server_node_id,
+                      const char* const remote_file_path)
+    {
+        can_bus_bit_rate_ = can_bus_bit_rate;
+        bit_rate_from_cache_ = false;
+        node_id_from_cache_ = false;
+        node_id_conflict_monitoring_ = false;
+        node_id_conflict_detected_ = false;
+        confirmed_local_node_id_ = 0;
+        init_done_ = false;
+
+        remote_server_node_id_ = 0;
+        firmware_file_path_.clear();
+        additional_server_node_ids_.fill(0);
+
+        if ((remote_server_node_id >= CANARD_MIN_NODE_ID) &&
+            (remote_server_node_id <= CANARD_MAX_NODE_ID))
+        {
+            remote_server_node_id_ = remote_server_node_id;
+            firmware_file_path_ = remote_file_path;
+        }
+
+        send_next_node_id_allocation_request_at_ = 0;
+        node_id_allocation_unique_id_offset_ = 0;
+
+        initCanard();
+
+        if ((node_id >= CANARD_MIN_NODE_ID) &&
+            (node_id <= CANARD_MAX_NODE_ID))
+        {
+            canardSetLocalNodeID(&canard_, node_id);
+        }
+    }
+
+    /**
+     * Resets the library state; this is also the only way to drop the local node ID.
+     */
+    void initCanard()
+    {
+        canardInit(&canard_,
+                   memory_pool_.data(),
+                   memory_pool_.size(),
+                   &UAVCANFirmwareUpdateNode::onTransferReceptionTrampoline,
+                   &UAVCANFirmwareUpdateNode::shouldAcceptTransferTrampoline,
+                   this);
+    }
+
 
     void delayAfterDriverError()
     {
@@ -353,10 +661,54 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
         }
         }
 
-        canardEncodeScalar(buffer,  0, 32, &uptime_sec);
-        canardEncodeScalar(buffer, 32,  2, &node_health);
-        canardEncodeScalar(buffer, 34,  3, &node_mode);
-        canardEncodeScalar(buffer, 40, 16, &vendor_specific_status_);
+        // The layout is byte-aligned except for health and mode, so the fields are stored directly (little endian)
+        buffer[0] = std::uint8_t(uptime_sec);
+        buffer[1] = std::uint8_t(uptime_sec >> 8);
+        buffer[2] = std::uint8_t(uptime_sec >> 16);
+        buffer[3] = std::uint8_t(uptime_sec >> 24);
+        buffer[4] = std::uint8_t((node_health << 6) | (node_mode << 3));
+        buffer[5] = std::uint8_t(vendor_specific_status_);
+        buffer[6] = std::uint8_t(vendor_specific_status_ >> 8);
+    }
+
+    /**
+     * Serializes the static part of the GetNodeInfo response, i.e. everything except the NodeStatus prefix.
+     * Someday this mess should be replaced with auto-generated message serialization code, like in libuavcan.
+     */
+    void updateNodeInfoResponse()
+    {
+        auto& buffer = node_info_response_;
+        buffer.fill(0);
+
+        // SoftwareVersion (query the bootloader)
+        const auto sw_success = bootloader_.getAppInfo();
+        if (sw_success.second)
+        {
+            const AppInfo sw = sw_success.first;
+            buffer[7] = sw.major_version;
+            buffer[8] = sw.minor_version;
+            buffer[9] = 3;                                              // Optional field flags
+            canardEncodeScalar(buffer.data(),  80, 32, &sw.vcs_commit);
+            canardEncodeScalar(buffer.data(), 112, 64, &sw.image_crc);
+        }
+
+        // HardwareVersion
+        buffer[22] = hw_info_.major;
+        buffer[23] = hw_info_.minor;
+        std::memmove(&buffer[24], hw_info_.unique_id.data(), hw_info_.unique_id.size());
+        buffer[40] = hw_info_.certificate_of_authenticity_length;
+        std::memmove(&buffer[41],
+                     hw_info_.certificate_of_authenticity.data(),
+                     hw_info_.certificate_of_authenticity_length);
+
+        // Name
+        std::memcpy(&buffer[41 + hw_info_.certificate_of_authenticity_length],
+                    node_name_.c_str(),
+                    node_name_.length());
+
+        const std::size_t total_size = 41 + hw_info_.certificate_of_authenticity_length + node_name_.length();
+        assert(total_size <= buffer.size());
+        node_info_response_size_ = std::uint16_t(total_size);
     }
 
     void sendNodeStatus()
@@ -416,8 +768,13 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
         const auto res = iface_.receive(timeout_msec);
         if (res.first < 0)
         {
+            statistics_.rx_driver_errors++;
             logger_.println("RX err %d", res.first);
         }
+        else if (res.first > 0)
+        {
+            statistics_.rx_frames++;
+        }
         return res;
     }
 
@@ -426,37 +783,150 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
         const int res = iface_.send(frame, timeout_msec);
         if (res < 0)
         {
+            statistics_.tx_driver_errors++;
             logger_.println("TX err %d", res);
         }
+        else if (res > 0)
+        {
+            statistics_.tx_frames++;
+        }
+        else
+        {
+            statistics_.tx_driver_queue_full++;
+        }
         return res;
     }
 
+    unsigned getTxQueueDepth() const
+    {
+        unsigned depth = 0;
+        for (const CanardTxQueueItem* item = canard_.tx_queue; item != nullptr; item = item->next)
+        {
+            depth++;
+        }
+        return depth;
+    }
+
+    void updateStatistics()
+    {
+        const auto pool = canardGetPoolAllocatorStatistics(&canard_);
+        statistics_.memory_pool_capacity_blocks   = pool.capacity_blocks;
+        statistics_.memory_pool_usage_blocks      = pool.current_usage_blocks;
+        statistics_.memory_pool_peak_usage_blocks = pool.peak_usage_blocks;
+
+        const int overruns = iface_.getRxOverflowCount();
+        if (overruns >= 0)
+        {
+            statistics_.rx_overruns = unsigned(overruns);
+        }
+    }
+
+    void sendStatistics()
+    {
+        const NodeStatistics& st = statistics_;
+        char buffer[91]{};
+        chsnprintf(&buffer[0], sizeof(buffer), "rx%u tx%u err%u/%u/%u ovr%u full%u q%u spin%u mem%u/%u/%u",
+                   unsigned(st.rx_frames), unsigned(st.tx_frames),
+                   unsigned(st.rx_driver_errors), unsigned(st.tx_driver_errors), unsigned(st.rx_transfer_errors),
+                   unsigned(st.rx_overruns), unsigned(st.tx_driver_queue_full),
+                   unsigned(st.tx_queue_depth_peak), unsigned(st.rx_frames_per_spin_peak),
+                   unsigned(st.memory_pool_usage_blocks), unsigned(st.memory_pool_peak_usage_blocks),
+                   unsigned(st.memory_pool_capacity_blocks));
+        sendLog(impl_::LogLevel::Debug, buffer);
+    }
+
     void handle1HzTasks()
     {
         canardCleanupStaleTransfers(&canard_, getMonotonicTimestampUSec());
 
+        updateStatistics();
+
+        if (init_done_ && bit_rate_from_cache_ && (iface_.getProtocolErrorCount() > 0))
+        {
+            invalidateCachedBitRate();
+        }
+
         // NodeStatus broadcasting
         if (init_done_ && (canardGetLocalNodeID(&canard_) > 0))
         {
             sendNodeStatus();
+
+            if (getMonotonicTimestampUSec() >= next_statistics_report_at_)
+            {
+                next_statistics_report_at_ =
+                    getMonotonicTimestampUSec() + impl_::StatisticsReportIntervalMillisecond * 1000ULL;
+                sendStatistics();
+            }
         }
     }
 
-    void poll()
+    /**
+     * Sleeps until there is work to do or the deadline is reached, then processes the queues.
+     * Returns after one iteration; the caller is expected to re-check its condition and invoke it again.
+     * The sleep duration is also limited by the 1 Hz task schedule and by @ref impl_::MaxBlockingWaitMillisecond.
+     */
+    void poll(const std::uint64_t deadline_usec = std::numeric_limits<std::uint64_t>::max())
     {
         constexpr int MaxFramesPerSpin = 10;
 
+        // Wait for work
+        {
+            unsigned event_mask = ICANIface::EventRxReady;
+            if (canardPeekTxQueue(&canard_) != nullptr)
+            {
+                event_mask |= ICANIface::EventTxReady;
+            }
+
+            const std::uint64_t ts = getMonotonicTimestampUSec();
+            const std::uint64_t wait_until = std::min(deadline_usec, next_1hz_task_invocation_);
+            const std::uint64_t timeout_msec = (wait_until > ts) ? ((wait_until - ts + 999U) / 1000U) : 0;
+
+            const int res = iface_.waitForEvent(event_mask,
+                                                int(std::min<std::uint64_t>(timeout_msec,
+                                                                            impl_::MaxBlockingWaitMillisecond)));
+            if (res < 0)
+            {
+                logger_.println("Wait err %d", res);    // Proceeding anyway, the queues will be checked below
+            }
+        }
+
         // Receive
-        for (int i = 0; i < MaxFramesPerSpin; i++)
+        int num_received = 0;
+        for (; num_received < MaxFramesPerSpin; num_received++)
         {
-            const auto res = receive(1);        // Blocking call
+            if ((iface_.waitForEvent(ICANIface::EventRxReady, 0) & int(ICANIface::EventRxReady)) == 0)
+            {
+                break;                          // RX queue is empty
+            }
+
+            const auto res = receive(1);        // Does not block unless the driver lacks event support
             if (res.first < 1)
             {
                 break;                          // Error or no frames
             }
 
-            canardHandleRxFrame(&canard_, &res.second, getMonotonicTimestampUSec());
+            // Source node ID is the same for all UAVCAN transfer types; our own frames are never received
+            if (node_id_conflict_monitoring_ &&
+                ((res.second.id & CANARD_MAX_NODE_ID) == canardGetLocalNodeID(&canard_)))
+            {
+                node_id_conflict_detected_ = true;
+            }
+
+            const int rx_res = canardHandleRxFrame(&canard_, &res.second, getMonotonicTimestampUSec());
+#if defined(CANARD_ERROR_RX_NOT_WANTED) && defined(CANARD_ERROR_RX_WRONG_ADDRESS)
+            if ((rx_res < 0) && (rx_res != -CANARD_ERROR_RX_NOT_WANTED) && (rx_res != -CANARD_ERROR_RX_WRONG_ADDRESS))
+#else
+            if (rx_res < 0)
+#endif
+            {
+                statistics_.rx_transfer_errors++;
+            }
         }
+        statistics_.rx_frames_per_spin_peak =
+            std::max(statistics_.rx_frames_per_spin_peak, std::uint16_t(num_received));
+
+        statistics_.tx_queue_depth_peak =
+            std::max(statistics_.tx_queue_depth_peak, std::uint16_t(std::min(getTxQueueDepth(), 0xFFFFU)));
 
         // Transmit
         for (int i = 0; i < MaxFramesPerSpin; i++)
@@ -484,8 +954,46 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
         }
     }
 
+    /**
+     * Listens to the bus in silent mode at the specified bit rate.
+     * Listening is aborted early if the driver reports protocol errors, which are added to the error counter.
+     * @retval      positive        A frame has been received, the bit rate is correct
+     * @retval      0               Nothing conclusive
+     * @retval      negative        Driver error
+     */
+    int probeCANBitRate(const std::uint32_t bitrate, const unsigned listen_msec, std::uint32_t& inout_num_errors)
+    {
+        using namespace impl_;
+
+        const int init_res = initCAN(bitrate, ICANIface::Mode::Silent);
+        if (init_res < 0)
+        {
+            return init_res;
+        }
+
+        for (unsigned elapsed = 0; elapsed < listen_msec; elapsed += BitRateDetectionListenSliceMillisecond)
+        {
+            const int res = receive(int(std::min(BitRateDetectionListenSliceMillisecond, listen_msec - elapsed))).first;
+            if (res != 0)
+            {
+                return res;
+            }
+
+            const int num_errors = iface_.getProtocolErrorCount();
+            if (num_errors > 0)
+            {
+                inout_num_errors += unsigned(num_errors);
+                break;                          // This bit rate is wrong, no point listening further
+            }
+        }
+
+        return 0;
+    }
+
     void performCANBitRateDetection()
     {
+        using namespace impl_;
+
         /// These are defined by the specification; 100 Kbps is added due to its popularity.
         static constexpr std::array<std::uint32_t, 5> StandardBitRates
         {
@@ -496,36 +1004,225 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
              100000         ///< Popular bit rate that is not defined by the specification
         };
 
-        int current_bit_rate_index = 0;
+        /*
+         * Indexes of the candidate bit rates ordered by likelihood, most likely first.
+         * Bit rates that cause protocol errors are moved towards the end of the list.
+         */
+        std::array<std::uint8_t, StandardBitRates.size()> candidates{};
+        std::iota(candidates.begin(), candidates.end(), 0);
+
+        std::array<std::uint32_t, StandardBitRates.size()> num_errors{};
 
-        // Loop forever until the bit rate is detected
-        while ((!os::isRebootRequested()) && (can_bus_bit_rate_ == 0))
+        const auto probe = [this](const std::uint32_t bitrate, const unsigned listen_msec, std::uint32_t& errors)
         {
             watchdog_.reset();
+            const int res = probeCANBitRate(bitrate, listen_msec, errors);
+            if (res > 0)
+            {
+                can_bus_bit_rate_ = bitrate;
+            }
+            if (res < 0)
+            {
+                delayAfterDriverError();
+            }
+            return isStopRequested() || (can_bus_bit_rate_ != 0);
+        };
 
-            const std::uint32_t br = StandardBitRates[current_bit_rate_index];
-            current_bit_rate_index = (current_bit_rate_index + 1) % StandardBitRates.size();
-
-            if (initCAN(br, ICANIface::Mode::Silent) >= 0)
+        // Loop forever until the bit rate is detected
+        while ((!isStopRequested()) && (can_bus_bit_rate_ == 0))
+        {
+            // Fast pass - detects the bit rate on a busy bus, collects error statistics otherwise
+            for (const auto index : candidates)
             {
-                const int res = receive(1100).first;
-                if (res > 0)
-                {
-                    can_bus_bit_rate_ = br;
-                }
-                if (res < 0)
+                if (probe(StandardBitRates[index], BitRateDetectionShortListenMillisecond, num_errors[index]))
                 {
-                    delayAfterDriverError();
+                    break;
                 }
             }
-            else
+
+            if (isStopRequested() || (can_bus_bit_rate_ != 0))
             {
-                delayAfterDriverError();
+                break;
             }
-        }
 
-        watchdog_.reset();
-    }
+            // The index is used as a tie breaker in order to keep the ordering stable
+            std::sort(candidates.begin(), candidates.end(), [&num_errors](std::uint8_t a, std::uint8_t b)
+                {
+                    return (num_errors[a] != num_errors[b]) ? (num_errors[a] < num_errors[b]) : (a < b);
+                });
+
+            // Slow pass - the fallback for quiet buses; the bit rates that caused errors are skipped if possible
+            const bool have_error_free_candidates = num_errors[candidates.front()] == 0;
+            for (const auto index : candidates)
+            {
+                if (have_error_free_candidates && (num_errors[index] > 0))
+                {
+                    break;                      // The list is sorted, all remaining candidates are erroneous
+                }
+
+                if (probe(StandardBitRates[index], BitRateDetectionLongListenMillisecond, num_errors[index]))
+                {
+                    break;
+                }
+            }
+
+            // The errors could have been caused by noise, so the collected evidence is not carried over
+            num_errors.fill(0);
+        }
+
+        watchdog_.reset();
+    }
+
+    /**
+     * Listens to the bus in silent mode in order to check whether the cached parameters are still valid.
+     * The bit rate is confirmed only if a frame is received; the absence of errors on a quiet bus proves nothing.
+     * @return First component - true if the bit rate is confirmed,
+     *         second component - true if the node ID is not used by other nodes.
+     */
+    std::pair<bool, bool> verifyCachedNetworkParameters(const CachedNetworkParameters& params)
+    {
+        using namespace impl_;
+
+        watchdog_.reset();
+
+        if (initCAN(params.can_bus_bit_rate, ICANIface::Mode::Silent) < 0)
+        {
+            return {false, false};
+        }
+
+        bool frame_received = false;
+        bool node_id_conflict = false;
+
+        const std::uint64_t deadline =
+            getMonotonicTimestampUSec() + CachedNetworkParametersVerificationMillisecond * 1000U;
+
+        while (getMonotonicTimestampUSec() < deadline)
+        {
+            const auto res = receive(int(BitRateDetectionListenSliceMillisecond));
+            if (res.first < 0)
+            {
+                return {false, false};
+            }
+
+            if (iface_.getProtocolErrorCount() > 0)
+            {
+                return {false, false};
+            }
+
+            if (res.first > 0)
+            {
+                frame_received = true;
+                // Source node ID is the same for all UAVCAN transfer types; it is zero for anonymous frames
+                if ((params.node_id != 0) && ((res.second.id & CANARD_MAX_NODE_ID) == params.node_id))
+                {
+                    node_id_conflict = true;
+                    break;
+                }
+            }
+        }
+
+        return {frame_received, frame_received && !node_id_conflict};
+    }
+
+    /**
+     * Takes the parameters from the cache unless they have been provided explicitly.
+     * Returns the cached parameters in order to detect changes later.
+     */
+    CachedNetworkParameters restoreCachedNetworkParameters()
+    {
+        if ((network_parameters_cache_ == nullptr) || (can_bus_bit_rate_ != 0))
+        {
+            return {};
+        }
+
+        const auto cached = network_parameters_cache_->load();
+        if ((!cached) || (cached->can_bus_bit_rate == 0))
+        {
+            return {};
+        }
+
+        const auto result = verifyCachedNetworkParameters(*cached);
+        if (result.first)
+        {
+            can_bus_bit_rate_ = cached->can_bus_bit_rate;
+            bit_rate_from_cache_ = true;
+
+            if (result.second &&
+                (canardGetLocalNodeID(&canard_) == 0) &&
+                (cached->node_id >= CANARD_MIN_NODE_ID) &&
+                (cached->node_id <= CANARD_MAX_NODE_ID))
+            {
+                canardSetLocalNodeID(&canard_, cached->node_id);
+                node_id_from_cache_ = true;
+            }
+        }
+
+        return *cached;
+    }
+
+    /**
+     * Invoked once if the bit rate taken from the cache turns out to be wrong after the node has gone online.
+     * The node ID is retained; it will be verified again at the next start.
+     */
+    void invalidateCachedBitRate()
+    {
+        bit_rate_from_cache_ = false;
+        logger_.puts("Cached bit rate invalidated");
+
+        if (network_parameters_cache_ != nullptr)
+        {
+            CachedNetworkParameters params;
+            params.node_id = confirmed_local_node_id_;
+            network_parameters_cache_->store(params);
+        }
+    }
+
+    /**
+     * Goes online with the node ID taken from the cache and listens to all messages for one NodeStatus period.
+     * The frames are processed as usual meanwhile.
+     * @return True if no other node has been seen using the same node ID.
+     */
+    bool verifyCachedNodeIDOnline()
+    {
+        using namespace impl_;
+
+        initCANForNormalOperation(true);
+
+        node_id_conflict_detected_ = false;
+        node_id_conflict_monitoring_ = true;
+
+        sendNodeStatus();
+
+        const std::uint64_t deadline = getMonotonicTimestampUSec() + CachedNodeIDMonitoringMillisecond * 1000U;
+        while ((!isStopRequested()) && (!node_id_conflict_detected_) && (getMonotonicTimestampUSec() < deadline))
+        {
+            watchdog_.reset();
+            poll(deadline);
+        }
+
+        node_id_conflict_monitoring_ = false;
+        node_id_from_cache_ = false;
+        return !node_id_conflict_detected_;
+    }
+
+    /**
+     * Invoked if another node is using the node ID taken from the cache.
+     * The node goes offline; the cache is updated so that the node ID is not used again after a restart.
+     */
+    void dropCachedNodeID()
+    {
+        logger_.println("NID %u conflict, cached NID dropped", unsigned(canardGetLocalNodeID(&canard_)));
+
+        initCanard();
+        confirmed_local_node_id_ = 0;
+
+        if (network_parameters_cache_ != nullptr)
+        {
+            CachedNetworkParameters params;
+            params.can_bus_bit_rate = can_bus_bit_rate_;
+            network_parameters_cache_->store(params);
+        }
+    }
 
     void performDynamicNodeIDAllocation()
     {
@@ -549,7 +1246,7 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
 
         using namespace impl_;
 
-        while ((!os::isRebootRequested()) && (canardGetLocalNodeID(&canard_) == 0))
+        while ((!isStopRequested()) && (canardGetLocalNodeID(&canard_) == 0))
         {
             watchdog_.reset();
 
@@ -559,7 +1256,7 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
             while ((getMonotonicTimestampUSec() < send_next_node_id_allocation_request_at_) &&
                    (canardGetLocalNodeID(&canard_) == 0))
             {
-                poll();
+                poll(send_next_node_id_allocation_request_at_);
             }
 
             if (canardGetLocalNodeID(&canard_) != 0)
@@ -611,9 +1308,17 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
         watchdog_.reset();
     }
 
-    void main() override
+    /**
+     * Runs the node until a reboot or a restart is requested.
+     */
+    void runSession()
     {
-        this->setName("btlduavcan");
+        updateNodeInfoResponse();
+
+        /*
+         * Fast start using the cached parameters, if available
+         */
+        const CachedNetworkParameters cached_network_parameters = restoreCachedNetworkParameters();
 
         /*
          * CAN bit rate
@@ -625,239 +1330,669 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
             performCANBitRateDetection();
         }
 
-        if (os::isRebootRequested())
+        if (isStopRequested())
         {
             return;
         }
 
         /*
-         * Node ID
+         * Node ID; the one taken from the cache is verified online and replaced if another node is using it
          */
-        watchdog_.reset();
-
-        if (canardGetLocalNodeID(&canard_) == 0)
+        while (true)
         {
-            performDynamicNodeIDAllocation();
+            watchdog_.reset();
+
+            if (canardGetLocalNodeID(&canard_) == 0)
+            {
+                performDynamicNodeIDAllocation();
+            }
+
+            if (isStopRequested())
+            {
+                return;
+            }
+
+            confirmed_local_node_id_ = canardGetLocalNodeID(&canard_);
+
+            if ((!node_id_from_cache_) || verifyCachedNodeIDOnline())
+            {
+                break;
+            }
+
+            if (isStopRequested())
+            {
+                return;
+            }
+
+            dropCachedNodeID();
         }
 
-        if (os::isRebootRequested())
+        if ((network_parameters_cache_ != nullptr) &&
+            ((cached_network_parameters.can_bus_bit_rate != can_bus_bit_rate_) ||
+             (cached_network_parameters.node_id != confirmed_local_node_id_)))
         {
-            return;
+            CachedNetworkParameters params;
+            params.can_bus_bit_rate = can_bus_bit_rate_;
+            params.node_id = confirmed_local_node_id_;
+            network_parameters_cache_->store(params);
         }
 
-        confirmed_local_node_id_ = canardGetLocalNodeID(&canard_);
-
         // This is the only info message we output during initialization.
         // Fewer messages reduce the chances of breaking UART CLI data flow.
         logger_.println("CAN %u bps, NID %u", unsigned(can_bus_bit_rate_), confirmed_local_node_id_);
 
         using namespace impl_;
 
-        /*
-         * Init CAN in proper mode now
-         */
-        watchdog_.reset();
+        /*
+         * Init CAN in proper mode now
+         */
+        initCANForNormalOperation(false);
+
+        init_done_ = true;
+
+        /*
+         * Update loop; run forever because there's nothing else to do
+         */
+        while (!isStopRequested())
+        {
+            assert((confirmed_local_node_id_ > 0) && (canardGetLocalNodeID(&canard_) > 0));
+
+            watchdog_.reset();
+
+            /*
+             * Waiting for the firmware update request
+             */
+            if (remote_server_node_id_ == 0)
+            {
+                while ((!isStopRequested()) && (remote_server_node_id_ == 0))
+                {
+                    watchdog_.reset();
+                    poll();
+                }
+            }
+
+            if (isStopRequested())
+            {
+                break;
+            }
+
+            logger_.println("FW server NID %u path %s",
+                            unsigned(remote_server_node_id_), firmware_file_path_.c_str());
+
+            /*
+             * Rewriting the old firmware with the new file
+             */
+            watchdog_.reset();
+            const int result = bootloader_.upgradeApp(*this);
+            watchdog_.reset();
+
+            updateNodeInfoResponse();   // The application info may have changed, even if the upgrade has failed
+
+            sendNodeStatus();   // Announcing the new status of the bootloader ASAP
+
+            if (result >= 0)
+            {
+                vendor_specific_status_ = 0;
+                if (bootloader_.getState() == State::NoAppToBoot)
+                {
+                    sendLog(LogLevel::Error, "Downloaded image is invalid");
+                }
+                else
+                {
+                    sendLog(LogLevel::Info, "OK");
+                }
+            }
+            else
+            {
+                vendor_specific_status_ = std::abs(result);
+                sendLog(LogLevel::Error,
+                        senoval::String<90>("Upgrade error ") + senoval::convertIntToString(result));
+            }
+
+            /*
+             * Reset everything to zero and loop again, because there's nothing else to do.
+             * The outer logic will request reboot if necessary.
+             */
+            remote_server_node_id_ = 0;
+            firmware_file_path_.clear();
+            additional_server_node_ids_.fill(0);
+        }
+    }
+
+    void main() override
+    {
+        this->setName("btlduavcan");
+
+        while (true)
+        {
+            runSession();
+
+            if (os::isRebootRequested() || !restart_requested_)
+            {
+                break;
+            }
+
+            resetSession(restart_can_bus_bit_rate_, restart_node_id_, 0, "");
+            restart_requested_ = false;
+            logger_.puts("Restart");
+        }
+
+        logger_.puts("Exit");
+        watchdog_.reset();
+    }
+
+    /**
+     * Initializes the CAN controller in normal mode, retrying until success.
+     * Only correctly addressed service requests and responses are accepted, because message transfers are
+     * not needed anymore, except for the multicast firmware stream.
+     */
+    void initCANForNormalOperation(const bool accept_messages)
+    {
+        watchdog_.reset();
+
+        while (true)
+        {
+            ICANIface::AcceptanceFilterConfig filt;
+            if (accept_messages)
+            {
+                filt.id   = CANARD_CAN_FRAME_EFF;
+                filt.mask = CANARD_CAN_FRAME_EFF | CANARD_CAN_FRAME_RTR | CANARD_CAN_FRAME_ERR;
+            }
+            else
+            {
+                filt.id   = 0b00000000000000000000010000000 | (confirmed_local_node_id_ << 8) | CANARD_CAN_FRAME_EFF;
+                filt.mask = 0b00000000000000111111110000000 |
+                    CANARD_CAN_FRAME_EFF | CANARD_CAN_FRAME_RTR | CANARD_CAN_FRAME_ERR;
+            }
+
+            if (initCAN(can_bus_bit_rate_, ICANIface::Mode::Normal, filt) >= 0)
+            {
+                break;
+            }
+
+            delayAfterDriverError();
+        }
+    }
+
+    void reportDownloadProgress(const std::uint64_t offset, std::uint64_t& inout_deadline)
+    {
+        if (getMonotonicTimestampUSec() > inout_deadline)
+        {
+            inout_deadline += impl_::ProgressReportIntervalMillisecond * 1000;
+            sendLog(impl_::LogLevel::Info, senoval::convertIntToString(offset) + senoval::String<90>("B down..."));
+        }
+    }
+
+    void sendMulticastChunkRequest(const std::uint64_t offset)
+    {
+        using impl_::dsdl::MulticastChunkRequest;
+
+        std::uint8_t buffer[MulticastChunkRequest::MaxSizeBytes]{};
+        canardEncodeScalar(buffer,  0, 32, &multicast_stream_id_);
+        canardEncodeScalar(buffer, 32, 40, &offset);
+        std::copy(firmware_file_path_.begin(), firmware_file_path_.end(), &buffer[9]);
+
+        const int res = canardBroadcast(&canard_,
+                                        MulticastChunkRequest::DataTypeSignature,
+                                        MulticastChunkRequest::DataTypeID,
+                                        &multicast_request_transfer_id_,
+                                        CANARD_TRANSFER_PRIORITY_LOW,
+                                        buffer,
+                                        std::uint16_t(firmware_file_path_.size() + 9));
+        if (res < 0)
+        {
+            logger_.println("MC req err %d", res);
+        }
+    }
+
+    /**
+     * Receives the image from the multicast stream, which allows the server to update many nodes at once.
+     * The server broadcasts the chunks in order; a node that has missed a chunk requests the data starting from
+     * the missing offset, and the server rewinds the stream accordingly. Chunks are delivered to the sink in order.
+     * @retval 0                the stream has ended, the download is complete
+     * @retval -ErrTimeout      the server does not support multicast or the stream has stalled; the caller
+     *                          should continue with unicast reads from the returned offset
+     * @retval negative         other error
+     */
+    int downloadMulticast(IDownloadStreamSink& sink, std::uint64_t& inout_offset)
+    {
+        using namespace impl_;
+
+        {
+            CRC64WE crc;
+            crc.add(firmware_file_path_.c_str(), unsigned(firmware_file_path_.size()));
+            multicast_stream_id_ = std::uint32_t(crc.get());
+        }
+
+        multicast_expected_offset_ = inout_offset;
+        multicast_gap_detected_ = false;
+        multicast_foreign_request_at_ = 0;
+        read_result_ = std::numeric_limits<int>::max();
+
+        std::uint64_t next_progress_report_deadline = getMonotonicTimestampUSec();
+        std::uint64_t next_request_at = getMonotonicTimestampUSec();
+        std::uint64_t stall_deadline = getMonotonicTimestampUSec() + MulticastProbeTimeoutMillisecond * 1000U;
+
+        while (true)
+        {
+            watchdog_.reset();
+
+            if (isStopRequested())
+            {
+                return -ErrInterrupted;
+            }
+
+            // If another node has recently requested our data, the server is already rewinding the stream for us
+            const std::uint64_t suppressed_until = (multicast_foreign_request_at_ > 0) ?
+                (multicast_foreign_request_at_ + MulticastRequestIntervalMillisecond * 1000U) : 0U;
+            const bool suppressed = getMonotonicTimestampUSec() < suppressed_until;
+
+            if (multicast_gap_detected_)
+            {
+                multicast_gap_detected_ = false;
+                if (!suppressed)
+                {
+                    const std::uint64_t delay =
+                        getRandomDurationMicrosecond(0, MulticastRequestMaxDelayMillisecond * 1000U);
+                    next_request_at = std::min(next_request_at, getMonotonicTimestampUSec() + delay);
+                }
+            }
+
+            if (suppressed)
+            {
+                next_request_at = std::max(next_request_at, suppressed_until);
+            }
+
+            if (getMonotonicTimestampUSec() >= next_request_at)
+            {
+                sendMulticastChunkRequest(inout_offset);
+                next_request_at = getMonotonicTimestampUSec() + MulticastRequestIntervalMillisecond * 1000U;
+            }
+
+            poll(std::min(next_request_at, stall_deadline));
+
+            if (read_result_ == std::numeric_limits<int>::max())
+            {
+                if (getMonotonicTimestampUSec() > stall_deadline)
+                {
+                    logger_.println("MC stalled at %u", unsigned(inout_offset));
+                    return -ErrTimeout;
+                }
+                continue;
+            }
+
+            watchdog_.reset();
 
-        while (true)
-        {
-            // Accept only correctly addressed service requests and responses
-            // We don't need message transfers anymore
-            ICANIface::AcceptanceFilterConfig filt;
-            filt.id   = 0b00000000000000000000010000000 | (confirmed_local_node_id_ << 8) | CANARD_CAN_FRAME_EFF;
-            filt.mask = 0b00000000000000111111110000000 |
-                CANARD_CAN_FRAME_EFF | CANARD_CAN_FRAME_RTR | CANARD_CAN_FRAME_ERR;
+            if (read_result_ == 0)
+            {
+                return 0;       // Done
+            }
 
-            if (initCAN(can_bus_bit_rate_, ICANIface::Mode::Normal, filt) >= 0)
+            const int res = sink.handleNextDataChunk(read_buffer_.data(), read_result_);
+            if (res < 0)
             {
-                break;
+                return res;
             }
 
-            delayAfterDriverError();
+            inout_offset += read_result_;
+            multicast_expected_offset_ = inout_offset;
+            read_result_ = std::numeric_limits<int>::max();
+
+            stall_deadline = getMonotonicTimestampUSec() + MulticastStallTimeoutMillisecond * 1000U;
+            next_request_at = getMonotonicTimestampUSec() + MulticastRequestIntervalMillisecond * 1000U;
+
+            reportDownloadProgress(inout_offset, next_progress_report_deadline);
         }
+    }
 
-        init_done_ = true;
+    int download(IDownloadStreamSink& sink) override
+    {
+        using namespace impl_;
+
+        std::uint64_t offset = 0;
+
+        sendNodeStatus();       // Announcing the new state of the bootloader ASAP
 
         /*
-         * Update loop; run forever because there's nothing else to do
+         * Try the multicast stream first; fall back to unicast reads if the server does not support it.
+         * Message transfers are normally filtered out, so the CAN controller is reconfigured for the duration.
          */
-        while (!os::isRebootRequested())
         {
-            assert((confirmed_local_node_id_ > 0) && (canardGetLocalNodeID(&canard_) > 0));
+            multicast_active_ = true;
+            initCANForNormalOperation(true);
 
-            watchdog_.reset();
+            const int res = downloadMulticast(sink, offset);
 
-            /*
-             * Waiting for the firmware update request
-             */
-            if (remote_server_node_id_ == 0)
-            {
-                while ((!os::isRebootRequested()) && (remote_server_node_id_ == 0))
-                {
-                    watchdog_.reset();
-                    poll();
-                }
-            }
+            multicast_active_ = false;
+            initCANForNormalOperation(false);
 
-            if (os::isRebootRequested())
+            if (res != -ErrTimeout)
             {
-                break;
+                return res;
             }
+        }
 
-            logger_.println("FW server NID %u path %s",
-                            unsigned(remote_server_node_id_), firmware_file_path_.c_str());
-
-            /*
-             * Rewriting the old firmware with the new file
-             */
-            watchdog_.reset();
-            const int result = bootloader_.upgradeApp(*this);
-            watchdog_.reset();
+        return downloadUnicast(sink, offset);
+    }
 
-            sendNodeStatus();   // Announcing the new status of the bootloader ASAP
+    bool isFileServerKnown(const std::uint8_t node_id) const
+    {
+        return (node_id == remote_server_node_id_) ||
+               (std::find(additional_server_node_ids_.begin(), additional_server_node_ids_.end(), node_id) !=
+                additional_server_node_ids_.end());
+    }
 
-            if (result >= 0)
+    /**
+     * Assigns a read slot to every known file server that does not have one yet.
+     * Servers can be added while the download is in progress.
+     */
+    void assignFileReadSlots()
+    {
+        const auto assign = [this](const std::uint8_t node_id)
+        {
+            if (node_id == 0)
             {
-                vendor_specific_status_ = 0;
-                if (bootloader_.getState() == State::NoAppToBoot)
+                return;
+            }
+            for (auto& x : file_read_slots_)
+            {
+                if (x.server_node_id == node_id)
                 {
-                    sendLog(LogLevel::Error, "Downloaded image is invalid");
+                    return;
                 }
-                else
+            }
+            for (auto& x : file_read_slots_)
+            {
+                if (x.server_node_id == 0)
                 {
-                    sendLog(LogLevel::Info, "OK");
+                    x = FileReadSlot();
+                    x.server_node_id = node_id;
+                    x.deadline = getMonotonicTimestampUSec();
+                    return;
                 }
             }
-            else
+        };
+
+        assign(remote_server_node_id_);
+        for (auto x : additional_server_node_ids_)
+        {
+            assign(x);
+        }
+    }
+
+    /**
+     * Removes the server from the set, so that its stripes will be fetched from the other servers.
+     */
+    void dropFileServer(FileReadSlot& slot)
+    {
+        logger_.println("FW server %u dropped", unsigned(slot.server_node_id));
+
+        if (remote_server_node_id_ == slot.server_node_id)
+        {
+            remote_server_node_id_ = 0;         // The file path is retained, it identifies the download
+        }
+        for (auto& x : additional_server_node_ids_)
+        {
+            if (x == slot.server_node_id)
             {
-                vendor_specific_status_ = std::abs(result);
-                sendLog(LogLevel::Error,
-                        senoval::String<90>("Upgrade error ") + senoval::convertIntToString(result));
+                x = 0;
             }
+        }
 
-            /*
-             * Reset everything to zero and loop again, because there's nothing else to do.
-             * The outer logic will request reboot if necessary.
-             */
-            remote_server_node_id_ = 0;
-            firmware_file_path_.clear();
+        slot = FileReadSlot();
+    }
+
+    /**
+     * Returns the lowest offset that is not being fetched or buffered by any slot.
+     */
+    std::uint64_t findNextStripeOffset(const std::uint64_t delivered_offset) const
+    {
+        std::uint64_t offset = delivered_offset;
+        while (std::any_of(file_read_slots_.begin(), file_read_slots_.end(), [offset](const FileReadSlot& x)
+            {
+                return (x.server_node_id != 0) && (x.state != FileReadSlot::State::Idle) && (x.offset == offset);
+            }))
+        {
+            offset += FileReadChunkSize;
         }
+        return offset;
+    }
 
-        logger_.puts("Exit");
-        watchdog_.reset();
+    /**
+     * Delay between consecutive requests to the same server, in order to avoid bus congestion.
+     * The magic shift ensures that the relative bus utilization does not depend on the bit rate.
+     */
+    std::uint64_t getFileReadIntervalUSec() const
+    {
+        return 1000000UL / (1UL + (can_bus_bit_rate_ >> 16));
     }
 
-    int download(IDownloadStreamSink& sink) override
+    int sendFileReadRequest(FileReadSlot& slot)
+    {
+        using namespace impl_;
+
+        std::uint8_t buffer[dsdl::FileRead::MaxSizeBytesRequest]{};
+        canardEncodeScalar(buffer, 0, 40, &slot.offset);
+        std::copy(firmware_file_path_.begin(), firmware_file_path_.end(), &buffer[5]);
+
+        const int res = canardRequestOrRespond(&canard_,
+                                               slot.server_node_id,
+                                               dsdl::FileRead::DataTypeSignature,
+                                               dsdl::FileRead::DataTypeID,
+                                               &file_read_transfer_ids_[slot.server_node_id],
+                                               CANARD_TRANSFER_PRIORITY_LOW,
+                                               CanardRequest,
+                                               buffer,
+                                               firmware_file_path_.size() + 5);
+        if (res < 0)
+        {
+            logger_.println("File req err %d", res);
+        }
+        return res;
+    }
+
+    /**
+     * Fetches the image using regular file read requests, from all known servers concurrently.
+     * A request that has timed out is retried with backoff. If a server keeps timing out or reports an error,
+     * it is dropped and its stripes are fetched from the others. If no servers are left, the download waits
+     * for a server to resume it, see FileReadResumeTimeoutMillisecond.
+     * The end of file is reached when the server returns an empty response at the delivered offset.
+     * A short (incomplete) response is handled correctly: the stripes beyond it are discarded and re-requested.
+     */
+    int downloadUnicast(IDownloadStreamSink& sink, std::uint64_t offset)
     {
         using namespace impl_;
 
-        std::uint64_t offset = 0;
         std::uint64_t next_progress_report_deadline = getMonotonicTimestampUSec();
+        std::uint64_t end_offset = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t resume_deadline = 0;
+        int last_error = -ErrTimeout;
 
-        sendNodeStatus();       // Announcing the new state of the bootloader ASAP
+        for (auto& x : file_read_slots_)
+        {
+            x = FileReadSlot();
+        }
 
         while (true)
         {
             watchdog_.reset();
 
-            if (os::isRebootRequested())
+            if (isStopRequested())
             {
                 return -ErrInterrupted;
             }
 
+            assignFileReadSlots();
+
             /*
-             * Send request
+             * Send requests and handle timeouts.
+             * The watchdog is not reset while waiting, since its timeout is large enough to wait for response.
              */
+            for (auto& slot : file_read_slots_)
             {
-                std::uint8_t buffer[dsdl::FileRead::MaxSizeBytesRequest]{};
-                canardEncodeScalar(buffer, 0, 40, &offset);
-                std::copy(firmware_file_path_.begin(), firmware_file_path_.end(), &buffer[5]);
-
-                const int res = canardRequestOrRespond(&canard_,
-                                                       remote_server_node_id_,
-                                                       dsdl::FileRead::DataTypeSignature,
-                                                       dsdl::FileRead::DataTypeID,
-                                                       &file_read_transfer_id_,
-                                                       CANARD_TRANSFER_PRIORITY_LOW,
-                                                       CanardRequest,
-                                                       buffer,
-                                                       firmware_file_path_.size() + 5);
-                if (res < 0)
+                if (slot.server_node_id == 0)
+                {
+                    continue;
+                }
+
+                if ((slot.state == FileReadSlot::State::Pending) &&
+                    (getMonotonicTimestampUSec() > slot.deadline))
+                {
+                    slot.num_failed_attempts++;
+                    if (slot.num_failed_attempts >= FileReadMaxAttempts)
+                    {
+                        last_error = -ErrTimeout;
+                        dropFileServer(slot);
+                        continue;
+                    }
+
+                    // The stripe is uncovered now, so the retry will likely be assigned the same offset
+                    const unsigned backoff_msec = FileReadRetryBackoffMillisecond << (slot.num_failed_attempts - 1U);
+                    logger_.println("FW read timeout %u/%u, retry in %u ms",
+                                    unsigned(slot.num_failed_attempts), FileReadMaxAttempts, backoff_msec);
+                    slot.state = FileReadSlot::State::Idle;
+                    slot.deadline = getMonotonicTimestampUSec() + backoff_msec * 1000U;
+                }
+
+                if ((slot.state == FileReadSlot::State::Idle) &&
+                    (getMonotonicTimestampUSec() >= slot.deadline))
                 {
-                    logger_.println("File req err %d", res);
-                    return res;
+                    slot.offset = findNextStripeOffset(offset);
+                    if (slot.offset >= end_offset)
+                    {
+                        slot.deadline = getMonotonicTimestampUSec() + getFileReadIntervalUSec();
+                        continue;                       // Everything is requested already, check again later
+                    }
+
+                    const int res = sendFileReadRequest(slot);
+                    if (res < 0)
+                    {
+                        return res;
+                    }
+
+                    slot.state = FileReadSlot::State::Pending;
+                    slot.deadline = getMonotonicTimestampUSec() + ServiceRequestTimeoutMillisecond * 1000;
                 }
             }
 
             /*
-             * Await response.
-             * Note that the watchdog is not reset in the loop, since its timeout is large enough to wait for response.
+             * Process the responses in order.
+             * Observe that we don't constrain the maximum image size - either the bootloader
+             * or the storage backend will return error if we exceed it.
              */
-            const std::uint64_t response_deadline =
-                getMonotonicTimestampUSec() + ServiceRequestTimeoutMillisecond * 1000;
+            bool delivered = true;
+            while (delivered)
+            {
+                delivered = false;
+                for (auto& slot : file_read_slots_)
+                {
+                    if ((slot.server_node_id == 0) || (slot.state != FileReadSlot::State::Ready))
+                    {
+                        continue;
+                    }
+
+                    if (slot.result < 0)
+                    {
+                        last_error = slot.result;
+                        dropFileServer(slot);
+                        continue;
+                    }
+
+                    if (slot.result == 0)
+                    {
+                        end_offset = std::min(end_offset, slot.offset);
+                    }
+
+                    // Stale stripes left over after a short response are discarded
+                    if ((slot.offset < offset) || (((slot.offset - offset) % FileReadChunkSize) != 0))
+                    {
+                        slot.state = FileReadSlot::State::Idle;
+                        continue;
+                    }
+
+                    if (slot.offset != offset)
+                    {
+                        continue;                       // Not yet, waiting for the preceding stripes
+                    }
+
+                    if (slot.result == 0)
+                    {
+                        watchdog_.reset();
+                        return 0;                       // Done
+                    }
+
+                    const int res = sink.handleNextDataChunk(slot.buffer.data(), unsigned(slot.result));
+                    watchdog_.reset();
+                    if (res < 0)
+                    {
+                        return res;
+                    }
 
-            read_result_ = std::numeric_limits<int>::max();
+                    offset += unsigned(slot.result);
+                    delivered = true;
 
-            while (read_result_ == std::numeric_limits<int>::max())
-            {
-                poll();
+                    slot.state = FileReadSlot::State::Idle;
+                    slot.deadline = getMonotonicTimestampUSec() + getFileReadIntervalUSec();
+                }
+            }
 
-                if (getMonotonicTimestampUSec() > response_deadline)
+            if (std::none_of(file_read_slots_.begin(), file_read_slots_.end(),
+                             [](const FileReadSlot& x) { return x.server_node_id != 0; }))
+            {
+                if (resume_deadline == 0)
                 {
-                    return -ErrTimeout;
+                    logger_.println("All FW servers lost at %u, waiting for resume", unsigned(offset));
+                    sendLog(LogLevel::Warning, senoval::convertIntToString(offset) + senoval::String<90>("B, stalled"));
+                    resume_deadline = getMonotonicTimestampUSec() + FileReadResumeTimeoutMillisecond * 1000U;
+                }
+                else if (getMonotonicTimestampUSec() > resume_deadline)
+                {
+                    return last_error;                  // Nobody came back
                 }
-            }
 
-            watchdog_.reset();
+                poll(resume_deadline);
+                continue;
+            }
 
-            if (read_result_ < 0)
+            if (resume_deadline != 0)
             {
-                return read_result_;
+                logger_.println("FW download resumed at %u", unsigned(offset));
+                resume_deadline = 0;
             }
 
             /*
-             * Process the response.
-             * Observe that we don't constrain the maximum image size - either the bootloader
-             * or the storage backend will return error if we exceed it.
+             * If the server that was fetching the next stripe was dropped while the remaining servers are holding
+             * the stripes that follow it, nobody is left to fetch it. The buffered stripes are discarded then.
              */
-            if (read_result_ > 0)
+            if (std::none_of(file_read_slots_.begin(), file_read_slots_.end(), [](const FileReadSlot& x)
+                {
+                    return (x.server_node_id != 0) && (x.state != FileReadSlot::State::Ready);
+                }))
             {
-                offset += read_result_;
-
-                const int res = sink.handleNextDataChunk(read_buffer_.data(), read_result_);
-                if (res < 0)
+                for (auto& slot : file_read_slots_)
                 {
-                    watchdog_.reset();
-                    return res;
+                    slot.state = FileReadSlot::State::Idle;
+                    slot.deadline = getMonotonicTimestampUSec();
                 }
             }
-            else
-            {
-                watchdog_.reset();
-                return 0;       // Done
-            }
 
             /*
              * Send a progress report if time is up
              */
-            if (getMonotonicTimestampUSec() > next_progress_report_deadline)
-            {
-                next_progress_report_deadline += ProgressReportIntervalMillisecond * 1000;
-                sendLog(LogLevel::Info, senoval::convertIntToString(offset) + senoval::String<90>("B down..."));
-            }
+            reportDownloadProgress(offset, next_progress_report_deadline);
 
             /*
-             * Wait in order to avoid bus congestion
-             * The magic shift ensures that the relative bus utilization does not depend on the bit rate.
+             * Sleep until the next deadline or response
              */
-            watchdog_.reset();
-
-            const std::uint64_t wait_deadline =
-                getMonotonicTimestampUSec() + 1000000UL / (1UL + (can_bus_bit_rate_ >> 16));
-
-            while (getMonotonicTimestampUSec() < wait_deadline)
+            std::uint64_t deadline = std::numeric_limits<std::uint64_t>::max();
+            for (auto& slot : file_read_slots_)
             {
-                poll();
+                if ((slot.server_node_id != 0) && (slot.state != FileReadSlot::State::Ready))
+                {
+                    deadline = std::min(deadline, slot.deadline);
+                }
             }
+            poll(deadline);
         }
 
         assert(false);  // Should never get here
@@ -927,44 +2062,12 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
 
         /*
          * GetNodeInfo request.
-         * Someday this mess should be replaced with auto-generated message serialization code, like in libuavcan.
          */
         if ((transfer->transfer_type == CanardTransferTypeRequest) &&
             (transfer->data_type_id == dsdl::GetNodeInfo::DataTypeID))
         {
-            std::uint8_t buffer[dsdl::GetNodeInfo::MaxSizeBytesResponse]{};
-
-            // NodeStatus
-            makeNodeStatusMessage(buffer);
-
-            // SoftwareVersion (query the bootloader)
-            const auto sw_success = bootloader_.getAppInfo();
-            if (sw_success.second)
-            {
-                const AppInfo sw = sw_success.first;
-                buffer[7] = sw.major_version;
-                buffer[8] = sw.minor_version;
-                buffer[9] = 3;                                              // Optional field flags
-                canardEncodeScalar(buffer,  80, 32, &sw.vcs_commit);
-                canardEncodeScalar(buffer, 112, 64, &sw.image_crc);
-            }
-
-            // HardwareVersion
-            buffer[22] = hw_info_.major;
-            buffer[23] = hw_info_.minor;
-            std::memmove(&buffer[24], hw_info_.unique_id.data(), hw_info_.unique_id.size());
-            buffer[40] = hw_info_.certificate_of_authenticity_length;
-            std::memmove(&buffer[41],
-                         hw_info_.certificate_of_authenticity.data(),
-                         hw_info_.certificate_of_authenticity_length);
-
-            // Name
-            std::memcpy(&buffer[41 + hw_info_.certificate_of_authenticity_length],
-                        node_name_.c_str(),
-                        node_name_.length());
-
-            const std::size_t total_size = 41 + hw_info_.certificate_of_authenticity_length + node_name_.length();
-            assert(total_size <= dsdl::GetNodeInfo::MaxSizeBytesResponse);
+            // Only the NodeStatus prefix changes between requests; the rest is serialized in advance
+            makeNodeStatusMessage(node_info_response_.data());
 
             // No need to release the transfer payload, it's empty
             const int resp_res = canardRequestOrRespond(&canard_,
@@ -974,8 +2077,8 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
                                                         &transfer->transfer_id,
                                                         transfer->priority,
                                                         CanardResponse,
-                                                        &buffer[0],
-                                                        std::uint16_t(total_size));
+                                                        node_info_response_.data(),
+                                                        node_info_response_size_);
             if (resp_res <= 0)
             {
                 logger_.println("GetNodeInfo resp err %d", resp_res);
@@ -1021,9 +2124,56 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
             const auto bl_state = bootloader_.getState();
             std::uint8_t error = 0;
 
+            // Determine the node ID of the firmware server
+            std::uint8_t server_node_id = 0;
+            (void) canardDecodeScalar(transfer, 0, 8, false, &server_node_id);
+            if ((server_node_id == 0) ||
+                (server_node_id >= CANARD_MAX_NODE_ID))
+            {
+                server_node_id = transfer->source_node_id;
+            }
+
+            // Copy the path
+            senoval::String<200> path;
+            for (unsigned i = 0;
+                 i < std::min(transfer->payload_len - 1U,
+                              path.capacity());
+                 i++)
+            {
+                char val = '\0';
+                (void) canardDecodeScalar(transfer, i * 8 + 8, 8, false, &val);
+                path.push_back(val);
+            }
+
             if ((bl_state == State::AppUpgradeInProgress) || (remote_server_node_id_ != 0))
             {
                 error = 2;      // Already in progress
+
+                /*
+                 * Another server offering the same file while the update is in progress joins the download.
+                 * If the download has been suspended because all servers were lost, this resumes it.
+                 */
+                auto free_slot = std::find(additional_server_node_ids_.begin(), additional_server_node_ids_.end(), 0);
+                if ((!firmware_file_path_.empty()) &&
+                    (path == firmware_file_path_) &&
+                    !isFileServerKnown(server_node_id))
+                {
+                    if (remote_server_node_id_ == 0)
+                    {
+                        remote_server_node_id_ = server_node_id;
+                        error = 0;
+                    }
+                    else if (free_slot != additional_server_node_ids_.end())
+                    {
+                        *free_slot = server_node_id;
+                        error = 0;
+                    }
+
+                    if (error == 0)
+                    {
+                        logger_.println("FW server %u added", unsigned(server_node_id));
+                    }
+                }
             }
             else if ((bl_state == State::ReadyToBoot))
             {
@@ -1031,26 +2181,8 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
             }
             else
             {
-                // Determine the node ID of the firmware server
-                (void) canardDecodeScalar(transfer, 0, 8, false, &remote_server_node_id_);
-                if ((remote_server_node_id_ == 0) ||
-                    (remote_server_node_id_ >= CANARD_MAX_NODE_ID))
-                {
-                    remote_server_node_id_ = transfer->source_node_id;
-                }
-
-                // Copy the path
-                firmware_file_path_.clear();
-                for (unsigned i = 0;
-                     i < std::min(transfer->payload_len - 1U,
-                                  firmware_file_path_.capacity());
-                     i++)
-                {
-                    char val = '\0';
-                    (void) canardDecodeScalar(transfer, i * 8 + 8, 8, false, &val);
-                    firmware_file_path_.push_back(val);
-                }
-
+                remote_server_node_id_ = server_node_id;
+                firmware_file_path_ = path;
                 error = 0;
             }
 
@@ -1070,27 +2202,92 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
             }
         }
 
+        /*
+         * Multicast firmware stream.
+         */
+        if (multicast_active_ &&
+            (transfer->transfer_type == CanardTransferTypeBroadcast))
+        {
+            onMulticastTransferReception(transfer);
+        }
+
         /*
          * File read response.
          */
         if ((transfer->transfer_type == CanardTransferTypeResponse) &&
-            (transfer->data_type_id == dsdl::FileRead::DataTypeID) &&
-            (((transfer->transfer_id + 1) & 31) == file_read_transfer_id_))
+            (transfer->data_type_id == dsdl::FileRead::DataTypeID))
         {
-            std::uint16_t error = 0;
-            (void) canardDecodeScalar(transfer, 0, 16, false, &error);
-            if (error != 0)
+            for (auto& slot : file_read_slots_)
             {
-                read_result_ = -error;
+                if ((slot.server_node_id != transfer->source_node_id) ||
+                    (slot.state != FileReadSlot::State::Pending) ||
+                    (((transfer->transfer_id + 1) & 31) != file_read_transfer_ids_[slot.server_node_id]))
+                {
+                    continue;
+                }
+
+                std::uint16_t error = 0;
+                (void) canardDecodeScalar(transfer, 0, 16, false, &error);
+                if (error != 0)
+                {
+                    slot.result = -error;
+                }
+                else
+                {
+                    slot.result = std::min(int(FileReadChunkSize), transfer->payload_len - 2);
+                    for (int i = 0; i < slot.result; i++)
+                    {
+                        (void) canardDecodeScalar(transfer, 16 + i * 8, 8, false, &slot.buffer[i]);
+                    }
+                }
+                slot.state = FileReadSlot::State::Ready;
+                slot.num_failed_attempts = 0;
+                break;
             }
-            else
+        }
+    }
+
+    void onMulticastTransferReception(CanardRxTransfer* const transfer)
+    {
+        using namespace impl_;
+
+        std::uint32_t stream_id = 0;
+        std::uint64_t offset = 0;
+        (void) canardDecodeScalar(transfer,  0, 32, false, &stream_id);
+        (void) canardDecodeScalar(transfer, 32, 40, false, &offset);
+
+        if ((stream_id != multicast_stream_id_) || (transfer->payload_len < 9))
+        {
+            return;
+        }
+
+        if ((transfer->data_type_id == dsdl::MulticastChunk::DataTypeID) &&
+            (transfer->source_node_id == remote_server_node_id_))
+        {
+            if ((offset == multicast_expected_offset_) &&
+                (read_result_ == std::numeric_limits<int>::max()))
             {
-                read_result_ = std::min(256, transfer->payload_len - 2);
+                read_result_ = std::min(256, transfer->payload_len - 9);
                 for (int i = 0; i < read_result_; i++)
                 {
-                    (void) canardDecodeScalar(transfer, 16 + i * 8, 8, false, &read_buffer_[i]);
+                    (void) canardDecodeScalar(transfer, 72 + i * 8, 8, false, &read_buffer_[i]);
                 }
             }
+            else if (offset > multicast_expected_offset_)
+            {
+                multicast_gap_detected_ = true;
+            }
+            else
+            {
+                ;   // Retransmission requested by another node, ignore
+            }
+        }
+
+        // If another node has requested the same data, the server will rewind the stream for us as well
+        if ((transfer->data_type_id == dsdl::MulticastChunkRequest::DataTypeID) &&
+            (offset <= multicast_expected_offset_))
+        {
+            multicast_foreign_request_at_ = getMonotonicTimestampUSec();
         }
     }
 
@@ -1146,6 +2343,21 @@ class UAVCANFirmwareUpdateNode : protected ::os::bootloader::IDownloader,
                 *out_data_type_signature = RestartNode::DataTypeSignature;
                 return true;
             }
+
+            // Multicast firmware stream and requests from other nodes
+            if (multicast_active_ && (transfer_type == CanardTransferTypeBroadcast))
+            {
+                if (data_type_id == MulticastChunk::DataTypeID)
+                {
+                    *out_data_type_signature = MulticastChunk::DataTypeSignature;
+                    return true;
+                }
+                if (data_type_id == MulticastChunkRequest::DataTypeID)
+                {
+                    *out_data_type_signature = MulticastChunkRequest::DataTypeSignature;
+                    return true;
+                }
+            }
         }
 
         return false;
@@ -1180,13 +2392,16 @@ public:
      * @param iface                     CAN driver adaptor instance
      * @param name                      product ID, UAVCAN node name
      * @param hw
+     * @param network_parameters_cache  optional; enables fast start, see @ref INetworkParametersCache
      */
     UAVCANFirmwareUpdateNode(::os::bootloader::Bootloader& bl,
                              ICANIface& iface,
                              const NodeName& name,
-                             const HardwareInfo& hw) :
+                             const HardwareInfo& hw,
+                             INetworkParametersCache* network_parameters_cache = nullptr) :
         bootloader_(bl),
         iface_(iface),
+        network_parameters_cache_(network_parameters_cache),
         node_name_(name),
         hw_info_(hw)
     {
@@ -1194,11 +2409,13 @@ public:
     }
 
     /**
-     * This function can be invoked only once.
+     * This function can be invoked only once; see @ref restart() for starting the node over.
      *
      * @param thread_priority           priority of the UAVCAN thread
      * @param can_bus_bit_rate          set if known; defaults to zero, which initiates CAN bit rate autodetect
+     *                                  (or makes the node use the cached value, if the cache is available)
      * @param node_id                   set if known; defaults to zero, which initiates dynamic node ID allocation
+     *                                  (or makes the node use the cached value, if the cache is available)
      * @param remote_server_node_id     set if known; defaults to zero, which makes the node wait for an update request
      * @param remote_file_path          set if known; defaults to an empty string, which can be a valid path too
      */
@@ -1208,31 +2425,33 @@ public:
                                       const std::uint8_t remote_server_node_id = 0,
                                       const char* const remote_file_path = "")
     {
-        this->can_bus_bit_rate_ = can_bus_bit_rate;
+        resetSession(can_bus_bit_rate, node_id, remote_server_node_id, remote_file_path);
 
-        if ((remote_server_node_id >= CANARD_MIN_NODE_ID) &&
-            (remote_server_node_id <= CANARD_MAX_NODE_ID))
-        {
-            this->remote_server_node_id_ = remote_server_node_id;
-            this->firmware_file_path_ = remote_file_path;
-        }
+        watchdog_.start(impl_::WatchdogTimeout);
 
-        canardInit(&canard_,
-                   memory_pool_.data(),
-                   memory_pool_.size(),
-                   &UAVCANFirmwareUpdateNode::onTransferReceptionTrampoline,
-                   &UAVCANFirmwareUpdateNode::shouldAcceptTransferTrampoline,
-                   this);
+        return chibios_rt::BaseStaticThread<StackSize>::start(thread_priority);
+    }
 
-        if ((node_id >= CANARD_MIN_NODE_ID) &&
-            (node_id <= CANARD_MAX_NODE_ID))
+    /**
+     * Makes the running node leave the current session and start over from the bit rate detection and the node ID
+     * allocation, as if it has just been started; an upgrade in progress is interrupted. The thread keeps running,
+     * so the watchdog is served throughout. This is needed for benchmarking a series of configurations in one run.
+     * Blocks until the node has reset its state; must not be invoked from the node thread.
+     *
+     * @param can_bus_bit_rate          same as in @ref start()
+     * @param node_id                   same as in @ref start()
+     */
+    void restart(const std::uint32_t can_bus_bit_rate = 0,
+                 const std::uint8_t node_id = 0)
+    {
+        restart_can_bus_bit_rate_ = can_bus_bit_rate;
+        restart_node_id_ = node_id;
+        restart_requested_ = true;
+
+        while (restart_requested_ && !os::isRebootRequested())
         {
-            canardSetLocalNodeID(&canard_, node_id);
+            ::usleep(1000);
         }
-
-        watchdog_.start(impl_::WatchdogTimeout);
-
-        return chibios_rt::BaseStaticThread<StackSize>::start(thread_priority);
     }
 
     /**
@@ -1243,6 +2462,16 @@ public:
         return can_bus_bit_rate_;               // No thread sync is needed, read is atomic
     }
 
+    /**
+     * Returns the CAN and libcanard statistics of the node.
+     * The counters are updated by the node thread without locking; every field is read atomically,
+     * but the fields may be slightly inconsistent with each other, which is acceptable for diagnostics.
+     */
+    NodeStatistics getStatistics() const
+    {
+        return statistics_;
+    }
+
     /**
      * Returns the local UAVCAN node ID, if set, otherwise zero.
      */
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#pragma once
+
+#include "uavcan.hpp"
+#include <zubax_chibios/util/shell.hpp>
+
+
+namespace os
+{
+namespace bootloader
+{
+namespace uavcan_loader
+{
+/**
+ * Shell command that prints the CAN bus and libcanard statistics of the UAVCAN node.
+ * Useful for sizing MemoryPoolSize (see the peak pool usage) and for diagnosing slow updates.
+ * The node type is a template parameter because the node class is a template itself.
+ */
+template <typename Node>
+class StatisticsCommandHandler : public os::shell::ICommandHandler
+{
+    const Node& node_;
+
+public:
+    explicit StatisticsCommandHandler(const Node& node) :
+        node_(node)
+    { }
+
+    const char* getName() const override { return "canstat"; }
+
+    void execute(os::shell::BaseChannelWrapper& ios, int, char**) override
+    {
+        const NodeStatistics st = node_.getStatistics();
+
+        ios.print("CAN %u bps, NID %u\n", unsigned(node_.getCANBusBitRate()), unsigned(node_.getLocalNodeID()));
+        ios.print("Frames         RX %-10u TX %u\n", unsigned(st.rx_frames), unsigned(st.tx_frames));
+        ios.print("Driver errors  RX %-10u TX %u\n", unsigned(st.rx_driver_errors), unsigned(st.tx_driver_errors));
+        ios.print("RX overruns    %u\n", unsigned(st.rx_overruns));
+        ios.print("TX queue full  %u\n", unsigned(st.tx_driver_queue_full));
+        ios.print("Transfer errs  %u\n", unsigned(st.rx_transfer_errors));
+        ios.print("TX queue peak  %u frames\n", unsigned(st.tx_queue_depth_peak));
+        ios.print("RX spin peak   %u frames\n", unsigned(st.rx_frames_per_spin_peak));
+        ios.print("Memory pool    %u/%u blocks, peak %u\n",
+                  unsigned(st.memory_pool_usage_blocks),
+                  unsigned(st.memory_pool_capacity_blocks),
+                  unsigned(st.memory_pool_peak_usage_blocks));
+    }
+};
+
+}
+}
+}
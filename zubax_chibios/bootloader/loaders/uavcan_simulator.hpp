@@ -0,0 +1,1079 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#pragma once
+
+/*
+ * In-process UAVCAN network for benchmarking the UAVCAN firmware loader without hardware.
+ * It consists of:
+ *  - A virtual CAN bus that models the bit timing, the arbitration, the bit rate mismatch, and error injection.
+ *  - Virtual CAN interfaces (ICANIface) attached to the bus, one per node.
+ *  - Simulated peer nodes that act as a dynamic node ID allocator and/or a file server.
+ *  - A benchmark runner that measures the time-to-online and the full image transfer time, either for one
+ *    configuration or for a sweep over the bus bit rates and the window sizes (number of concurrent requests).
+ *
+ * All components run in the same firmware, every node in its own thread. The storage backend is replaced with
+ * a null backend, so the benchmark does not modify the real application image.
+ * Frame timing is computed exactly in virtual time. The bus is advanced by the threads that access it: the waiting
+ * interfaces are woken up at the end of the frame that is on the wire and whenever the bus state changes, so the
+ * frames are observed at the moment of their completion, within the resolution of the system timer.
+ * The host test (tests/uavcan_simulator_test.cpp) runs the same code on a virtual time kernel, where the
+ * timer resolution is one microsecond and the CPU time of the nodes is zero.
+ */
+
+#include "uavcan.hpp"
+#include <zubax_chibios/os.hpp>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <utility>
+#include <algorithm>
+
+
+namespace os
+{
+namespace bootloader
+{
+namespace uavcan_loader
+{
+namespace sim
+{
+
+class VirtualCANIface;
+
+/**
+ * Shared medium for the virtual CAN interfaces.
+ * The frame duration is computed for an extended data frame including the interframe space, with an assumed
+ * stuffing overhead of 10%. When the bus becomes idle, the pending frame with the lowest ID wins the arbitration;
+ * the frames of one interface that have the same ID leave in the order they were enqueued, like from a FIFO.
+ * Every completed frame is corrupted with the configured probability; a corrupted frame increments the protocol
+ * error counters of all interfaces and is retransmitted, unless the sender has requested automatic abort.
+ * Interfaces configured with a different bit rate see only protocol errors, and their own frames are lost.
+ * The bit rate of the bus can be changed at run time, which makes all interfaces that are not reconfigured go offline.
+ */
+class VirtualCANBus
+{
+    friend class VirtualCANIface;
+
+public:
+    static constexpr unsigned MaxInterfaces = 8;
+
+    struct Statistics
+    {
+        std::uint32_t frames_delivered = 0;
+        std::uint32_t frames_corrupted = 0;
+        std::uint32_t frames_lost = 0;                  ///< Aborted, sent at a wrong bit rate, or RX overflow
+        std::uint64_t busy_time_usec = 0;
+    };
+
+private:
+    mutable chibios_rt::Mutex mutex_;
+    impl_::MonotonicTimekeeper timekeeper_;
+
+    std::uint32_t bit_rate_;
+    std::uint32_t error_rate_ppm_ = 0;
+    std::uint32_t rng_state_ = 0x1234567U;
+
+    std::array<VirtualCANIface*, MaxInterfaces> ifaces_{};
+    unsigned num_ifaces_ = 0;
+
+    VirtualCANIface* transmitter_ = nullptr;           ///< Owner of the frame that is on the wire, if any
+    unsigned transmitter_slot_ = 0;
+    std::uint64_t busy_until_usec_ = 0;
+    std::uint64_t tx_sequence_ = 0;                     ///< Orders the frames enqueued at the same moment
+
+    Statistics stats_;
+
+    std::uint32_t getRandom()
+    {
+        // Xorshift32, good enough for error injection
+        rng_state_ ^= rng_state_ << 13;
+        rng_state_ ^= rng_state_ >> 17;
+        rng_state_ ^= rng_state_ << 5;
+        return rng_state_;
+    }
+
+    std::uint64_t getFrameDurationUSec(const CanardCANFrame& frame) const
+    {
+        const std::uint32_t bits = ((67U + 8U * frame.data_len) * 11U) / 10U;
+        return (std::uint64_t(bits) * 1000000ULL + bit_rate_ - 1U) / bit_rate_;
+    }
+
+    void attach(VirtualCANIface& iface)
+    {
+        os::MutexLocker mlock(mutex_);
+        assert(num_ifaces_ < MaxInterfaces);
+        if (num_ifaces_ < MaxInterfaces)
+        {
+            ifaces_[num_ifaces_++] = &iface;
+        }
+    }
+
+    inline void completeTransmission();
+    inline bool startTransmission(const std::uint64_t now_usec);
+
+    /**
+     * Wakes up the interfaces that are waiting for a bus event. The mutex must be locked by the caller.
+     */
+    inline void notifyAll();
+
+    /**
+     * Processes all bus events up to the specified moment. The mutex must be locked by the caller.
+     */
+    void advance(const std::uint64_t now_usec)
+    {
+        while (true)
+        {
+            if (transmitter_ != nullptr)
+            {
+                if (now_usec < busy_until_usec_)
+                {
+                    break;
+                }
+                completeTransmission();
+            }
+
+            if (!startTransmission(now_usec))
+            {
+                break;
+            }
+        }
+    }
+
+    /**
+     * Blocks until the predicate is satisfied or the timeout expires. The predicate is invoked under the mutex.
+     * The interface sleeps until the next bus event: the end of the frame that is on the wire, or a notification.
+     */
+    template <typename Predicate>
+    inline bool waitUntil(VirtualCANIface& iface, const Predicate& predicate, const int timeout_millisec);
+
+public:
+    explicit VirtualCANBus(const std::uint32_t bit_rate) :
+        bit_rate_(bit_rate)
+    {
+        assert(bit_rate_ > 0);
+    }
+
+    std::uint32_t getBitRate() const
+    {
+        os::MutexLocker mlock(mutex_);
+        return bit_rate_;
+    }
+
+    /**
+     * The interfaces keep their configuration, so they have to be reinitialized with the new bit rate.
+     * The frame that is on the wire at the moment is timed at the old bit rate.
+     */
+    void setBitRate(const std::uint32_t bit_rate)
+    {
+        assert(bit_rate > 0);
+        os::MutexLocker mlock(mutex_);
+        advance(timekeeper_.getMicroseconds());
+        bit_rate_ = bit_rate;
+    }
+
+    /**
+     * Probability of corruption of every frame, in parts per million.
+     */
+    void setErrorRate(const std::uint32_t ppm)
+    {
+        os::MutexLocker mlock(mutex_);
+        error_rate_ppm_ = ppm;
+    }
+
+    Statistics getStatistics() const
+    {
+        os::MutexLocker mlock(mutex_);
+        return stats_;
+    }
+
+    void resetStatistics()
+    {
+        os::MutexLocker mlock(mutex_);
+        stats_ = Statistics();
+    }
+};
+
+/**
+ * Virtual CAN controller attached to a @ref VirtualCANBus.
+ * It has three transmit mailboxes, like most CAN controllers, and a receive FIFO.
+ */
+class VirtualCANIface : public ICANIface
+{
+    friend class VirtualCANBus;
+
+    static constexpr unsigned NumTxMailboxes = 3;
+    static constexpr unsigned RxQueueCapacity = 64;
+
+    struct TxMailbox
+    {
+        CanardCANFrame frame{};
+        std::uint64_t enqueued_at_usec = 0;
+        std::uint64_t sequence = 0;
+        bool used = false;
+    };
+
+    VirtualCANBus& bus_;
+
+    bool initialized_ = false;
+    std::uint32_t bit_rate_ = 0;
+    Mode mode_ = Mode::Normal;
+    AcceptanceFilterConfig filter_;
+
+    std::array<TxMailbox, NumTxMailboxes> tx_{};
+    std::array<CanardCANFrame, RxQueueCapacity> rx_{};
+    unsigned rx_head_ = 0;
+    unsigned rx_size_ = 0;
+    std::uint32_t protocol_errors_ = 0;
+    std::uint32_t rx_overflows_ = 0;
+
+    chibios_rt::BinarySemaphore event_{true};          ///< Signaled by the bus when its state changes
+
+    bool isOnline() const { return initialized_ && (bit_rate_ == bus_.bit_rate_); }
+
+    bool hasFreeMailbox() const
+    {
+        return std::any_of(tx_.begin(), tx_.end(), [](const TxMailbox& x) { return !x.used; });
+    }
+
+    /**
+     * Returns false if the frame has been lost due to RX queue overflow.
+     */
+    bool accept(const CanardCANFrame& frame)
+    {
+        if ((frame.id & filter_.mask) != (filter_.id & filter_.mask))
+        {
+            return true;
+        }
+        if (rx_size_ >= RxQueueCapacity)
+        {
+            rx_overflows_++;
+            return false;
+        }
+        rx_[(rx_head_ + rx_size_) % RxQueueCapacity] = frame;
+        rx_size_++;
+        return true;
+    }
+
+public:
+    explicit VirtualCANIface(VirtualCANBus& bus) :
+        bus_(bus)
+    {
+        bus_.attach(*this);
+    }
+
+    int init(const std::uint32_t bitrate, const Mode mode, const AcceptanceFilterConfig& acceptance_filter) override
+    {
+        os::MutexLocker mlock(bus_.mutex_);
+        bus_.advance(bus_.timekeeper_.getMicroseconds());
+
+        initialized_ = true;
+        bit_rate_ = bitrate;
+        mode_ = mode;
+        filter_ = acceptance_filter;
+        rx_size_ = 0;
+        protocol_errors_ = 0;
+        rx_overflows_ = 0;
+        for (unsigned i = 0; i < NumTxMailboxes; i++)
+        {
+            if ((bus_.transmitter_ != this) || (bus_.transmitter_slot_ != i))
+            {
+                tx_[i].used = false;                            // The frame on the wire cannot be recalled
+            }
+        }
+        return 0;
+    }
+
+    int send(const CanardCANFrame& frame, const int timeout_millisec) override
+    {
+        if (!bus_.waitUntil(*this, [this]() { return hasFreeMailbox(); }, timeout_millisec))
+        {
+            return 0;
+        }
+
+        os::MutexLocker mlock(bus_.mutex_);
+        if (mode_ == Mode::Silent)
+        {
+            return 1;                                           // Silent mode - the frame never reaches the bus
+        }
+        for (auto& x : tx_)
+        {
+            if (!x.used)
+            {
+                x.frame = frame;
+                x.enqueued_at_usec = bus_.timekeeper_.getMicroseconds();
+                x.sequence = bus_.tx_sequence_++;
+                x.used = true;
+                bus_.advance(x.enqueued_at_usec);               // Starts the transmission if the bus is idle
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    std::pair<int, CanardCANFrame> receive(const int timeout_millisec) override
+    {
+        if (!bus_.waitUntil(*this, [this]() { return rx_size_ > 0; }, timeout_millisec))
+        {
+            return {0, CanardCANFrame()};
+        }
+
+        os::MutexLocker mlock(bus_.mutex_);
+        const CanardCANFrame frame = rx_[rx_head_];
+        rx_head_ = (rx_head_ + 1U) % RxQueueCapacity;
+        rx_size_--;
+        return {1, frame};
+    }
+
+    int waitForEvent(const unsigned event_mask, const int timeout_millisec) override
+    {
+        int result = 0;
+        (void) bus_.waitUntil(*this, [&]()
+            {
+                result = int(event_mask & (((rx_size_ > 0) ? EventRxReady : 0U) |
+                                           (hasFreeMailbox() ? EventTxReady : 0U)));
+                return result != 0;
+            }, timeout_millisec);
+        return result;
+    }
+
+    VirtualCANBus& getBus() const { return bus_; }
+
+    int getProtocolErrorCount() override
+    {
+        os::MutexLocker mlock(bus_.mutex_);
+        return int(std::min<std::uint32_t>(protocol_errors_, 0x7FFFFFFFU));
+    }
+
+    int getRxOverflowCount() override
+    {
+        os::MutexLocker mlock(bus_.mutex_);
+        return int(std::min<std::uint32_t>(rx_overflows_, 0x7FFFFFFFU));
+    }
+};
+
+template <typename Predicate>
+inline bool VirtualCANBus::waitUntil(VirtualCANIface& iface, const Predicate& predicate, const int timeout_millisec)
+{
+    std::uint64_t deadline = 0;
+    {
+        os::MutexLocker mlock(mutex_);
+        deadline = timekeeper_.getMicroseconds() + std::uint64_t(std::max(timeout_millisec, 0)) * 1000U;
+    }
+    while (true)
+    {
+        std::uint64_t sleep_usec = 0;
+        {
+            os::MutexLocker mlock(mutex_);
+            const std::uint64_t now = timekeeper_.getMicroseconds();
+            advance(now);
+            if (predicate())
+            {
+                return true;
+            }
+            if (now >= deadline)
+            {
+                return false;
+            }
+            const std::uint64_t wake_at = (transmitter_ != nullptr) ? std::min(deadline, busy_until_usec_) : deadline;
+            sleep_usec = std::min<std::uint64_t>(wake_at - now, 1000000U);
+        }
+        (void) iface.event_.wait(TIME_US2I(sleep_usec));
+    }
+}
+
+inline void VirtualCANBus::notifyAll()
+{
+    for (unsigned i = 0; i < num_ifaces_; i++)
+    {
+        ifaces_[i]->event_.signal();
+    }
+}
+
+inline void VirtualCANBus::completeTransmission()
+{
+    VirtualCANIface& sender = *transmitter_;
+    auto& mailbox = sender.tx_[transmitter_slot_];
+    transmitter_ = nullptr;
+    notifyAll();                                                // Either a mailbox or the bus becomes available
+
+    if ((error_rate_ppm_ > 0) && ((getRandom() % 1000000U) < error_rate_ppm_))
+    {
+        stats_.frames_corrupted++;
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            ifaces_[i]->protocol_errors_++;
+        }
+        if (sender.mode_ == ICANIface::Mode::AutomaticTxAbortOnError)
+        {
+            mailbox.used = false;
+            stats_.frames_lost++;
+        }
+        return;                                                 // Otherwise it will be retransmitted
+    }
+
+    for (unsigned i = 0; i < num_ifaces_; i++)
+    {
+        VirtualCANIface& x = *ifaces_[i];
+        if ((&x == &sender) || !x.initialized_)
+        {
+            continue;
+        }
+        if (x.bit_rate_ != bit_rate_)
+        {
+            x.protocol_errors_++;
+        }
+        else if (!x.accept(mailbox.frame))
+        {
+            stats_.frames_lost++;
+        }
+    }
+
+    mailbox.used = false;
+    stats_.frames_delivered++;
+}
+
+inline bool VirtualCANBus::startTransmission(const std::uint64_t now_usec)
+{
+    /*
+     * The bus becomes available at the end of the previous frame or when the first frame is enqueued,
+     * whichever is later. All frames that are pending at that moment take part in the arbitration.
+     */
+    std::uint64_t earliest = std::numeric_limits<std::uint64_t>::max();
+    for (unsigned i = 0; i < num_ifaces_; i++)
+    {
+        VirtualCANIface& x = *ifaces_[i];
+        for (auto& m : x.tx_)
+        {
+            if (!m.used)
+            {
+                continue;
+            }
+            if (!x.isOnline())
+            {
+                // Transmission at a wrong bit rate destroys the frame and disturbs the other nodes
+                m.used = false;
+                stats_.frames_lost++;
+                for (unsigned k = 0; k < num_ifaces_; k++)
+                {
+                    ifaces_[k]->protocol_errors_++;
+                }
+                notifyAll();
+                continue;
+            }
+            earliest = std::min(earliest, m.enqueued_at_usec);
+        }
+    }
+
+    const std::uint64_t start_at = std::max(busy_until_usec_, earliest);
+    if ((earliest == std::numeric_limits<std::uint64_t>::max()) || (start_at > now_usec))
+    {
+        return false;
+    }
+
+    // A multi-frame transfer is enqueued as a sequence of frames with the same ID, which must not be reordered
+    const auto precedes = [](const VirtualCANIface::TxMailbox& a, const VirtualCANIface::TxMailbox& b)
+    {
+        const std::uint32_t a_id = a.frame.id & CANARD_CAN_EXT_ID_MASK;
+        const std::uint32_t b_id = b.frame.id & CANARD_CAN_EXT_ID_MASK;
+        return (a_id < b_id) || ((a_id == b_id) && (a.sequence < b.sequence));
+    };
+
+    VirtualCANIface* winner = nullptr;
+    unsigned winner_slot = 0;
+    for (unsigned i = 0; i < num_ifaces_; i++)
+    {
+        VirtualCANIface& x = *ifaces_[i];
+        for (unsigned k = 0; k < x.tx_.size(); k++)
+        {
+            const auto& m = x.tx_[k];
+            if (m.used && (m.enqueued_at_usec <= start_at) &&
+                ((winner == nullptr) || precedes(m, winner->tx_[winner_slot])))
+            {
+                winner = &x;
+                winner_slot = k;
+            }
+        }
+    }
+    assert(winner != nullptr);
+
+    const std::uint64_t duration = getFrameDurationUSec(winner->tx_[winner_slot].frame);
+    transmitter_ = winner;
+    transmitter_slot_ = winner_slot;
+    busy_until_usec_ = start_at + duration;
+    stats_.busy_time_usec += duration;
+    notifyAll();                                                // The waiters have to wake up at the end of the frame
+    return true;
+}
+
+/**
+ * Storage backend that discards the written data; the image is never valid.
+ * It reads as erased flash of the specified capacity. The reads stop at the end, which is what terminates
+ * the search for the application descriptor, so the capacity also bounds the time it takes.
+ */
+class NullAppStorageBackend : public ::os::bootloader::IAppStorageBackend
+{
+    const std::size_t capacity_;
+
+public:
+    explicit NullAppStorageBackend(const std::size_t capacity) :
+        capacity_(capacity)
+    { }
+
+    int beginUpgrade() override { return 0; }
+
+    int write(std::size_t offset, const void*, std::size_t size) override
+    {
+        return ((offset <= capacity_) && (size <= (capacity_ - offset))) ? int(size) : -ErrAppStorageWriteFailure;
+    }
+
+    int endUpgrade(bool) override { return 0; }
+
+    int read(std::size_t offset, void* data, std::size_t size) const override
+    {
+        size = (offset < capacity_) ? std::min(size, capacity_ - offset) : 0U;
+        std::memset(data, 0xFF, size);
+        return int(size);
+    }
+};
+
+/**
+ * A simulated UAVCAN node that serves the loader under test.
+ * It publishes NodeStatus, which is required for the bit rate detection on a quiet bus, and optionally acts as:
+ *  - The dynamic node ID allocator (a simplified single-server implementation).
+ *  - The file server that serves a synthetic image of the specified size, see @ref getImageByte().
+ */
+template <int StackSize = 2048, int MemoryPoolSize = 4096>
+class SimulatedPeer : public chibios_rt::BaseStaticThread<StackSize>
+{
+public:
+    struct Statistics
+    {
+        std::uint32_t file_read_requests = 0;
+        std::uint64_t bytes_served = 0;
+        std::uint64_t end_of_file_served_at_usec = 0;   ///< Zero until the first empty response
+        std::int16_t begin_update_response = -1;        ///< Negative until the response is received
+    };
+
+private:
+    VirtualCANIface iface_;
+    impl_::MonotonicTimekeeper timekeeper_;
+
+    alignas(std::max_align_t) std::array<std::uint8_t, MemoryPoolSize> memory_pool_{};
+    CanardInstance canard_{};
+
+    const std::uint8_t node_id_;
+    const std::uint32_t image_size_;
+    const bool allocator_;
+
+    mutable chibios_rt::Mutex mutex_;
+    Statistics stats_;
+    std::uint8_t update_target_node_id_ = 0;
+    senoval::String<200> update_file_path_;
+
+    std::array<std::uint8_t, 16> allocation_unique_id_{};
+    std::uint8_t allocation_unique_id_len_ = 0;
+    std::uint8_t next_allocated_node_id_ = CANARD_MAX_NODE_ID - 2;
+
+    std::uint8_t node_status_transfer_id_ = 0;
+    std::uint8_t allocation_transfer_id_ = 0;
+    std::uint8_t begin_update_transfer_id_ = 0;
+
+    void onAllocationMessage(CanardRxTransfer* const transfer)
+    {
+        using impl_::dsdl::NodeIDAllocation;
+
+        if ((!allocator_) || (transfer->source_node_id != CANARD_BROADCAST_NODE_ID) || (transfer->payload_len < 2))
+        {
+            return;
+        }
+
+        std::uint8_t first_part = 0;
+        (void) canardDecodeScalar(transfer, 7, 1, false, &first_part);
+        if (first_part != 0)
+        {
+            allocation_unique_id_len_ = 0;
+        }
+        else if (allocation_unique_id_len_ == 0)
+        {
+            return;                                     // Missed the first part
+        }
+
+        for (unsigned i = 1; (i < transfer->payload_len) && (allocation_unique_id_len_ < 16); i++)
+        {
+            (void) canardDecodeScalar(transfer, i * 8U, 8, false,
+                                      &allocation_unique_id_[allocation_unique_id_len_++]);
+        }
+
+        std::uint8_t response[1 + 16]{};
+        if (allocation_unique_id_len_ >= 16)
+        {
+            response[0] = std::uint8_t(next_allocated_node_id_ << 1);
+            next_allocated_node_id_--;
+        }
+        std::copy_n(allocation_unique_id_.begin(), allocation_unique_id_len_, &response[1]);
+
+        (void) canardBroadcast(&canard_,
+                               NodeIDAllocation::DataTypeSignature,
+                               NodeIDAllocation::DataTypeID,
+                               &allocation_transfer_id_,
+                               CANARD_TRANSFER_PRIORITY_LOW,
+                               response,
+                               std::uint16_t(1U + allocation_unique_id_len_));
+
+        if (allocation_unique_id_len_ >= 16)
+        {
+            allocation_unique_id_len_ = 0;
+        }
+    }
+
+    void onFileReadRequest(CanardRxTransfer* const transfer)
+    {
+        using impl_::dsdl::FileRead;
+
+        std::uint64_t offset = 0;
+        (void) canardDecodeScalar(transfer, 0, 40, false, &offset);
+        canardReleaseRxTransferPayload(&canard_, transfer);
+
+        std::uint8_t response[2 + 256]{};
+        const std::uint64_t size = (offset < image_size_) ? std::min<std::uint64_t>(256, image_size_ - offset) : 0;
+        for (unsigned i = 0; i < size; i++)
+        {
+            response[2 + i] = getImageByte(offset + i);
+        }
+
+        (void) canardRequestOrRespond(&canard_,
+                                      transfer->source_node_id,
+                                      FileRead::DataTypeSignature,
+                                      FileRead::DataTypeID,
+                                      &transfer->transfer_id,
+                                      transfer->priority,
+                                      CanardResponse,
+                                      response,
+                                      std::uint16_t(2U + size));
+
+        os::MutexLocker mlock(mutex_);
+        stats_.file_read_requests++;
+        stats_.bytes_served += size;
+        if ((size == 0) && (stats_.end_of_file_served_at_usec == 0))
+        {
+            stats_.end_of_file_served_at_usec = timekeeper_.getMicroseconds();
+        }
+    }
+
+    void onTransferReception(CanardRxTransfer* const transfer)
+    {
+        using namespace impl_::dsdl;
+
+        if ((transfer->transfer_type == CanardTransferTypeBroadcast) &&
+            (transfer->data_type_id == NodeIDAllocation::DataTypeID))
+        {
+            onAllocationMessage(transfer);
+        }
+
+        if ((transfer->transfer_type == CanardTransferTypeRequest) &&
+            (transfer->data_type_id == FileRead::DataTypeID))
+        {
+            onFileReadRequest(transfer);
+        }
+
+        if ((transfer->transfer_type == CanardTransferTypeResponse) &&
+            (transfer->data_type_id == BeginFirmwareUpdate::DataTypeID))
+        {
+            std::uint8_t error = 0;
+            (void) canardDecodeScalar(transfer, 0, 8, false, &error);
+            os::MutexLocker mlock(mutex_);
+            stats_.begin_update_response = error;
+        }
+    }
+
+    bool shouldAcceptTransfer(std::uint64_t* out_data_type_signature,
+                              const std::uint16_t data_type_id,
+                              const CanardTransferType transfer_type)
+    {
+        using namespace impl_::dsdl;
+
+        if ((transfer_type == CanardTransferTypeBroadcast) && (data_type_id == NodeIDAllocation::DataTypeID))
+        {
+            *out_data_type_signature = NodeIDAllocation::DataTypeSignature;
+            return allocator_;
+        }
+        if ((transfer_type == CanardTransferTypeRequest) && (data_type_id == FileRead::DataTypeID))
+        {
+            *out_data_type_signature = FileRead::DataTypeSignature;
+            return image_size_ > 0;
+        }
+        if ((transfer_type == CanardTransferTypeResponse) && (data_type_id == BeginFirmwareUpdate::DataTypeID))
+        {
+            *out_data_type_signature = BeginFirmwareUpdate::DataTypeSignature;
+            return true;
+        }
+        return false;
+    }
+
+    static void onTransferReceptionTrampoline(CanardInstance* ins, CanardRxTransfer* transfer)
+    {
+        static_cast<SimulatedPeer*>(ins->user_reference)->onTransferReception(transfer);
+    }
+
+    static bool shouldAcceptTransferTrampoline(const CanardInstance* ins,
+                                               std::uint64_t* out_data_type_signature,
+                                               std::uint16_t data_type_id,
+                                               CanardTransferType transfer_type,
+                                               std::uint8_t)
+    {
+        return static_cast<SimulatedPeer*>(ins->user_reference)->shouldAcceptTransfer(out_data_type_signature,
+                                                                                       data_type_id,
+                                                                                       transfer_type);
+    }
+
+    void sendNodeStatus()
+    {
+        using impl_::dsdl::NodeStatus;
+        std::uint8_t buffer[NodeStatus::MaxSizeBytes]{};
+        const std::uint32_t uptime_sec = std::uint32_t(timekeeper_.getUptimeMicroseconds() / 1000000U);
+        canardEncodeScalar(buffer, 0, 32, &uptime_sec);
+        (void) canardBroadcast(&canard_,
+                               NodeStatus::DataTypeSignature,
+                               NodeStatus::DataTypeID,
+                               &node_status_transfer_id_,
+                               CANARD_TRANSFER_PRIORITY_LOW,
+                               buffer,
+                               NodeStatus::MaxSizeBytes);
+    }
+
+    void sendBeginFirmwareUpdateIfRequested()
+    {
+        std::uint8_t buffer[1 + 200]{};
+        std::uint8_t target = 0;
+        std::size_t path_len = 0;
+        {
+            os::MutexLocker mlock(mutex_);
+            std::swap(target, update_target_node_id_);
+            path_len = update_file_path_.size();
+            buffer[0] = node_id_;
+            std::copy(update_file_path_.begin(), update_file_path_.end(), &buffer[1]);
+        }
+
+        if (target != 0)
+        {
+            using impl_::dsdl::BeginFirmwareUpdate;
+            (void) canardRequestOrRespond(&canard_,
+                                          target,
+                                          BeginFirmwareUpdate::DataTypeSignature,
+                                          BeginFirmwareUpdate::DataTypeID,
+                                          &begin_update_transfer_id_,
+                                          CANARD_TRANSFER_PRIORITY_LOW,
+                                          CanardRequest,
+                                          buffer,
+                                          std::uint16_t(1U + path_len));
+        }
+    }
+
+    void main() override
+    {
+        this->setName("simpeer");
+
+        std::uint32_t bit_rate = 0;
+        std::uint64_t next_1hz_task_at = timekeeper_.getMicroseconds();
+
+        while (!os::isRebootRequested())
+        {
+            if (bit_rate != iface_.getBus().getBitRate())       // Following the changes made by the benchmark
+            {
+                bit_rate = iface_.getBus().getBitRate();
+                (void) iface_.init(bit_rate, ICANIface::Mode::Normal, ICANIface::AcceptanceFilterConfig());
+            }
+
+            (void) iface_.waitForEvent(ICANIface::EventRxReady |
+                                       ((canardPeekTxQueue(&canard_) != nullptr) ? ICANIface::EventTxReady : 0U),
+                                       10);
+
+            while (true)
+            {
+                const auto rx = iface_.receive(0);
+                if (rx.first <= 0)
+                {
+                    break;
+                }
+                canardHandleRxFrame(&canard_, &rx.second, timekeeper_.getMicroseconds());
+            }
+
+            sendBeginFirmwareUpdateIfRequested();
+
+            for (const CanardCANFrame* txf = canardPeekTxQueue(&canard_);
+                 txf != nullptr;
+                 txf = canardPeekTxQueue(&canard_))
+            {
+                if (iface_.send(*txf, 0) == 0)
+                {
+                    break;
+                }
+                canardPopTxQueue(&canard_);
+            }
+
+            if (timekeeper_.getMicroseconds() >= next_1hz_task_at)
+            {
+                next_1hz_task_at += 1000000U;
+                canardCleanupStaleTransfers(&canard_, timekeeper_.getMicroseconds());
+                sendNodeStatus();
+            }
+        }
+    }
+
+public:
+    /**
+     * @param bus           the bus to attach to
+     * @param node_id       node ID of the peer
+     * @param image_size    size of the synthetic image to serve; zero disables the file server
+     * @param allocator     whether to act as the dynamic node ID allocator
+     */
+    SimulatedPeer(VirtualCANBus& bus,
+                  const std::uint8_t node_id,
+                  const std::uint32_t image_size,
+                  const bool allocator) :
+        iface_(bus),
+        node_id_(node_id),
+        image_size_(image_size),
+        allocator_(allocator)
+    {
+        canardInit(&canard_,
+                   memory_pool_.data(),
+                   memory_pool_.size(),
+                   &SimulatedPeer::onTransferReceptionTrampoline,
+                   &SimulatedPeer::shouldAcceptTransferTrampoline,
+                   this);
+        canardSetLocalNodeID(&canard_, node_id_);
+    }
+
+    /**
+     * Content of the synthetic image.
+     */
+    static std::uint8_t getImageByte(const std::uint64_t offset)
+    {
+        return std::uint8_t((offset * 31U) ^ (offset >> 8U));
+    }
+
+    /**
+     * Asks the target node to update from this peer. Thread-safe.
+     */
+    void requestUpdate(const std::uint8_t target_node_id, const char* const path)
+    {
+        os::MutexLocker mlock(mutex_);
+        update_target_node_id_ = target_node_id;
+        update_file_path_ = path;
+    }
+
+    Statistics getStatistics() const
+    {
+        os::MutexLocker mlock(mutex_);
+        return stats_;
+    }
+
+    void resetStatistics()
+    {
+        os::MutexLocker mlock(mutex_);
+        stats_ = Statistics();
+    }
+
+    std::uint8_t getNodeID() const { return node_id_; }
+};
+
+/**
+ * Benchmark results; the times are in microseconds, zero if the stage has not been completed.
+ */
+struct BenchmarkResult
+{
+    int status = 0;                                     ///< Negative if the benchmark has failed
+    std::uint64_t time_to_online_usec = 0;              ///< From start to the node ID assignment
+    std::uint64_t transfer_time_usec = 0;               ///< From the update request to the end of the download
+    std::uint64_t bytes_served = 0;                     ///< By all servers, including retransmissions
+    VirtualCANBus::Statistics bus;
+};
+
+/**
+ * Runs one benchmark scenario: starts the node under test using the provided function, waits for it to come online
+ * (the bit rate detection and the node ID allocation are performed unless the node is given the values explicitly),
+ * then requests the update from the specified servers concurrently and waits for the download to finish.
+ * The statistics of the bus and of the servers are reset beforehand.
+ *
+ * @param node              the node under test; its Bootloader instance should use @ref NullAppStorageBackend
+ * @param bootloader        the Bootloader instance used by the node
+ * @param bus               the bus the node and the peers are attached to
+ * @param servers           the peers that serve the image; their number is the window size, i.e. the number of
+ *                          concurrently outstanding requests, which is limited by the node's MaxFileServers
+ * @param num_servers       number of entries in the array above
+ * @param start_node        function that starts or restarts the node
+ * @param timeout_sec       the benchmark fails with -ErrTimeout if any stage takes longer than this
+ */
+template <typename Node, typename Peer, typename StartNode>
+BenchmarkResult measureBenchmark(Node& node,
+                                 ::os::bootloader::Bootloader& bootloader,
+                                 VirtualCANBus& bus,
+                                 Peer* const servers[],
+                                 const unsigned num_servers,
+                                 const StartNode& start_node,
+                                 const unsigned timeout_sec = 120)
+{
+    impl_::MonotonicTimekeeper timekeeper;
+    BenchmarkResult result;
+
+    const auto wait_for = [&](const auto& condition) -> bool
+    {
+        const std::uint64_t deadline = timekeeper.getMicroseconds() + timeout_sec * 1000000ULL;
+        while (!condition())
+        {
+            if ((timekeeper.getMicroseconds() > deadline) || os::isRebootRequested())
+            {
+                return false;
+            }
+            chThdSleepMilliseconds(1);
+        }
+        return true;
+    };
+
+    bus.resetStatistics();
+    for (unsigned i = 0; i < num_servers; i++)
+    {
+        servers[i]->resetStatistics();
+    }
+
+    /*
+     * Time to online
+     */
+    const std::uint64_t started_at = timekeeper.getMicroseconds();
+    start_node();
+
+    if (!wait_for([&]() { return node.getLocalNodeID() != 0; }))
+    {
+        result.status = -ErrTimeout;
+        return result;
+    }
+    result.time_to_online_usec = timekeeper.getMicroseconds() - started_at;
+
+    /*
+     * Full image transfer
+     */
+    const std::uint64_t update_requested_at = timekeeper.getMicroseconds();
+    for (unsigned i = 0; i < num_servers; i++)
+    {
+        servers[i]->requestUpdate(node.getLocalNodeID(), "benchmark.bin");
+        chThdSleepMilliseconds(1);                      // The first one becomes the primary server
+    }
+
+    if (!wait_for([&]() { return bootloader.getState() == State::AppUpgradeInProgress; }) ||
+        !wait_for([&]() { return bootloader.getState() != State::AppUpgradeInProgress; }))
+    {
+        result.status = -ErrTimeout;
+        return result;
+    }
+    result.transfer_time_usec = timekeeper.getMicroseconds() - update_requested_at;
+
+    for (unsigned i = 0; i < num_servers; i++)
+    {
+        result.bytes_served += servers[i]->getStatistics().bytes_served;
+    }
+    result.bus = bus.getStatistics();
+    return result;
+}
+
+/**
+ * Starts the node and runs one benchmark scenario, see @ref measureBenchmark().
+ */
+template <typename Node, typename Peer>
+BenchmarkResult runBenchmark(Node& node,
+                             ::os::bootloader::Bootloader& bootloader,
+                             VirtualCANBus& bus,
+                             Peer* const servers[],
+                             const unsigned num_servers,
+                             const ::tprio_t thread_priority,
+                             const unsigned timeout_sec = 120)
+{
+    return measureBenchmark(node, bootloader, bus, servers, num_servers,
+                            [&]() { (void) node.start(thread_priority); }, timeout_sec);
+}
+
+/**
+ * Runs the benchmark for every combination of the bus bit rate and the window size in one run.
+ * The window size goes from one to the number of servers; see @ref measureBenchmark().
+ * The node is started for the first configuration and restarted for every next one, so that every configuration
+ * includes the bit rate detection and the node ID allocation. The peers follow the changes of the bus bit rate.
+ *
+ * @param bit_rates         the bus bit rates to benchmark at
+ * @param num_bit_rates     number of entries in the array above
+ * @param callback          invoked as (const BenchmarkResult&, bit_rate, window_size) after every configuration
+ * @return                  number of failed configurations
+ */
+template <typename Node, typename Peer, typename Callback>
+unsigned runBenchmarkSweep(Node& node,
+                           ::os::bootloader::Bootloader& bootloader,
+                           VirtualCANBus& bus,
+                           Peer* const servers[],
+                           const unsigned num_servers,
+                           const std::uint32_t bit_rates[],
+                           const unsigned num_bit_rates,
+                           const ::tprio_t thread_priority,
+                           const Callback& callback,
+                           const unsigned timeout_sec = 120)
+{
+    bool started = false;
+    const auto start_node = [&]()
+    {
+        if (started)
+        {
+            node.restart();
+        }
+        else
+        {
+            (void) node.start(thread_priority);
+            started = true;
+        }
+    };
+
+    unsigned num_failures = 0;
+    for (unsigned i = 0; i < num_bit_rates; i++)
+    {
+        bus.setBitRate(bit_rates[i]);
+
+        for (unsigned window_size = 1; window_size <= num_servers; window_size++)
+        {
+            const BenchmarkResult result =
+                measureBenchmark(node, bootloader, bus, servers, window_size, start_node, timeout_sec);
+            if (result.status < 0)
+            {
+                num_failures++;
+            }
+            callback(result, bit_rates[i], window_size);
+
+            if (os::isRebootRequested())
+            {
+                return num_failures;
+            }
+        }
+    }
+    return num_failures;
+}
+
+/**
+ * Prints the benchmark results in a human-readable form.
+ */
+inline void printBenchmarkResult(const BenchmarkResult& r, const std::uint32_t bit_rate, const unsigned window_size)
+{
+    os::Logger logger("Bootloader.UAVCAN.Benchmark");
+    logger.println("%u bps, window %u: status %d, online %u ms, transfer %u ms, %u B served",
+                   unsigned(bit_rate), window_size, r.status,
+                   unsigned(r.time_to_online_usec / 1000U), unsigned(r.transfer_time_usec / 1000U),
+                   unsigned(r.bytes_served));
+    logger.println("Bus: %u frames, %u corrupted, %u lost, utilization %u%%",
+                   unsigned(r.bus.frames_delivered), unsigned(r.bus.frames_corrupted), unsigned(r.bus.frames_lost),
+                   unsigned((r.transfer_time_usec + r.time_to_online_usec > 0) ?
+                            (r.bus.busy_time_usec * 100U) / (r.transfer_time_usec + r.time_to_online_usec) : 0U));
+}
+
+}
+}
+}
+}
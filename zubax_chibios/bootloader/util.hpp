@@ -69,5 +69,43 @@ public:
     std::uint64_t get() const { return crc_ ^ 0xFFFFFFFFFFFFFFFFULL; }
 };
 
+/**
+ * This class provides an absolute time base that never overflows.
+ * Note that the implementation requires two things:
+ *      - The system tick interval must be an integer number of microseconds (checked at compile time)
+ *      - The system time is queried at least once between system time overflows (not checked!)
+ */
+class MonotonicTimekeeper
+{
+    static_assert(unsigned(1000000 / unsigned(1000000 / CH_CFG_ST_FREQUENCY)) == CH_CFG_ST_FREQUENCY,
+                  "The system tick interval must be an integer number of microseconds!");
+
+    mutable ::systime_t prev_sample_at_st_ = 0;
+    mutable std::uint64_t base_usec_ = 0;
+    const std::uint64_t started_at_usec_;
+
+public:
+    MonotonicTimekeeper() :
+        started_at_usec_(getMicroseconds())
+    { }
+
+    std::uint64_t getMicroseconds() const
+    {
+        // Computing increment since last invocation
+        const ::systime_t ts = chVTGetSystemTimeX();
+        const std::uint64_t increment_usec =
+            TIME_I2US(::systime_t(ts - prev_sample_at_st_)); // this shall be 64 bit wide!
+        prev_sample_at_st_ = ts;
+        // Add the increment to the absolute time estimate
+        base_usec_ += increment_usec;
+        return base_usec_;
+    }
+
+    std::uint64_t getUptimeMicroseconds() const
+    {
+        return getMicroseconds() - started_at_usec_;
+    }
+};
+
 }
 }
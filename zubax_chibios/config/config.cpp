@@ -20,6 +20,7 @@
 #include <cstdint>
 #include <limits>
 #include <zubax_chibios/os.hpp>
+#include <zubax_chibios/sys/benchmark.hpp>
 #include "config.hpp"
 #include "config.h"
 
@@ -52,7 +53,7 @@ static int _num_params = 0;
 static std::uint32_t _layout_hash = 0;
 static bool _frozen = false;
 
-static chibios_rt::Mutex _mutex;
+static os::NamedMutex _mutex("Config");
 
 static unsigned _modification_cnt = 0;
 
@@ -327,6 +328,28 @@ float configGet(const char* name)
     return val;
 }
 
+/*
+ * The parameters are looked up by name, so the cost depends on the number of parameters;
+ * the last one is the worst case. configSet() is not benchmarked, because it increments the modification counter
+ * even if the value is unchanged, which may make the application save the configuration into the flash.
+ */
+#if BENCHMARKS_ENABLED
+
+static const char* getNameOfLastParam()
+{
+    return (_frozen && (_num_params > 0)) ? _descr_pool[_num_params - 1]->name : nullptr;
+}
+
+OS_BENCHMARK("config.get", 0)
+{
+    if (const char* const name = getNameOfLastParam())
+    {
+        os::benchmark::doNotOptimizeAway(configGet(name));
+    }
+}
+
+#endif
+
 namespace os
 {
 namespace config
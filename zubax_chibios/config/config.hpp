@@ -11,6 +11,7 @@
 #include <variant>
 #include <optional>
 #include <cstdint>
+#include <zubax_chibios/sys/sys.hpp>
 #include "config.h"
 
 
@@ -219,5 +220,32 @@ using ParamMetadataPointer = std::variant<
  */
 std::optional<ParamMetadataPointer> getParamMetadata(const char* name);
 
+/**
+ * Configuration parameter that holds the run time log level of a module, see os::setLogLevel().
+ * The value is the numeric log level: 0 - debug, 1 - info, 2 - warning, 3 - error, 4 - off.
+ * The value is not applied automatically; call apply() after the configuration is initialized
+ * and whenever getModificationCounter() changes.
+ *
+ *      static LogLevelParam param_log_uavcan("log.uavcan", "Bootloader.UAVCAN", LogLevel::Warning);
+ */
+class LogLevelParam
+{
+    Param<std::uint8_t> param_;
+    const char* const module_name_;
+
+public:
+    LogLevelParam(const char* param_name, const char* module_name, LogLevel default_level) :
+        param_(param_name, std::uint8_t(default_level), std::uint8_t(LogLevel::Debug), std::uint8_t(LogLevel::Off)),
+        module_name_(module_name)
+    { }
+
+    int apply() const
+    {
+        return setLogLevel(module_name_, LogLevel(param_.get()));
+    }
+
+    const Param<std::uint8_t>& getParam() const { return param_; }
+};
+
 }
 }
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#include "benchmark.hpp"
+#include "sys.hpp"
+#include <hal.h>
+#include <zubax_chibios/bootloader/util.hpp>
+#include <zubax_chibios/util/base64.hpp>
+#include <array>
+#include <algorithm>
+#include <cstring>
+
+/**
+ * Frequency of the DWT cycle counter, which is the core clock.
+ */
+#if !defined(BENCHMARK_CYCLE_COUNTER_FREQUENCY)
+# define BENCHMARK_CYCLE_COUNTER_FREQUENCY  STM32_HCLK
+#endif
+
+/**
+ * The number of iterations is chosen so that one run takes at least this long.
+ */
+#if !defined(BENCHMARK_RUN_DURATION_MS)
+# define BENCHMARK_RUN_DURATION_MS          20
+#endif
+
+/**
+ * The flash read benchmark reads this many bytes from the beginning of the flash in a circular manner,
+ * so that the prefetch buffers and caches are defeated as they would be by the real code.
+ */
+#if !defined(BENCHMARK_FLASH_READ_REGION_SIZE)
+# define BENCHMARK_FLASH_READ_REGION_SIZE   16384
+#endif
+
+
+namespace os
+{
+namespace benchmark
+{
+namespace
+{
+
+constexpr unsigned NumRuns = 3;
+constexpr std::uint32_t MaxIterations = 1UL << 24;
+
+Benchmark* g_benchmarks = nullptr;              ///< Linked list, populated during the static initialization
+
+__attribute__((noinline))
+void emptyBenchmark() { }
+
+/**
+ * Not inlined, so that the call overhead is the same for every benchmark and for the empty function.
+ */
+__attribute__((noinline))
+std::uint32_t measure(void (* const function)(), const std::uint32_t iterations)
+{
+    const std::uint32_t started_at = DWT->CYCCNT;
+    for (std::uint32_t i = 0; i < iterations; i++)
+    {
+        function();
+    }
+    return DWT->CYCCNT - started_at;
+}
+
+/**
+ * Returns the shortest of several runs, which is the one least disturbed by the interrupts.
+ */
+std::uint32_t measureBest(void (* const function)(), const std::uint32_t iterations)
+{
+    std::uint32_t best = 0xFFFFFFFFU;
+    for (unsigned i = 0; i < NumRuns; i++)
+    {
+        best = std::min(best, measure(function, iterations));
+    }
+    return best;
+}
+
+std::uint32_t calibrate(void (* const function)())
+{
+    constexpr std::uint32_t TargetCycles = std::uint32_t(std::uint64_t(BENCHMARK_CYCLE_COUNTER_FREQUENCY) *
+                                                         BENCHMARK_RUN_DURATION_MS / 1000U);
+    std::uint32_t iterations = 1;
+    while ((iterations < MaxIterations) && (measure(function, iterations) < TargetCycles))
+    {
+        iterations *= 2U;
+    }
+    return iterations;
+}
+
+}
+
+Benchmark::Benchmark(const char* const name, const std::uint32_t bytes_per_operation, void (* const function)()) :
+    name_(name),
+    bytes_per_operation_(bytes_per_operation),
+    function_(function)
+{
+    next_ = g_benchmarks;
+    g_benchmarks = this;
+}
+
+std::uint64_t Result::getCyclesPerOperationX100() const
+{
+    return (iterations > 0) ? ((cycles * 100U) / iterations) : 0;
+}
+
+std::uint64_t Result::getBytesPerSecond() const
+{
+    if ((cycles == 0) || (bytes_per_operation == 0))
+    {
+        return 0;
+    }
+    return (std::uint64_t(bytes_per_operation) * iterations * BENCHMARK_CYCLE_COUNTER_FREQUENCY) / cycles;
+}
+
+void forEach(const std::function<void (const char* name, std::uint32_t bytes_per_operation)>& callback)
+{
+    for (const Benchmark* b = g_benchmarks; b != nullptr; b = b->next_)
+    {
+        callback(b->name_, b->bytes_per_operation_);
+    }
+}
+
+int run(const char* const name_prefix, const bool isolate, const std::function<void (const Result&)>& callback)
+{
+    // The DWT cycle counter is enabled by the port of the OS; this is just to make sure
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    int count = 0;
+    for (const Benchmark* b = g_benchmarks; b != nullptr; b = b->next_)
+    {
+        if (std::strncmp(b->name_, name_prefix, std::strlen(name_prefix)) != 0)
+        {
+            continue;
+        }
+
+        Result result;
+        result.name = b->name_;
+        result.bytes_per_operation = b->bytes_per_operation_;
+        {
+            TemporaryPriorityChanger priority_changer(isolate ? HIGHPRIO : chThdGetSelfX()->prio);
+
+            result.iterations = calibrate(b->function_);
+            const std::uint32_t total = measureBest(b->function_, result.iterations);
+            const std::uint32_t overhead = measureBest(&emptyBenchmark, result.iterations);
+            result.cycles = (total > overhead) ? (total - overhead) : 0;
+        }
+
+        callback(result);
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Built-in benchmarks of the facilities of this library. Those of the configuration storage are defined in config.cpp.
+ */
+#if BENCHMARKS_ENABLED
+
+namespace
+{
+
+std::array<std::uint8_t, 1024> g_data_buffer{};
+
+OS_BENCHMARK("crc64we.1k", 1024)
+{
+    bootloader::CRC64WE crc;
+    crc.add(g_data_buffer.data(), unsigned(g_data_buffer.size()));
+    doNotOptimizeAway(crc.get());
+}
+
+OS_BENCHMARK("base64.encode.48", 48)
+{
+    std::array<std::uint8_t, 48> input{};
+    char output[base64::predictEncodedDataLength(48) + 1];
+    std::memcpy(input.data(), g_data_buffer.data(), input.size());
+    doNotOptimizeAway(base64::encode(input, &output[0]));
+}
+
+OS_BENCHMARK("base64.decode.48", 48)
+{
+    static const char* const Encoded = "AAECAwQFBgcICQoLDA0ODxAREhMUFRYXGBkaGxwdHh8gISIjJCUmJygpKissLS4v";
+    std::array<std::uint8_t, 48> output{};
+    doNotOptimizeAway(base64::decode(output, Encoded));
+    doNotOptimizeAway(output);
+}
+
+OS_BENCHMARK("flash.read.1k", 1024)
+{
+    static_assert((BENCHMARK_FLASH_READ_REGION_SIZE % 1024) == 0, "Flash read region size must be a multiple of 1K");
+    static std::uint32_t offset = 0;
+
+    const volatile std::uint32_t* const words =
+        reinterpret_cast<const volatile std::uint32_t*>(FLASH_BASE + offset);
+    std::uint32_t sum = 0;
+    for (unsigned i = 0; i < 1024 / 4; i++)
+    {
+        sum += words[i];
+    }
+    doNotOptimizeAway(sum);
+
+    offset = (offset + 1024U) % BENCHMARK_FLASH_READ_REGION_SIZE;
+}
+
+OS_BENCHMARK("memcpy.1k", 1024)
+{
+    static std::array<std::uint8_t, 1024> destination;
+    std::memcpy(destination.data(), g_data_buffer.data(), destination.size());
+    doNotOptimizeAway(destination);
+}
+
+}
+
+#endif
+
+}
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Micro-benchmarks executed on the target, so that the flash wait states, the caches, and the bus contention are
+ * accounted for. A benchmark is a function that performs one operation; it is registered with the macro:
+ *
+ *      OS_BENCHMARK("crc64we.1k", 1024)          // Name (must be a literal), bytes processed per operation or 0
+ *      {
+ *          CRC64WE crc;
+ *          crc.add(g_buffer, 1024);
+ *          os::benchmark::doNotOptimizeAway(crc.get());
+ *      }
+ *
+ * The runner calibrates the number of iterations so that a run takes about BENCHMARK_RUN_DURATION_MS,
+ * measures several runs with the DWT cycle counter, takes the fastest one, and subtracts the call overhead.
+ * The results are reported in cycles per operation and bytes per second; see the shell command "bench".
+ *
+ * The benchmarks are registered only if BENCHMARKS_ENABLED is set; otherwise they are compiled but discarded.
+ */
+
+#pragma once
+
+#include <ch.hpp>
+#include <cstdint>
+#include <functional>
+
+/**
+ * Must be defined identically for all translation units, normally via UDEFS.
+ */
+#if !defined(BENCHMARKS_ENABLED)
+# define BENCHMARKS_ENABLED             0
+#endif
+
+#define OS_BENCHMARK_CAT2_(a, b)        a##b
+#define OS_BENCHMARK_CAT1_(a, b)        OS_BENCHMARK_CAT2_(a, b)
+
+#if BENCHMARKS_ENABLED
+# define OS_BENCHMARK(name, bytes_per_operation)                                                    \
+    static void OS_BENCHMARK_CAT1_(os_benchmark_fn_, __LINE__)();                                   \
+    static ::os::benchmark::Benchmark OS_BENCHMARK_CAT1_(os_benchmark_, __LINE__)(                  \
+        name, bytes_per_operation, &OS_BENCHMARK_CAT1_(os_benchmark_fn_, __LINE__));                \
+    static void OS_BENCHMARK_CAT1_(os_benchmark_fn_, __LINE__)()
+#else
+# define OS_BENCHMARK(name, bytes_per_operation)                                                    \
+    [[maybe_unused]] static void OS_BENCHMARK_CAT1_(os_benchmark_fn_, __LINE__)()
+#endif
+
+
+namespace os
+{
+namespace benchmark
+{
+/**
+ * Prevents the compiler from eliminating the computation of the value as unused.
+ */
+template <typename T>
+inline void doNotOptimizeAway(const T& value)
+{
+    asm volatile ("" : : "g"(value) : "memory");
+}
+
+struct Result
+{
+    const char* name = nullptr;
+    std::uint32_t bytes_per_operation = 0;
+    std::uint32_t iterations = 0;
+    std::uint64_t cycles = 0;                   ///< Of all iterations, excluding the call overhead
+
+    /// Fixed point with two decimal places, because the shell does not print floats.
+    std::uint64_t getCyclesPerOperationX100() const;
+
+    /// Zero if the benchmark does not process any data.
+    std::uint64_t getBytesPerSecond() const;
+};
+
+/**
+ * Registration record of a benchmark; prefer the macro OS_BENCHMARK().
+ * The instances must have static storage duration.
+ */
+class Benchmark
+{
+    friend void forEach(const std::function<void (const char* name, std::uint32_t bytes_per_operation)>&);
+    friend int run(const char*, bool, const std::function<void (const Result&)>&);
+
+    const char* const name_;
+    const std::uint32_t bytes_per_operation_;
+    void (* const function_)();
+    Benchmark* next_ = nullptr;
+
+public:
+    Benchmark(const char* name, std::uint32_t bytes_per_operation, void (*function)());
+
+    Benchmark(const Benchmark&) = delete;
+    Benchmark& operator=(const Benchmark&) = delete;
+};
+
+/**
+ * Invokes the callback for every registered benchmark.
+ */
+void forEach(const std::function<void (const char* name, std::uint32_t bytes_per_operation)>& callback);
+
+/**
+ * Runs the benchmarks whose names begin with the prefix (an empty prefix matches all), reporting each result
+ * via the callback. If isolate is set, the calling thread is raised to HIGHPRIO for the duration of each benchmark,
+ * so that the threads of lower priority cannot preempt it; the interrupts and the other HIGHPRIO threads are not
+ * excluded.
+ * Returns the number of benchmarks executed.
+ */
+int run(const char* name_prefix, bool isolate, const std::function<void (const Result&)>& callback);
+
+}
+}
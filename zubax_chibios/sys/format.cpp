@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#include "format.hpp"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+
+namespace os
+{
+namespace format
+{
+
+void BufferOutput::write(const char* const data, const std::size_t size)
+{
+    if (capacity_ > 0)
+    {
+        const std::size_t amount = std::min(size, capacity_ - 1U - size_);
+        std::memcpy(&buffer_[size_], data, amount);
+        size_ += amount;
+        buffer_[size_] = '\0';
+    }
+}
+
+namespace impl_
+{
+namespace
+{
+/// Enough for a 64-bit binary number
+constexpr std::size_t ConversionBufferSize = 64;
+
+constexpr unsigned MaxFloatPrecision = 9;
+constexpr unsigned DefaultFloatPrecision = 6;
+
+void writePadding(IOutput& out, const char fill, std::size_t amount)
+{
+    static const char Spaces[] = "                ";
+    static const char Zeros[]  = "0000000000000000";
+    const char* const source = (fill == '0') ? Zeros : Spaces;
+    while (amount > 0)
+    {
+        const std::size_t chunk = std::min(amount, sizeof(Spaces) - 1U);
+        out.write(source, chunk);
+        amount -= chunk;
+    }
+}
+
+/**
+ * Writes the field applying the width and the alignment. The sign, if any, is kept before the zero padding.
+ */
+void writeField(IOutput& out, const Spec& spec, const char default_align,
+                const char* const sign, const char* const body, const std::size_t body_size)
+{
+    const std::size_t sign_size = std::strlen(sign);
+    const std::size_t padding = (spec.width > (sign_size + body_size)) ? (spec.width - sign_size - body_size) : 0U;
+    const char align = (spec.align != '\0') ? spec.align : default_align;
+
+    if (align == '<')
+    {
+        out.write(sign, sign_size);
+        out.write(body, body_size);
+        writePadding(out, ' ', padding);
+    }
+    else if (spec.zero_pad)
+    {
+        out.write(sign, sign_size);
+        writePadding(out, '0', padding);
+        out.write(body, body_size);
+    }
+    else
+    {
+        writePadding(out, ' ', padding);
+        out.write(sign, sign_size);
+        out.write(body, body_size);
+    }
+}
+
+/**
+ * Converts the number into the end of the buffer; returns the pointer to the first digit.
+ */
+char* convertUnsigned(std::uint64_t x, const unsigned base, const bool uppercase, char* const buffer_end)
+{
+    const char* const digits = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+    char* p = buffer_end;
+    do
+    {
+        *--p = digits[x % base];
+        x /= base;
+    }
+    while (x > 0);
+    return p;
+}
+
+unsigned getBase(const char type)
+{
+    switch (type)
+    {
+    case 'x':
+    case 'X':
+    case 'p':
+        return 16;
+    case 'o':
+        return 8;
+    case 'b':
+        return 2;
+    default:
+        return 10;
+    }
+}
+
+void formatInteger(IOutput& out, const Spec& spec, const bool negative, const std::uint64_t magnitude)
+{
+    char buffer[ConversionBufferSize];
+    char* const end = &buffer[0] + sizeof(buffer);
+    const char* const begin = convertUnsigned(magnitude, getBase(spec.type), spec.type == 'X', end);
+    writeField(out, spec, '>', negative ? "-" : "", begin, std::size_t(end - begin));
+}
+
+void formatFloat(IOutput& out, const Spec& spec, double x)
+{
+    const bool negative = std::signbit(x);
+    if (negative)
+    {
+        x = -x;
+    }
+
+    if (x != x)
+    {
+        writeField(out, spec, '>', "", "nan", 3);
+        return;
+    }
+    if (std::isinf(x))
+    {
+        writeField(out, spec, '>', negative ? "-" : "", "inf", 3);
+        return;
+    }
+
+    unsigned exponent = 0;                          // Too large for the integer part: printed as d.ddde+NN
+    if (x > 1.8e19)
+    {
+        while (x >= 10.0)
+        {
+            x /= 10.0;
+            exponent++;
+        }
+    }
+
+    const unsigned precision = (spec.precision >= 0) ?
+                               std::min(unsigned(spec.precision), MaxFloatPrecision) : DefaultFloatPrecision;
+    std::uint64_t scale = 1;
+    for (unsigned i = 0; i < precision; i++)
+    {
+        scale *= 10U;
+    }
+
+    std::uint64_t integer = std::uint64_t(x);
+    std::uint64_t fraction = std::uint64_t((x - double(integer)) * double(scale) + 0.5);
+    if (fraction >= scale)
+    {
+        fraction -= scale;
+        integer++;
+    }
+    if ((exponent > 0) && (integer >= 10U))         // The mantissa was rounded up to 10.000
+    {
+        integer = 1;
+        exponent++;
+    }
+
+    char buffer[ConversionBufferSize];
+    char* const end = &buffer[0] + sizeof(buffer);
+    char* const fraction_end = (exponent > 0) ? convertUnsigned(exponent, 10, false, end) - 2 : end;
+    if (exponent > 0)
+    {
+        fraction_end[0] = 'e';
+        fraction_end[1] = '+';
+    }
+    char* begin = fraction_end;
+    if (precision > 0)
+    {
+        begin = convertUnsigned(fraction, 10, false, fraction_end);
+        while (std::size_t(fraction_end - begin) < precision)
+        {
+            *--begin = '0';
+        }
+
+        std::size_t size = std::size_t(fraction_end - begin);
+        if (spec.type == '\0')                      // Shortest form: trailing zeros are not significant
+        {
+            while ((size > 0) && (begin[size - 1] == '0'))
+            {
+                size--;
+            }
+            std::memmove(fraction_end - size, begin, size);
+            begin = fraction_end - size;
+        }
+        if (size > 0)
+        {
+            *--begin = '.';
+        }
+    }
+    begin = convertUnsigned(integer, 10, false, begin);
+
+    writeField(out, spec, '>', negative ? "-" : "", begin, std::size_t(end - begin));
+}
+
+void formatString(IOutput& out, const Spec& spec, const char* const str)
+{
+    std::size_t size = std::strlen(str);
+    if (spec.precision >= 0)
+    {
+        size = std::min(size, std::size_t(spec.precision));
+    }
+    Spec spec_without_zeros = spec;
+    spec_without_zeros.zero_pad = false;
+    writeField(out, spec_without_zeros, '<', "", str, size);
+}
+
+void formatArg(IOutput& out, const Spec& spec, const Arg& arg)
+{
+    switch (arg.type)
+    {
+    case ArgType::Bool:
+    {
+        if ((spec.type == '\0') || (spec.type == 's'))
+        {
+            formatString(out, spec, arg.value.u ? "true" : "false");
+        }
+        else
+        {
+            formatInteger(out, spec, false, arg.value.u);
+        }
+        break;
+    }
+    case ArgType::Char:
+    case ArgType::Signed:
+    case ArgType::Unsigned:
+    {
+        if ((spec.type == 'c') || ((arg.type == ArgType::Char) && (spec.type == '\0')))
+        {
+            const char ch = char(arg.value.u);
+            Spec spec_without_zeros = spec;
+            spec_without_zeros.zero_pad = false;
+            writeField(out, spec_without_zeros, '<', "", &ch, 1);
+        }
+        else if ((arg.type == ArgType::Signed) && (arg.value.i < 0))
+        {
+            formatInteger(out, spec, true, ~std::uint64_t(arg.value.i) + 1U);  // Safe for the most negative value
+        }
+        else
+        {
+            formatInteger(out, spec, false, arg.value.u);
+        }
+        break;
+    }
+    case ArgType::Float:
+    {
+        formatFloat(out, spec, arg.value.f);
+        break;
+    }
+    case ArgType::String:
+    {
+        formatString(out, spec, arg.value.s);
+        break;
+    }
+    case ArgType::Pointer:
+    {
+        char buffer[ConversionBufferSize];
+        char* const end = &buffer[0] + sizeof(buffer);
+        char* begin = convertUnsigned(std::uint64_t(reinterpret_cast<std::uintptr_t>(arg.value.p)), 16, false, end);
+        *--begin = 'x';
+        *--begin = '0';
+        writeField(out, spec, '>', "", begin, std::size_t(end - begin));
+        break;
+    }
+    case ArgType::None:
+    default:
+    {
+        break;
+    }
+    }
+}
+
+} // namespace
+
+void vformat(IOutput& out, const char* format, const Arg* const args, const std::size_t num_args)
+{
+    std::size_t index = 0;
+    const char* literal = format;
+    while (*format != '\0')
+    {
+        const bool escaped_brace = ((format[0] == '{') || (format[0] == '}')) && (format[1] == format[0]);
+        if (escaped_brace || (*format == '{'))
+        {
+            out.write(literal, std::size_t(format - literal));
+            if (escaped_brace)
+            {
+                literal = format + 1;           // The second brace of the pair is emitted with the next literal
+                format += 2;
+                continue;
+            }
+
+            Spec spec;
+            const char* const next = parseSpec(format + 1, spec);
+            if ((next == nullptr) || (index >= num_args))
+            {
+                break;                          // Never happens because the format is validated at compile time
+            }
+            formatArg(out, spec, args[index++]);
+            format = next;
+            literal = next;
+        }
+        else
+        {
+            format++;
+        }
+    }
+    out.write(literal, std::size_t(format - literal));
+}
+
+} // namespace impl_
+} // namespace format
+} // namespace os
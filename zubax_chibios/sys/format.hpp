@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Type-safe heap-free text formatter with the format strings checked at compile time.
+ * The syntax is a subset of that of {fmt} and std::format:
+ *
+ *      {[:[<|>][0][width][.precision][type]]}
+ *
+ *      <, >        - left or right alignment; numbers are right-aligned by default, the rest is left-aligned
+ *      0           - pad numbers with zeros instead of spaces (after the sign)
+ *      width       - minimum field width
+ *      precision   - digits after the decimal point for floats; maximum length for strings
+ *      type        - d (decimal), x, X (hex), o (octal), b (binary) for integers, chars and bools;
+ *                    f (fixed point; above 1.8e19 the exponent form d.ddde+NN) for floats; s for strings and bools;
+ *                    c for chars; p for pointers
+ *      {{ }}       - literal braces
+ *
+ * The format string must be wrapped into OS_FMT(), which turns it into a type so that it can be validated against
+ * the argument types at compile time:
+ *
+ *      os::print(OS_FMT("Voltage {:.2f} V, status 0x{:08x}, {}\n"), voltage, status, name);
+ *
+ * The output is produced in chunks into an IOutput, so there is no intermediate buffer and no length limit.
+ * 64-bit integers are supported.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+
+/**
+ * Turns the string literal into a type that carries the string as a constant expression.
+ */
+#define OS_FMT(str)                                                                 \
+    [] {                                                                            \
+        struct OsFormatString_                                                      \
+        {                                                                           \
+            static constexpr const char* get() { return str; }                      \
+        };                                                                          \
+        return OsFormatString_{};                                                   \
+    }()
+
+
+namespace os
+{
+namespace format
+{
+/**
+ * Receives the formatted text in chunks of arbitrary size.
+ */
+class IOutput
+{
+public:
+    virtual ~IOutput() { }
+
+    virtual void write(const char* data, std::size_t size) = 0;
+};
+
+/**
+ * Writes into a fixed buffer, truncating the output if it does not fit; the buffer is always null-terminated.
+ */
+class BufferOutput : public IOutput
+{
+    char* const buffer_;
+    const std::size_t capacity_;
+    std::size_t size_ = 0;
+
+public:
+    BufferOutput(char* buffer, std::size_t capacity) :
+        buffer_(buffer),
+        capacity_(capacity)
+    {
+        if (capacity_ > 0)
+        {
+            buffer_[0] = '\0';
+        }
+    }
+
+    void write(const char* data, std::size_t size) override;
+
+    /// Length of the string in the buffer, excluding the terminator.
+    std::size_t getSize() const { return size_; }
+};
+
+/**
+ * Implementation details, do not use directly.
+ */
+namespace impl_
+{
+
+enum class ArgType : std::uint8_t
+{
+    None,
+    Bool,
+    Char,
+    Signed,
+    Unsigned,
+    Float,
+    String,
+    Pointer
+};
+
+/**
+ * The underlying type of enums; the type itself otherwise.
+ */
+template <typename T, bool = std::is_enum<T>::value>
+struct IntegerOf { using Type = T; };
+
+template <typename T>
+struct IntegerOf<T, true> { using Type = typename std::underlying_type<T>::type; };
+
+/**
+ * Type-erased argument, so that the formatting logic is not instantiated per argument type combination.
+ */
+struct Arg
+{
+    ArgType type = ArgType::None;
+    union
+    {
+        std::int64_t i;
+        std::uint64_t u;
+        double f;
+        const char* s;
+        const void* p;
+    } value{};
+
+    Arg() { }
+    Arg(const bool x)           : type(ArgType::Bool)     { value.u = x; }
+    Arg(const char x)           : type(ArgType::Char)     { value.u = std::uint8_t(x); }
+    Arg(const float x)          : type(ArgType::Float)    { value.f = double(x); }
+    Arg(const double x)         : type(ArgType::Float)    { value.f = x; }
+    Arg(const char* const x)    : type(ArgType::String)   { value.s = (x == nullptr) ? "(null)" : x; }
+    Arg(const void* const x)    : type(ArgType::Pointer)  { value.p = x; }
+
+    template <typename T, typename = typename std::enable_if<std::is_integral<T>::value ||
+                                                             std::is_enum<T>::value>::type>
+    Arg(const T x)
+    {
+        using U = typename IntegerOf<T>::Type;
+        if (std::is_signed<U>::value)
+        {
+            type = ArgType::Signed;
+            value.i = std::int64_t(U(x));
+        }
+        else
+        {
+            type = ArgType::Unsigned;
+            value.u = std::uint64_t(U(x));
+        }
+    }
+};
+
+template <typename T>
+constexpr ArgType getArgType()
+{
+    using D = typename std::decay<T>::type;
+    return std::is_same<D, bool>::value ? ArgType::Bool :
+           std::is_same<D, char>::value ? ArgType::Char :
+           std::is_floating_point<D>::value ? ArgType::Float :
+           (std::is_same<D, char*>::value || std::is_same<D, const char*>::value) ? ArgType::String :
+           std::is_pointer<D>::value ? ArgType::Pointer :
+           (std::is_integral<D>::value || std::is_enum<D>::value) ?
+               (std::is_signed<typename IntegerOf<D>::Type>::value ? ArgType::Signed : ArgType::Unsigned) :
+           ArgType::None;
+}
+
+template <typename... Args>
+struct ArgTypeList
+{
+    static constexpr ArgType Types[] = { getArgType<Args>()..., ArgType::None };
+};
+
+/**
+ * Parsed replacement field.
+ */
+struct Spec
+{
+    char align = '\0';          ///< '<', '>', or zero if not specified
+    bool zero_pad = false;
+    std::uint16_t width = 0;
+    std::int16_t precision = -1;
+    char type = '\0';           ///< Zero if not specified
+};
+
+/**
+ * Parses the replacement field that starts after the opening brace.
+ * Returns the pointer past the closing brace, or nullptr if the field is malformed.
+ */
+constexpr const char* parseSpec(const char* p, Spec& out)
+{
+    if (*p == ':')
+    {
+        p++;
+        if ((*p == '<') || (*p == '>'))
+        {
+            out.align = *p++;
+        }
+        if (*p == '0')
+        {
+            out.zero_pad = true;
+            p++;
+        }
+        while ((*p >= '0') && (*p <= '9'))
+        {
+            out.width = std::uint16_t(out.width * 10 + (*p++ - '0'));
+        }
+        if (*p == '.')
+        {
+            p++;
+            out.precision = 0;
+            if (!((*p >= '0') && (*p <= '9')))
+            {
+                return nullptr;
+            }
+            while ((*p >= '0') && (*p <= '9'))
+            {
+                out.precision = std::int16_t(out.precision * 10 + (*p++ - '0'));
+            }
+        }
+        if ((*p != '}') && (*p != '\0'))
+        {
+            out.type = *p++;
+        }
+    }
+    return (*p == '}') ? (p + 1) : nullptr;
+}
+
+constexpr bool isSpecApplicable(const Spec& spec, const ArgType type)
+{
+    const char t = spec.type;
+    switch (type)
+    {
+    case ArgType::Bool:
+        return (t == '\0') || (t == 's') || (t == 'd') || (t == 'x') || (t == 'X') || (t == 'o') || (t == 'b');
+    case ArgType::Char:
+        return (t == '\0') || (t == 'c') || (t == 'd') || (t == 'x') || (t == 'X') || (t == 'o') || (t == 'b');
+    case ArgType::Signed:
+    case ArgType::Unsigned:
+        return (t == '\0') || (t == 'd') || (t == 'x') || (t == 'X') || (t == 'o') || (t == 'b') || (t == 'c');
+    case ArgType::Float:
+        return (t == '\0') || (t == 'f');
+    case ArgType::String:
+        return (t == '\0') || (t == 's');
+    case ArgType::Pointer:
+        return (t == '\0') || (t == 'p');
+    case ArgType::None:
+    default:
+        return false;
+    }
+}
+
+/**
+ * Validates the format string against the argument types. Evaluated at compile time.
+ */
+constexpr bool checkFormat(const char* p, const ArgType* types, const std::size_t num_args)
+{
+    std::size_t index = 0;
+    while (*p != '\0')
+    {
+        if ((p[0] == '{') && (p[1] == '{'))
+        {
+            p += 2;
+        }
+        else if ((p[0] == '}') && (p[1] == '}'))
+        {
+            p += 2;
+        }
+        else if (*p == '}')
+        {
+            return false;           // Unmatched closing brace
+        }
+        else if (*p == '{')
+        {
+            Spec spec;
+            p = parseSpec(p + 1, spec);
+            if ((p == nullptr) || (index >= num_args) || !isSpecApplicable(spec, types[index]))
+            {
+                return false;
+            }
+            index++;
+        }
+        else
+        {
+            p++;
+        }
+    }
+    return index == num_args;
+}
+
+/**
+ * The formatting logic; the format string shall be validated beforehand.
+ */
+void vformat(IOutput& out, const char* format, const Arg* args, std::size_t num_args);
+
+} // namespace impl_
+
+/**
+ * True if the type has been produced by OS_FMT(). Used to tell the formatter overloads from the printf-style ones.
+ */
+template <typename T, typename = void>
+struct IsFormatString : std::false_type { };
+
+template <typename T>
+struct IsFormatString<T, decltype(void(T::get()))> : std::true_type { };
+
+/**
+ * Validates the format string produced by OS_FMT() against the argument types at compile time.
+ */
+template <typename Format, typename... Args>
+constexpr bool isFormatValid()
+{
+    return impl_::checkFormat(Format::get(), impl_::ArgTypeList<Args...>::Types, sizeof...(Args));
+}
+
+/**
+ * Formats the arguments into the output. Use OS_FMT() to specify the format string.
+ */
+template <typename Format, typename... Args>
+inline void formatTo(IOutput& out, Format, const Args&... args)
+{
+    static_assert(isFormatValid<Format, Args...>(), "Invalid format string, or the arguments do not match it");
+    const impl_::Arg packed[] = { impl_::Arg(args)..., impl_::Arg() };
+    impl_::vformat(out, Format::get(), &packed[0], sizeof...(Args));
+}
+
+/**
+ * Formats the arguments into the buffer like snprintf(). Returns the length of the resulting string.
+ */
+template <typename Format, typename... Args>
+inline std::size_t formatToBuffer(char* buffer, std::size_t capacity, Format format, const Args&... args)
+{
+    BufferOutput out(buffer, capacity);
+    formatTo(out, format, args...);
+    return out.getSize();
+}
+
+}
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#include "latency.hpp"
+#include "sys.hpp"
+
+
+namespace os
+{
+namespace latency
+{
+#if LATENCY_STATISTICS
+
+namespace
+{
+/*
+ * The statistics are kept in the probe sites, so they are also listed by the probe facilities, including the CSV.
+ */
+probe::Site g_critical_sections("critical_section");
+
+/// Protected by the critical section itself.
+WorstCriticalSection g_worst_critical_section;
+}
+
+namespace impl_
+{
+
+probe::Site g_interrupt_latency("interrupt_latency");
+
+__attribute__((noinline))
+void recordCriticalSection(const std::uint32_t cycles)
+{
+    g_critical_sections.add(cycles);
+
+    if (cycles > g_worst_critical_section.cycles)
+    {
+        g_worst_critical_section.cycles = cycles;
+        g_worst_critical_section.address = __builtin_return_address(0);
+#if CH_CFG_USE_REGISTRY
+        // There is no current thread before the OS is initialized, e.g. in the static constructors
+        const thread_t* const self = port_is_isr_context() ? nullptr : chThdGetSelfX();
+        g_worst_critical_section.thread_name = (self == nullptr) ? nullptr : self->name;
+#endif
+    }
+}
+
+}
+
+probe::Statistics getInterruptLatencyStatistics()
+{
+    return impl_::g_interrupt_latency.getStatistics();
+}
+
+probe::Statistics getCriticalSectionStatistics()
+{
+    return g_critical_sections.getStatistics();
+}
+
+WorstCriticalSection getWorstCriticalSection()
+{
+    CriticalSectionLocker locker;
+    return g_worst_critical_section;
+}
+
+void reset()
+{
+    impl_::g_interrupt_latency.reset();
+    g_critical_sections.reset();
+    CriticalSectionLocker locker;
+    g_worst_critical_section = WorstCriticalSection();
+}
+
+#else
+
+probe::Statistics getInterruptLatencyStatistics() { return probe::Statistics(); }
+probe::Statistics getCriticalSectionStatistics() { return probe::Statistics(); }
+WorstCriticalSection getWorstCriticalSection() { return WorstCriticalSection(); }
+void reset() { }
+
+#endif
+
+}
+}
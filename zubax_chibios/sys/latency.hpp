@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Interrupt latency measurement. There are two parts:
+ *
+ *  - The harness, which measures the latency of a periodic timer interrupt: the time from the moment the interrupt
+ *    was expected to be entered, i.e. the update event of the timer, to the moment it was actually entered.
+ *    The timer is specific to the application; the elapsed time is obtained from its counter, which starts from
+ *    zero at the update event. The handler should report the latency before doing anything else:
+ *
+ *      CH_IRQ_HANDLER(STM32_TIM7_HANDLER)
+ *      {
+ *          const std::uint32_t ticks = TIM7->CNT;          // Timer ticks since the update event
+ *          TIM7->SR = 0;
+ *          os::latency::recordInterruptLatency(ticks * CyclesPerTimerTick);
+ *          ...
+ *      }
+ *
+ *    Unlike the sampling profiler, the measurement interrupt must be masked by the kernel, i.e. its priority
+ *    must not be above CORTEX_MAX_KERNEL_PRIORITY, otherwise the effect of the critical sections is not observed.
+ *    The spread between the minimum and the maximum latency is the jitter.
+ *
+ *  - Tracking of the duration of the critical sections entered via @ref os::CriticalSectionLocker, along with
+ *    the location of the longest one, which is typically the cause of the worst latency. Nested critical sections
+ *    are accounted for as part of the outermost one. The critical sections entered via chSysLock() directly are
+ *    not tracked; their effect is still visible in the interrupt latency.
+ *
+ * The durations are in the cycles of the DWT cycle counter. Both parts are compiled in only if LATENCY_STATISTICS
+ * is set; see the shell command "latency".
+ */
+
+#pragma once
+
+#include <ch.hpp>
+#include <hal.h>
+#include <cstdint>
+#include "probe.hpp"
+
+/**
+ * Must be defined identically for all translation units, normally via UDEFS.
+ */
+#if !defined(LATENCY_STATISTICS)
+# define LATENCY_STATISTICS             0
+#endif
+
+
+namespace os
+{
+namespace latency
+{
+/**
+ * Location of the longest critical section since the last reset.
+ */
+struct WorstCriticalSection
+{
+    std::uint32_t cycles = 0;
+    const void* address = nullptr;          ///< Where the critical section was left; use addr2line to locate
+    const char* thread_name = nullptr;      ///< Null if left in an ISR or before the OS initialization
+};
+
+namespace impl_
+{
+#if LATENCY_STATISTICS
+extern probe::Site g_interrupt_latency;
+
+/**
+ * Invoked by @ref os::CriticalSectionLocker when the outermost critical section is left, before the interrupts
+ * are re-enabled.
+ */
+void recordCriticalSection(std::uint32_t cycles);
+#endif
+}
+
+/**
+ * Reports the latency of one interrupt of the measurement timer; see the description of the harness above.
+ * Can be invoked only from the ISR. Does nothing if LATENCY_STATISTICS is disabled.
+ */
+inline void recordInterruptLatency(const std::uint32_t cycles)
+{
+#if LATENCY_STATISTICS
+    impl_::g_interrupt_latency.add(cycles);
+#else
+    (void) cycles;
+#endif
+}
+
+/**
+ * The statistics are zero if LATENCY_STATISTICS is disabled, or if no data was reported yet.
+ */
+probe::Statistics getInterruptLatencyStatistics();
+probe::Statistics getCriticalSectionStatistics();
+WorstCriticalSection getWorstCriticalSection();
+
+/**
+ * Zeroes all of the statistics above.
+ */
+void reset();
+
+}
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#include "probe.hpp"
+#include "format.hpp"
+
+
+namespace os
+{
+namespace probe
+{
+namespace
+{
+/**
+ * Singly linked list of the registered sites; the sites are only added, never removed.
+ */
+std::atomic<Site*> g_sites{nullptr};
+}
+
+void Site::registerSelf()
+{
+    if (!registered_.exchange(true, std::memory_order_relaxed))
+    {
+        // The DWT cycle counter is enabled by the port of the OS; this is just to make sure
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+        Site* head = g_sites.load(std::memory_order_relaxed);
+        do
+        {
+            next_.store(head, std::memory_order_relaxed);
+        }
+        while (!g_sites.compare_exchange_weak(head, this, std::memory_order_release, std::memory_order_relaxed));
+    }
+}
+
+Statistics Site::getStatistics() const
+{
+    Statistics st;
+    st.name = name_;
+    st.count = count_.load(std::memory_order_relaxed);
+    st.min = (st.count > 0) ? min_.load(std::memory_order_relaxed) : 0;
+    st.max = max_.load(std::memory_order_relaxed);
+
+    std::uint32_t high = 0;
+    std::uint32_t low = 0;
+    do
+    {
+        high = sum_high_.load(std::memory_order_relaxed);
+        low = sum_low_.load(std::memory_order_relaxed);
+    }
+    while (high != sum_high_.load(std::memory_order_relaxed));
+    st.sum = (std::uint64_t(high) << 32U) | low;
+
+    for (unsigned i = 0; i < Statistics::HistogramBins; i++)
+    {
+        st.histogram[i] = histogram_[i].load(std::memory_order_relaxed);
+    }
+    return st;
+}
+
+void Site::reset()
+{
+    count_.store(0, std::memory_order_relaxed);
+    min_.store(0xFFFFFFFFU, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+    sum_low_.store(0, std::memory_order_relaxed);
+    sum_high_.store(0, std::memory_order_relaxed);
+    for (auto& x : histogram_)
+    {
+        x.store(0, std::memory_order_relaxed);
+    }
+}
+
+void forEachSite(const std::function<void (const Statistics&)>& callback)
+{
+    for (const Site* s = g_sites.load(std::memory_order_acquire);
+         s != nullptr;
+         s = s->next_.load(std::memory_order_relaxed))
+    {
+        callback(s->getStatistics());
+    }
+}
+
+void resetAll()
+{
+    for (Site* s = g_sites.load(std::memory_order_acquire); s != nullptr; s = s->next_.load(std::memory_order_relaxed))
+    {
+        s->reset();
+    }
+}
+
+void dumpCSV(const std::function<void (const char* line)>& output)
+{
+    char line[480];                 // Enough for all columns at their maximum widths
+    {
+        format::BufferOutput out(&line[0], sizeof(line));
+        format::formatTo(out, OS_FMT("name,count,min,mean,max"));
+        for (unsigned i = 0; i < Statistics::HistogramBins; i++)
+        {
+            format::formatTo(out, OS_FMT(",bin{}"), i);
+        }
+        output(&line[0]);
+    }
+
+    forEachSite([&output, &line](const Statistics& st)
+        {
+            format::BufferOutput out(&line[0], sizeof(line));
+            format::formatTo(out, OS_FMT("{},{},{},{},{}"), st.name, st.count, st.min, st.getMean(), st.max);
+            for (unsigned i = 0; i < Statistics::HistogramBins; i++)
+            {
+                format::formatTo(out, OS_FMT(",{}"), st.histogram[i]);
+            }
+            output(&line[0]);
+        });
+}
+
+}
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Timing probes for the hot paths. A probe measures the execution time of the enclosing scope in the cycles of
+ * the DWT cycle counter and aggregates the count, minimum, maximum, mean, and a log2 histogram in the static
+ * storage of the probe site; no memory is allocated, and the update is lock-free, so the probes can be placed into
+ * ISRs as well. The sites register themselves when executed for the first time; the registry can be printed via
+ * the shell or as CSV:
+ *
+ *      void processFrame()
+ *      {
+ *          OS_SCOPED_PROBE("processFrame");         // The name must be a literal
+ *          ...
+ *      }
+ *
+ * The probes are compiled in only if PROBES_ENABLED is set, so they can be left in the code permanently.
+ * A probe costs a few dozen cycles, which are partially included into the measurement.
+ */
+
+#pragma once
+
+#include <ch.hpp>
+#include <hal.h>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+
+/**
+ * Must be defined identically for all translation units, normally via UDEFS.
+ */
+#if !defined(PROBES_ENABLED)
+# define PROBES_ENABLED                 0
+#endif
+
+#define OS_PROBE_CAT2_(a, b)            a##b
+#define OS_PROBE_CAT1_(a, b)            OS_PROBE_CAT2_(a, b)
+
+#if PROBES_ENABLED
+# define OS_SCOPED_PROBE(name)                                                                      \
+    static ::os::probe::Site OS_PROBE_CAT1_(os_probe_site_, __LINE__)(name);                        \
+    const ::os::probe::Scope OS_PROBE_CAT1_(os_probe_scope_, __LINE__)(OS_PROBE_CAT1_(os_probe_site_, __LINE__))
+#else
+# define OS_SCOPED_PROBE(name)          ((void)0)
+#endif
+
+
+namespace os
+{
+namespace probe
+{
+/**
+ * Snapshot of the statistics of one probe site. The durations are in cycles.
+ * Bin N of the histogram counts the durations in [2^N, 2^(N+1)) cycles; the first bin also includes zero.
+ */
+struct Statistics
+{
+    static constexpr unsigned HistogramBins = 32;
+
+    const char* name = nullptr;
+    std::uint32_t count = 0;
+    std::uint32_t min = 0;
+    std::uint32_t max = 0;
+    std::uint64_t sum = 0;
+    std::uint32_t histogram[HistogramBins]{};
+
+    std::uint32_t getMean() const { return (count > 0) ? std::uint32_t(sum / count) : 0; }
+};
+
+/**
+ * Static storage of a probe site; prefer the macro OS_SCOPED_PROBE().
+ * The constructor is constexpr in order to make the static instances constant-initialized, which is why
+ * the site is added to the registry on the first update rather than on construction.
+ */
+class Site
+{
+    friend void forEachSite(const std::function<void (const Statistics&)>& callback);
+    friend void resetAll();
+
+    const char* const name_;
+    std::atomic<Site*> next_{nullptr};
+    std::atomic<bool> registered_{false};
+
+    std::atomic<std::uint32_t> count_{0};
+    std::atomic<std::uint32_t> min_{0xFFFFFFFFU};
+    std::atomic<std::uint32_t> max_{0};
+    std::atomic<std::uint32_t> sum_low_{0};
+    std::atomic<std::uint32_t> sum_high_{0};
+    std::atomic<std::uint32_t> histogram_[Statistics::HistogramBins]{};
+
+    void registerSelf();
+
+public:
+    constexpr explicit Site(const char* name) : name_(name) { }
+
+    void add(const std::uint32_t cycles)
+    {
+        if (!registered_.load(std::memory_order_relaxed))
+        {
+            registerSelf();
+        }
+
+        (void) count_.fetch_add(1U, std::memory_order_relaxed);
+
+        if (sum_low_.fetch_add(cycles, std::memory_order_relaxed) > (0xFFFFFFFFU - cycles))
+        {
+            (void) sum_high_.fetch_add(1U, std::memory_order_relaxed);         // Carry
+        }
+
+        std::uint32_t x = min_.load(std::memory_order_relaxed);
+        while ((cycles < x) && !min_.compare_exchange_weak(x, cycles, std::memory_order_relaxed)) { }
+
+        x = max_.load(std::memory_order_relaxed);
+        while ((cycles > x) && !max_.compare_exchange_weak(x, cycles, std::memory_order_relaxed)) { }
+
+        const unsigned bin = unsigned(31 - __builtin_clz(cycles | 1U));
+        (void) histogram_[bin].fetch_add(1U, std::memory_order_relaxed);
+    }
+
+    /**
+     * Same snapshot as the one passed to the callback of @ref forEachSite().
+     */
+    Statistics getStatistics() const;
+
+    void reset();
+
+    Site(const Site&) = delete;
+    Site& operator=(const Site&) = delete;
+};
+
+/**
+ * Measures the lifetime of the instance; prefer the macro OS_SCOPED_PROBE().
+ */
+class Scope
+{
+    Site& site_;
+    const std::uint32_t started_at_ = DWT->CYCCNT;
+
+public:
+    explicit Scope(Site& site) : site_(site) { }
+
+    ~Scope()
+    {
+        site_.add(DWT->CYCCNT - started_at_);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+/**
+ * Invokes the callback with a snapshot of every registered site, newest first.
+ * The snapshot is not atomic, so the values may be slightly inconsistent if the site is being updated meanwhile.
+ */
+void forEachSite(const std::function<void (const Statistics&)>& callback);
+
+/**
+ * Zeroes the statistics of every registered site.
+ */
+void resetAll();
+
+/**
+ * Writes the statistics as CSV lines, header first, without the line terminators.
+ * The columns are: name, count, min, mean, max, and the histogram bins bin0...bin31; the durations are in cycles.
+ */
+void dumpCSV(const std::function<void (const char* line)>& output);
+
+}
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#include "profiler.hpp"
+#include "sys.hpp"
+#include <atomic>
+#include <cstring>
+
+#if !defined(PROFILER_THREAD_PRIORITY)
+# define PROFILER_THREAD_PRIORITY           LOWPRIO
+#endif
+
+#if !defined(PROFILER_THREAD_STACK_SIZE)
+# define PROFILER_THREAD_STACK_SIZE         512
+#endif
+
+/**
+ * How often the collected samples are streamed out.
+ */
+#if !defined(PROFILER_STREAM_INTERVAL_MS)
+# define PROFILER_STREAM_INTERVAL_MS        10
+#endif
+
+
+namespace os
+{
+namespace profiler
+{
+#if PROFILER_BUFFER_SAMPLES > 0
+
+static_assert((PROFILER_BUFFER_SAMPLES & (PROFILER_BUFFER_SAMPLES - 1)) == 0,
+              "Profiler buffer size must be a power of two");
+
+namespace
+{
+/**
+ * The context is the address of the interrupted thread, or the exception number if an exception was interrupted.
+ */
+struct Sample
+{
+    std::uint32_t pc;
+    std::uint32_t lr;
+    std::uint32_t context;
+};
+
+/*
+ * Single producer (the sampling IRQ), single consumer (the streaming thread).
+ */
+Sample g_samples[PROFILER_BUFFER_SAMPLES];
+std::atomic<std::uint32_t> g_head{0};
+std::atomic<std::uint32_t> g_tail{0};
+std::atomic<std::uint32_t> g_num_dropped{0};
+std::atomic<bool> g_enabled{false};
+
+/**
+ * Streams the samples and the thread table out as binary records. The record layout, all values little endian:
+ *
+ *      u8      Marker (zero)
+ *      u8      Number of bytes that follow
+ *      u32     Record kind, see impl_::BinaryRecordKind
+ *
+ *  ProfilerSamples:
+ *      u32     Number of samples dropped since the previous record
+ *      ...     Samples: u32 PC, u32 LR, u32 context
+ *
+ *  ProfilerThreads:
+ *      ...     Threads: u32 thread address, u32 thread name address (the name is looked up in the ELF)
+ */
+class StreamingThread : public chibios_rt::BaseStaticThread<PROFILER_THREAD_STACK_SIZE>
+{
+    static constexpr unsigned MaxSamplesPerRecord = 20;
+    static constexpr unsigned MaxThreadsPerRecord = 30;
+    static constexpr unsigned ThreadTableIntervalMSec = 1000;
+
+    std::uint8_t buffer_[2 + 4 + 4 + MaxSamplesPerRecord * sizeof(Sample)]{};
+    std::size_t size_ = 0;
+
+    void begin(const impl_::BinaryRecordKind kind)
+    {
+        buffer_[0] = 0;
+        size_ = 2;
+        addWord(std::uint32_t(kind));
+    }
+
+    void addWord(const std::uint32_t x)
+    {
+        std::memcpy(&buffer_[size_], &x, 4);            // The target is little endian
+        size_ += 4;
+    }
+
+    void finish()
+    {
+        buffer_[1] = std::uint8_t(size_ - 2U);
+        impl_::emitBinaryRecord(&buffer_[0], size_);
+    }
+
+    void streamThreadTable()
+    {
+#if CH_CFG_USE_REGISTRY
+        begin(impl_::BinaryRecordKind::ProfilerThreads);
+        unsigned count = 0;
+        for (thread_t* tp = chRegFirstThread(); tp != nullptr; tp = chRegNextThread(tp))
+        {
+            addWord(std::uint32_t(reinterpret_cast<std::uintptr_t>(tp)));
+            addWord(std::uint32_t(reinterpret_cast<std::uintptr_t>(tp->name)));
+            if (++count >= MaxThreadsPerRecord)
+            {
+                finish();
+                begin(impl_::BinaryRecordKind::ProfilerThreads);
+                count = 0;
+            }
+        }
+        if (count > 0)
+        {
+            finish();
+        }
+#endif
+    }
+
+    void streamSamples()
+    {
+        std::uint32_t tail = g_tail.load(std::memory_order_relaxed);
+        const std::uint32_t head = g_head.load(std::memory_order_acquire);
+        while (tail != head)
+        {
+            begin(impl_::BinaryRecordKind::ProfilerSamples);
+            addWord(g_num_dropped.exchange(0, std::memory_order_relaxed));
+            for (unsigned i = 0; (i < MaxSamplesPerRecord) && (tail != head); i++, tail++)
+            {
+                const Sample& s = g_samples[tail % PROFILER_BUFFER_SAMPLES];
+                addWord(s.pc);
+                addWord(s.lr);
+                addWord(s.context);
+            }
+            finish();
+            g_tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    void main() override
+    {
+        setName("profiler");
+
+        bool was_enabled = false;
+        systime_t thread_table_streamed_at = 0;
+
+        while (true)
+        {
+            const bool enabled = g_enabled.load(std::memory_order_relaxed);
+            const bool thread_table_due =
+                chVTTimeElapsedSinceX(thread_table_streamed_at) >= TIME_MS2I(ThreadTableIntervalMSec);
+            if (enabled && (!was_enabled || thread_table_due))
+            {
+                streamThreadTable();
+                thread_table_streamed_at = chVTGetSystemTimeX();
+            }
+            was_enabled = enabled;
+
+            streamSamples();
+
+            chThdSleepMilliseconds(PROFILER_STREAM_INTERVAL_MS);
+        }
+    }
+};
+
+StreamingThread g_streaming_thread;
+std::atomic<bool> g_streaming_thread_started{false};
+
+}
+
+void start()
+{
+    if (!g_streaming_thread_started.exchange(true, std::memory_order_relaxed))
+    {
+        (void) g_streaming_thread.start(PROFILER_THREAD_PRIORITY);
+    }
+    g_enabled.store(true, std::memory_order_relaxed);
+}
+
+void stop()
+{
+    g_enabled.store(false, std::memory_order_relaxed);
+}
+
+bool isRunning()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+#else
+
+void start() { }
+void stop() { }
+bool isRunning() { return false; }
+
+#endif
+}
+}
+
+extern "C"
+{
+
+void zchProfilerSampleHook(const std::uint32_t* const exception_frame)
+{
+#if PROFILER_BUFFER_SAMPLES > 0
+    using namespace os::profiler;
+
+    if (!g_enabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    const std::uint32_t head = g_head.load(std::memory_order_relaxed);
+    if ((head - g_tail.load(std::memory_order_acquire)) >= PROFILER_BUFFER_SAMPLES)
+    {
+        g_num_dropped.fetch_add(1U, std::memory_order_relaxed);
+        return;
+    }
+
+    // The stacked xPSR holds the number of the interrupted exception, zero if a thread was interrupted
+    const std::uint32_t interrupted_exception = exception_frame[7] & 0x1FFU;
+
+    Sample& s = g_samples[head % PROFILER_BUFFER_SAMPLES];
+    s.pc = exception_frame[6];
+    s.lr = exception_frame[5];
+    s.context = (interrupted_exception != 0) ? interrupted_exception :
+                std::uint32_t(reinterpret_cast<std::uintptr_t>(chThdGetSelfX()));
+
+    g_head.store(head + 1U, std::memory_order_release);
+#else
+    (void) exception_frame;
+#endif
+}
+
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Statistical sampling profiler. A high-rate timer interrupt samples the interrupted program counter, link register,
+ * and context (thread or exception); the samples are collected into a ring buffer and streamed out through
+ * the console as binary records by a low-priority thread. tools/profiler.py symbolizes the samples against the ELF
+ * and produces folded stacks for flamegraph.pl. Unlike tools/pmsp_profiler.sh, the target is never halted.
+ *
+ * The profiler is enabled by defining PROFILER_BUFFER_SAMPLES, normally via UDEFS. The sampling timer is specific
+ * to the application; its interrupt handler is defined with the macro below, which acknowledges the interrupt by
+ * calling the provided function and then records the sample:
+ *
+ *      static void acknowledgeProfilerTimer() { TIM7->SR = 0; }
+ *      PROFILER_SAMPLING_IRQ_HANDLER(Vector118, acknowledgeProfilerTimer)
+ *
+ * The handler does not use the OS, so its priority should be above CORTEX_MAX_KERNEL_PRIORITY; that way the critical
+ * sections are profiled too. The sample rate should not be a multiple of the system tick frequency, and it should
+ * be chosen with the console bandwidth in mind: each sample takes 12 bytes. The samples that could not be streamed
+ * out in time are dropped and counted; the timer may keep running while the profiler is stopped.
+ */
+
+#pragma once
+
+#include <ch.hpp>
+#include <hal.h>
+#include <cstdint>
+
+/**
+ * Capacity of the sample ring buffer; must be a power of two. Each sample occupies 12 bytes.
+ * Zero disables the profiler. Must be defined identically for all translation units.
+ */
+#if !defined(PROFILER_BUFFER_SAMPLES)
+# define PROFILER_BUFFER_SAMPLES        0
+#endif
+
+#if PROFILER_BUFFER_SAMPLES > 0
+
+/**
+ * Defines the interrupt handler of the sampling timer. The exception frame of the interrupted context is located
+ * before anything is pushed onto the stack, hence the handler is written in assembly. Requires ARMv7-M.
+ */
+# define PROFILER_SAMPLING_IRQ_HANDLER(vector, acknowledge)                             \
+    extern "C" __attribute__((used)) void vector##_acknowledgeProfilerTimer()           \
+    {                                                                                   \
+        acknowledge();                                                                  \
+    }                                                                                   \
+    extern "C" __attribute__((naked)) void vector()                                     \
+    {                                                                                   \
+        __asm volatile ("tst    lr, #4                  \n"                             \
+                        "ite    eq                      \n"                             \
+                        "mrseq  r0, msp                 \n"                             \
+                        "mrsne  r0, psp                 \n"                             \
+                        "push   {r0, lr}                \n"                             \
+                        "bl     " #vector "_acknowledgeProfilerTimer \n"                \
+                        "pop    {r0, lr}                \n"                             \
+                        "b      zchProfilerSampleHook   \n");                           \
+    }
+
+#else
+
+# define PROFILER_SAMPLING_IRQ_HANDLER(vector, acknowledge)
+
+#endif
+
+extern "C"
+{
+/**
+ * Records one sample from the exception frame of the interrupted context; invoked by the sampling IRQ handler.
+ */
+void zchProfilerSampleHook(const std::uint32_t* exception_frame);
+}
+
+namespace os
+{
+namespace profiler
+{
+/**
+ * Starts collecting and streaming the samples. The table of thread names is streamed out first.
+ */
+void start();
+
+/**
+ * Stops collecting the samples; the ones already collected are still streamed out.
+ */
+void stop();
+
+bool isRunning();
+
+}
+}
@@ -23,6 +23,15 @@ namespace os
 
 extern void emergencyPrint(const char* str);
 
+/**
+ * Prints the panic report and mirrors it into the crash log, so that it can be recovered after the reset.
+ */
+static void panicPrint(const char* str)
+{
+    emergencyPrint(str);
+    impl_::writeToCrashLogFromPanicHandler(str);
+}
+
 __attribute__((weak))
 void applicationHaltHook(void) { }
 
@@ -62,6 +71,76 @@ bool isRebootRequested()
     return reboot_request_flag;
 }
 
+#if MUTEX_STATISTICS
+
+/*
+ * The list is modified in critical sections, because the static mutexes are constructed before the OS is started.
+ */
+static NamedMutex* g_named_mutexes = nullptr;
+
+NamedMutex::NamedMutex(const char* const name)
+{
+    stats_.name = name;
+    CriticalSectionLocker locker;
+    next_ = g_named_mutexes;
+    g_named_mutexes = this;
+}
+
+NamedMutex::~NamedMutex()
+{
+    CriticalSectionLocker locker;
+    for (NamedMutex** pp = &g_named_mutexes; *pp != nullptr; pp = &(*pp)->next_)
+    {
+        if (*pp == this)
+        {
+            *pp = next_;
+            break;
+        }
+    }
+}
+
+void forEachMutexStatistics(const std::function<void (const MutexStatistics&)>& callback)
+{
+    // The list is walked from the beginning for every entry so that no pointers are retained between
+    // the critical sections, in case a mutex is destroyed meanwhile.
+    for (unsigned index = 0; ; index++)
+    {
+        MutexStatistics snapshot;
+        {
+            CriticalSectionLocker locker;
+            const NamedMutex* p = g_named_mutexes;
+            for (unsigned i = 0; (i < index) && (p != nullptr); i++)
+            {
+                p = p->next_;
+            }
+            if (p == nullptr)
+            {
+                break;
+            }
+            snapshot = p->stats_;
+        }
+        callback(snapshot);
+    }
+}
+
+void resetMutexStatistics()
+{
+    CriticalSectionLocker locker;
+    for (NamedMutex* p = g_named_mutexes; p != nullptr; p = p->next_)
+    {
+        const char* const name = p->stats_.name;
+        p->stats_ = MutexStatistics();
+        p->stats_.name = name;
+    }
+}
+
+#else
+
+void forEachMutexStatistics(const std::function<void (const MutexStatistics&)>&) { }
+void resetMutexStatistics() { }
+
+#endif
+
 } // namespace os
 
 extern "C"
@@ -88,31 +167,31 @@ void zchSysHaltHook(const char* msg)
      * Printing the general panic message
      */
     port_disable();
-    emergencyPrint("\r\nPANIC [");
+    panicPrint("\r\nPANIC [");
 #if CH_CFG_USE_REGISTRY
     const thread_t *pthread = chThdGetSelfX();
     if (pthread && pthread->name)
     {
-        emergencyPrint(pthread->name);
+        panicPrint(pthread->name);
     }
 #endif
-    emergencyPrint("] ");
+    panicPrint("] ");
 
     if (msg != NULL)
     {
-        emergencyPrint(msg);
+        panicPrint(msg);
     }
-    emergencyPrint("\r\n");
+    panicPrint("\r\n");
 
 #if !defined(AGGRESSIVE_SIZE_OPTIMIZATION) || (AGGRESSIVE_SIZE_OPTIMIZATION == 0)
     static const auto print_register = [](const char* name, std::uint32_t value)
         {
-            emergencyPrint(name);
-            emergencyPrint("\t");
+            panicPrint(name);
+            panicPrint("\t");
             char buffer[20];
             chsnprintf(&buffer[0], sizeof(buffer), "%08x", value);
-            emergencyPrint(&buffer[0]);
-            emergencyPrint("\r\n");
+            panicPrint(&buffer[0]);
+            panicPrint("\r\n");
         };
 
     static const auto print_stack = [](const std::uint32_t* const ptr)
@@ -131,7 +210,7 @@ void zchSysHaltHook(const char* msg)
     /*
      * Printing registers
      */
-    emergencyPrint("\r\nCore registers:\r\n");
+    panicPrint("\r\nCore registers:\r\n");
 #define PRINT_CORE_REGISTER(name)       print_register(#name, __get_##name())
     PRINT_CORE_REGISTER(CONTROL);
     PRINT_CORE_REGISTER(IPSR);
@@ -147,13 +226,13 @@ void zchSysHaltHook(const char* msg)
 #endif
 #undef PRINT_CORE_REGISTER
 
-    emergencyPrint("\r\nProcess stack:\r\n");
+    panicPrint("\r\nProcess stack:\r\n");
     print_stack(reinterpret_cast<std::uint32_t*>(__get_PSP()));
 
-    emergencyPrint("\r\nMain stack:\r\n");
+    panicPrint("\r\nMain stack:\r\n");
     print_stack(reinterpret_cast<std::uint32_t*>(__get_MSP()));
 
-    emergencyPrint("\r\nSCB:\r\n");
+    panicPrint("\r\nSCB:\r\n");
 #define PRINT_SCB_REGISTER(name)        print_register(#name, SCB->name)
     PRINT_SCB_REGISTER(AIRCR);
     PRINT_SCB_REGISTER(SCR);
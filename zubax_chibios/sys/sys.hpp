@@ -12,11 +12,18 @@
 
 #include <ch.hpp>
 #include <hal.h>
+#include "format.hpp"
+#include "trace.hpp"
+#include "latency.hpp"
 #include <type_traits>
 #include <limits>
+#include <algorithm>
 #include <cstdint>
 #include <cassert>
+#include <cstring>
 #include <functional>
+#include <atomic>
+#include <cstdarg>
 
 
 #ifndef STRINGIZE
@@ -43,27 +50,445 @@
 # define DEBUG_LOG(...)         ((void)0)
 #endif
 
+/**
+ * If enabled, @ref os::Logger::printlnDeferred() emits compact binary records instead of formatted text.
+ * The records are converted back into text on the host by tools/deferred_log_decoder.py using the firmware ELF.
+ * Must be defined identically for all translation units, normally via UDEFS.
+ */
+#if !defined(CONSOLE_DEFERRED_LOGGING)
+# define CONSOLE_DEFERRED_LOGGING       0
+#endif
+
+/**
+ * Log messages below this level are removed at compile time by the LOG_*() macros; see @ref os::LogLevel.
+ * The default is 0 (debug) in debug builds and 1 (info) in release builds.
+ * The threshold can be changed for one module (translation unit) by redefining the macro after including this header.
+ */
+#if !defined(LOG_LEVEL_THRESHOLD)
+# if defined(DEBUG_BUILD) && DEBUG_BUILD
+#  define LOG_LEVEL_THRESHOLD           0
+# else
+#  define LOG_LEVEL_THRESHOLD           1
+# endif
+#endif
+
+/**
+ * Default token bucket parameters of the per-logger rate limiter, see @ref os::Logger::setRateLimit().
+ * The rate is in messages per second; zero disables rate limiting.
+ */
+#if !defined(LOG_RATE_LIMIT_PER_SECOND)
+# define LOG_RATE_LIMIT_PER_SECOND      10
+#endif
+
+#if !defined(LOG_RATE_LIMIT_BURST)
+# define LOG_RATE_LIMIT_BURST           20
+#endif
+
+/**
+ * Identical messages (same format string and same arguments) that follow each other closer than this are coalesced
+ * into "N similar messages suppressed"; zero disables coalescing. Messages printed with puts() are never coalesced.
+ */
+#if !defined(LOG_REPEAT_WINDOW_MS)
+# define LOG_REPEAT_WINDOW_MS           1000
+#endif
+
+/**
+ * While the messages keep being suppressed, the suppression counters are reported at least this often.
+ */
+#if !defined(LOG_SUPPRESSION_REPORT_INTERVAL_MS)
+# define LOG_SUPPRESSION_REPORT_INTERVAL_MS 5000
+#endif
+
+/**
+ * If enabled, the mutexes of type @ref os::NamedMutex collect the wait and hold time statistics when locked via
+ * @ref os::MutexLocker; see @ref os::forEachMutexStatistics(). If disabled, a NamedMutex is a plain mutex.
+ * Must be defined identically for all translation units, normally via UDEFS.
+ */
+#if !defined(MUTEX_STATISTICS)
+# define MUTEX_STATISTICS               0
+#endif
+
+/**
+ * Leveled logging. The message is discarded at compile time if its level is below LOG_LEVEL_THRESHOLD,
+ * and at run time, before any formatting is done, if it is below the run time level of the logger's module.
+ * Usage:
+ *      LOG_WARNING(logger_, "RX err %d", res);
+ */
+#define LOG_DEBUG(logger, ...)          OS_LOG_AT_LEVEL_(logger, Debug, __VA_ARGS__)
+#define LOG_INFO(logger, ...)           OS_LOG_AT_LEVEL_(logger, Info, __VA_ARGS__)
+#define LOG_WARNING(logger, ...)        OS_LOG_AT_LEVEL_(logger, Warning, __VA_ARGS__)
+#define LOG_ERROR(logger, ...)          OS_LOG_AT_LEVEL_(logger, Error, __VA_ARGS__)
+
+#define OS_LOG_AT_LEVEL_(logger, level, ...)                                        \
+    do {                                                                            \
+        if (::os::impl_::isLogLevelCompiledIn(::os::LogLevel::level,                \
+                                              LOG_LEVEL_THRESHOLD)) {               \
+            (logger).log(::os::LogLevel::level, __VA_ARGS__);                       \
+        }                                                                           \
+    } while (0)
+
+/**
+ * Deferred logging at the info level, see @ref os::Logger::printlnDeferred(). Unlike a direct invocation of the
+ * method, the format string is checked against the arguments at compile time, like that of printf().
+ * Usage:
+ *      LOG_DEFERRED(logger_, "RX err %d", res);
+ */
+#define LOG_DEFERRED(logger, ...)                                                   \
+    do {                                                                            \
+        static_cast<void>(sizeof(::os::impl_::checkPrintfFormat(__VA_ARGS__)));     \
+        if (::os::impl_::isLogLevelCompiledIn(::os::LogLevel::Info,                 \
+                                              LOG_LEVEL_THRESHOLD)) {               \
+            (logger).printlnDeferred(__VA_ARGS__);                                  \
+        }                                                                           \
+    } while (0)
+
 
 namespace os
 {
+/**
+ * Severity of a log message, in the ascending order.
+ * Off is only meaningful as a run time level of a module, where it disables all messages.
+ */
+enum class LogLevel : std::uint8_t
+{
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Off
+};
+
+namespace impl_
+{
+/**
+ * Incremented whenever the run time log levels are changed, which invalidates the levels cached by the loggers.
+ */
+extern std::atomic<std::uint32_t> g_log_level_generation;
+
+constexpr bool isLogLevelCompiledIn(const LogLevel level, const int threshold)
+{
+    return int(level) >= threshold;
+}
+
+/**
+ * Looks up the run time log level of the module.
+ */
+LogLevel resolveLogLevel(const char* module_name);
+
+/**
+ * Formats the message directly into the standard output in chunks; the prefix, if not null, is the logger name.
+ * In that case the message is terminated with a newline.
+ */
+void printFormatted(const char* prefix, const char* format, const format::impl_::Arg* args, std::size_t num_args);
+
+/**
+ * Hash of the argument values of a log message, used to coalesce only the identical messages.
+ * Strings are hashed by content. Returns zero if coalescing is disabled (LOG_REPEAT_WINDOW_MS is zero).
+ */
+std::uint32_t hashLogArguments(const format::impl_::Arg* args, std::size_t num_args);
+std::uint32_t hashLogArguments(const std::uint8_t* data, std::size_t size);
+
+/**
+ * Never defined; used only in unevaluated context by LOG_DEFERRED() to check the format string against the arguments.
+ */
+__attribute__ ((format (printf, 1, 2)))
+int checkPrintfFormat(const char* format, ...);
+
+/**
+ * Binary record of a deferred log message. The layout is as follows (all values are little endian):
+ *
+ *      u8      Marker (zero; never occurs in the text output)
+ *      u8      Number of bytes that follow
+ *      u32     Address of the format string
+ *      u32     Address of the logger name
+ *      u32     System time in ticks
+ *      ...     Arguments:
+ *                  - integers, enums and non-string pointers are stored as 32-bit words
+ *                  - floating point values are stored as IEEE 754 single precision
+ *                  - C strings are stored inline as u8 length followed by the characters (truncated if too long)
+ *
+ * The strings are located by address in the ELF, hence the format string and the logger name must be literals.
+ * Other kinds of binary records share the framing; they are distinguished by the first word, which is then
+ * a small record kind tag (see BinaryRecordKind) rather than a string address.
+ */
+class DeferredLogRecordBuilder
+{
+public:
+    static constexpr std::size_t MaxSize = 128;
+
+private:
+    static constexpr std::size_t HeaderSize = 14;
+
+    std::uint8_t buffer_[MaxSize];
+    std::size_t size_ = 2;
+
+    void addWord(const std::uint32_t x)
+    {
+        if ((size_ + 4U) <= MaxSize)
+        {
+            std::memcpy(&buffer_[size_], &x, 4);            // The target is little endian
+            size_ += 4U;
+        }
+    }
+
+public:
+    DeferredLogRecordBuilder(const char* const format, const char* const logger_name, const systime_t timestamp)
+    {
+        buffer_[0] = 0;
+        addWord(std::uint32_t(reinterpret_cast<std::uintptr_t>(format)));
+        addWord(std::uint32_t(reinterpret_cast<std::uintptr_t>(logger_name)));
+        addWord(std::uint32_t(timestamp));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type add(const T x)
+    {
+        static_assert(sizeof(T) <= 4, "64-bit integers are not supported by chprintf() nor by deferred logging");
+        if (std::is_signed<T>::value)
+        {
+            addWord(std::uint32_t(std::int32_t(x)));
+        }
+        else
+        {
+            addWord(std::uint32_t(x));
+        }
+    }
+
+    void add(const float x)
+    {
+        std::uint32_t word = 0;
+        std::memcpy(&word, &x, 4);
+        addWord(word);
+    }
+
+    void add(const double x) { add(float(x)); }
+
+    void add(const void* const x) { addWord(std::uint32_t(reinterpret_cast<std::uintptr_t>(x))); }
+
+    void add(const char* const x)
+    {
+        if (size_ < MaxSize)
+        {
+            const std::size_t len = std::min<std::size_t>(std::strlen(x), MaxSize - size_ - 1U);
+            buffer_[size_++] = std::uint8_t(len);
+            std::memcpy(&buffer_[size_], x, len);
+            size_ += len;
+        }
+    }
+
+    /// The encoded arguments, i.e. the record without the header; the size is written into the reference.
+    const std::uint8_t* getArguments(std::size_t& out_size) const
+    {
+        out_size = size_ - HeaderSize;
+        return &buffer_[HeaderSize];
+    }
+
+    /// Returns the pointer to the finished record; the size is written into the reference.
+    const std::uint8_t* finalize(std::size_t& out_size)
+    {
+        buffer_[1] = std::uint8_t(size_ - 2U);
+        out_size = size_;
+        return &buffer_[0];
+    }
+};
+
+/**
+ * Tags of the binary records other than the deferred log records; the values are below any valid string address.
+ */
+enum class BinaryRecordKind : std::uint32_t
+{
+    ProfilerSamples = 1,
+    ProfilerThreads = 2
+};
+
+/**
+ * Writes the binary record into the standard output bypassing the newline translation.
+ * The record shall begin with the zero marker followed by the length, as described above.
+ */
+void emitBinaryRecord(const std::uint8_t* data, std::size_t size);
+
+} // namespace impl_
+
 /**
  * A standard output helper that adds the name of the calling module before the message.
+ *
+ * The output of every logger is limited by a token bucket, and consecutive identical messages (same format string
+ * and same arguments) are coalesced; identical literals may be merged by the compiler, so the messages from
+ * different call sites may be coalesced too. The arguments are compared by hash: the type-safe and the deferred
+ * messages hash the argument values, the printf-style messages are formatted once without output to hash the text.
+ * Either way the message is not written out if it is suppressed, so a flapping error cannot saturate the console.
+ * The numbers of suppressed messages are reported by the logger when the suppression ends, and at least every
+ * LOG_SUPPRESSION_REPORT_INTERVAL_MS while it lasts, even if the logger goes quiet; see
+ * @ref reportSuppressedLogMessages().
  */
 class Logger
 {
+    friend void reportSuppressedLogMessages();
+
+    static constexpr std::uint32_t CachedLevelInvalid = 0xFFFFFFFFUL;
+    static constexpr std::uint32_t MilliTokensPerMessage = 1000;
+
     const char* const name_;
 
+    /// Generation of the log level table in the upper 24 bits, resolved log level in the lower 8 bits.
+    mutable std::atomic<std::uint32_t> cached_level_{CachedLevelInvalid};
+
+    /// Rate limiter and duplicate suppression state, protected by a critical section.
+    std::uint16_t rate_limit_per_second_ = LOG_RATE_LIMIT_PER_SECOND;
+    std::uint16_t rate_limit_burst_ = LOG_RATE_LIMIT_BURST;
+    std::uint32_t milli_tokens_ = LOG_RATE_LIMIT_BURST * MilliTokensPerMessage;
+    systime_t last_refill_at_ = 0;
+    const void* last_call_site_ = nullptr;
+    std::uint32_t last_arguments_hash_ = 0;
+    systime_t last_call_site_at_ = 0;
+    systime_t suppression_reported_at_ = 0;
+    std::uint32_t num_repeated_ = 0;            ///< Coalesced since the last report
+    std::uint32_t num_rate_limited_ = 0;        ///< Dropped by the token bucket since the last report
+    bool coalescing_ = false;                   ///< The last message has been printed or coalesced
+
+    /// Next logger with unreported suppressed messages; a logger is listed while its counters are not zero.
+    Logger* next_suppressing_ = nullptr;
+
+    /**
+     * Decides whether the message with the specified format string and arguments shall be emitted; a null pointer
+     * means that the message is never coalesced. Emits the suppression reports first if they are due.
+     */
+    bool admit(const void* call_site, std::uint32_t arguments_hash);
+
+    /// Removes the logger from the list of the loggers with unreported suppressed messages; critical section only.
+    void unlistSuppressing();
+
+    void vprintln(const char* format, va_list vl);
+
 public:
     Logger(const char* module_name) : name_(module_name) { }
+    ~Logger();
+
+    /**
+     * Configures the token bucket: up to @p burst messages at once, refilled at @p per_second messages per second.
+     * Zero rate disables rate limiting for this logger. The defaults are LOG_RATE_LIMIT_PER_SECOND and
+     * LOG_RATE_LIMIT_BURST. Duplicate suppression is not affected.
+     */
+    void setRateLimit(std::uint16_t per_second, std::uint16_t burst);
+
+    /**
+     * Whether the messages of the specified level are enabled at run time for this module.
+     * The level is resolved by name only when the log level table has been changed, so normally this is cheap.
+     */
+    bool isEnabled(const LogLevel level) const
+    {
+        const std::uint32_t generation = impl_::g_log_level_generation.load(std::memory_order_relaxed) & 0xFFFFFFUL;
+        std::uint32_t cached = cached_level_.load(std::memory_order_relaxed);
+        if ((cached >> 8) != generation)
+        {
+            cached = (generation << 8) | std::uint32_t(impl_::resolveLogLevel(name_));
+            cached_level_.store(cached, std::memory_order_relaxed);
+        }
+        return std::uint8_t(level) >= std::uint8_t(cached & 0xFFU);
+    }
 
+    /**
+     * Prints the message if its level is enabled at run time. Prefer the LOG_*() macros,
+     * which also remove the messages below LOG_LEVEL_THRESHOLD at compile time.
+     */
+    __attribute__ ((format (printf, 3, 4)))
+    void log(LogLevel level, const char* format, ...);
+
+    /**
+     * Type-safe version of log() that uses the formatter from format.hpp; the format string is checked at compile
+     * time. Neither version limits the length of the output:
+     *      logger.log(LogLevel::Warning, OS_FMT("RX err {}"), res);
+     */
+    template <typename Format, typename... Args,
+              typename = typename std::enable_if<format::IsFormatString<Format>::value>::type>
+    void log(const LogLevel level, Format, const Args&... args)
+    {
+        static_assert(format::isFormatValid<Format, Args...>(), "Invalid format string, or arguments mismatch");
+        if (isEnabled(level))
+        {
+            const format::impl_::Arg packed[] = { format::impl_::Arg(args)..., format::impl_::Arg() };
+            if (admit(Format::get(), impl_::hashLogArguments(&packed[0], sizeof...(Args))))
+            {
+                impl_::printFormatted(name_, Format::get(), &packed[0], sizeof...(Args));
+            }
+        }
+    }
+
+    /**
+     * Type-safe version of println(), see the type-safe log().
+     */
+    template <typename Format, typename... Args,
+              typename = typename std::enable_if<format::IsFormatString<Format>::value>::type>
+    void println(Format format, const Args&... args)
+    {
+        log(LogLevel::Info, format, args...);
+    }
+
+    /**
+     * Same as log() at the info level.
+     */
     __attribute__ ((format (printf, 2, 3)))
     void println(const char* format, ...);
 
     void puts(const char* line);
 
+    /**
+     * Like println(), but if CONSOLE_DEFERRED_LOGGING is enabled, the message is not formatted on the target.
+     * Instead, the format string address and the raw arguments are emitted as a binary record. This saves the
+     * formatting, but the record is output like any other message: if the asynchronous output queue is enabled
+     * (CONSOLE_ASYNC_QUEUE_SLOTS > 0), it is copied into the queue; otherwise it is written into the sink by the
+     * calling thread with the console mutex locked, which takes as long as writing the record bytes does.
+     * The format string and the logger name must be literals.
+     * If CONSOLE_DEFERRED_LOGGING is disabled, this is equivalent to println().
+     * This method cannot check the format string against the arguments; use LOG_DEFERRED() instead.
+     */
+    template <typename... Args>
+    void printlnDeferred(const char* format, const Args... args)
+    {
+#if CONSOLE_DEFERRED_LOGGING
+        if (!isEnabled(LogLevel::Info))
+        {
+            return;
+        }
+        impl_::DeferredLogRecordBuilder builder(format, name_, chVTGetSystemTimeX());
+        (builder.add(args), ...);
+        std::size_t size = 0;
+        const std::uint8_t* const arguments = builder.getArguments(size);
+        if (admit(format, impl_::hashLogArguments(arguments, size)))
+        {
+            const std::uint8_t* const data = builder.finalize(size);
+            impl_::emitBinaryRecord(data, size);
+        }
+#else
+        println(format, args...);
+#endif
+    }
+
     const char* getName() const { return name_; }
 };
 
+/**
+ * Emits the suppression reports of the loggers that have been suppressing messages for longer than
+ * LOG_SUPPRESSION_REPORT_INTERVAL_MS, so that the report is not delayed until the logger prints again.
+ * This is invoked before any logger output, by @ref BufferedStandardOutputSink::drain(), and periodically by
+ * the console thread if the asynchronous output queue is enabled. An application that uses none of these may
+ * invoke it periodically itself. Must not be invoked from an ISR.
+ */
+void reportSuppressedLogMessages();
+
+/**
+ * Type-safe replacement of printf() that formats directly into the standard output without intermediate buffering
+ * and without length limitations. See format.hpp for the syntax.
+ *      os::print(OS_FMT("{} bytes at 0x{:08x}\n"), size, address);
+ */
+template <typename Format, typename... Args>
+inline void print(Format, const Args&... args)
+{
+    static_assert(format::isFormatValid<Format, Args...>(), "Invalid format string, or arguments mismatch");
+    const format::impl_::Arg packed[] = { format::impl_::Arg(args)..., format::impl_::Arg() };
+    impl_::printFormatted(nullptr, Format::get(), &packed[0], sizeof...(Args));
+}
+
 /**
  * This delegate is invoked when the OS needs to emit a standard output.
  * It accepts a pointer to the data and the number of data bytes to write,
@@ -80,10 +505,209 @@ using StandardOutputSink = std::function<bool (const std::uint8_t*, std::size_t)
  * Access to the sink is always serialized through a global mutex, i.e. it is guaranteed that only one
  * thread can access the sink at any given time.
  * Assign an empty function to restore the default sink.
- * Note that the library may segment writes into multiple sequential invocations of the sink.
+ * The library translates each message into a staging buffer and normally writes it with one invocation of the sink;
+ * long messages may be segmented into multiple sequential invocations.
+ * If the asynchronous output queue is enabled (CONSOLE_ASYNC_QUEUE_SLOTS > 0), the sink is invoked from the
+ * low-priority console thread rather than from the thread that generated the output.
  */
 void setStandardOutputSink(const StandardOutputSink& sink);
 
+/**
+ * One piece of data passed to @ref StandardOutputGatherSink.
+ */
+struct StandardOutputFragment
+{
+    const std::uint8_t* data;
+    std::size_t size;
+};
+
+/**
+ * Gather-write (vectored, iovec-style) variant of @ref StandardOutputSink.
+ * It accepts an array of fragments that must be written back to back, which allows the library to pass the pieces
+ * of a message and the inserted CR LF sequences without copying them into the staging buffer.
+ * The return value has the same meaning as for the regular sink. The fragments are valid only during the call.
+ */
+using StandardOutputGatherSink = std::function<bool (const StandardOutputFragment*, std::size_t)>;
+
+/**
+ * Like @ref setStandardOutputSink(), but for the gather-write sink. While assigned, the gather sink is used instead
+ * of the regular sink; assigning a regular sink removes it. Assign an empty function to restore the default sink.
+ */
+void setStandardOutputGatherSink(const StandardOutputGatherSink& sink);
+
+/**
+ * What a @ref BufferedStandardOutputSink does with the new output when its buffer is full.
+ */
+enum class StandardOutputDropPolicy : std::uint8_t
+{
+    DropNewest,         ///< The rest of the message that doesn't fit is discarded; the buffered data is kept
+    DropOldest          ///< The oldest buffered data is overwritten; suits post-mortem and "latest state" channels
+};
+
+/**
+ * Non-blocking write delegate of @ref BufferedStandardOutputSink.
+ * Returns the number of bytes accepted, which may be less than requested if the destination is busy.
+ */
+using StandardOutputStreamSink = std::function<std::size_t (const std::uint8_t*, std::size_t)>;
+
+namespace impl_
+{
+/**
+ * Copies the translated output into all registered buffered sinks. Invoked by the console with its mutex locked.
+ */
+void writeToBufferedSinks(const std::uint8_t* data, std::size_t size);
+void endBufferedSinksMessage();
+
+/**
+ * Appends the string to the crash log bypassing the locks. For use by the panic handler only.
+ */
+void writeToCrashLogFromPanicHandler(const char* str);
+}
+
+/**
+ * An additional standard output destination with its own buffer, drop policy and drain path, e.g. USB CDC or
+ * a CAN debug channel mirroring the UART console. The console copies every message, after the CR LF translation,
+ * into the buffers of all registered sinks; the copying never waits for the destinations. Each sink is drained by
+ * calling @ref drain() from a thread of the application's choice, so a stalled destination affects neither
+ * the other sinks nor the logging threads.
+ * To route the console exclusively through the buffered sinks, replace the primary sink with a no-op.
+ * Usage:
+ *      static os::StaticBufferedStandardOutputSink<1024> g_usb_console(
+ *          [](const std::uint8_t* data, std::size_t size) { return chnWriteTimeout(&SDU1, data, size, 0); },
+ *          os::StandardOutputDropPolicy::DropOldest);
+ *      os::addStandardOutputSink(g_usb_console);
+ *      ...
+ *      while (true) { g_usb_console.drain(TIME_MS2I(100)); }          // In the USB thread
+ */
+class BufferedStandardOutputSink
+{
+    friend void addStandardOutputSink(BufferedStandardOutputSink&);
+    friend void removeStandardOutputSink(BufferedStandardOutputSink&);
+    friend void impl_::writeToBufferedSinks(const std::uint8_t*, std::size_t);
+    friend void impl_::endBufferedSinksMessage();
+
+    static constexpr std::size_t ChunkSize = 64;
+
+    BufferedStandardOutputSink* next_ = nullptr;            ///< Protected by the console mutex
+
+    const StandardOutputStreamSink sink_;
+    std::uint8_t* const buffer_;
+    const std::size_t capacity_;
+    const StandardOutputDropPolicy drop_policy_;
+
+    chibios_rt::Mutex mutex_;                               ///< Protects the ring buffer and the counters
+    chibios_rt::BinarySemaphore data_available_{true};
+    std::size_t read_index_ = 0;
+    std::size_t size_ = 0;
+    std::size_t peak_size_ = 0;
+    std::uint32_t num_dropped_bytes_ = 0;
+    bool discarding_message_ = false;                       ///< Set by DropNewest until the end of the message
+
+    /// The data taken out of the ring buffer but not yet accepted by the destination; drain() context only.
+    std::uint8_t chunk_[ChunkSize]{};
+    std::size_t chunk_offset_ = 0;
+    std::size_t chunk_size_ = 0;
+
+    /// Invoked by the console with its mutex locked.
+    void push(const std::uint8_t* data, std::size_t size);
+    void endMessage();
+
+public:
+    /**
+     * The buffer must outlive the object; see @ref StaticBufferedStandardOutputSink for the self-contained version.
+     */
+    BufferedStandardOutputSink(std::uint8_t* buffer,
+                               std::size_t capacity,
+                               const StandardOutputStreamSink& sink,
+                               StandardOutputDropPolicy drop_policy);
+
+    /**
+     * Writes the buffered data into the destination until either the buffer is empty or the destination stops
+     * accepting data. If there is nothing to write, waits for new data up to the specified timeout.
+     * Must be invoked from one thread at a time. Returns the number of bytes written.
+     */
+    std::size_t drain(sysinterval_t timeout = TIME_IMMEDIATE);
+
+    std::uint32_t getNumDroppedBytes() const { return num_dropped_bytes_; }
+
+    std::size_t getPeakUsageBytes() const { return peak_size_; }
+
+    std::size_t getCapacity() const { return capacity_; }
+};
+
+template <std::size_t BufferSize>
+class StaticBufferedStandardOutputSink : public BufferedStandardOutputSink
+{
+    std::uint8_t storage_[BufferSize];
+
+public:
+    StaticBufferedStandardOutputSink(const StandardOutputStreamSink& sink, StandardOutputDropPolicy drop_policy) :
+        BufferedStandardOutputSink(&storage_[0], BufferSize, sink, drop_policy)
+    { }
+};
+
+/**
+ * Registers an additional buffered sink; the primary sink is not affected. The object must not be destroyed
+ * while registered. Adding a sink that is already registered has no effect.
+ */
+void addStandardOutputSink(BufferedStandardOutputSink& sink);
+
+void removeStandardOutputSink(BufferedStandardOutputSink& sink);
+
+/**
+ * If the crash log is enabled (CONSOLE_CRASH_LOG_SIZE > 0), the standard output and the panic report are mirrored
+ * into a ring buffer in .noinit RAM, which is retained across watchdog, panic, and software resets.
+ * This function passes the preserved tail of the output of the previous session to the callback in chunks.
+ * Invoke it early after boot: the new output continues the same ring buffer, so the old output gets overwritten;
+ * the overwritten part is skipped. The callback is invoked with the console locked, so it must not print.
+ * Returns the number of bytes read; zero if there is nothing or the crash log is disabled.
+ */
+std::size_t readPreviousSessionLog(const std::function<void (const std::uint8_t*, std::size_t)>& callback);
+
+/**
+ * Prints the preserved output of the previous session, if any, between banners; see @ref readPreviousSessionLog().
+ */
+void printPreviousSessionLog();
+
+/**
+ * Accounting of the standard output. The queue values are zero if the asynchronous output queue is disabled.
+ * Messages that don't fit into the queue are dropped entirely; the producer is never blocked.
+ */
+struct StandardOutputStatistics
+{
+    std::uint32_t queue_capacity_bytes = 0;
+    std::uint32_t queue_peak_usage_bytes = 0;
+    std::uint32_t num_dropped_messages = 0;
+    std::uint32_t num_suppressed_log_messages = 0;  ///< Rate-limited or coalesced by the loggers
+};
+
+StandardOutputStatistics getStandardOutputStatistics();
+
+/**
+ * Sets the run time log level of the module, which applies also to its submodules, i.e. the loggers whose names
+ * continue with a dot: "Bootloader" covers "Bootloader.UAVCAN" unless the latter has its own level.
+ * An empty module name sets the default level, which is initially LogLevel::Debug.
+ * The module name is copied. Returns a negative errno if the table of module levels is full or the name is too long.
+ */
+int setLogLevel(const char* module_name, LogLevel level);
+
+/**
+ * Returns the run time log level that applies to the module.
+ */
+LogLevel getLogLevel(const char* module_name);
+
+/**
+ * Invokes the callback for each module that has its own log level, and then once with an empty module name
+ * for the default level.
+ */
+void forEachLogLevel(const std::function<void (const char* module_name, LogLevel level)>& callback);
+
+/**
+ * Returns the name of the log level, e.g. "warning", or parses the level from such a name.
+ */
+const char* logLevelToString(LogLevel level);
+bool parseLogLevel(const char* str, LogLevel& out_level);
+
 /**
  * Emergency termination hook that can be overridden by the application.
  * The hook must return immediately after bringing the hardware into a safe state.
@@ -106,6 +730,113 @@ void requestReboot();
  */
 bool isRebootRequested();
 
+namespace impl_
+{
+class MutexLockerImpl;
+}
+
+/**
+ * Contention statistics of a @ref NamedMutex. The durations are measured in the cycles of the realtime counter.
+ * Bin N of a histogram counts the durations in [4^N, 4^(N+1)) cycles; the first bin starts from zero, and the last
+ * one is unbounded.
+ */
+struct MutexStatistics
+{
+    static constexpr unsigned HistogramBins = 12;
+
+    const char* name = nullptr;
+    std::uint32_t num_locks = 0;
+    std::uint32_t num_contended = 0;                ///< Number of times the mutex was held by another thread
+    std::uint32_t max_wait_cycles = 0;
+    std::uint32_t max_hold_cycles = 0;
+    const thread_t* max_wait_waiter = nullptr;      ///< The thread that waited for the longest time
+    const thread_t* max_wait_owner = nullptr;       ///< The thread that held the mutex meanwhile
+    const thread_t* max_hold_owner = nullptr;
+    std::uint32_t wait_histogram[HistogramBins]{};  ///< Contended acquisitions only
+    std::uint32_t hold_histogram[HistogramBins]{};
+};
+
+/**
+ * Mutex with a name, used for the contention statistics if MUTEX_STATISTICS is enabled.
+ * The statistics are updated only when the mutex is locked via @ref MutexLocker.
+ */
+class NamedMutex : public chibios_rt::Mutex
+{
+#if MUTEX_STATISTICS
+    friend class impl_::MutexLockerImpl;
+    friend void forEachMutexStatistics(const std::function<void (const MutexStatistics&)>& callback);
+    friend void resetMutexStatistics();
+
+    MutexStatistics stats_;
+    NamedMutex* next_ = nullptr;
+    std::uint32_t locked_at_ = 0;
+
+    static unsigned computeHistogramBin(const std::uint32_t cycles)
+    {
+        const unsigned bin = unsigned(31 - __builtin_clz(cycles | 1U)) / 2U;
+        return std::min(bin, MutexStatistics::HistogramBins - 1U);
+    }
+
+    void lockInstrumented()
+    {
+        if (!tryLock())
+        {
+            trace::record(trace::EventType::MutexWait, this);
+            const thread_t* const owner = mutex.owner;
+            const std::uint32_t started_at = chSysGetRealtimeCounterX();
+            lock();
+            const std::uint32_t wait = chSysGetRealtimeCounterX() - started_at;
+
+            stats_.num_contended++;
+            stats_.wait_histogram[computeHistogramBin(wait)]++;
+            if (wait > stats_.max_wait_cycles)
+            {
+                stats_.max_wait_cycles = wait;
+                stats_.max_wait_waiter = chThdGetSelfX();
+                stats_.max_wait_owner = owner;
+            }
+        }
+        trace::record(trace::EventType::MutexAcquired, this);
+        stats_.num_locks++;
+        locked_at_ = chSysGetRealtimeCounterX();
+    }
+
+    void unlockInstrumented()
+    {
+        const std::uint32_t hold = chSysGetRealtimeCounterX() - locked_at_;
+        stats_.hold_histogram[computeHistogramBin(hold)]++;
+        if (hold > stats_.max_hold_cycles)
+        {
+            stats_.max_hold_cycles = hold;
+            stats_.max_hold_owner = chThdGetSelfX();
+        }
+        trace::record(trace::EventType::MutexReleased, this);
+        unlock();
+    }
+
+public:
+    explicit NamedMutex(const char* name);
+    ~NamedMutex();
+#else
+public:
+    explicit NamedMutex(const char*) { }
+#endif
+
+    NamedMutex(const NamedMutex&) = delete;
+    NamedMutex& operator=(const NamedMutex&) = delete;
+};
+
+/**
+ * Invokes the callback with a snapshot of the statistics of every existing NamedMutex.
+ * Does nothing if MUTEX_STATISTICS is disabled.
+ */
+void forEachMutexStatistics(const std::function<void (const MutexStatistics&)>& callback);
+
+/**
+ * Zeroes the statistics of every NamedMutex.
+ */
+void resetMutexStatistics();
+
 
 namespace impl_
 {
@@ -113,13 +844,39 @@ namespace impl_
 class MutexLockerImpl
 {
     chibios_rt::Mutex& mutex_;
+#if MUTEX_STATISTICS
+    NamedMutex* const named_mutex_ = nullptr;
+#endif
 public:
     MutexLockerImpl(chibios_rt::Mutex& m) : mutex_(m)
     {
+#if TRACE_BUFFER_EVENTS > 0
+        if (!mutex_.tryLock())
+        {
+            trace::record(trace::EventType::MutexWait, &mutex_);
+            mutex_.lock();
+        }
+        trace::record(trace::EventType::MutexAcquired, &mutex_);
+#else
         mutex_.lock();
+#endif
     }
+#if MUTEX_STATISTICS
+    MutexLockerImpl(NamedMutex& m) : mutex_(m), named_mutex_(&m)
+    {
+        named_mutex_->lockInstrumented();
+    }
+#endif
     ~MutexLockerImpl()
     {
+#if MUTEX_STATISTICS
+        if (named_mutex_ != nullptr)
+        {
+            named_mutex_->unlockInstrumented();
+            return;
+        }
+#endif
+        trace::record(trace::EventType::MutexReleased, &mutex_);
         mutex_.unlock();
     }
 };
@@ -127,8 +884,20 @@ public:
 class CriticalSectionLockerImpl
 {
     volatile const syssts_t st_ = chSysGetStatusAndLockX();
+#if LATENCY_STATISTICS
+    const std::uint32_t entered_at_ = DWT->CYCCNT;
+#endif
 public:
-    ~CriticalSectionLockerImpl() { chSysRestoreStatusX(st_); }
+    ~CriticalSectionLockerImpl()
+    {
+#if LATENCY_STATISTICS
+        if (port_irq_enabled(st_))      // Nested critical sections are accounted for as part of the outermost one
+        {
+            latency::impl_::recordCriticalSection(DWT->CYCCNT - entered_at_);
+        }
+#endif
+        chSysRestoreStatusX(st_);
+    }
 };
 
 class TemporaryPriorityChangerImpl
@@ -8,116 +8,1217 @@
 #include <ch.hpp>
 #include <hal.h>
 #include <chprintf.h>
-#include <memstreams.h>
 #include <cstdio>
 #include <cassert>
 #include <cstring>
 #include <cstdarg>
+#include <atomic>
+#include <cerrno>
 
+/**
+ * Number of slots in the asynchronous output queue; must be a power of two.
+ * Zero disables the queue, in which case the output is written into the sink synchronously by the calling thread.
+ * Each slot holds up to 58 bytes of output and occupies 64 bytes of RAM.
+ */
+#if !defined(CONSOLE_ASYNC_QUEUE_SLOTS)
+# define CONSOLE_ASYNC_QUEUE_SLOTS                  0
+#endif
+
+#if !defined(CONSOLE_ASYNC_THREAD_PRIORITY)
+# define CONSOLE_ASYNC_THREAD_PRIORITY              LOWPRIO
+#endif
+
+#if !defined(CONSOLE_ASYNC_THREAD_STACK_SIZE)
+# define CONSOLE_ASYNC_THREAD_STACK_SIZE            512
+#endif
+
+/**
+ * Capacity of the table of per-module run time log levels, see os::setLogLevel().
+ */
+#if !defined(LOG_LEVEL_MAX_MODULES)
+# define LOG_LEVEL_MAX_MODULES                      8
+#endif
+
+#if !defined(LOG_LEVEL_MAX_MODULE_NAME_LENGTH)
+# define LOG_LEVEL_MAX_MODULE_NAME_LENGTH           31
+#endif
+
+/**
+ * Size of the crash log ring in .noinit RAM, see os::readPreviousSessionLog(); zero disables the crash log.
+ */
+#if !defined(CONSOLE_CRASH_LOG_SIZE)
+# define CONSOLE_CRASH_LOG_SIZE                     0
+#endif
+
+
+namespace os
+{
+
+static bool defaultSink(const std::uint8_t*, std::size_t);
+
+static NamedMutex g_mutex("Console");
+static StandardOutputSink g_sink{&defaultSink};
+static StandardOutputGatherSink g_gather_sink;          ///< If set, takes precedence over the regular sink
+static BufferedStandardOutputSink* g_buffered_sinks = nullptr;  ///< Linked list, protected by the mutex
+
+static constexpr std::size_t StagingBufferSize = 256;
+
+static std::uint8_t g_staging_buffer[StagingBufferSize];   ///< Protected by the mutex
+
+// Sink invocations are guaranteed to be protected by the mutex, so no extra locking is needed.
+static bool defaultSink(const std::uint8_t* const data, const std::size_t sz)
+{
+    return chnWriteTimeout(&STDOUT_SD, data, sz, TIME_MS2I(10)) == sz;
+}
+
+namespace
+{
+
+#if CONSOLE_CRASH_LOG_SIZE > 0
+/**
+ * The last CONSOLE_CRASH_LOG_SIZE bytes of the output in a ring buffer that survives resets other than power loss.
+ * The header is protected by a CRC, which is updated on every write; this is cheap because the header is tiny.
+ * The data is not protected: if the header is intact, the RAM has been retained, and so has the data.
+ */
+struct CrashLog
+{
+    static constexpr std::uint32_t Magic = 0x4C4F4721UL;     // "!GOL"
+
+    std::uint32_t magic;
+    std::uint32_t capacity;
+    std::uint32_t head;                     ///< Number of bytes written ever; the write position is head % capacity
+    std::uint32_t header_crc;               ///< Over the fields above
+    std::uint8_t data[CONSOLE_CRASH_LOG_SIZE];
+
+    std::uint32_t computeHeaderCRC() const
+    {
+        // CRC-32, nibble-wise to keep it small yet fast enough for the logging hot path
+        static const std::uint32_t Table[16] = {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+        };
+        const std::uint32_t words[] = { magic, capacity, head };
+        std::uint32_t crc = 0xFFFFFFFFUL;
+        for (const std::uint32_t w : words)
+        {
+            for (unsigned i = 0; i < 8; i++)
+            {
+                crc = (crc >> 4) ^ Table[(crc ^ (w >> (i * 4U))) & 0xFU];
+            }
+        }
+        return ~crc;
+    }
+
+    bool isValid() const
+    {
+        return (magic == Magic) && (capacity == sizeof(data)) && (header_crc == computeHeaderCRC());
+    }
+};
+
+CrashLog g_crash_log __attribute__((section (".noinit")));
+
+bool g_crash_log_initialized = false;
+std::uint32_t g_crash_log_head_at_boot = 0;     ///< The output of the previous session ends here
+
+/**
+ * Adopts the log of the previous session if it is valid, otherwise resets the log.
+ * The new output continues the old log, which therefore remains readable until overwritten.
+ */
+void initCrashLog()
+{
+    if (!g_crash_log_initialized)
+    {
+        g_crash_log_initialized = true;
+        if (!g_crash_log.isValid())
+        {
+            g_crash_log.magic = CrashLog::Magic;
+            g_crash_log.capacity = sizeof(g_crash_log.data);
+            g_crash_log.head = 0;
+            g_crash_log.header_crc = g_crash_log.computeHeaderCRC();
+        }
+        g_crash_log_head_at_boot = g_crash_log.head;
+    }
+}
+
+/**
+ * Must be invoked with the mutex locked, or from the panic handler.
+ */
+void writeToCrashLog(const std::uint8_t* data, std::size_t size)
+{
+    initCrashLog();
+    if (size > sizeof(g_crash_log.data))
+    {
+        data += size - sizeof(g_crash_log.data);
+        size = sizeof(g_crash_log.data);
+    }
+    const std::size_t position = g_crash_log.head % sizeof(g_crash_log.data);
+    const std::size_t first = std::min(size, sizeof(g_crash_log.data) - position);
+    std::memcpy(&g_crash_log.data[position], data, first);
+    std::memcpy(&g_crash_log.data[0], data + first, size - first);
+    g_crash_log.head += size;
+    g_crash_log.header_crc = g_crash_log.computeHeaderCRC();   // Updated last, so that a reset here loses nothing
+}
+
+/**
+ * Invokes the callback with the preserved output of the previous session in chunks, skipping the part that has been
+ * overwritten by the output of this session. Must be invoked with the mutex locked. Returns the number of bytes.
+ */
+template <typename Callback>
+std::size_t forEachPreviousSessionLogChunk(const Callback& callback)
+{
+    constexpr std::uint32_t Capacity = sizeof(g_crash_log.data);
+    initCrashLog();
+
+    std::uint32_t position = g_crash_log_head_at_boot - std::min(g_crash_log_head_at_boot, Capacity);
+    if ((g_crash_log.head - position) > Capacity)
+    {
+        position = g_crash_log.head - Capacity;
+    }
+
+    std::size_t num_read = 0;
+    while (std::int32_t(g_crash_log_head_at_boot - position) > 0)
+    {
+        std::uint8_t chunk[64];
+        const std::size_t size = std::min<std::size_t>(sizeof(chunk), g_crash_log_head_at_boot - position);
+        const std::size_t offset = position % Capacity;
+        const std::size_t first = std::min<std::size_t>(size, Capacity - offset);
+        std::memcpy(&chunk[0], &g_crash_log.data[offset], first);
+        std::memcpy(&chunk[first], &g_crash_log.data[0], size - first);
+        position += size;
+        num_read += size;
+        callback(&chunk[0], size);
+    }
+    return num_read;
+}
+#else
+inline void writeToCrashLog(const std::uint8_t*, std::size_t) { }
+
+template <typename Callback>
+std::size_t forEachPreviousSessionLogChunk(const Callback&) { return 0; }
+#endif
+
+/**
+ * A piece of output; several segments are emitted as one message that can't be interleaved with other messages.
+ */
+struct OutputSegment
+{
+    const char* data;
+    std::size_t size;
+};
+
+/**
+ * Writes one message into the sink translating "\n" into "\r\n" in a single pass, normally with one sink invocation.
+ * With the regular sink, the data is translated into the staging buffer, which is flushed when full or at the end.
+ * With the gather sink, the message is passed as a list of fragments referring to the original data and to
+ * the inserted CR LF sequences, so nothing is copied; except for the data passed via copy(), which is translated into
+ * the staging buffer and referred to from there. Must be used with the mutex locked.
+ * If the sink reports an error, the rest of the message is discarded, unless there are buffered sinks to feed
+ * or the crash log is enabled.
+ */
+class SinkWriter
+{
+    static constexpr std::size_t MaxFragments = 16;
+
+    StandardOutputFragment fragments_[MaxFragments];
+    std::size_t num_fragments_ = 0;
+    std::size_t staged_size_ = 0;
+    std::size_t staged_fragment_begin_ = 0;     ///< With the gather sink, the staged data is a fragment from here
+    std::size_t num_written_bytes_ = 0;
+    bool failed_ = false;
+    const bool record_to_crash_log_;
+
+    bool isDiscarding() const
+    {
+        return failed_ && (g_buffered_sinks == nullptr) && (CONSOLE_CRASH_LOG_SIZE == 0);
+    }
+
+    bool hasStagedFragment() const { return staged_size_ > staged_fragment_begin_; }
+
+    /**
+     * The staged data preceding the new fragment is listed first. There is always room for the staged fragment,
+     * so that it is never separated from its data by a flush.
+     */
+    void addFragment(const char* const data, const std::size_t size)
+    {
+        if ((size > 0) && !isDiscarding())
+        {
+            if ((num_fragments_ + (hasStagedFragment() ? 2U : 1U)) > MaxFragments)
+            {
+                flush();
+            }
+            if (hasStagedFragment())
+            {
+                fragments_[num_fragments_++] = {&g_staging_buffer[staged_fragment_begin_],
+                                                staged_size_ - staged_fragment_begin_};
+                staged_fragment_begin_ = staged_size_;
+            }
+            fragments_[num_fragments_++] = {reinterpret_cast<const std::uint8_t*>(data), size};
+        }
+    }
+
+    void stage(const char* const data, const std::size_t size, const bool raw)
+    {
+        if (g_gather_sink && !hasStagedFragment() && (num_fragments_ >= MaxFragments))
+        {
+            flush();                                            // Making room for the staged fragment
+        }
+        for (std::size_t i = 0; (i < size) && !isDiscarding(); i++)
+        {
+            if ((staged_size_ + 2U) > StagingBufferSize)        // Reserving space for CR LF
+            {
+                flush();
+            }
+            if ((data[i] == '\n') && !raw)
+            {
+                g_staging_buffer[staged_size_++] = '\r';
+            }
+            g_staging_buffer[staged_size_++] = std::uint8_t(data[i]);
+        }
+    }
+
+    void flush()
+    {
+        std::size_t size = 0;
+        bool ok = true;
+        if (g_gather_sink)
+        {
+            if (hasStagedFragment())
+            {
+                fragments_[num_fragments_++] = {&g_staging_buffer[staged_fragment_begin_],
+                                                staged_size_ - staged_fragment_begin_};
+            }
+            for (std::size_t i = 0; i < num_fragments_; i++)
+            {
+                size += fragments_[i].size;
+                if (record_to_crash_log_)
+                {
+                    writeToCrashLog(fragments_[i].data, fragments_[i].size);
+                }
+                impl_::writeToBufferedSinks(fragments_[i].data, fragments_[i].size);
+            }
+            ok = failed_ || (num_fragments_ == 0) || g_gather_sink(&fragments_[0], num_fragments_);
+        }
+        else
+        {
+            size = staged_size_;
+            if (record_to_crash_log_)
+            {
+                writeToCrashLog(&g_staging_buffer[0], size);
+            }
+            impl_::writeToBufferedSinks(&g_staging_buffer[0], size);
+            ok = failed_ || (size == 0) || g_sink(&g_staging_buffer[0], size);
+        }
+
+        num_fragments_ = 0;
+        staged_size_ = 0;
+        staged_fragment_begin_ = 0;
+        if (!failed_)
+        {
+            if (ok)
+            {
+                num_written_bytes_ += size;
+            }
+            else
+            {
+                failed_ = true;
+            }
+        }
+    }
+
+public:
+    explicit SinkWriter(const bool record_to_crash_log = true) :
+        record_to_crash_log_(record_to_crash_log)
+    { }
+
+    /**
+     * With the gather sink, the data is referred to until the message is finished, so it must stay intact.
+     */
+    void write(const char* const data, const std::size_t size, const bool raw)
+    {
+        if (g_gather_sink)
+        {
+            std::size_t begin = 0;
+            for (std::size_t i = 0; (i < size) && !raw; i++)
+            {
+                if (data[i] == '\n')
+                {
+                    addFragment(&data[begin], i - begin);
+                    addFragment("\r\n", 2);
+                    begin = i + 1U;
+                }
+            }
+            addFragment(&data[begin], size - begin);
+        }
+        else
+        {
+            stage(data, size, raw);
+        }
+    }
+
+    /**
+     * Same as write(), but the data is always copied, so the caller may reuse it as soon as this returns.
+     */
+    void copy(const char* const data, const std::size_t size, const bool raw)
+    {
+        stage(data, size, raw);
+    }
+
+    /// Returns the number of bytes accepted by the sink, including the inserted CR.
+    std::size_t finish()
+    {
+        if (!isDiscarding())
+        {
+            flush();
+        }
+        impl_::endBufferedSinksMessage();
+        return num_written_bytes_;
+    }
+};
+
+std::size_t writeToSink(const OutputSegment* const segments, const std::size_t num_segments, const bool raw)
+{
+    SinkWriter writer;
+    for (std::size_t i = 0; i < num_segments; i++)
+    {
+        writer.write(segments[i].data, segments[i].size, raw);
+    }
+    return writer.finish();
+}
+
+#if CONSOLE_ASYNC_QUEUE_SLOTS > 0
+/**
+ * Lock-free multi-producer single-consumer queue of output messages.
+ * A message is split into fixed-size slots; a producer reserves all slots of its message at once by advancing
+ * the head with CAS, so messages from different producers never interleave. The consumer releases slots by advancing
+ * the tail. If there is not enough free space, the message is dropped entirely and accounted; producers never block.
+ * Each slot carries a sequence number which tells the consumer whether the slot has been filled by its producer.
+ */
+template <unsigned NumSlots>
+class AsyncOutputQueue
+{
+    static_assert((NumSlots > 0) && ((NumSlots & (NumSlots - 1U)) == 0), "Number of slots must be a power of two");
+
+public:
+    static constexpr std::size_t SlotCapacity = 58;
+
+private:
+    struct Slot
+    {
+        std::atomic<std::uint32_t> sequence{0};     ///< Position + 1 once filled
+        std::uint8_t size = 0;
+        bool raw = false;                           ///< Bypass the newline translation
+        char data[SlotCapacity]{};
+    };
+
+    Slot slots_[NumSlots];
+
+    std::atomic<std::uint32_t> head_{0};            ///< Next position to be reserved by producers
+    std::atomic<std::uint32_t> tail_{0};            ///< Next position to be consumed
+    std::atomic<std::uint32_t> num_dropped_messages_{0};
+    std::atomic<std::uint32_t> peak_usage_slots_{0};
+
+    void updatePeakUsage(const std::uint32_t usage)
+    {
+        std::uint32_t peak = peak_usage_slots_.load(std::memory_order_relaxed);
+        while ((usage > peak) &&
+               !peak_usage_slots_.compare_exchange_weak(peak, usage, std::memory_order_relaxed))
+        { }
+    }
+
+public:
+    /**
+     * Safe to call from any thread concurrently. Returns false if the message has been dropped.
+     */
+    bool push(const OutputSegment* const segments, const std::size_t num_segments, const bool raw)
+    {
+        std::size_t total_size = 0;
+        for (std::size_t i = 0; i < num_segments; i++)
+        {
+            total_size += segments[i].size;
+        }
+
+        const std::uint32_t num_slots = std::uint32_t((total_size + SlotCapacity - 1U) / SlotCapacity);
+        if (num_slots == 0)
+        {
+            return true;
+        }
+
+        /*
+         * Reserving all slots at once. The acquire load of the tail guarantees that the consumer is done with them.
+         */
+        std::uint32_t head = head_.load(std::memory_order_relaxed);
+        std::uint32_t usage = 0;
+        while (true)
+        {
+            const std::uint32_t used = head - tail_.load(std::memory_order_acquire);
+            if (used > NumSlots)
+            {
+                head = head_.load(std::memory_order_relaxed);       // Stale head, the consumer has overtaken it
+                continue;
+            }
+
+            usage = used + num_slots;
+            if (usage > NumSlots)
+            {
+                num_dropped_messages_.fetch_add(1U, std::memory_order_relaxed);
+                return false;
+            }
+
+            if (head_.compare_exchange_weak(head, head + num_slots, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+
+        updatePeakUsage(usage);
+
+        /*
+         * Filling the reserved slots and committing them one by one
+         */
+        std::size_t segment_index = 0;
+        std::size_t segment_offset = 0;
+        for (std::uint32_t pos = head; pos != (head + num_slots); pos++)
+        {
+            Slot& slot = slots_[pos % NumSlots];
+            std::size_t slot_size = 0;
+            while ((slot_size < SlotCapacity) && (segment_index < num_segments))
+            {
+                const OutputSegment& seg = segments[segment_index];
+                const std::size_t amount = std::min(SlotCapacity - slot_size, seg.size - segment_offset);
+                std::memcpy(&slot.data[slot_size], seg.data + segment_offset, amount);
+                slot_size += amount;
+                segment_offset += amount;
+                if (segment_offset >= seg.size)
+                {
+                    segment_index++;
+                    segment_offset = 0;
+                }
+            }
+
+            slot.size = std::uint8_t(slot_size);
+            slot.raw = raw;
+            slot.sequence.store(pos + 1U, std::memory_order_release);
+        }
+
+        return true;
+    }
+
+    /**
+     * Must be invoked from one thread only. Copies out as many committed slots as the buffer can fit;
+     * raw and text slots are never mixed in one chunk. Returns the number of bytes copied; zero if nothing to read.
+     */
+    std::size_t pop(char* const out_buffer, const std::size_t capacity, bool& out_raw)
+    {
+        std::uint32_t tail = tail_.load(std::memory_order_relaxed);
+        std::size_t size = 0;
+        while (true)
+        {
+            const Slot& slot = slots_[tail % NumSlots];
+            if ((slot.sequence.load(std::memory_order_acquire) != (tail + 1U)) ||
+                ((size + slot.size) > capacity) ||
+                ((size > 0) && (slot.raw != out_raw)))
+            {
+                break;
+            }
+
+            out_raw = slot.raw;
+            std::memcpy(&out_buffer[size], &slot.data[0], slot.size);
+            size += slot.size;
+            tail++;
+            tail_.store(tail, std::memory_order_release);
+        }
+        return size;
+    }
+
+    std::uint32_t getNumDroppedMessages() const { return num_dropped_messages_.load(std::memory_order_relaxed); }
+
+    std::uint32_t getPeakUsageSlots() const { return peak_usage_slots_.load(std::memory_order_relaxed); }
+};
+
+static AsyncOutputQueue<CONSOLE_ASYNC_QUEUE_SLOTS> g_async_queue;
+static chibios_rt::BinarySemaphore g_async_semaphore(true);
+
+/**
+ * Low-priority thread that moves the queued output into the sink.
+ * It is the only place where the sink is invoked, except for the case when the sink is being replaced.
+ */
+class AsyncOutputThread : public chibios_rt::BaseStaticThread<CONSOLE_ASYNC_THREAD_STACK_SIZE>
+{
+    static constexpr std::size_t BufferSize = AsyncOutputQueue<CONSOLE_ASYNC_QUEUE_SLOTS>::SlotCapacity * 4U;
+
+    char buffer_[BufferSize]{};     // Not on the stack to keep the stack usage low
+    std::uint32_t num_reported_dropped_messages_ = 0;
+
+    void main() override
+    {
+        setName("console");
+
+        while (true)
+        {
+            (void) g_async_semaphore.wait(TIME_MS2I(LOG_SUPPRESSION_REPORT_INTERVAL_MS));
+            reportSuppressedLogMessages();              // The loggers that went quiet are not reported otherwise
+
+            std::size_t size = 0;
+            bool raw = false;
+            while ((size = g_async_queue.pop(&buffer_[0], sizeof(buffer_), raw)) > 0)
+            {
+                const OutputSegment seg{&buffer_[0], size};
+                MutexLocker locker(g_mutex);
+                (void) writeToSink(&seg, 1, raw);
+            }
+
+            const std::uint32_t num_dropped = g_async_queue.getNumDroppedMessages();
+            if (num_dropped != num_reported_dropped_messages_)
+            {
+                const std::size_t len = format::formatToBuffer(&buffer_[0], sizeof(buffer_),
+                                                               OS_FMT("Console: {} messages dropped\n"),
+                                                               num_dropped - num_reported_dropped_messages_);
+                num_reported_dropped_messages_ = num_dropped;
+                const OutputSegment seg{&buffer_[0], len};
+                MutexLocker locker(g_mutex);
+                (void) writeToSink(&seg, 1, false);
+            }
+        }
+    }
+};
+
+static AsyncOutputThread g_async_thread;
+static std::atomic<bool> g_async_thread_started{false};
+
+#endif  // CONSOLE_ASYNC_QUEUE_SLOTS > 0
+
+/**
+ * Emits the segments as one message. Returns the number of bytes accepted.
+ * Raw messages are written as is, otherwise newlines are translated into CR LF.
+ */
+std::size_t emit(const OutputSegment* const segments, const std::size_t num_segments, const bool raw = false)
+{
+#if CONSOLE_ASYNC_QUEUE_SLOTS > 0
+    if (!g_async_thread_started.exchange(true, std::memory_order_relaxed))
+    {
+        (void) g_async_thread.start(CONSOLE_ASYNC_THREAD_PRIORITY);
+    }
+
+    if (!g_async_queue.push(segments, num_segments, raw))
+    {
+        return 0;
+    }
+
+    g_async_semaphore.signal();
+
+    std::size_t ret = 0;
+    for (std::size_t i = 0; i < num_segments; i++)
+    {
+        ret += segments[i].size;
+    }
+    return ret;
+#else
+    MutexLocker locker(g_mutex);
+    return writeToSink(segments, num_segments, raw);
+#endif
+}
+
+/**
+ * Receives the output of the type-safe formatter in chunks.
+ * In the synchronous mode the chunks are copied by the sink writer, because the formatter passes the converted
+ * numbers from its stack; the mutex is held for the whole message.
+ * In the asynchronous mode they are collected into a buffer that is enqueued as one message when it fills up or
+ * when the message is finished. The buffer holds 256 bytes (or the whole queue if it is smaller), so only the
+ * messages that are longer than that may be interleaved with other output.
+ */
+class ConsoleFormatOutput : public format::IOutput
+{
+#if CONSOLE_ASYNC_QUEUE_SLOTS > 0
+    char buffer_[std::min<std::size_t>(256U, AsyncOutputQueue<CONSOLE_ASYNC_QUEUE_SLOTS>::SlotCapacity *
+                                             CONSOLE_ASYNC_QUEUE_SLOTS)];
+    std::size_t size_ = 0;
+
+public:
+    void write(const char* data, std::size_t size) override
+    {
+        while (size > 0)
+        {
+            if (size_ >= sizeof(buffer_))
+            {
+                flush();
+            }
+            const std::size_t amount = std::min(size, sizeof(buffer_) - size_);
+            std::memcpy(&buffer_[size_], data, amount);
+            size_ += amount;
+            data += amount;
+            size -= amount;
+        }
+    }
+
+    void flush()
+    {
+        if (size_ > 0)
+        {
+            const OutputSegment seg{&buffer_[0], size_};
+            (void) emit(&seg, 1);
+            size_ = 0;
+        }
+    }
+#else
+    MutexLocker locker_{g_mutex};
+    SinkWriter writer_;
+
+public:
+    void write(const char* data, std::size_t size) override
+    {
+        writer_.copy(data, size, false);
+    }
+
+    void flush()
+    {
+        (void) writer_.finish();
+    }
+#endif
+};
+
+/**
+ * Lets chvprintf() write into the console output directly, so that the printf-style output is processed in chunks,
+ * exactly like the output of the type-safe formatter; it is never truncated and needs no intermediate buffer.
+ * Any other formatter output can be used as well, see @ref HashingOutput.
+ */
+class ConsoleOutputStream : public ::BaseSequentialStream
+{
+    format::IOutput& output_;
+
+    static format::IOutput& getOutput(void* const instance)
+    {
+        return static_cast<ConsoleOutputStream*>(static_cast<::BaseSequentialStream*>(instance))->output_;
+    }
+
+    static std::size_t writeImpl(void* const instance, const std::uint8_t* const data, const std::size_t size)
+    {
+        getOutput(instance).write(reinterpret_cast<const char*>(data), size);
+        return size;
+    }
+
+    static std::size_t readImpl(void*, std::uint8_t*, std::size_t) { return 0; }
+
+    static msg_t putImpl(void* const instance, const std::uint8_t byte)
+    {
+        const char ch = char(byte);
+        getOutput(instance).write(&ch, 1);
+        return MSG_OK;
+    }
+
+    static msg_t getImpl(void*) { return MSG_RESET; }
+
+    static constexpr ::BaseSequentialStreamVMT makeVMT()
+    {
+        ::BaseSequentialStreamVMT vmt{};        // The members are assigned by name, the layout differs between versions
+        vmt.write = &writeImpl;
+        vmt.read  = &readImpl;
+        vmt.put   = &putImpl;
+        vmt.get   = &getImpl;
+        return vmt;
+    }
+
+public:
+    explicit ConsoleOutputStream(format::IOutput& output) :
+        output_(output)
+    {
+        static constexpr ::BaseSequentialStreamVMT VMT = makeVMT();      // Constant-initialized, no guard
+        vmt = &VMT;
+    }
+};
+
+/**
+ * Computes the 32-bit FNV-1a hash of the data written into it; the data is not stored.
+ */
+class HashingOutput : public format::IOutput
+{
+    std::uint32_t hash_ = 2166136261UL;
+
+public:
+    void write(const char* const data, const std::size_t size) override
+    {
+        for (std::size_t i = 0; i < size; i++)
+        {
+            hash_ = (hash_ ^ std::uint8_t(data[i])) * 16777619UL;
+        }
+    }
+
+    std::uint32_t get() const { return hash_; }
+};
+
+/**
+ * Formats the printf-style message without output to hash the text; the argument list is not consumed.
+ */
+std::uint32_t hashPrintfArguments(const char* const format, va_list vl)
+{
+    if (LOG_REPEAT_WINDOW_MS == 0)
+    {
+        return 0;
+    }
+    HashingOutput out;
+    ConsoleOutputStream stream(out);
+    va_list copy;
+    va_copy(copy, vl);
+    (void) chvprintf(&stream, format, copy);
+    va_end(copy);
+    return out.get();
+}
+
+/**
+ * Prints the suppression counters of the logger, if any.
+ */
+void printSuppressionReport(const char* const logger_name,
+                            const std::uint32_t num_repeated,
+                            const std::uint32_t num_rate_limited)
+{
+    if ((num_repeated > 0) || (num_rate_limited > 0))
+    {
+        ConsoleFormatOutput out;
+        if (num_repeated > 0)
+        {
+            format::formatTo(out, OS_FMT("{}: {} similar messages suppressed\n"), logger_name, num_repeated);
+        }
+        if (num_rate_limited > 0)
+        {
+            format::formatTo(out, OS_FMT("{}: {} messages suppressed by the rate limiter\n"),
+                             logger_name, num_rate_limited);
+        }
+        out.flush();
+    }
+}
+
+} // namespace
+
+static std::size_t genericPrint(const char* format, va_list vl)
+{
+    ConsoleFormatOutput out;
+    ConsoleOutputStream stream(out);
+    const int res = chvprintf(&stream, format, vl);
+    out.flush();
+    return (res > 0) ? std::size_t(res) : 0U;
+}
+
+
+static std::atomic<std::uint32_t> g_num_suppressed_log_messages{0};
+
+/// The loggers with unreported suppressed messages, linked via Logger::next_suppressing_; protected by a critical
+/// section. Atomic so that the output paths can check it for emptiness without locking.
+static std::atomic<Logger*> g_suppressing_loggers{nullptr};
+
+Logger::~Logger()
+{
+    std::uint32_t num_repeated = 0;
+    std::uint32_t num_rate_limited = 0;
+    {
+        CriticalSectionLocker locker;
+        num_repeated = num_repeated_;
+        num_rate_limited = num_rate_limited_;
+        unlistSuppressing();
+    }
+    printSuppressionReport(name_, num_repeated, num_rate_limited);
+}
+
+void Logger::unlistSuppressing()
+{
+    Logger* prev = nullptr;
+    for (Logger* p = g_suppressing_loggers.load(std::memory_order_relaxed); p != nullptr; p = p->next_suppressing_)
+    {
+        if (p == this)
+        {
+            if (prev == nullptr)
+            {
+                g_suppressing_loggers.store(next_suppressing_, std::memory_order_relaxed);
+            }
+            else
+            {
+                prev->next_suppressing_ = next_suppressing_;
+            }
+            next_suppressing_ = nullptr;
+            break;
+        }
+        prev = p;
+    }
+}
+
+void reportSuppressedLogMessages()
+{
+    while (g_suppressing_loggers.load(std::memory_order_relaxed) != nullptr)
+    {
+        // One logger at a time, so that the critical section stays short and the reports are printed unlocked.
+        // The name is copied because the logger may be destroyed while its report is being printed.
+        const char* name = nullptr;
+        std::uint32_t num_repeated = 0;
+        std::uint32_t num_rate_limited = 0;
+        {
+            CriticalSectionLocker locker;
+            for (Logger* p = g_suppressing_loggers.load(std::memory_order_relaxed);
+                 p != nullptr;
+                 p = p->next_suppressing_)
+            {
+                if (chVTTimeElapsedSinceX(p->suppression_reported_at_) >=
+                    TIME_MS2I(LOG_SUPPRESSION_REPORT_INTERVAL_MS))
+                {
+                    name = p->name_;
+                    num_repeated = p->num_repeated_;
+                    num_rate_limited = p->num_rate_limited_;
+                    p->num_repeated_ = 0;
+                    p->num_rate_limited_ = 0;
+                    p->suppression_reported_at_ = chVTGetSystemTimeX();
+                    p->unlistSuppressing();
+                    break;
+                }
+            }
+        }
+        if (name == nullptr)
+        {
+            break;                                      // Nothing is due yet
+        }
+        printSuppressionReport(name, num_repeated, num_rate_limited);
+    }
+}
 
-namespace os
+void Logger::setRateLimit(const std::uint16_t per_second, const std::uint16_t burst)
 {
+    CriticalSectionLocker locker;
+    rate_limit_per_second_ = per_second;
+    rate_limit_burst_ = burst;
+    milli_tokens_ = std::uint32_t(burst) * MilliTokensPerMessage;
+    last_refill_at_ = chVTGetSystemTimeX();
+}
 
-static bool defaultSink(const std::uint8_t*, std::size_t);
+bool Logger::admit(const void* const call_site, const std::uint32_t arguments_hash)
+{
+    bool admitted = false;
+    std::uint32_t report_repeated = 0;
+    std::uint32_t report_rate_limited = 0;
+    {
+        CriticalSectionLocker locker;
+        const systime_t now = chVTGetSystemTimeX();
 
-static chibios_rt::Mutex g_mutex;
-static StandardOutputSink g_sink{&defaultSink};
+        if (rate_limit_per_second_ > 0)
+        {
+            // Clamping the elapsed time to avoid the overflow; one minute is enough to refill any bucket
+            const std::uint32_t elapsed_ms = std::min<std::uint32_t>(TIME_I2MS(chVTTimeElapsedSinceX(last_refill_at_)),
+                                                                     60000U);
+            milli_tokens_ = std::min(milli_tokens_ + elapsed_ms * rate_limit_per_second_,
+                                     std::uint32_t(rate_limit_burst_) * MilliTokensPerMessage);
+            last_refill_at_ = now;
+        }
 
-// Sink invocations are guaranteed to be protected by the mutex, so no extra locking is needed.
-static bool defaultSink(const std::uint8_t* const data, const std::size_t sz)
+        // Only a message that has been printed can be repeated; otherwise the rate limiter applies
+        const bool repeated = (LOG_REPEAT_WINDOW_MS > 0) &&
+                              coalescing_ &&
+                              (call_site != nullptr) &&
+                              (call_site == last_call_site_) &&
+                              (arguments_hash == last_arguments_hash_) &&
+                              (chVTTimeElapsedSinceX(last_call_site_at_) < TIME_MS2I(LOG_REPEAT_WINDOW_MS));
+        last_call_site_ = call_site;
+        last_arguments_hash_ = arguments_hash;
+        last_call_site_at_ = now;
+
+        const bool was_suppressing = (num_repeated_ > 0) || (num_rate_limited_ > 0);
+        if (repeated)
+        {
+            num_repeated_++;
+        }
+        else if ((rate_limit_per_second_ == 0) || (milli_tokens_ >= MilliTokensPerMessage))
+        {
+            milli_tokens_ -= (rate_limit_per_second_ > 0) ? MilliTokensPerMessage : 0U;
+            admitted = true;
+        }
+        else
+        {
+            num_rate_limited_++;
+        }
+        coalescing_ = admitted || repeated;
+
+        // The counters are reported when the suppression ends, and periodically while it lasts
+        if (was_suppressing &&
+            (admitted ||
+             (chVTTimeElapsedSinceX(suppression_reported_at_) >= TIME_MS2I(LOG_SUPPRESSION_REPORT_INTERVAL_MS))))
+        {
+            report_repeated = num_repeated_;
+            report_rate_limited = num_rate_limited_;
+            num_repeated_ = 0;
+            num_rate_limited_ = 0;
+            suppression_reported_at_ = now;
+            unlistSuppressing();
+        }
+        else if (!admitted && !was_suppressing)
+        {
+            suppression_reported_at_ = now;             // The suppression has just begun
+            next_suppressing_ = g_suppressing_loggers.load(std::memory_order_relaxed);
+            g_suppressing_loggers.store(this, std::memory_order_relaxed);
+        }
+    }
+
+    if (!admitted)
+    {
+        g_num_suppressed_log_messages.fetch_add(1U, std::memory_order_relaxed);
+    }
+
+    printSuppressionReport(name_, report_repeated, report_rate_limited);
+    reportSuppressedLogMessages();                      // Other loggers may have gone quiet while suppressing
+
+    return admitted;
+}
+
+void Logger::vprintln(const char* format, va_list vl)
 {
-    return chnWriteTimeout(&STDOUT_SD, data, sz, TIME_MS2I(10)) == sz;
+    ConsoleFormatOutput out;
+    out.write(name_, std::strlen(name_));
+    out.write(": ", 2);
+    ConsoleOutputStream stream(out);
+    (void) chvprintf(&stream, format, vl);
+    out.write("\n", 1);
+    out.flush();
 }
 
-static std::size_t writeExpandingCrLf(const char* str)
+void Logger::log(LogLevel level, const char* format, ...)
 {
-    std::size_t ret = 0;
-    const char* end = str;
+    if (isEnabled(level))
+    {
+        va_list vl;
+        va_start(vl, format);
+        if (admit(format, hashPrintfArguments(format, vl)))
+        {
+            vprintln(format, vl);
+        }
+        va_end(vl);
+    }
+}
 
-    while (*str != '\0')
+void Logger::println(const char* format, ...)
+{
+    if (isEnabled(LogLevel::Info))
     {
-        if ((*end == '\n') ||
-            (*end == '\0'))
+        va_list vl;
+        va_start(vl, format);
+        if (admit(format, hashPrintfArguments(format, vl)))
         {
-            if (end != str)
-            {
-                const std::size_t range = end - str;
-                if (!g_sink(reinterpret_cast<const std::uint8_t*>(str), range))
-                {
-                    break;
-                }
+            vprintln(format, vl);
+        }
+        va_end(vl);
+    }
+}
 
-                ret += range;
-                str += range;
-            }
+void Logger::puts(const char* line)
+{
+    if (!isEnabled(LogLevel::Info) || !admit(nullptr, 0))    // The line may be a reused buffer
+    {
+        return;
+    }
 
-            if (*end == '\n')
-            {
-                if (!g_sink(reinterpret_cast<const std::uint8_t*>("\r\n"), 2))
-                {
-                    break;
-                }
+    const OutputSegment segments[] = {
+        {name_, std::strlen(name_)},
+        {": ", 2},
+        {line, std::strlen(line)},
+        {"\n", 1}
+    };
+    (void) emit(&segments[0], sizeof(segments) / sizeof(segments[0]));
+}
 
-                ret += 2U;
-                str++;
-            }
+
+/*
+ * Run time log levels
+ */
+namespace
+{
+
+struct ModuleLogLevel
+{
+    char module_name[LOG_LEVEL_MAX_MODULE_NAME_LENGTH + 1]{};   ///< Empty if the entry is not used
+    LogLevel level = LogLevel::Debug;
+};
+
+chibios_rt::Mutex g_log_level_mutex;
+ModuleLogLevel g_module_log_levels[LOG_LEVEL_MAX_MODULES];
+LogLevel g_default_log_level = LogLevel::Debug;
+
+/// Whether the entry applies to the module: either the same name or a parent module.
+bool doesModuleLogLevelApply(const ModuleLogLevel& entry, const char* const module_name)
+{
+    const std::size_t len = std::strlen(&entry.module_name[0]);
+    return (len > 0) &&
+           (std::strncmp(&entry.module_name[0], module_name, len) == 0) &&
+           ((module_name[len] == '\0') || (module_name[len] == '.'));
+}
+
+} // namespace
+
+namespace impl_
+{
+
+std::atomic<std::uint32_t> g_log_level_generation{1};
+
+LogLevel resolveLogLevel(const char* const module_name)
+{
+    MutexLocker locker(g_log_level_mutex);
+    LogLevel level = g_default_log_level;
+    std::size_t best_match_length = 0;
+    for (const ModuleLogLevel& entry : g_module_log_levels)
+    {
+        const std::size_t len = std::strlen(&entry.module_name[0]);
+        if ((len > best_match_length) && doesModuleLogLevelApply(entry, module_name))
+        {
+            best_match_length = len;
+            level = entry.level;
         }
+    }
+    return level;
+}
 
-        end++;
+void printFormatted(const char* const prefix,
+                    const char* const format,
+                    const format::impl_::Arg* const args,
+                    const std::size_t num_args)
+{
+    ConsoleFormatOutput out;
+    if (prefix != nullptr)
+    {
+        out.write(prefix, std::strlen(prefix));
+        out.write(": ", 2);
+    }
+    format::impl_::vformat(out, format, args, num_args);
+    if (prefix != nullptr)
+    {
+        out.write("\n", 1);
     }
+    out.flush();
+}
 
-    return ret;
+std::uint32_t hashLogArguments(const format::impl_::Arg* const args, const std::size_t num_args)
+{
+    if (LOG_REPEAT_WINDOW_MS == 0)
+    {
+        return 0;
+    }
+    HashingOutput out;
+    for (std::size_t i = 0; i < num_args; i++)
+    {
+        const char type = char(args[i].type);
+        out.write(&type, 1);
+        if (args[i].type == format::impl_::ArgType::String)
+        {
+            out.write(args[i].value.s, std::strlen(args[i].value.s) + 1U);     // With the terminator as separator
+        }
+        else
+        {
+            out.write(reinterpret_cast<const char*>(&args[i].value), sizeof(args[i].value));
+        }
+    }
+    return out.get();
 }
 
-static std::size_t genericPrint(const char* format, va_list vl)
+std::uint32_t hashLogArguments(const std::uint8_t* const data, const std::size_t size)
 {
-    MutexLocker locker(g_mutex);
+    if (LOG_REPEAT_WINDOW_MS == 0)
+    {
+        return 0;
+    }
+    HashingOutput out;
+    out.write(reinterpret_cast<const char*>(data), size);
+    return out.get();
+}
 
-    /*
-     * Printing the string into the buffer
-     */
-    char buffer[256]{};
-    MemoryStream ms;
-    msObjectInit(&ms, (uint8_t*)buffer, sizeof(buffer), 0);
-    ::BaseSequentialStream* chp = (::BaseSequentialStream*)&ms;
-    chvprintf(chp, format, vl);
-    buffer[sizeof(buffer) - 1] = 0;     // Paranoid termination
-
-    /*
-     * Writing the buffer replacing "\n" --> "\r\n"
-     */
-    return writeExpandingCrLf(buffer);
+void emitBinaryRecord(const std::uint8_t* const data, const std::size_t size)
+{
+    const OutputSegment seg{reinterpret_cast<const char*>(data), size};
+    (void) emit(&seg, 1, true);
 }
 
+}
 
-void Logger::println(const char* format, ...)
+
+int setLogLevel(const char* const module_name, const LogLevel level)
 {
-    MutexLocker locker(g_mutex);
+    if (std::strlen(module_name) > LOG_LEVEL_MAX_MODULE_NAME_LENGTH)
+    {
+        return -ENAMETOOLONG;
+    }
 
-    writeExpandingCrLf(name_);
-    writeExpandingCrLf(": ");
+    MutexLocker locker(g_log_level_mutex);
 
-    va_list vl;
-    va_start(vl, format);
-    genericPrint(format, vl);
-    va_end(vl);
+    if (module_name[0] == '\0')
+    {
+        g_default_log_level = level;
+    }
+    else
+    {
+        ModuleLogLevel* entry = nullptr;
+        for (ModuleLogLevel& x : g_module_log_levels)
+        {
+            if (std::strcmp(&x.module_name[0], module_name) == 0)
+            {
+                entry = &x;
+                break;
+            }
+            if ((entry == nullptr) && (x.module_name[0] == '\0'))
+            {
+                entry = &x;
+            }
+        }
+
+        if (entry == nullptr)
+        {
+            return -ENOSPC;
+        }
 
-    writeExpandingCrLf("\n");
+        std::strncpy(&entry->module_name[0], module_name, LOG_LEVEL_MAX_MODULE_NAME_LENGTH);
+        entry->level = level;
+    }
+
+    impl_::g_log_level_generation.fetch_add(1U, std::memory_order_relaxed);
+    return 0;
 }
 
-void Logger::puts(const char* line)
+LogLevel getLogLevel(const char* const module_name)
 {
-    MutexLocker locker(g_mutex);
-    writeExpandingCrLf(name_);
-    writeExpandingCrLf(": ");
-    writeExpandingCrLf(line);
-    writeExpandingCrLf("\n");
+    return impl_::resolveLogLevel(module_name);
+}
+
+void forEachLogLevel(const std::function<void (const char* module_name, LogLevel level)>& callback)
+{
+    for (const ModuleLogLevel& x : g_module_log_levels)
+    {
+        ModuleLogLevel copy;
+        {
+            MutexLocker locker(g_log_level_mutex);
+            copy = x;
+        }
+        if (copy.module_name[0] != '\0')
+        {
+            callback(&copy.module_name[0], copy.level);
+        }
+    }
+    callback("", getLogLevel(""));
+}
+
+static const char* const LogLevelNames[] = { "debug", "info", "warning", "error", "off" };
+
+const char* logLevelToString(const LogLevel level)
+{
+    const unsigned index = unsigned(level);
+    return (index < (sizeof(LogLevelNames) / sizeof(LogLevelNames[0]))) ? LogLevelNames[index] : "?";
+}
+
+bool parseLogLevel(const char* const str, LogLevel& out_level)
+{
+    for (unsigned i = 0; i < (sizeof(LogLevelNames) / sizeof(LogLevelNames[0])); i++)
+    {
+        if (std::strcmp(str, LogLevelNames[i]) == 0)
+        {
+            out_level = LogLevel(i);
+            return true;
+        }
+    }
+    return false;
 }
 
 
 void setStandardOutputSink(const StandardOutputSink& sink)
 {
     MutexLocker locker(g_mutex);
+    g_gather_sink = nullptr;
     if (sink)
     {
         g_sink = sink;
@@ -128,6 +1229,228 @@ void setStandardOutputSink(const StandardOutputSink& sink)
     }
 }
 
+void setStandardOutputGatherSink(const StandardOutputGatherSink& sink)
+{
+    MutexLocker locker(g_mutex);
+    g_gather_sink = sink;
+    if (!sink)
+    {
+        g_sink = defaultSink;
+    }
+}
+
+
+/*
+ * Buffered sinks
+ */
+BufferedStandardOutputSink::BufferedStandardOutputSink(std::uint8_t* const buffer,
+                                                       const std::size_t capacity,
+                                                       const StandardOutputStreamSink& sink,
+                                                       const StandardOutputDropPolicy drop_policy) :
+    sink_(sink),
+    buffer_(buffer),
+    capacity_(capacity),
+    drop_policy_(drop_policy)
+{
+    assert((buffer_ != nullptr) && (capacity_ > 0));
+}
+
+void BufferedStandardOutputSink::push(const std::uint8_t* data, std::size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    {
+        MutexLocker locker(mutex_);
+
+        if (drop_policy_ == StandardOutputDropPolicy::DropNewest)
+        {
+            if (discarding_message_ || (size > (capacity_ - size_)))
+            {
+                discarding_message_ = true;             // Not breaking the message in the middle
+                num_dropped_bytes_ += size;
+                return;
+            }
+        }
+        else
+        {
+            if (size > capacity_)
+            {
+                num_dropped_bytes_ += size - capacity_;
+                data += size - capacity_;
+                size = capacity_;
+            }
+            const std::size_t excess = ((size_ + size) > capacity_) ? (size_ + size - capacity_) : 0U;
+            read_index_ = (read_index_ + excess) % capacity_;
+            size_ -= excess;
+            num_dropped_bytes_ += excess;
+        }
+
+        const std::size_t write_index = (read_index_ + size_) % capacity_;
+        const std::size_t first = std::min(size, capacity_ - write_index);
+        std::memcpy(&buffer_[write_index], data, first);
+        std::memcpy(&buffer_[0], data + first, size - first);
+        size_ += size;
+        peak_size_ = std::max(peak_size_, size_);
+    }
+
+    data_available_.signal();
+}
+
+void BufferedStandardOutputSink::endMessage()
+{
+    discarding_message_ = false;
+}
+
+std::size_t BufferedStandardOutputSink::drain(const sysinterval_t timeout)
+{
+    reportSuppressedLogMessages();                      // Before locking, the reports are written here too
+
+    std::size_t num_written = 0;
+    bool waited = false;
+    while (true)
+    {
+        if (chunk_offset_ >= chunk_size_)
+        {
+            {
+                MutexLocker locker(mutex_);
+                chunk_offset_ = 0;
+                chunk_size_ = std::min(size_, ChunkSize);
+                const std::size_t first = std::min(chunk_size_, capacity_ - read_index_);
+                std::memcpy(&chunk_[0], &buffer_[read_index_], first);
+                std::memcpy(&chunk_[first], &buffer_[0], chunk_size_ - first);
+                read_index_ = (read_index_ + chunk_size_) % capacity_;
+                size_ -= chunk_size_;
+            }
+
+            if (chunk_size_ == 0)
+            {
+                if (waited || (num_written > 0) || (timeout == TIME_IMMEDIATE))
+                {
+                    break;
+                }
+                (void) data_available_.wait(timeout);
+                waited = true;
+                continue;
+            }
+        }
+
+        // The destination is never invoked with the lock held, so it can't block the console
+        const std::size_t remaining = chunk_size_ - chunk_offset_;
+        const std::size_t accepted = std::min(sink_(&chunk_[chunk_offset_], remaining), remaining);
+        chunk_offset_ += accepted;
+        num_written += accepted;
+        if (accepted < remaining)
+        {
+            break;                                      // The destination is busy, the rest will be written later
+        }
+    }
+    return num_written;
+}
+
+void addStandardOutputSink(BufferedStandardOutputSink& sink)
+{
+    MutexLocker locker(g_mutex);
+    for (BufferedStandardOutputSink* p = g_buffered_sinks; p != nullptr; p = p->next_)
+    {
+        if (p == &sink)
+        {
+            return;
+        }
+    }
+    sink.next_ = g_buffered_sinks;
+    g_buffered_sinks = &sink;
+}
+
+void removeStandardOutputSink(BufferedStandardOutputSink& sink)
+{
+    MutexLocker locker(g_mutex);
+    for (BufferedStandardOutputSink** pp = &g_buffered_sinks; *pp != nullptr; pp = &(*pp)->next_)
+    {
+        if (*pp == &sink)
+        {
+            *pp = sink.next_;
+            sink.next_ = nullptr;
+            break;
+        }
+    }
+}
+
+/*
+ * Crash log
+ */
+std::size_t readPreviousSessionLog(const std::function<void (const std::uint8_t*, std::size_t)>& callback)
+{
+    MutexLocker locker(g_mutex);
+    return forEachPreviousSessionLogChunk(callback);
+}
+
+void printPreviousSessionLog()
+{
+    static const char Banner[] = "\n--- Output of the previous session ---\n";
+    static const char Footer[] = "--- End of the output of the previous session ---\n";
+
+    MutexLocker locker(g_mutex);
+    SinkWriter writer(false);                           // Not recording the old output into the crash log again
+    bool printed = false;
+    (void) forEachPreviousSessionLogChunk([&](const std::uint8_t* data, std::size_t size)
+        {
+            if (!printed)
+            {
+                printed = true;
+                writer.write(&Banner[0], sizeof(Banner) - 1U, false);
+            }
+            // The chunk is overwritten by the next one; the line endings are translated already
+            writer.copy(reinterpret_cast<const char*>(data), size, true);
+        });
+    if (printed)
+    {
+        writer.write(&Footer[0], sizeof(Footer) - 1U, false);
+    }
+    (void) writer.finish();
+}
+
+namespace impl_
+{
+
+void writeToCrashLogFromPanicHandler(const char* const str)
+{
+    writeToCrashLog(reinterpret_cast<const std::uint8_t*>(str), std::strlen(str));
+}
+
+void writeToBufferedSinks(const std::uint8_t* const data, const std::size_t size)
+{
+    for (BufferedStandardOutputSink* p = g_buffered_sinks; p != nullptr; p = p->next_)
+    {
+        p->push(data, size);
+    }
+}
+
+void endBufferedSinksMessage()
+{
+    for (BufferedStandardOutputSink* p = g_buffered_sinks; p != nullptr; p = p->next_)
+    {
+        p->endMessage();
+    }
+}
+
+}
+
+StandardOutputStatistics getStandardOutputStatistics()
+{
+    StandardOutputStatistics out;
+#if CONSOLE_ASYNC_QUEUE_SLOTS > 0
+    out.queue_capacity_bytes    = CONSOLE_ASYNC_QUEUE_SLOTS * AsyncOutputQueue<CONSOLE_ASYNC_QUEUE_SLOTS>::SlotCapacity;
+    out.queue_peak_usage_bytes  = g_async_queue.getPeakUsageSlots() *
+                                  AsyncOutputQueue<CONSOLE_ASYNC_QUEUE_SLOTS>::SlotCapacity;
+    out.num_dropped_messages    = g_async_queue.getNumDroppedMessages();
+#endif
+    out.num_suppressed_log_messages = g_num_suppressed_log_messages.load(std::memory_order_relaxed);
+    return out;
+}
+
 } // namespace os
 
 extern "C"
@@ -151,10 +1474,11 @@ int vprintf(const char* format, va_list vl)
 
 int puts(const char* str)
 {
-    MutexLocker locker(g_mutex);
-    int ret = int(writeExpandingCrLf(str));
-    ret += int(writeExpandingCrLf("\n"));
-    return ret;
+    const OutputSegment segments[] = {
+        {str, std::strlen(str)},
+        {"\n", 1}
+    };
+    return int(emit(&segments[0], sizeof(segments) / sizeof(segments[0])));
 }
 
 }
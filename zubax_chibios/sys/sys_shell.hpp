@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Shell commands that expose the facilities of the system module. Register the needed ones with the shell.
+ */
+
+#pragma once
+
+#include "sys.hpp"
+#include "profiler.hpp"
+#include "probe.hpp"
+#include "benchmark.hpp"
+#include "latency.hpp"
+#include "thread_stats.hpp"
+#include <zubax_chibios/util/shell.hpp>
+
+
+namespace os
+{
+namespace shell
+{
+/**
+ * Shows or changes the run time log levels.
+ *      loglevel                    - list the module levels and the default level
+ *      loglevel <level>            - set the default level
+ *      loglevel <module> <level>   - set the level of the module and its submodules
+ * The levels are: debug, info, warning, error, off.
+ */
+class LogLevelCommandHandler : public ICommandHandler
+{
+public:
+    const char* getName() const override { return "loglevel"; }
+
+    void execute(BaseChannelWrapper& ios, int argc, char** argv) override
+    {
+        if (argc <= 1)
+        {
+            forEachLogLevel([&ios](const char* module_name, LogLevel level)
+                {
+                    ios.print("%-32s %s\n", (module_name[0] == '\0') ? "<default>" : module_name,
+                              logLevelToString(level));
+                });
+            return;
+        }
+
+        LogLevel level = LogLevel::Debug;
+        if ((argc > 3) || !parseLogLevel(argv[argc - 1], level))
+        {
+            ios.print("Usage: %s [[module] debug|info|warning|error|off]\n", argv[0]);
+            return;
+        }
+
+        const int res = setLogLevel((argc == 3) ? argv[1] : "", level);
+        if (res < 0)
+        {
+            ios.print("Error %d\n", res);
+        }
+    }
+};
+
+/**
+ * Controls the trace recorder; see trace.hpp.
+ *      trace start                 - discard the recorded events and start recording
+ *      trace stop                  - stop recording
+ *      trace dump                  - stop recording and print the events for tools/trace_to_chrome.py
+ */
+class TraceCommandHandler : public ICommandHandler
+{
+public:
+    const char* getName() const override { return "trace"; }
+
+    void execute(BaseChannelWrapper& ios, int argc, char** argv) override
+    {
+        if ((argc == 2) && (std::strcmp(argv[1], "start") == 0))
+        {
+            trace::start();
+        }
+        else if ((argc == 2) && (std::strcmp(argv[1], "stop") == 0))
+        {
+            trace::stop();
+        }
+        else if ((argc == 2) && (std::strcmp(argv[1], "dump") == 0))
+        {
+            trace::stop();
+            trace::dump([&ios](const char* line) { ios.puts(line); });
+        }
+        else
+        {
+            ios.print("Usage: %s start|stop|dump\n", argv[0]);
+        }
+    }
+};
+
+/**
+ * Controls the sampling profiler; see profiler.hpp.
+ *      profile                     - show whether the profiler is running
+ *      profile start|stop          - start or stop streaming the samples for tools/profiler.py
+ */
+class ProfileCommandHandler : public ICommandHandler
+{
+public:
+    const char* getName() const override { return "profile"; }
+
+    void execute(BaseChannelWrapper& ios, int argc, char** argv) override
+    {
+        if (argc <= 1)
+        {
+            ios.puts(profiler::isRunning() ? "running" : "stopped");
+        }
+        else if ((argc == 2) && (std::strcmp(argv[1], "start") == 0))
+        {
+            profiler::start();
+        }
+        else if ((argc == 2) && (std::strcmp(argv[1], "stop") == 0))
+        {
+            profiler::stop();
+        }
+        else
+        {
+            ios.print("Usage: %s [start|stop]\n", argv[0]);
+        }
+    }
+};
+
+/**
+ * Shows the CPU usage per thread since the previous invocation, and the stack usage; see thread_stats.hpp.
+ *      threads
+ */
+class ThreadsCommandHandler : public ICommandHandler
+{
+    /// The values are printed with one decimal place without floating point support in chprintf().
+    static unsigned toPermille(const float x) { return unsigned(x * 1000.0F + 0.5F); }
+
+public:
+    const char* getName() const override { return "threads"; }
+
+    void execute(BaseChannelWrapper& ios, int, char**) override
+    {
+        ios.print("%-20s %4s %6s %6s %6s\n", "Name", "Prio", "CPU%", "Stack", "Unused");
+        const float load = sampleThreadStatistics([&ios](const ThreadStatistics& st)
+            {
+                const unsigned cpu = toPermille(st.cpu_load);
+                if (st.stack_size > 0)
+                {
+                    ios.print("%-20s %4u %4u.%u %6u %6u\n", st.name, unsigned(st.priority), cpu / 10U, cpu % 10U,
+                              unsigned(st.stack_size), unsigned(st.stack_unused));
+                }
+                else
+                {
+                    ios.print("%-20s %4u %4u.%u %6s %6s\n", st.name, unsigned(st.priority), cpu / 10U, cpu % 10U,
+                              "?", "?");
+                }
+            });
+        const unsigned cpu = toPermille(load);
+        ios.print("CPU load %u.%u%%\n", cpu / 10U, cpu % 10U);
+    }
+};
+
+/**
+ * Shows the contention statistics of the named mutexes; requires MUTEX_STATISTICS, see @ref NamedMutex.
+ *      mutexes                     - show the counters and the worst cases with the threads involved
+ *      mutexes hist                - also show the histograms of the wait and hold times
+ *      mutexes reset               - reset the statistics
+ */
+class MutexesCommandHandler : public ICommandHandler
+{
+    static unsigned cyclesToMicroseconds(const std::uint32_t cycles)
+    {
+        return unsigned(cycles / (STM32_HCLK / 1000000U));
+    }
+
+    /// The thread may have been terminated, so it is looked up in the registry rather than dereferenced.
+    static const char* getThreadName(const thread_t* const thread)
+    {
+#if CH_CFG_USE_REGISTRY
+        const char* name = "?";
+        for (thread_t* tp = chRegFirstThread(); tp != nullptr; tp = chRegNextThread(tp))
+        {
+            if ((tp == thread) && (tp->name != nullptr))
+            {
+                name = tp->name;
+            }
+        }
+        return (thread == nullptr) ? "-" : name;
+#else
+        return (thread == nullptr) ? "-" : "?";
+#endif
+    }
+
+    static void printHistogram(BaseChannelWrapper& ios, const char* title, const std::uint32_t* bins)
+    {
+        ios.print("  %s:", title);
+        for (unsigned i = 0; i < MutexStatistics::HistogramBins; i++)
+        {
+            ios.print(" %u", unsigned(bins[i]));
+        }
+        ios.print("\n");
+    }
+
+public:
+    const char* getName() const override { return "mutexes"; }
+
+    void execute(BaseChannelWrapper& ios, int argc, char** argv) override
+    {
+        const bool histograms = (argc == 2) && (std::strcmp(argv[1], "hist") == 0);
+        if ((argc == 2) && (std::strcmp(argv[1], "reset") == 0))
+        {
+            resetMutexStatistics();
+            return;
+        }
+        if ((argc > 1) && !histograms)
+        {
+            ios.print("Usage: %s [hist|reset]\n", argv[0]);
+            return;
+        }
+        if (MUTEX_STATISTICS == 0)
+        {
+            ios.puts("Mutex statistics are disabled");
+            return;
+        }
+
+        ios.print("%-16s %8s %8s %10s %10s  %s\n", "Name", "Locks", "Contend", "MaxWait,us", "MaxHold,us",
+                  "Worst waiter <- owner; worst holder");
+        forEachMutexStatistics([&ios, histograms](const MutexStatistics& st)
+            {
+                ios.print("%-16s %8u %8u %10u %10u  %s <- %s; %s\n", st.name,
+                          unsigned(st.num_locks), unsigned(st.num_contended),
+                          cyclesToMicroseconds(st.max_wait_cycles), cyclesToMicroseconds(st.max_hold_cycles),
+                          getThreadName(st.max_wait_waiter), getThreadName(st.max_wait_owner),
+                          getThreadName(st.max_hold_owner));
+                if (histograms)
+                {
+                    printHistogram(ios, "wait", &st.wait_histogram[0]);
+                    printHistogram(ios, "hold", &st.hold_histogram[0]);
+                }
+            });
+        if (histograms)
+        {
+            ios.puts("Histogram bin N counts the durations in [4^N, 4^(N+1)) cycles");
+        }
+    }
+};
+
+/**
+ * Shows the statistics of the timing probes; see probe.hpp.
+ *      probes                      - show the count, min, mean, and max per probe site, in cycles
+ *      probes csv                  - dump the statistics including the histograms as CSV
+ *      probes reset                - reset the statistics
+ */
+class ProbesCommandHandler : public ICommandHandler
+{
+public:
+    const char* getName() const override { return "probes"; }
+
+    void execute(BaseChannelWrapper& ios, int argc, char** argv) override
+    {
+        if (argc <= 1)
+        {
+            ios.print("%-32s %10s %10s %10s %10s\n", "Name", "Count", "Min", "Mean", "Max");
+            probe::forEachSite([&ios](const probe::Statistics& st)
+                {
+                    ios.print("%-32s %10u %10u %10u %10u\n", st.name, unsigned(st.count),
+                              unsigned(st.min), unsigned(st.getMean()), unsigned(st.max));
+                });
+        }
+        else if ((argc == 2) && (std::strcmp(argv[1], "csv") == 0))
+        {
+            probe::dumpCSV([&ios](const char* line) { ios.puts(line); });
+        }
+        else if ((argc == 2) && (std::strcmp(argv[1], "reset") == 0))
+        {
+            probe::resetAll();
+        }
+        else
+        {
+            ios.print("Usage: %s [csv|reset]\n", argv[0]);
+        }
+    }
+};
+
+/**
+ * Runs the micro-benchmarks; see benchmark.hpp.
+ *      bench list                  - list the benchmarks with the number of bytes processed per operation
+ *      bench [-i] [prefix]         - run the benchmarks whose names begin with the prefix, or all of them;
+ *                                    -i raises the priority to HIGHPRIO while measuring, but the interrupts and
+ *                                    the other HIGHPRIO threads are not excluded
+ */
+class BenchCommandHandler : public ICommandHandler
+{
+public:
+    const char* getName() const override { return "bench"; }
+
+    void execute(BaseChannelWrapper& ios, int argc, char** argv) override
+    {
+        if ((argc == 2) && (std::strcmp(argv[1], "list") == 0))
+        {
+            benchmark::forEach([&ios](const char* name, std::uint32_t bytes_per_operation)
+                {
+                    ios.print("%-32s %10u\n", name, unsigned(bytes_per_operation));
+                });
+            return;
+        }
+
+        bool isolate = false;
+        const char* prefix = "";
+        for (int i = 1; i < argc; i++)
+        {
+            if (std::strcmp(argv[i], "-i") == 0)
+            {
+                isolate = true;
+            }
+            else if (prefix[0] == '\0')
+            {
+                prefix = argv[i];
+            }
+            else
+            {
+                ios.print("Usage: %s list | %s [-i] [name-prefix]\n", argv[0], argv[0]);
+                ios.puts("  -i  run at HIGHPRIO; the interrupts and the other HIGHPRIO threads are not excluded");
+                return;
+            }
+        }
+
+        ios.print("%-32s %10s %14s %12s\n", "Name", "Iterations", "Cycles/op", "Bytes/s");
+        const int count = benchmark::run(prefix, isolate, [&ios](const benchmark::Result& r)
+            {
+                const auto cycles_x100 = r.getCyclesPerOperationX100();
+                ios.print("%-32s %10u %11u.%02u %12u\n", r.name, unsigned(r.iterations),
+                          unsigned(cycles_x100 / 100U), unsigned(cycles_x100 % 100U),
+                          unsigned(r.getBytesPerSecond()));
+            });
+        if (count == 0)
+        {
+            ios.puts("No matching benchmarks");
+        }
+    }
+};
+
+/**
+ * Shows the interrupt latency and the critical section durations; requires LATENCY_STATISTICS, see latency.hpp.
+ *      latency                     - show the count, min, mean, max, and jitter in cycles, and the longest section
+ *      latency hist                - also show the histograms
+ *      latency reset               - reset the statistics
+ */
+class LatencyCommandHandler : public ICommandHandler
+{
+    static void printStatistics(BaseChannelWrapper& ios, const char* title, const probe::Statistics& st)
+    {
+        ios.print("%-20s %10u %10u %10u %10u %10u\n", title, unsigned(st.count), unsigned(st.min),
+                  unsigned(st.getMean()), unsigned(st.max), unsigned(st.max - st.min));
+    }
+
+    static void printHistogram(BaseChannelWrapper& ios, const char* title, const probe::Statistics& st)
+    {
+        ios.print("%s histogram:\n", title);
+        for (unsigned i = 0; i < probe::Statistics::HistogramBins; i++)
+        {
+            if (st.histogram[i] > 0)
+            {
+                ios.print("  <=%10u %10u\n", unsigned((2ULL << i) - 1U), unsigned(st.histogram[i]));
+            }
+        }
+    }
+
+public:
+    const char* getName() const override { return "latency"; }
+
+    void execute(BaseChannelWrapper& ios, int argc, char** argv) override
+    {
+        const bool print_histograms = (argc == 2) && (std::strcmp(argv[1], "hist") == 0);
+        if ((argc == 2) && (std::strcmp(argv[1], "reset") == 0))
+        {
+            latency::reset();
+            return;
+        }
+        if ((argc > 2) || ((argc == 2) && !print_histograms))
+        {
+            ios.print("Usage: %s [hist|reset]\n", argv[0]);
+            return;
+        }
+
+        const auto interrupt = latency::getInterruptLatencyStatistics();
+        const auto critical = latency::getCriticalSectionStatistics();
+        const auto worst = latency::getWorstCriticalSection();
+
+        ios.print("%-20s %10s %10s %10s %10s %10s\n", "Cycles", "Count", "Min", "Mean", "Max", "Jitter");
+        printStatistics(ios, "Interrupt latency", interrupt);
+        printStatistics(ios, "Critical section", critical);
+        ios.print("Longest critical section: %u cycles at %p in %s\n", unsigned(worst.cycles), worst.address,
+                  (worst.thread_name == nullptr) ? "ISR/init" : worst.thread_name);
+
+        if (print_histograms)
+        {
+            printHistogram(ios, "Interrupt latency", interrupt);
+            printHistogram(ios, "Critical section", critical);
+        }
+    }
+};
+
+}
+}
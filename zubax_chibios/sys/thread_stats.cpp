@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#include "thread_stats.hpp"
+#include "trace_hooks.h"
+#include <hal.h>
+
+#define THREAD_STATS_STACK_SCAN_AVAILABLE   (CH_DBG_FILL_THREADS && CH_DBG_ENABLE_STACK_CHECK)
+
+#if THREAD_STATS_STACK_SCAN_AVAILABLE
+extern "C"
+{
+extern stkalign_t __main_thread_stack_base__;   // Defined by the linker script
+extern stkalign_t __main_thread_stack_end__;
+}
+#endif
+
+
+namespace os
+{
+namespace
+{
+
+struct RunTimeEntry
+{
+    const void* thread = nullptr;
+    std::uint64_t cycles = 0;                   ///< 32 bits would overflow in seconds between the samples
+};
+
+/*
+ * Updated from the context switch hook, i.e. with the kernel locked; read and reset from sampleThreadStatistics().
+ */
+RunTimeEntry g_run_time[THREAD_STATS_MAX_THREADS];
+std::uint64_t g_untracked_cycles = 0;
+std::uint32_t g_switched_at = 0;
+
+void accumulate(const void* const thread, const std::uint32_t cycles)
+{
+    RunTimeEntry* free_entry = nullptr;
+    for (RunTimeEntry& x : g_run_time)
+    {
+        if (x.thread == thread)
+        {
+            x.cycles += cycles;
+            return;
+        }
+        if ((free_entry == nullptr) && (x.thread == nullptr))
+        {
+            free_entry = &x;
+        }
+    }
+
+    if (free_entry != nullptr)
+    {
+        free_entry->thread = thread;
+        free_entry->cycles = cycles;
+    }
+    else
+    {
+        g_untracked_cycles += cycles;
+    }
+}
+
+void accountSwitch(const void* const previous_thread)
+{
+    const std::uint32_t now = DWT->CYCCNT;
+    accumulate(previous_thread, now - g_switched_at);
+    g_switched_at = now;
+}
+
+void computeStackUsage(const thread_t* const tp, ThreadStatistics& out)
+{
+#if THREAD_STATS_STACK_SCAN_AVAILABLE
+    const auto base = reinterpret_cast<const std::uint8_t*>(tp->wabase);
+    const std::uint8_t* end = reinterpret_cast<const std::uint8_t*>(tp);   // The descriptor is above the stack
+    if (tp->wabase == &__main_thread_stack_base__)
+    {
+        end = reinterpret_cast<const std::uint8_t*>(&__main_thread_stack_end__);
+    }
+    if ((base == nullptr) || (end <= base))
+    {
+        return;
+    }
+
+    // The stack grows downwards, so the unused space is at the bottom
+    const std::uint8_t* p = base;
+    while ((p < end) && (*p == CH_DBG_STACK_FILL_VALUE))
+    {
+        p++;
+    }
+
+    out.stack_size = std::size_t(end - base);
+    out.stack_unused = std::size_t(p - base);
+#else
+    (void) tp;
+    (void) out;
+#endif
+}
+
+}
+
+float sampleThreadStatistics(const std::function<void (const ThreadStatistics&)>& callback)
+{
+    RunTimeEntry snapshot[THREAD_STATS_MAX_THREADS];
+    std::uint64_t total_cycles = 0;
+
+    chSysLock();
+    if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0)
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        g_switched_at = DWT->CYCCNT;
+    }
+    accountSwitch(chThdGetSelfX());                 // Closing the interval of the calling thread
+    for (unsigned i = 0; i < THREAD_STATS_MAX_THREADS; i++)
+    {
+        snapshot[i] = g_run_time[i];
+        total_cycles += g_run_time[i].cycles;
+        g_run_time[i] = RunTimeEntry();             // The terminated threads are forgotten this way
+    }
+    total_cycles += g_untracked_cycles;
+    g_untracked_cycles = 0;
+    chSysUnlock();
+
+    float idle_load = 0.0F;
+
+#if CH_CFG_USE_REGISTRY
+    for (thread_t* tp = chRegFirstThread(); tp != nullptr; tp = chRegNextThread(tp))
+    {
+        ThreadStatistics st;
+        st.thread = tp;
+        st.name = (tp->name == nullptr) ? "?" : tp->name;
+        st.priority = tp->prio;
+
+        for (const RunTimeEntry& x : snapshot)
+        {
+            if ((x.thread == tp) && (total_cycles > 0))
+            {
+                st.cpu_load = float(x.cycles) / float(total_cycles);
+                break;
+            }
+        }
+        if (tp->prio == IDLEPRIO)
+        {
+            idle_load += st.cpu_load;
+        }
+
+        computeStackUsage(tp, st);
+
+        callback(st);
+    }
+#else
+    (void) callback;
+#endif
+
+    return (total_cycles > 0) ? (1.0F - idle_load) : 0.0F;
+}
+
+}
+
+extern "C"
+{
+
+void zchThreadStatsContextSwitchHook(void*, void* otp)
+{
+    os::accountSwitch(otp);
+}
+
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Per-thread CPU usage and stack headroom.
+ *
+ * The run time of every thread is accumulated in DWT cycles by the context switch hook, which must be installed
+ * in chconf.h (if the trace recorder is used too, both hooks are invoked from the same macro):
+ *
+ *      #include <zubax_chibios/sys/trace_hooks.h>
+ *      #define CH_CFG_CONTEXT_SWITCH_HOOK(ntp, otp)    zchThreadStatsContextSwitchHook(ntp, otp)
+ *
+ * The time spent in the interrupts is attributed to the interrupted thread. The CPU load is the share of time
+ * not spent in the idle thread. The unused stack space is found by scanning the stacks for the fill pattern,
+ * which requires CH_DBG_FILL_THREADS and CH_DBG_ENABLE_STACK_CHECK; otherwise it is not reported.
+ */
+
+#pragma once
+
+#include <ch.hpp>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+/**
+ * Maximum number of threads whose run time is tracked; the time of the others is not attributed to any thread,
+ * but it is still accounted for in the CPU load.
+ */
+#if !defined(THREAD_STATS_MAX_THREADS)
+# define THREAD_STATS_MAX_THREADS           16
+#endif
+
+
+namespace os
+{
+
+struct ThreadStatistics
+{
+    const thread_t* thread = nullptr;
+    const char* name = nullptr;                 ///< Never null
+    tprio_t priority = 0;
+    float cpu_load = 0.0F;                      ///< Share of the CPU time over the measurement interval, [0, 1]
+    std::size_t stack_size = 0;                 ///< Zero if the stack bounds are unknown
+    std::size_t stack_unused = 0;               ///< Bytes that have never been used (the high-water mark)
+};
+
+/**
+ * Reports the statistics of every thread over the interval since the previous call, and returns the total CPU load.
+ * The first call enables the cycle counter unless it is enabled already (e.g. by the trace recorder), so it may
+ * report zero load as nothing could be measured yet. The run time is accumulated in 64 bits, so the interval between
+ * the calls is not limited; but the time between two context switches is measured with the 32-bit cycle counter,
+ * so a thread that runs without being switched out for 2^32 cycles or longer (25 seconds at 168 MHz) is
+ * under-reported.
+ * Requires the registry (CH_CFG_USE_REGISTRY). The callback is invoked from the caller's context.
+ */
+float sampleThreadStatistics(const std::function<void (const ThreadStatistics&)>& callback);
+
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+#include "trace.hpp"
+#include "trace_hooks.h"
+#include "format.hpp"
+#include <algorithm>
+
+/**
+ * Frequency of the DWT cycle counter, which is the core clock. Reported in the dump for the host tools.
+ */
+#if !defined(TRACE_CYCLE_COUNTER_FREQUENCY)
+# define TRACE_CYCLE_COUNTER_FREQUENCY      STM32_HCLK
+#endif
+
+
+namespace os
+{
+namespace trace
+{
+#if TRACE_BUFFER_EVENTS > 0
+
+namespace impl_
+{
+
+Event g_events[TRACE_BUFFER_EVENTS];
+std::atomic<std::uint32_t> g_next_index{0};
+std::atomic<bool> g_enabled{false};
+
+}
+
+void start()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    impl_::g_enabled.store(false, std::memory_order_relaxed);
+    impl_::g_next_index.store(0, std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    impl_::g_enabled.store(true, std::memory_order_relaxed);
+}
+
+void stop()
+{
+    impl_::g_enabled.store(false, std::memory_order_relaxed);
+}
+
+void dump(const std::function<void (const char* line)>& output)
+{
+    char line[80];
+
+    (void) format::formatToBuffer(&line[0], sizeof(line), OS_FMT("TRACE BEGIN {}"),
+                                  std::uint32_t(TRACE_CYCLE_COUNTER_FREQUENCY));
+    output(&line[0]);
+
+#if CH_CFG_USE_REGISTRY
+    for (thread_t* tp = chRegFirstThread(); tp != nullptr; tp = chRegNextThread(tp))
+    {
+        (void) format::formatToBuffer(&line[0], sizeof(line), OS_FMT("T {:08x} {}"),
+                                      std::uint32_t(reinterpret_cast<std::uintptr_t>(tp)),
+                                      (tp->name == nullptr) ? "?" : tp->name);
+        output(&line[0]);
+    }
+#endif
+
+    const std::uint32_t end = impl_::g_next_index.load(std::memory_order_relaxed);
+    const std::uint32_t num_events = std::min<std::uint32_t>(end, TRACE_BUFFER_EVENTS);
+    for (std::uint32_t index = end - num_events; index != end; index++)
+    {
+        const Event& ev = impl_::g_events[index % TRACE_BUFFER_EVENTS];
+        if ((ev.type == EventType::SpanBegin) || (ev.type == EventType::SpanEnd))
+        {
+            (void) format::formatToBuffer(&line[0], sizeof(line), OS_FMT("E {:08x} {:x} {:08x} {:x} {:.40}"),
+                                          ev.timestamp, unsigned(ev.type), ev.argument, ev.auxiliary,
+                                          reinterpret_cast<const char*>(std::uintptr_t(ev.argument)));
+        }
+        else
+        {
+            (void) format::formatToBuffer(&line[0], sizeof(line), OS_FMT("E {:08x} {:x} {:08x} {:x}"),
+                                          ev.timestamp, unsigned(ev.type), ev.argument, ev.auxiliary);
+        }
+        output(&line[0]);
+    }
+
+    (void) format::formatToBuffer(&line[0], sizeof(line), OS_FMT("TRACE END {}"), end - num_events);
+    output(&line[0]);
+}
+
+#else
+
+void start() { }
+void stop() { }
+void dump(const std::function<void (const char* line)>&) { }
+
+#endif
+}
+}
+
+extern "C"
+{
+
+void zchTraceContextSwitchHook(void* ntp, void*)
+{
+    os::trace::record(os::trace::EventType::ContextSwitch, ntp);
+}
+
+void zchTraceIRQPrologueHook(void)
+{
+    os::trace::record(os::trace::EventType::IRQEnter, nullptr, std::uint16_t(__get_IPSR() & 0x1FFU));
+}
+
+void zchTraceIRQEpilogueHook(void)
+{
+    os::trace::record(os::trace::EventType::IRQExit, nullptr, std::uint16_t(__get_IPSR() & 0x1FFU));
+}
+
+}
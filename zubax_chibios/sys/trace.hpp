@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Event trace recorder. Fixed-size binary events timestamped with the DWT cycle counter are written into
+ * a lock-free ring buffer from any context, including ISRs and the kernel hooks; a few dozen cycles per event.
+ * The recorded events are dumped as text over the console, and tools/trace_to_chrome.py converts the dump into
+ * a Chrome trace (JSON) that can be viewed in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * The recorder is enabled by defining TRACE_BUFFER_EVENTS, normally via UDEFS; otherwise, all hooks are no-op.
+ * The context switches and ISRs are traced if the hooks are installed in chconf.h:
+ *
+ *      #include <zubax_chibios/sys/trace_hooks.h>
+ *      #define CH_CFG_CONTEXT_SWITCH_HOOK(ntp, otp)    zchTraceContextSwitchHook(ntp, otp)
+ *      #define CH_CFG_IRQ_PROLOGUE_HOOK()              zchTraceIRQPrologueHook()
+ *      #define CH_CFG_IRQ_EPILOGUE_HOOK()              zchTraceIRQEpilogueHook()
+ *
+ * The mutex waits of os::MutexLocker are traced automatically. Spans of application code are traced like this:
+ *
+ *      OS_TRACE_SPAN("ProcessFrame");              // Until the end of the scope; the name must be a literal
+ */
+
+#pragma once
+
+#include <ch.hpp>
+#include <hal.h>
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <functional>
+
+/**
+ * Capacity of the trace ring buffer, in events; must be a power of two. Each event occupies 12 bytes.
+ * Zero disables tracing. Must be defined identically for all translation units.
+ */
+#if !defined(TRACE_BUFFER_EVENTS)
+# define TRACE_BUFFER_EVENTS            0
+#endif
+
+#define OS_TRACE_CAT2_(a, b)            a##b
+#define OS_TRACE_CAT1_(a, b)            OS_TRACE_CAT2_(a, b)
+
+#define OS_TRACE_SPAN(name)             ::os::trace::Span OS_TRACE_CAT1_(os_trace_span_, __LINE__)(name)
+
+
+namespace os
+{
+namespace trace
+{
+
+enum class EventType : std::uint16_t
+{
+    ContextSwitch,                      ///< Argument: the thread that is switched in
+    IRQEnter,                           ///< Auxiliary value: exception number
+    IRQExit,
+    MutexWait,                          ///< Argument: the mutex
+    MutexAcquired,
+    MutexReleased,
+    SpanBegin,                          ///< Argument: the name of the span
+    SpanEnd
+};
+
+struct Event
+{
+    std::uint32_t timestamp;            ///< DWT cycle counter
+    std::uint32_t argument;
+    EventType type;
+    std::uint16_t auxiliary;
+};
+
+#if TRACE_BUFFER_EVENTS > 0
+
+static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0, "Trace buffer size must be a power of two");
+
+namespace impl_
+{
+
+extern Event g_events[TRACE_BUFFER_EVENTS];
+extern std::atomic<std::uint32_t> g_next_index;
+extern std::atomic<bool> g_enabled;
+
+}
+
+/**
+ * Records one event. Safe to call from any context; never blocks.
+ */
+inline void record(const EventType type, const void* const argument = nullptr, const std::uint16_t auxiliary = 0)
+{
+    if (impl_::g_enabled.load(std::memory_order_relaxed))
+    {
+        const std::uint32_t timestamp = DWT->CYCCNT;
+        Event& ev = impl_::g_events[impl_::g_next_index.fetch_add(1U, std::memory_order_relaxed) %
+                                    TRACE_BUFFER_EVENTS];
+        ev.timestamp = timestamp;
+        ev.argument  = std::uint32_t(reinterpret_cast<std::uintptr_t>(argument));
+        ev.type      = type;
+        ev.auxiliary = auxiliary;
+    }
+}
+
+#else
+
+inline void record(EventType, const void* = nullptr, std::uint16_t = 0) { }
+
+#endif
+
+/**
+ * Enables the cycle counter and starts recording. The previously recorded events are discarded.
+ */
+void start();
+
+/**
+ * Stops recording; the recorded events are retained until the next start().
+ */
+void stop();
+
+/**
+ * Writes the recorded events as text lines, oldest first; recording shall be stopped beforehand.
+ * The line terminators are not included. The format is understood by tools/trace_to_chrome.py:
+ *
+ *      TRACE BEGIN <cycle counter frequency, Hz>
+ *      T <thread address> <thread name>                    - one per thread, from the registry
+ *      E <timestamp> <type> <argument> <auxiliary> [name]  - one per event, hexadecimal; spans carry the name
+ *      TRACE END <number of events lost due to overwriting>
+ *
+ * Does nothing if tracing is disabled.
+ */
+void dump(const std::function<void (const char* line)>& output);
+
+/**
+ * RAII span; prefer the macro OS_TRACE_SPAN().
+ */
+class Span
+{
+    const char* const name_;
+
+public:
+    explicit Span(const char* name) : name_(name)
+    {
+        record(EventType::SpanBegin, name_);
+    }
+
+    ~Span()
+    {
+        record(EventType::SpanEnd, name_);
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+};
+
+}
+}
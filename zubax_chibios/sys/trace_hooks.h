@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2018 Zubax Robotics, zubax.com
+ * Distributed under the MIT License, available in the file LICENSE.
+ * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
+ */
+
+/*
+ * Kernel hooks of the trace recorder (see trace.hpp) and of the thread statistics (see thread_stats.hpp).
+ * This header is meant to be included from chconf.h, hence it is C-compatible and safe to include from
+ * the assembly sources of the port.
+ */
+
+#pragma once
+
+#if !defined(_FROM_ASM_)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void zchTraceContextSwitchHook(void* ntp, void* otp);
+void zchTraceIRQPrologueHook(void);
+void zchTraceIRQEpilogueHook(void);
+
+void zchThreadStatsContextSwitchHook(void* ntp, void* otp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
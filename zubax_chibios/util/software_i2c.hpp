@@ -74,7 +74,7 @@ private:
         bool get() const { return palReadPad(port_, pin_); }
     };
 
-    chibios_rt::Mutex mutex_;
+    ::os::NamedMutex mutex_{"SoftwareI2C"};
     I2CPin scl_;
     I2CPin sda_;
     bool started_ = false;